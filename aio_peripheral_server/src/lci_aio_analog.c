@@ -0,0 +1,314 @@
+/**
+ * @file lci_aio_analog.c
+ * @brief Analog inputs of the Automation IO service
+ *
+ * The IADC timer triggers a scan of all inputs every
+ * LCI_AIO_ANALOG_SCAN_PERIOD_MS. Every conversion is oversampled and
+ * averaged in hardware, and the LDMA moves the results from the scan FIFO
+ * into one half of a double buffer while the device stays in EM2. The CPU
+ * only wakes up once a half is full: the half is averaged per input, the
+ * inputs are checked against their thresholds, and the Bluetooth context is
+ * signalled on a threshold crossing or every LCI_AIO_ANALOG_REFRESH_BLOCKS.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "em_cmu.h"
+#include "em_core.h"
+#include "em_gpio.h"
+#include "em_iadc.h"
+#include "em_ldma.h"
+#include "sl_bluetooth.h"
+#include "lci_aio_analog.h"
+/* Analog input pin */
+#ifndef LCI_AIO_ANALOG_INPUT
+#define LCI_AIO_ANALOG_INPUT          iadcPosInputPortCPin4
+#endif
+/* Allocation of the analog bus of the input pin port to the IADC, even pins
+ * of port C or D by default. Another pin may need another bus: set both
+ * LCI_AIO_ANALOG_INPUT and this, e.g. GPIO->ABUSALLOC for port A or B */
+#ifndef LCI_AIO_ANALOG_BUS_ALLOC
+#define LCI_AIO_ANALOG_BUS_ALLOC()    (GPIO->CDBUSALLOC |= GPIO_CDBUSALLOC_CDEVEN0_ADC0)
+#endif
+/* Thresholds of the analog input pin in millivolts */
+#ifndef LCI_AIO_ANALOG_INPUT_LOW_MV
+#define LCI_AIO_ANALOG_INPUT_LOW_MV   300
+#endif
+#ifndef LCI_AIO_ANALOG_INPUT_HIGH_MV
+#define LCI_AIO_ANALOG_INPUT_HIGH_MV  2000
+#endif
+/* Thresholds of the supply voltage in millivolts */
+#define SUPPLY_LOW_MV                 2200
+#define SUPPLY_HIGH_MV                3600
+/* IADC clocks, the FSRCO keeps running in EM2 */
+#define CLK_SRC_ADC_FREQ              1000000
+#define CLK_ADC_FREQ                  1000000
+/* Full scale of the 1.21 V internal reference with a 0.5 analog gain */
+#define FULL_SCALE_MV                 2420
+#define RESULT_MAX                    4095
+/* LDMA channel of the scan FIFO */
+#define DMA_CHANNEL                   0
+/* Words in one half of the double buffer */
+#define BLOCK_WORDS                   (LCI_AIO_ANALOG_BLOCK_SCANS * LCI_AIO_ANALOG_CHANNELS)
+/* Input of the scan table */
+typedef struct {
+  IADC_PosInput_t input;
+  /* The supply is measured divided by 4 */
+  uint8_t scale;
+  uint16_t low_mv;
+  uint16_t high_mv;
+} analog_channel_t;
+/* Scanned inputs, in scan table order */
+static const analog_channel_t channels[LCI_AIO_ANALOG_CHANNELS] = {
+  { iadcPosInputAvdd, 4, SUPPLY_LOW_MV, SUPPLY_HIGH_MV },
+  { LCI_AIO_ANALOG_INPUT, 1, LCI_AIO_ANALOG_INPUT_LOW_MV, LCI_AIO_ANALOG_INPUT_HIGH_MV }
+};
+/* Double buffer filled by the LDMA */
+static uint32_t buffer[2][BLOCK_WORDS];
+/* Linked descriptors, each one fills a half and links to the other */
+static LDMA_Descriptor_t descriptors[2];
+/* Half the LDMA completes next */
+static uint8_t next_half;
+/* Latest averaged values and threshold states */
+static volatile uint16_t values_mv[LCI_AIO_ANALOG_CHANNELS];
+static volatile uint8_t states[LCI_AIO_ANALOG_CHANNELS];
+/* Channels that crossed a threshold since the last take */
+static volatile uint32_t crossings;
+/* Blocks since the last refresh signal */
+static uint8_t blocks;
+/* External signal of the Bluetooth context */
+static uint32_t analog_signal;
+/* Local functions */
+static void init_iadc(void);
+static void init_ldma(void);
+static uint8_t evaluate_threshold(const analog_channel_t *channel, uint8_t state, uint16_t mv);
+static void process_block(const uint32_t *block);
+/**
+* @brief Configure the IADC for timer triggered scans in EM2
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void init_iadc(void)
+{
+  IADC_Init_t init = IADC_INIT_DEFAULT;
+  IADC_AllConfigs_t configs = IADC_ALLCONFIGS_DEFAULT;
+  IADC_InitScan_t init_scan = IADC_INITSCAN_DEFAULT;
+  IADC_ScanTable_t scan_table = IADC_SCANTABLE_DEFAULT;
+
+  CMU_ClockEnable(cmuClock_IADC0, true);
+  CMU_ClockEnable(cmuClock_GPIO, true);
+  CMU_ClockSelectSet(cmuClock_IADCCLK, cmuSelect_FSRCO);
+
+  /* The timer counts CLK_SRC_ADC cycles */
+  init.warmup = iadcWarmupNormal;
+  init.srcClkPrescale = IADC_calcSrcClkPrescale(IADC0, CLK_SRC_ADC_FREQ, 0);
+  init.timerCycles = (CLK_SRC_ADC_FREQ / 1000) * LCI_AIO_ANALOG_SCAN_PERIOD_MS;
+
+  /* Oversampling and digital averaging in hardware */
+  configs.configs[0].reference = iadcCfgReferenceInt1V2;
+  configs.configs[0].vRef = 1210;
+  configs.configs[0].analogGain = iadcCfgAnalogGain0P5x;
+  configs.configs[0].osrHighSpeed = iadcCfgOsrHighSpeed32x;
+  configs.configs[0].digAvg = iadcDigitalAverage4;
+  configs.configs[0].adcClkPrescale = IADC_calcAdcClkPrescale(IADC0,
+                                                              CLK_ADC_FREQ,
+                                                              0,
+                                                              iadcCfgModeNormal,
+                                                              init.srcClkPrescale);
+
+  /* Every conversion requests the LDMA, which is woken up in EM2 */
+  init_scan.triggerSelect = iadcTriggerSelTimer;
+  init_scan.triggerAction = iadcTriggerActionOnce;
+  init_scan.dataValidLevel = iadcFifoCfgDvl1;
+  init_scan.fifoDmaWakeup = true;
+  init_scan.start = true;
+
+  for (uint8_t i = 0; i < LCI_AIO_ANALOG_CHANNELS; i++) {
+    scan_table.entries[i].posInput = channels[i].input;
+    scan_table.entries[i].negInput = iadcNegInputGnd;
+    scan_table.entries[i].configId = 0;
+    scan_table.entries[i].includeInScan = true;
+  }
+  LCI_AIO_ANALOG_BUS_ALLOC();
+
+  IADC_reset(IADC0);
+  IADC_init(IADC0, &init, &configs);
+  IADC_initScan(IADC0, &init_scan, &scan_table);
+  IADC_command(IADC0, iadcCmdEnableTimer);
+}
+/**
+* @brief Configure the LDMA to fill the double buffer from the scan FIFO
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void init_ldma(void)
+{
+  LDMA_Init_t init = LDMA_INIT_DEFAULT;
+  LDMA_TransferCfg_t transfer = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_IADC0_IADC_SCAN);
+
+  LDMA_Init(&init);
+  descriptors[0] = (LDMA_Descriptor_t)LDMA_DESCRIPTOR_LINKREL_P2M_WORD(&IADC0->SCANFIFODATA,
+                                                                        buffer[0],
+                                                                        BLOCK_WORDS,
+                                                                        1);
+  descriptors[1] = (LDMA_Descriptor_t)LDMA_DESCRIPTOR_LINKREL_P2M_WORD(&IADC0->SCANFIFODATA,
+                                                                        buffer[1],
+                                                                        BLOCK_WORDS,
+                                                                        -1);
+  /* One interrupt per half */
+  descriptors[0].xfer.doneIfs = 1;
+  descriptors[1].xfer.doneIfs = 1;
+  next_half = 0;
+  LDMA_StartTransfer(DMA_CHANNEL, &transfer, &descriptors[0]);
+}
+/**
+* @brief Threshold state of an input, with hysteresis
+ *
+* @param[in] channel input
+* @param[in] state   current state
+* @param[in] mv      value in millivolts
+*
+* @retval new state
+*/
+static uint8_t evaluate_threshold(const analog_channel_t *channel, uint8_t state, uint16_t mv)
+{
+  switch (state) {
+    case lci_aio_analog_low:
+      if (mv > channel->low_mv + LCI_AIO_ANALOG_HYSTERESIS_MV) {
+        state = lci_aio_analog_normal;
+      }
+      break;
+    case lci_aio_analog_high:
+      if (mv + LCI_AIO_ANALOG_HYSTERESIS_MV < channel->high_mv) {
+        state = lci_aio_analog_normal;
+      }
+      break;
+    default:
+      break;
+  }
+  if (state == lci_aio_analog_normal) {
+    if (mv < channel->low_mv) {
+      state = lci_aio_analog_low;
+    } else if (mv > channel->high_mv) {
+      state = lci_aio_analog_high;
+    }
+  }
+  return state;
+}
+/**
+* @brief Average a full half of the buffer and check the thresholds
+ *
+* @param[in] block half of the double buffer
+*
+* @retval None
+*/
+static void process_block(const uint32_t *block)
+{
+  uint32_t sums[LCI_AIO_ANALOG_CHANNELS] = { 0 };
+  uint32_t crossed = 0;
+  uint16_t mv;
+  uint8_t state;
+
+  /* The LDMA keeps the scan table order */
+  for (uint32_t i = 0; i < BLOCK_WORDS; i++) {
+    sums[i % LCI_AIO_ANALOG_CHANNELS] += block[i] & RESULT_MAX;
+  }
+  for (uint8_t i = 0; i < LCI_AIO_ANALOG_CHANNELS; i++) {
+    mv = (uint16_t)((sums[i] * FULL_SCALE_MV * channels[i].scale)
+                    / ((uint32_t)RESULT_MAX * LCI_AIO_ANALOG_BLOCK_SCANS));
+    values_mv[i] = mv;
+    state = evaluate_threshold(&channels[i], states[i], mv);
+    if (state != states[i]) {
+      states[i] = state;
+      crossed |= 1UL << i;
+    }
+  }
+  crossings |= crossed;
+  if ((crossed != 0) || (++blocks >= LCI_AIO_ANALOG_REFRESH_BLOCKS)) {
+    blocks = 0;
+    sl_bt_external_signal(analog_signal);
+  }
+}
+/**
+* @brief LDMA interrupt, a half of the double buffer is full
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void LDMA_IRQHandler(void)
+{
+  uint32_t pending = LDMA_IntGet();
+
+  LDMA_IntClear(pending);
+  if (pending & (1UL << DMA_CHANNEL)) {
+    /* The LDMA already fills the other half */
+    process_block(buffer[next_half]);
+    next_half ^= 1;
+  }
+}
+/**
+* @brief Start the scans of the analog inputs
+ *
+* @param[in] signal external signal raised when the values are refreshed
+*
+* @retval None
+*/
+void lci_aio_analog_init(uint32_t signal)
+{
+  analog_signal = signal;
+  for (uint8_t i = 0; i < LCI_AIO_ANALOG_CHANNELS; i++) {
+    states[i] = lci_aio_analog_normal;
+    values_mv[i] = 0;
+  }
+  crossings = 0;
+  blocks = 0;
+  init_ldma();
+  init_iadc();
+}
+/**
+* @brief Latest averaged value of an input
+ *
+* @param[in] channel input index
+*
+* @retval value in millivolts
+*/
+uint16_t lci_aio_analog_get_mv(uint8_t channel)
+{
+  return (channel < LCI_AIO_ANALOG_CHANNELS) ? values_mv[channel] : 0;
+}
+/**
+* @brief Threshold state of an input
+ *
+* @param[in] channel input index
+*
+* @retval threshold state
+*/
+lci_aio_analog_state_t lci_aio_analog_get_state(uint8_t channel)
+{
+  return (channel < LCI_AIO_ANALOG_CHANNELS) ? (lci_aio_analog_state_t)states[channel]
+         : lci_aio_analog_normal;
+}
+/**
+* @brief Take the inputs that crossed a threshold since the last call
+ *
+* @param[in] None
+*
+* @retval bit mask of the inputs
+*/
+uint32_t lci_aio_analog_take_crossings(void)
+{
+  uint32_t taken;
+  CORE_DECLARE_IRQ_STATE;
+
+  CORE_ENTER_ATOMIC();
+  taken = crossings;
+  crossings = 0;
+  CORE_EXIT_ATOMIC();
+  return taken;
+}
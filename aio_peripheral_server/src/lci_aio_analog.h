@@ -0,0 +1,36 @@
+/**
+ * @file lci_aio_analog.h
+ * @brief Analog inputs of the Automation IO service
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_AIO_ANALOG_H_
+#define LCI_AIO_ANALOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+/* Number of analog inputs: supply voltage and one GPIO pin */
+#define LCI_AIO_ANALOG_CHANNELS       2
+/* Time between two scans of all inputs, IADC timer */
+#define LCI_AIO_ANALOG_SCAN_PERIOD_MS 10
+/* Scans per half of the LDMA double buffer, one interrupt per half */
+#define LCI_AIO_ANALOG_BLOCK_SCANS    16
+/* Blocks between two refreshes of the characteristic values */
+#define LCI_AIO_ANALOG_REFRESH_BLOCKS 6
+/* Threshold hysteresis in millivolts */
+#define LCI_AIO_ANALOG_HYSTERESIS_MV  50
+/* Threshold state of an input */
+typedef enum {
+  lci_aio_analog_normal,
+  lci_aio_analog_low,
+  lci_aio_analog_high
+} lci_aio_analog_state_t;
+
+void lci_aio_analog_init(uint32_t signal);
+uint16_t lci_aio_analog_get_mv(uint8_t channel);
+lci_aio_analog_state_t lci_aio_analog_get_state(uint8_t channel);
+uint32_t lci_aio_analog_take_crossings(void);
+
+#endif /* LCI_AIO_ANALOG_H_ */
@@ -15,18 +15,58 @@
 #include "sl_simple_timer.h"
 #include "sl_simple_led_instances.h"
 #include "sl_simple_button_instances.h"
+#include "lci_error.h"
+#include "lci_fast_start.h"
+#include "lci_beacon.h"
+#include "lci_aio_analog.h"
+#include "lci_aio_cmd.h"
+#include "lci_bonding.h"
+#include "lci_gatt_caching.h"
 /* Simple timer timeout in milliseconds */
 #define ADV_TIMER_TIMEOUT_MS  1000
 /* LED instance selection*/
 #define ADV_IND_LED           SL_SIMPLE_LED_INSTANCE(0)
+/* Advertised service, Automation IO */
+#define ADV_SERVICE_UUID      0x1815
+/* Connectable advertising interval, the beacon carries the live state */
+#define ADV_INTERVAL          800  /* 500 milliseconds */
+/* External signal raised by the advertising retry timer */
+#define ADV_RETRY_SIGNAL      (1u << 0)
+/* External signal raised by the beacon update timer and the button */
+#define BEACON_SIGNAL         (1u << 1)
+/* External signal raised by the analog inputs */
+#define ANALOG_SIGNAL         (1u << 2)
+/* External signal raised by the command queue timer */
+#define CMD_SIGNAL            (1u << 3)
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID ((uint8_t)0xFFu)
+/* Button instance selection */
+#define BEACON_BUTTON         SL_SIMPLE_BUTTON_INSTANCE(0)
+/* Digital states in the beacon */
+#define BEACON_STATE_LED      0x01
+#define BEACON_STATE_BUTTON   0x02
 /* The advertising set handle allocated from Bluetooth stack */
 static uint8_t advertising_set_handle = 0xff;
 /* Simple timer for controlling an LED#0 during advertising */
 static sl_simple_timer_t adv_timer;
+/* Retries of a failed advertiser start */
+static lci_error_retry_t adv_retry;
+/* Analog characteristics of the Automation IO service, in input order */
+static const uint16_t analog_characteristics[LCI_AIO_ANALOG_CHANNELS] = {
+  gattdb_aio_analog_0,
+  gattdb_aio_analog_1
+};
+/* Connection of the client and the analog characteristics it gets notified of */
+static uint8_t client_connection = CONNECTION_HANDLE_INVALID;
+static uint8_t analog_notifications;
 /* Simple timer local functions */
 static void hdl_adv_timer_event(sl_simple_timer_t *timer, void *data);
 static void adv_start_timer(void);
 static void adv_stop_timer(void);
+static void start_advertising(void);
+static void update_beacon(void);
+static void update_analog(void);
+static void on_characteristic_status(sl_bt_evt_gatt_server_characteristic_status_t *status);
 /**
 * @brief Simple timer handler
  *
@@ -73,6 +113,132 @@ static void adv_stop_timer(void)
   sl_led_turn_on(ADV_IND_LED);
 }
 /**
+* @brief Start general advertising and enable connections
+*
+* A failed start, e.g. while the stack still releases the resources of a
+* closed connection, is retried with a backoff instead of a reset.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void start_advertising(void)
+{
+  sl_status_t sc;
+  /* The advertising data is set by the fast start */
+  sc = sl_bt_advertiser_start(
+    advertising_set_handle,
+    sl_bt_advertiser_user_data,
+    sl_bt_advertiser_connectable_scannable);
+  if (lci_error_check(sc, "Advertising start") != lci_error_none) {
+    if (!lci_error_retry_schedule(&adv_retry)) {
+      app_assert_status_f(sc, "Failed to start advertising\n");
+    }
+    return;
+  }
+  if (lci_fast_start_on_advertising()) {
+    /* System ID and the rest once the server can be found */
+    lci_fast_start_complete(advertising_set_handle);
+  }
+  lci_error_retry_done(&adv_retry);
+  adv_start_timer();
+}
+/**
+* @brief Broadcast the digital states in the beacon
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void update_beacon(void)
+{
+  uint8_t state = 0;
+
+  if (sl_led_get_state(ADV_IND_LED)) {
+    state |= BEACON_STATE_LED;
+  }
+  if (sl_button_get_state(BEACON_BUTTON)) {
+    state |= BEACON_STATE_BUTTON;
+  }
+  (void)lci_error_check_optional(lci_beacon_update(&state, sizeof(state)), "Beacon update");
+}
+/**
+* @brief Refresh the analog characteristics, notify threshold crossings
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void update_analog(void)
+{
+  static const char *const state_names[] = { "normal", "low", "high" };
+  uint32_t crossed = lci_aio_analog_take_crossings();
+  uint8_t value[sizeof(uint16_t)];
+  uint16_t mv;
+  sl_status_t sc;
+
+  for (uint8_t i = 0; i < LCI_AIO_ANALOG_CHANNELS; i++) {
+    /* Analog characteristic, millivolts little-endian */
+    mv = lci_aio_analog_get_mv(i);
+    value[0] = (uint8_t)mv;
+    value[1] = (uint8_t)(mv >> 8);
+    sc = sl_bt_gatt_server_write_attribute_value(analog_characteristics[i],
+                                                 0,
+                                                 sizeof(value),
+                                                 value);
+    (void)lci_error_check(sc, "Analog value");
+    if ((crossed & (1UL << i)) == 0) {
+      continue;
+    }
+    app_log_info("Analog input %d: %u mV, %s\n",
+                 i,
+                 mv,
+                 state_names[lci_aio_analog_get_state(i)]);
+    if ((client_connection != CONNECTION_HANDLE_INVALID)
+        && (analog_notifications & (1u << i))) {
+      sc = sl_bt_gatt_server_send_notification(client_connection,
+                                               analog_characteristics[i],
+                                               sizeof(value),
+                                               value);
+      (void)lci_error_check(sc, "Analog notification");
+    }
+  }
+}
+/**
+* @brief Track the analog characteristics the client gets notified of
+ *
+* @param[in] status characteristic status event
+*
+* @retval None
+*/
+static void on_characteristic_status(sl_bt_evt_gatt_server_characteristic_status_t *status)
+{
+#if LCI_GATT_CACHING
+  if (status->characteristic == gattdb_service_changed_char) {
+    lci_gatt_caching_on_status(status->connection, status->status_flags, status->client_config_flags);
+    return;
+  }
+#endif
+  if (status->status_flags != sl_bt_gatt_server_client_config) {
+    return;
+  }
+  if (status->characteristic == gattdb_aio_command) {
+    lci_aio_cmd_set_client(status->connection,
+                           (status->client_config_flags & sl_bt_gatt_notification) != 0);
+    return;
+  }
+  for (uint8_t i = 0; i < LCI_AIO_ANALOG_CHANNELS; i++) {
+    if (status->characteristic != analog_characteristics[i]) {
+      continue;
+    }
+    if (status->client_config_flags & sl_bt_gatt_notification) {
+      analog_notifications |= (uint8_t)(1u << i);
+    } else {
+      analog_notifications &= (uint8_t)~(1u << i);
+    }
+  }
+}
+/**
 * @brief Application initialization procedure
  *
 * @param[in] None
@@ -81,8 +247,7 @@ static void adv_stop_timer(void)
 */
 void app_init(void)
 {
-  app_log_info("[AIO] Laird Connectivity simple peripheral server demo\n");
-  app_log_nl();
+  /* Everything runs from the boot event, after the advertising started */
 }
 /**
 * @brief Bluetooth events handler
@@ -94,9 +259,6 @@ void app_init(void)
 void sl_bt_on_event(sl_bt_msg_t *evt)
 {
   sl_status_t sc;
-  bd_addr address;
-  uint8_t address_type;
-  uint8_t system_id[8];
 
   switch (SL_BT_MSG_ID(evt->header)) {
     /* ------------------------------- */
@@ -106,50 +268,59 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
      */
     case sl_bt_evt_system_boot_id:
 
-      /* Extract unique ID from BT Address */
-      sc = sl_bt_system_get_identity_address(&address, &address_type);
-      app_assert_status(sc);
-
-      /* Pad and reverse unique ID to get System ID */
-      system_id[0] = address.addr[5];
-      system_id[1] = address.addr[4];
-      system_id[2] = address.addr[3];
-      system_id[3] = 0xFF;
-      system_id[4] = 0xFE;
-      system_id[5] = address.addr[2];
-      system_id[6] = address.addr[1];
-      system_id[7] = address.addr[0];
-
-      sc = sl_bt_gatt_server_write_attribute_value(gattdb_system_id,
-                                                   0,
-                                                   sizeof(system_id),
-                                                   system_id);
-      app_assert_status(sc);
+      /* Load the advertising data kept from the previous boot */
+      lci_fast_start_init(ADV_SERVICE_UUID);
 
       /* Create an advertising set */
       sc = sl_bt_advertiser_create_set(&advertising_set_handle);
       app_assert_status(sc);
 
-      /* Set advertising interval to 100ms */
+      /* Set advertising interval to 500ms */
       sc = sl_bt_advertiser_set_timing(
         advertising_set_handle,
-        160, /* min. adv. interval (milliseconds * 1.6) */
-        160, /* max. adv. interval (milliseconds * 1.6) */
+        ADV_INTERVAL, /* min. adv. interval (milliseconds * 1.6) */
+        ADV_INTERVAL, /* max. adv. interval (milliseconds * 1.6) */
         0,   /* adv. duration */
         0);  /* max. num. adv. events */
       app_assert_status(sc);
-      /* Start general advertising and enable connections */
-      sc = sl_bt_advertiser_start(
-        advertising_set_handle,
-        sl_bt_advertiser_general_discoverable,
-        sl_bt_advertiser_connectable_scannable);
+      sc = lci_fast_start_set_adv_data(advertising_set_handle);
       app_assert_status(sc);
-      adv_start_timer();
+#if LCI_BONDING
+      /* Bonded clients reconnect encrypted, set up before the first one */
+      sc = lci_bonding_init();
+      (void)lci_error_check_optional(sc, "Bonding configuration");
+#endif
+#if LCI_GATT_CACHING
+      /* Bonded clients learn about a new database on reconnect */
+      lci_gatt_caching_init();
+#endif
+      /* Start general advertising and enable connections */
+      lci_error_retry_init(&adv_retry, ADV_RETRY_SIGNAL);
+      start_advertising();
+      app_log_info("[AIO] Laird Connectivity simple peripheral server demo\n");
+      app_log_nl();
+      /* Live digital states for passive listeners, also while connected */
+      sc = lci_beacon_start(lci_beacon_aio, BEACON_SIGNAL);
+      (void)lci_error_check_optional(sc, "Beacon start");
+      /* Scans of the analog inputs run in EM2 from now on */
+      lci_aio_analog_init(ANALOG_SIGNAL);
+      /* Batched writes of the digital output */
+      lci_aio_cmd_init(gattdb_aio_command, CMD_SIGNAL);
       break;
 
     /* ------------------------------- */
     /* This event indicates that a new connection was opened */
     case sl_bt_evt_connection_opened_id:
+      lci_fast_start_on_connection();
+      client_connection = evt->data.evt_connection_opened.connection;
+#if LCI_BONDING
+      lci_bonding_on_opened(evt->data.evt_connection_opened.connection,
+                            evt->data.evt_connection_opened.bonding);
+#endif
+#if LCI_GATT_CACHING
+      lci_gatt_caching_on_opened(evt->data.evt_connection_opened.connection,
+                                 evt->data.evt_connection_opened.bonding);
+#endif
       adv_stop_timer();
       break;
 
@@ -157,12 +328,81 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
     /* This event indicates that a connection was closed */
     case sl_bt_evt_connection_closed_id:
       /* Restart advertising after client has disconnected */
-      sc = sl_bt_advertiser_start(
-        advertising_set_handle,
-        sl_bt_advertiser_general_discoverable,
-        sl_bt_advertiser_connectable_scannable);
-      app_assert_status(sc);
-      adv_start_timer();
+      client_connection = CONNECTION_HANDLE_INVALID;
+      analog_notifications = 0;
+      /* Operations of the client are dropped, the LED blinks again */
+      lci_aio_cmd_reset();
+#if LCI_BONDING
+      lci_bonding_on_closed(evt->data.evt_connection_closed.connection);
+#endif
+#if LCI_GATT_CACHING
+      lci_gatt_caching_on_closed(evt->data.evt_connection_closed.connection);
+#endif
+      start_advertising();
+      break;
+
+#if LCI_BONDING
+    /* ------------------------------- */
+    /* This event indicates the parameters or the security of a connection */
+    case sl_bt_evt_connection_parameters_id:
+      lci_bonding_on_parameters(evt->data.evt_connection_parameters.connection,
+                                evt->data.evt_connection_parameters.security_mode);
+#if LCI_GATT_CACHING
+      lci_gatt_caching_on_parameters(evt->data.evt_connection_parameters.connection,
+                                     evt->data.evt_connection_parameters.security_mode);
+#endif
+      break;
+
+    /* ------------------------------- */
+    /* This event indicates a new bond with the client */
+    case sl_bt_evt_sm_bonded_id:
+      lci_bonding_on_bonded(evt->data.evt_sm_bonded.connection,
+                            evt->data.evt_sm_bonded.bonding);
+#if LCI_GATT_CACHING
+      lci_gatt_caching_on_bonded(evt->data.evt_sm_bonded.connection,
+                                 evt->data.evt_sm_bonded.bonding);
+#endif
+      break;
+
+    /* ------------------------------- */
+    /* This event indicates a failed pairing or encryption */
+    case sl_bt_evt_sm_bonding_failed_id:
+      lci_bonding_on_failed(evt->data.evt_sm_bonding_failed.connection,
+                            evt->data.evt_sm_bonding_failed.reason);
+      break;
+#endif
+
+    /* ------------------------------- */
+    /* This event indicates a change of the client configuration */
+    case sl_bt_evt_gatt_server_characteristic_status_id:
+      on_characteristic_status(&evt->data.evt_gatt_server_characteristic_status);
+      break;
+
+    /* ------------------------------- */
+    /* This event indicates the client wrote a characteristic value */
+    case sl_bt_evt_gatt_server_attribute_value_id:
+      if (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_aio_command) {
+        lci_aio_cmd_on_write(evt->data.evt_gatt_server_attribute_value.value.data,
+                             evt->data.evt_gatt_server_attribute_value.value.len);
+      }
+      break;
+
+    /* ------------------------------- */
+    /* This event is generated by the advertising retry and beacon timers
+     * and by the analog inputs and the command queue */
+    case sl_bt_evt_system_external_signal_id:
+      if (evt->data.evt_system_external_signal.extsignals & ADV_RETRY_SIGNAL) {
+        start_advertising();
+      }
+      if (evt->data.evt_system_external_signal.extsignals & BEACON_SIGNAL) {
+        update_beacon();
+      }
+      if (evt->data.evt_system_external_signal.extsignals & ANALOG_SIGNAL) {
+        update_analog();
+      }
+      if (evt->data.evt_system_external_signal.extsignals & CMD_SIGNAL) {
+        lci_aio_cmd_process();
+      }
       break;
 
     /* ------------------------------- */
@@ -186,4 +426,6 @@ void sl_button_on_change(const sl_button_t *handle)
   } else {
       app_log_info("BTN#0 is released \n");
   }
+  /* Broadcast the new state without waiting for the beacon timer */
+  sl_bt_external_signal(BEACON_SIGNAL);
 }
@@ -0,0 +1,428 @@
+/**
+ * @file lci_aio_cmd.c
+ * @brief Command queue of the Automation IO digital outputs
+ *
+ * Packets of timestamped operations are written without response, so a
+ * client is not limited by one ATT round trip per change. The operations
+ * of a packet with the expected sequence number go into a ring buffer and
+ * are applied in order from the Bluetooth context, every operation the
+ * given delay after the previous one. A single timer is armed for the next
+ * due operation or the end of a pulse. The free slots are notified back as
+ * credits, a dropped packet is notified at once with the reason and the
+ * sequence number the queue expects.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "app_log.h"
+#include "em_cmu.h"
+#include "em_gpio.h"
+#include "em_timer.h"
+#include "sl_bluetooth.h"
+#include "sl_power_manager.h"
+#include "sl_simple_led.h"
+#include "sl_simple_led_instances.h"
+#include "sl_simple_timer.h"
+#include "sl_sleeptimer.h"
+#include "lci_aio_cmd.h"
+/* Number of outputs */
+#define OUTPUTS                       1
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* The PWM timer, it only runs in EM0 and EM1 */
+#define PWM_TIMER                     TIMER1
+#define PWM_TIMER_CLOCK               cmuClock_TIMER1
+#define PWM_TIMER_ROUTE               1
+/* Queued operation */
+typedef struct {
+  uint16_t delay_ms;
+  uint8_t opcode;
+  uint8_t output;
+  uint16_t arg;
+} queued_op_t;
+/* State of an output */
+typedef struct {
+  bool pulse_active;
+  bool pwm_active;
+  uint32_t pulse_end;
+} output_state_t;
+/* Digital outputs */
+static const sl_led_t *const outputs[OUTPUTS] = { SL_SIMPLE_LED_INSTANCE(0) };
+static output_state_t output_states[OUTPUTS];
+/* Ring buffer, free-running indexes */
+static queued_op_t ring[LCI_AIO_CMD_RING_SIZE];
+static uint16_t ring_head;
+static uint16_t ring_tail;
+/* Sleeptimer tick the last operation was applied at */
+static uint32_t timeline;
+static bool timeline_running;
+/* Next expected sequence number */
+static uint8_t next_seq;
+/* Operations applied since the last credit notification */
+static uint16_t uncredited;
+/* Client */
+static uint16_t cmd_characteristic;
+static uint8_t client_connection = CONNECTION_HANDLE_INVALID;
+static bool client_notify;
+/* Timer of the next due operation or pulse end */
+static sl_simple_timer_t due_timer;
+static uint32_t cmd_signal;
+/* Counters */
+static lci_aio_cmd_stats_t stats;
+/* Local functions */
+static void hdl_due_timer_event(sl_simple_timer_t *timer, void *data);
+static uint16_t free_slots(void);
+static void notify(lci_aio_cmd_status_t status);
+static void stop_pwm(uint8_t output);
+static void start_pwm(uint8_t output, uint16_t duty);
+static void apply(const queued_op_t *op, uint32_t now);
+static void arm(uint32_t now, uint32_t due);
+/**
+* @brief Due timer handler, the queue runs in the Bluetooth context
+ *
+* @param[in] timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_due_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+  sl_bt_external_signal(cmd_signal);
+}
+/**
+* @brief Free operation slots of the ring buffer
+ *
+* @param[in] None
+*
+* @retval number of free slots
+*/
+static uint16_t free_slots(void)
+{
+  return (uint16_t)(LCI_AIO_CMD_RING_SIZE - (uint16_t)(ring_head - ring_tail));
+}
+/**
+* @brief Notify the queue state to the client
+ *
+* @param[in] status status of the last packet
+*
+* @retval None
+*/
+static void notify(lci_aio_cmd_status_t status)
+{
+  uint8_t value[LCI_AIO_CMD_CREDIT_SIZE];
+  uint16_t credits = free_slots();
+  sl_status_t sc;
+
+  uncredited = 0;
+  if ((client_connection == CONNECTION_HANDLE_INVALID) || !client_notify) {
+    return;
+  }
+  value[0] = next_seq;
+  value[1] = (uint8_t)status;
+  value[2] = (uint8_t)credits;
+  value[3] = (uint8_t)(credits >> 8);
+  sc = sl_bt_gatt_server_send_notification(client_connection,
+                                           cmd_characteristic,
+                                           sizeof(value),
+                                           value);
+  if (sc == SL_STATUS_OK) {
+    stats.notifications++;
+  } else {
+    app_log_status_warning_f(sc, "Command credit notification failed\n");
+  }
+}
+/**
+* @brief Stop the PWM of an output, the pin goes back to the LED driver
+ *
+* @param[in] output output index
+*
+* @retval None
+*/
+static void stop_pwm(uint8_t output)
+{
+  if (!output_states[output].pwm_active) {
+    return;
+  }
+  TIMER_Enable(PWM_TIMER, false);
+  GPIO->TIMERROUTE[PWM_TIMER_ROUTE].ROUTEEN = 0;
+  output_states[output].pwm_active = false;
+  sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1);
+}
+/**
+* @brief Drive an output with a PWM duty cycle
+*
+* Fully off and fully on are set on the GPIO, so the timer and the EM1
+* requirement only last while the output is dimmed.
+ *
+* @param[in] output output index
+* @param[in] duty   duty cycle per mille
+*
+* @retval None
+*/
+static void start_pwm(uint8_t output, uint16_t duty)
+{
+  const sl_simple_led_context_t *led = outputs[output]->context;
+  TIMER_Init_t init = TIMER_INIT_DEFAULT;
+  TIMER_InitCC_t cc = TIMER_INITCC_DEFAULT;
+  uint32_t top;
+
+  if ((duty == 0) || (duty >= LCI_AIO_CMD_PWM_DUTY_MAX)) {
+    stop_pwm(output);
+    if (duty == 0) {
+      sl_led_turn_off(outputs[output]);
+    } else {
+      sl_led_turn_on(outputs[output]);
+    }
+    return;
+  }
+  if (!output_states[output].pwm_active) {
+    sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1);
+    output_states[output].pwm_active = true;
+  }
+  CMU_ClockEnable(PWM_TIMER_CLOCK, true);
+  cc.mode = timerCCModePWM;
+  cc.outInvert = (led->polarity == SL_SIMPLE_LED_POLARITY_ACTIVE_LOW);
+  GPIO->TIMERROUTE[PWM_TIMER_ROUTE].ROUTEEN = GPIO_TIMER_ROUTEEN_CC0PEN;
+  GPIO->TIMERROUTE[PWM_TIMER_ROUTE].CC0ROUTE =
+    ((uint32_t)led->port << _GPIO_TIMER_CC0ROUTE_PORT_SHIFT)
+    | ((uint32_t)led->pin << _GPIO_TIMER_CC0ROUTE_PIN_SHIFT);
+  TIMER_InitCC(PWM_TIMER, 0, &cc);
+  top = CMU_ClockFreqGet(PWM_TIMER_CLOCK) / LCI_AIO_CMD_PWM_FREQ_HZ;
+  TIMER_TopSet(PWM_TIMER, top);
+  TIMER_CompareSet(PWM_TIMER, 0, (top * duty) / LCI_AIO_CMD_PWM_DUTY_MAX);
+  TIMER_Init(PWM_TIMER, &init);
+}
+/**
+* @brief Apply an operation
+ *
+* @param[in] op  operation
+* @param[in] now sleeptimer tick
+*
+* @retval None
+*/
+static void apply(const queued_op_t *op, uint32_t now)
+{
+  output_state_t *state = &output_states[op->output];
+
+  if (op->opcode != lci_aio_cmd_pwm) {
+    stop_pwm(op->output);
+  }
+  state->pulse_active = false;
+  switch (op->opcode) {
+    case lci_aio_cmd_set:
+      if (op->arg != 0) {
+        sl_led_turn_on(outputs[op->output]);
+      } else {
+        sl_led_turn_off(outputs[op->output]);
+      }
+      break;
+    case lci_aio_cmd_toggle:
+      sl_led_toggle(outputs[op->output]);
+      break;
+    case lci_aio_cmd_pulse:
+      sl_led_turn_on(outputs[op->output]);
+      state->pulse_active = true;
+      state->pulse_end = now + sl_sleeptimer_ms_to_tick(op->arg);
+      break;
+    case lci_aio_cmd_pwm:
+      start_pwm(op->output, op->arg);
+      break;
+    default:
+      break;
+  }
+  stats.applied++;
+}
+/**
+* @brief Arm the due timer
+ *
+* @param[in] now sleeptimer tick
+* @param[in] due tick the queue has to run again
+*
+* @retval None
+*/
+static void arm(uint32_t now, uint32_t due)
+{
+  uint32_t ms = sl_sleeptimer_tick_to_ms(due - now);
+
+  /* At least one millisecond, never early */
+  (void)sl_simple_timer_start(&due_timer,
+                              (ms == 0) ? 1 : ms + 1,
+                              hdl_due_timer_event,
+                              NULL,
+                              false);
+}
+/**
+* @brief Initialize the command queue
+ *
+* @param[in] characteristic command characteristic
+* @param[in] signal         external signal of the due timer
+*
+* @retval None
+*/
+void lci_aio_cmd_init(uint16_t characteristic, uint32_t signal)
+{
+  cmd_characteristic = characteristic;
+  cmd_signal = signal;
+  lci_aio_cmd_reset();
+}
+/**
+* @brief Set the client of the queue
+ *
+* @param[in] connection     client connection
+* @param[in] notify_enabled the client enabled the credit notifications
+*
+* @retval None
+*/
+void lci_aio_cmd_set_client(uint8_t connection, bool notify_enabled)
+{
+  client_connection = connection;
+  client_notify = notify_enabled;
+  if (notify_enabled) {
+    /* Initial credits */
+    notify(lci_aio_cmd_ok);
+  }
+}
+/**
+* @brief Queue the operations of a packet written by the client
+ *
+* @param[in] data packet
+* @param[in] len  packet length
+*
+* @retval None
+*/
+void lci_aio_cmd_on_write(const uint8_t *data, uint8_t len)
+{
+  const uint8_t *src = &data[1];
+  uint8_t count;
+  queued_op_t *op;
+
+  stats.packets++;
+  if ((len < 1 + LCI_AIO_CMD_OP_SIZE) || (((len - 1) % LCI_AIO_CMD_OP_SIZE) != 0)) {
+    stats.dropped++;
+    notify(lci_aio_cmd_malformed);
+    return;
+  }
+  if (data[0] != next_seq) {
+    stats.dropped++;
+    notify(lci_aio_cmd_sequence_error);
+    return;
+  }
+  count = (uint8_t)((len - 1) / LCI_AIO_CMD_OP_SIZE);
+  if (count > free_slots()) {
+    stats.dropped++;
+    notify(lci_aio_cmd_overflow);
+    return;
+  }
+  /* The whole packet or nothing */
+  for (uint8_t i = 0; i < count; i++) {
+    if ((src[i * LCI_AIO_CMD_OP_SIZE + 3] >= OUTPUTS)
+        || (src[i * LCI_AIO_CMD_OP_SIZE + 2] < lci_aio_cmd_set)
+        || (src[i * LCI_AIO_CMD_OP_SIZE + 2] > lci_aio_cmd_pwm)) {
+      stats.dropped++;
+      notify(lci_aio_cmd_malformed);
+      return;
+    }
+  }
+  for (uint8_t i = 0; i < count; i++, src += LCI_AIO_CMD_OP_SIZE) {
+    op = &ring[ring_head % LCI_AIO_CMD_RING_SIZE];
+    op->delay_ms = (uint16_t)(src[0] | (src[1] << 8));
+    op->opcode = src[2];
+    op->output = src[3];
+    op->arg = (uint16_t)(src[4] | (src[5] << 8));
+    ring_head++;
+  }
+  next_seq++;
+  lci_aio_cmd_process();
+}
+/**
+* @brief Apply the due operations and end the due pulses
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_aio_cmd_process(void)
+{
+  uint32_t now = sl_sleeptimer_get_tick_count();
+  uint32_t next = 0;
+  bool pending = false;
+  const queued_op_t *op;
+  uint32_t due;
+
+  while (ring_tail != ring_head) {
+    op = &ring[ring_tail % LCI_AIO_CMD_RING_SIZE];
+    if (!timeline_running) {
+      /* The delay of the first operation counts from its arrival */
+      timeline = now;
+      timeline_running = true;
+    }
+    due = timeline + sl_sleeptimer_ms_to_tick(op->delay_ms);
+    if ((int32_t)(due - now) > 0) {
+      next = due;
+      pending = true;
+      break;
+    }
+    apply(op, now);
+    timeline = due;
+    ring_tail++;
+    uncredited++;
+  }
+  if (ring_tail == ring_head) {
+    timeline_running = false;
+  }
+  for (uint8_t i = 0; i < OUTPUTS; i++) {
+    if (!output_states[i].pulse_active) {
+      continue;
+    }
+    if ((int32_t)(output_states[i].pulse_end - now) <= 0) {
+      output_states[i].pulse_active = false;
+      sl_led_turn_off(outputs[i]);
+    } else if (!pending || ((int32_t)(output_states[i].pulse_end - next) < 0)) {
+      next = output_states[i].pulse_end;
+      pending = true;
+    }
+  }
+  if (pending) {
+    arm(now, next);
+  }
+  if ((uncredited >= LCI_AIO_CMD_CREDIT_BATCH)
+      || ((uncredited != 0) && (ring_tail == ring_head))) {
+    notify(lci_aio_cmd_ok);
+  }
+}
+/**
+* @brief Flush the queue and stop the outputs, e.g. when the client left
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_aio_cmd_reset(void)
+{
+  (void)sl_simple_timer_stop(&due_timer);
+  for (uint8_t i = 0; i < OUTPUTS; i++) {
+    stop_pwm(i);
+    output_states[i].pulse_active = false;
+  }
+  ring_head = 0;
+  ring_tail = 0;
+  timeline_running = false;
+  next_seq = 0;
+  uncredited = 0;
+  client_connection = CONNECTION_HANDLE_INVALID;
+  client_notify = false;
+}
+/**
+* @brief Queue counters
+ *
+* @param[in] None
+*
+* @retval pointer to the counters
+*/
+const lci_aio_cmd_stats_t *lci_aio_cmd_get_stats(void)
+{
+  return &stats;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file lci_aio_cmd.h
+ * @brief Command queue of the Automation IO digital outputs
+ *
+ * A client writes commands without response to the command characteristic.
+ * Every packet is: sequence number (1 byte) followed by up to
+ * LCI_AIO_CMD_OPS_MAX operations of LCI_AIO_CMD_OP_SIZE bytes:
+ *
+ *   delay (2 bytes, ms after the previous operation), opcode (1 byte),
+ *   output (1 byte), argument (2 bytes), all little-endian
+ *
+ * The firmware notifies the state of the queue on the same characteristic:
+ *
+ *   next expected sequence number (1 byte), status (1 byte),
+ *   free operation slots (2 bytes, little-endian)
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_AIO_CMD_H_
+#define LCI_AIO_CMD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+/* Operation slots of the ring buffer, power of two */
+#define LCI_AIO_CMD_RING_SIZE         128
+/* Size of an operation in a packet */
+#define LCI_AIO_CMD_OP_SIZE           6
+/* Operations in the largest packet, ATT MTU of 247 */
+#define LCI_AIO_CMD_OPS_MAX           40
+/* Applied operations between two credit notifications */
+#define LCI_AIO_CMD_CREDIT_BATCH      16
+/* Size of the credit notification */
+#define LCI_AIO_CMD_CREDIT_SIZE       4
+/* PWM frequency of the outputs in Hz */
+#define LCI_AIO_CMD_PWM_FREQ_HZ       1000
+/* PWM duty cycle of a fully on output, per mille */
+#define LCI_AIO_CMD_PWM_DUTY_MAX      1000
+/* Operation codes */
+typedef enum {
+  /* Argument 0 turns the output off, anything else on */
+  lci_aio_cmd_set = 0x01,
+  lci_aio_cmd_toggle = 0x02,
+  /* Turn on for argument milliseconds */
+  lci_aio_cmd_pulse = 0x03,
+  /* Duty cycle in per mille */
+  lci_aio_cmd_pwm = 0x04
+} lci_aio_cmd_opcode_t;
+/* Status of the credit notification */
+typedef enum {
+  lci_aio_cmd_ok = 0x00,
+  /* The packet did not carry the expected sequence number, dropped */
+  lci_aio_cmd_sequence_error = 0x01,
+  /* More operations than free slots, dropped */
+  lci_aio_cmd_overflow = 0x02,
+  /* Wrong length, opcode or output, dropped */
+  lci_aio_cmd_malformed = 0x03
+} lci_aio_cmd_status_t;
+/* Queue counters */
+typedef struct {
+  uint32_t packets;
+  uint32_t applied;
+  uint32_t dropped;
+  uint32_t notifications;
+} lci_aio_cmd_stats_t;
+
+void lci_aio_cmd_init(uint16_t characteristic, uint32_t signal);
+void lci_aio_cmd_set_client(uint8_t connection, bool notify_enabled);
+void lci_aio_cmd_on_write(const uint8_t *data, uint8_t len);
+void lci_aio_cmd_process(void);
+void lci_aio_cmd_reset(void);
+const lci_aio_cmd_stats_t *lci_aio_cmd_get_stats(void);
+
+#endif /* LCI_AIO_CMD_H_ */
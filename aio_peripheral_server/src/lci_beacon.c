@@ -0,0 +1,147 @@
+/**
+ * @file lci_beacon.c
+ * @brief Non-connectable beacon carrying the live state of the server
+ *
+ * A second advertising set, next to the connectable one, broadcasts the
+ * state of the server in its manufacturer specific data at its own interval
+ * and TX power. The stack keeps it running while a client is connected, so
+ * passive listeners get the data without the cost of a connection.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "sl_simple_timer.h"
+#include "lci_beacon.h"
+/* Advertising data type of the manufacturer specific data */
+#define AD_TYPE_MANUFACTURER          0xFF
+/* Manufacturer specific data header: length, type, company ID, kind, sequence */
+#define HEADER_SIZE                   6
+/* Legacy advertising data size */
+#define ADV_DATA_MAX                  31
+/* Advertising packet type of sl_bt_advertiser_set_data */
+#define PACKET_ADVERTISING            0
+/* Invalidated advertising set handle */
+#define ADVERTISING_SET_INVALID       0xFF
+/* Beacon advertising set */
+static uint8_t advertising_set = ADVERTISING_SET_INVALID;
+/* Advertising data of the beacon */
+static uint8_t adv_data[ADV_DATA_MAX];
+static uint8_t adv_len;
+/* Timer raising the update signal */
+static sl_simple_timer_t update_timer;
+static uint32_t beacon_signal;
+/* Local functions */
+static void hdl_update_timer_event(sl_simple_timer_t *timer, void *data);
+/**
+* @brief Update timer handler, the update runs in the Bluetooth context
+ *
+* @param[in] timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_update_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+  sl_bt_external_signal(beacon_signal);
+}
+/**
+* @brief Create and start the beacon advertising set
+*
+* The state is empty until the first lci_beacon_update, the update signal
+* is raised every LCI_BEACON_UPDATE_MS.
+ *
+* @param[in] kind          kind of the state
+* @param[in] update_signal external signal asking for a state update
+*
+* @retval SL_STATUS_OK if started, error code otherwise
+*/
+sl_status_t lci_beacon_start(lci_beacon_kind_t kind, uint32_t update_signal)
+{
+  int16_t tx_power;
+  sl_status_t sc;
+
+  beacon_signal = update_signal;
+  adv_data[0] = HEADER_SIZE - 1;
+  adv_data[1] = AD_TYPE_MANUFACTURER;
+  adv_data[2] = (uint8_t)LCI_BEACON_COMPANY_ID;
+  adv_data[3] = (uint8_t)(LCI_BEACON_COMPANY_ID >> 8);
+  adv_data[4] = (uint8_t)kind;
+  adv_data[5] = 0;
+  adv_len = HEADER_SIZE;
+
+  /* Needs a second advertiser in the stack configuration */
+  sc = sl_bt_advertiser_create_set(&advertising_set);
+  if (sc != SL_STATUS_OK) {
+    advertising_set = ADVERTISING_SET_INVALID;
+    return sc;
+  }
+  sc = sl_bt_advertiser_set_timing(advertising_set,
+                                   LCI_BEACON_INTERVAL,
+                                   LCI_BEACON_INTERVAL,
+                                   0,
+                                   0);
+  if (sc == SL_STATUS_OK) {
+    /* The stack reports the power it could set, in 0.1 dBm */
+    sc = sl_bt_advertiser_set_tx_power(advertising_set,
+                                       LCI_BEACON_TX_POWER * 10,
+                                       &tx_power);
+  }
+  if (sc == SL_STATUS_OK) {
+    sc = sl_bt_advertiser_set_data(advertising_set, PACKET_ADVERTISING, adv_len, adv_data);
+  }
+  if (sc == SL_STATUS_OK) {
+    sc = sl_bt_advertiser_start(advertising_set,
+                                sl_bt_advertiser_user_data,
+                                sl_bt_advertiser_non_connectable);
+  }
+  if (sc == SL_STATUS_OK) {
+    sc = sl_simple_timer_start(&update_timer,
+                               LCI_BEACON_UPDATE_MS,
+                               hdl_update_timer_event,
+                               NULL,
+                               true);
+  }
+  if (sc != SL_STATUS_OK) {
+    /* No half configured beacon, and the updates are refused */
+    (void)sl_bt_advertiser_delete_set(advertising_set);
+    advertising_set = ADVERTISING_SET_INVALID;
+    return sc;
+  }
+  app_log_info("Beacon started, %d dBm\n", tx_power / 10);
+  return SL_STATUS_OK;
+}
+/**
+* @brief Update the state broadcast by the beacon
+*
+* The running advertising set picks the new data up on its next event.
+ *
+* @param[in] state state bytes
+* @param[in] len   number of state bytes
+*
+* @retval SL_STATUS_OK if updated or unchanged, error code otherwise
+*/
+sl_status_t lci_beacon_update(const uint8_t *state, uint8_t len)
+{
+  if (advertising_set == ADVERTISING_SET_INVALID) {
+    return SL_STATUS_INVALID_STATE;
+  }
+  if (len > LCI_BEACON_STATE_MAX) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  if ((adv_len == HEADER_SIZE + len)
+      && (memcmp(&adv_data[HEADER_SIZE], state, len) == 0)) {
+    return SL_STATUS_OK;
+  }
+  memcpy(&adv_data[HEADER_SIZE], state, len);
+  adv_len = (uint8_t)(HEADER_SIZE + len);
+  adv_data[0] = (uint8_t)(adv_len - 1);
+  /* Listeners tell a new state by the sequence number */
+  adv_data[5]++;
+  return sl_bt_advertiser_set_data(advertising_set, PACKET_ADVERTISING, adv_len, adv_data);
+}
@@ -0,0 +1,236 @@
+/**
+ * @file lci_error.c
+ * @brief Recoverable error policy for Bluetooth API calls
+ *
+ * A failed call is classified by its status. Transient failures, such as a
+ * busy controller or a state race with an event still in the queue, are
+ * counted and retried with an exponential backoff. Failures of a connection
+ * are counted and the caller tears the connection down. Only programming
+ * and configuration errors reset the device through app_assert, the caller
+ * decides what to do with an operation still failing after all retries.
+ * A failed optional call, e.g. of a feature the stack was built without,
+ * is only counted and logged whatever its status.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "app_assert.h"
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "lci_error.h"
+/* Status space of the ATT protocol errors */
+#define ATT_STATUS_SPACE              0x1100
+#define STATUS_SPACE_MASK             0xFF00
+/* Error counters */
+static lci_error_stats_t stats;
+/* Local functions */
+static void hdl_retry_timer_event(sl_simple_timer_t *timer, void *data);
+/**
+* @brief Retry timer handler, the retry runs in the Bluetooth context
+ *
+* @param[in] timer resource pointer
+* @param[in] data  retry
+*
+* @retval None
+*/
+static void hdl_retry_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  lci_error_retry_t *retry = (lci_error_retry_t *)data;
+  (void)timer;
+  retry->due = true;
+  sl_bt_external_signal(retry->signal);
+}
+/**
+* @brief Classify a status
+ *
+* @param[in] sc status
+*
+* @retval error class
+*/
+lci_error_class_t lci_error_classify(sl_status_t sc)
+{
+  switch (sc) {
+    case SL_STATUS_OK:
+      return lci_error_none;
+    case SL_STATUS_INVALID_STATE:
+    case SL_STATUS_NOT_READY:
+    case SL_STATUS_BUSY:
+    case SL_STATUS_IN_PROGRESS:
+    case SL_STATUS_WOULD_BLOCK:
+    case SL_STATUS_TIMEOUT:
+    case SL_STATUS_NO_MORE_RESOURCE:
+    case SL_STATUS_ALLOCATION_FAILED:
+    case SL_STATUS_FULL:
+    case SL_STATUS_BT_CTRL_CONTROLLER_BUSY:
+    case SL_STATUS_BT_CTRL_COMMAND_DISALLOWED:
+    case SL_STATUS_BT_CTRL_CONNECTION_LIMIT_EXCEEDED:
+      return lci_error_transient;
+    case SL_STATUS_INVALID_HANDLE:
+    case SL_STATUS_NOT_FOUND:
+    case SL_STATUS_BT_CTRL_UNKNOWN_CONNECTION_IDENTIFIER:
+    case SL_STATUS_BT_CTRL_CONNECTION_TIMEOUT:
+      return lci_error_link;
+    default:
+      break;
+  }
+  if ((sc & STATUS_SPACE_MASK) == ATT_STATUS_SPACE) {
+    /* Error response of the peer */
+    return lci_error_link;
+  }
+  return lci_error_fatal;
+}
+/**
+* @brief Check the status of a call, reset on unrecoverable errors
+ *
+* @param[in] sc   status of the call
+* @param[in] what description of the call
+*
+* @retval error class, never lci_error_fatal
+*/
+lci_error_class_t lci_error_check(sl_status_t sc, const char *what)
+{
+  lci_error_class_t error = lci_error_classify(sc);
+
+  switch (error) {
+    case lci_error_none:
+      break;
+    case lci_error_transient:
+      stats.transient++;
+      app_log_status_warning_f(sc, "%s failed, recoverable\n", what);
+      break;
+    case lci_error_link:
+      stats.link++;
+      app_log_status_warning_f(sc, "%s failed on the connection\n", what);
+      break;
+    default:
+      app_assert_status_f(sc, "%s failed\n", what);
+      break;
+  }
+  return error;
+}
+/**
+* @brief Check the status of an optional call, never resets
+ *
+* @param[in] sc   status of the call
+* @param[in] what description of the call
+*
+* @retval true if the call succeeded
+*/
+bool lci_error_check_optional(sl_status_t sc, const char *what)
+{
+  if (sc == SL_STATUS_OK) {
+    return true;
+  }
+  stats.optional++;
+  app_log_status_warning_f(sc, "%s failed, carrying on without it\n", what);
+  return false;
+}
+/**
+* @brief Initialize the retry of an operation
+ *
+* @param[out] retry  retry
+* @param[in]  signal external signal raised when the operation is due
+*
+* @retval None
+*/
+void lci_error_retry_init(lci_error_retry_t *retry, uint32_t signal)
+{
+  retry->signal = signal;
+  retry->due = false;
+  retry->delay_ms = LCI_ERROR_RETRY_BASE_MS;
+  retry->attempts = 0;
+}
+/**
+* @brief Schedule the retry of a failed operation with exponential backoff
+ *
+* @param[in] retry retry
+*
+* @retval true if scheduled, false if all attempts are used up
+*/
+bool lci_error_retry_schedule(lci_error_retry_t *retry)
+{
+  sl_status_t sc;
+
+  if (retry->attempts >= LCI_ERROR_RETRY_ATTEMPTS) {
+    return false;
+  }
+  sc = sl_simple_timer_start(&retry->timer,
+                             retry->delay_ms,
+                             hdl_retry_timer_event,
+                             retry,
+                             false);
+  app_assert_status(sc);
+  stats.retries++;
+  retry->attempts++;
+  retry->delay_ms = (retry->delay_ms * 2 > LCI_ERROR_RETRY_MAX_MS)
+                    ? LCI_ERROR_RETRY_MAX_MS : retry->delay_ms * 2;
+  return true;
+}
+/**
+* @brief The operation succeeded, reset the backoff
+ *
+* @param[in] retry retry
+*
+* @retval None
+*/
+void lci_error_retry_done(lci_error_retry_t *retry)
+{
+  if (retry->attempts != 0) {
+    stats.recovered++;
+  }
+  retry->delay_ms = LCI_ERROR_RETRY_BASE_MS;
+  retry->attempts = 0;
+}
+/**
+* @brief Take the expiry of a retry
+ *
+* @param[in] retry retry
+*
+* @retval true once after its timer expired
+*/
+bool lci_error_retry_due(lci_error_retry_t *retry)
+{
+  bool due = retry->due;
+
+  retry->due = false;
+  return due;
+}
+/**
+* @brief Make a retry due at once
+*
+* The timer is linked by its address, a retry must be expired before it
+* is copied.
+ *
+* @param[in] retry retry
+*
+* @retval None
+*/
+void lci_error_retry_expire(lci_error_retry_t *retry)
+{
+  (void)sl_simple_timer_stop(&retry->timer);
+  retry->due = true;
+  sl_bt_external_signal(retry->signal);
+}
+/**
+* @brief Count a connection torn down after an error
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_error_count_teardown(void)
+{
+  stats.teardowns++;
+}
+/**
+* @brief Error counters
+ *
+* @param[in] None
+*
+* @retval pointer to the counters
+*/
+const lci_error_stats_t *lci_error_get_stats(void)
+{
+  return &stats;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file lci_error.h
+ * @brief Recoverable error policy for Bluetooth API calls
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_ERROR_H_
+#define LCI_ERROR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_status.h"
+#include "sl_simple_timer.h"
+/* First retry delay in milliseconds, doubled on every further attempt */
+#define LCI_ERROR_RETRY_BASE_MS       50
+/* Longest retry delay in milliseconds */
+#define LCI_ERROR_RETRY_MAX_MS        2000
+/* Attempts before a failing operation is treated as unrecoverable */
+#define LCI_ERROR_RETRY_ATTEMPTS      10
+/* Error classes */
+typedef enum {
+  /* No error */
+  lci_error_none,
+  /* Busy controller, resources or state race, retry later */
+  lci_error_transient,
+  /* The connection is gone or broken, tear it down */
+  lci_error_link,
+  /* Programming or configuration error, reset */
+  lci_error_fatal
+} lci_error_class_t;
+/* Retry of an operation, the timer raises an external signal */
+typedef struct {
+  sl_simple_timer_t timer;
+  uint32_t signal;
+  /* The timer expired, several retries can share the signal */
+  volatile bool due;
+  uint16_t delay_ms;
+  uint8_t attempts;
+} lci_error_retry_t;
+/* Error counters */
+typedef struct {
+  uint32_t transient;
+  uint32_t link;
+  uint32_t retries;
+  uint32_t recovered;
+  uint32_t teardowns;
+  /* Failed optional calls, the application carries on without them */
+  uint32_t optional;
+} lci_error_stats_t;
+
+lci_error_class_t lci_error_classify(sl_status_t sc);
+lci_error_class_t lci_error_check(sl_status_t sc, const char *what);
+bool lci_error_check_optional(sl_status_t sc, const char *what);
+void lci_error_retry_init(lci_error_retry_t *retry, uint32_t signal);
+bool lci_error_retry_schedule(lci_error_retry_t *retry);
+void lci_error_retry_done(lci_error_retry_t *retry);
+bool lci_error_retry_due(lci_error_retry_t *retry);
+void lci_error_retry_expire(lci_error_retry_t *retry);
+void lci_error_count_teardown(void);
+const lci_error_stats_t *lci_error_get_stats(void);
+
+#endif /* LCI_ERROR_H_ */
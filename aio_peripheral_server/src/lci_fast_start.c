@@ -0,0 +1,331 @@
+/**
+ * @file lci_fast_start.c
+ * @brief Fast start of the advertising after a reset
+ *
+ * The advertising data and scan response of the server are kept in NVM3
+ * with their CRC. After a reset, e.g. a brown-out or an OTA update, the
+ * advertising starts from this copy with a single NVM3 read. The GATT
+ * database reads, the System ID and the check of the copy only run after
+ * the first advertisement: the data is built again and a CRC that differs,
+ * e.g. a device name changed by an update, replaces the advertised data and
+ * the copy. The time from reset to the first advertisement and to the first
+ * connection is logged.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "app_assert.h"
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "sl_sleeptimer.h"
+#include "gatt_db.h"
+#include "nvm3.h"
+#include "nvm3_default.h"
+#include "lci_fast_start.h"
+/* Layout version of the cache, stale layouts are rebuilt */
+#define CACHE_VERSION                 2
+/* Advertising data types */
+#define AD_TYPE_FLAGS                 0x01
+#define AD_TYPE_UUID16_COMPLETE       0x03
+#define AD_TYPE_NAME_SHORT            0x08
+#define AD_TYPE_NAME_COMPLETE         0x09
+/* LE general discoverable, BR/EDR not supported */
+#define AD_FLAGS                      0x06
+/* Advertising packet types of sl_bt_advertiser_set_data */
+#define PACKET_ADVERTISING            0
+#define PACKET_SCAN_RESPONSE          1
+/* Persistent cache */
+typedef struct {
+  uint8_t version;
+  uint8_t adv_len;
+  uint8_t scan_rsp_len;
+  /* CRC-16/CCITT-FALSE of the advertising data and scan response */
+  uint16_t crc;
+  uint8_t adv_data[LCI_FAST_START_ADV_DATA_MAX];
+  uint8_t scan_rsp_data[LCI_FAST_START_ADV_DATA_MAX];
+} fast_start_cache_t;
+/* Cache of this boot */
+static fast_start_cache_t cache;
+/* The cache was read from NVM3 */
+static bool cache_loaded;
+/* Advertised service of this boot */
+static uint16_t adv_service_uuid;
+/* Boot timestamps */
+static lci_fast_start_times_t times;
+/* Local functions */
+static uint32_t now_ms(void);
+static uint16_t crc16(const uint8_t *data, uint16_t len, uint16_t crc);
+static uint16_t cache_crc(const fast_start_cache_t *data);
+static void build_adv_data(fast_start_cache_t *data, uint16_t service_uuid);
+static void build_system_id(uint8_t *system_id);
+/**
+* @brief Time since reset
+ *
+* @param[in] None
+*
+* @retval milliseconds, at least 1
+*/
+static uint32_t now_ms(void)
+{
+  uint64_t ms = 0;
+
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return (ms == 0) ? 1 : (uint32_t)ms;
+}
+/**
+* @brief CRC-16/CCITT-FALSE
+ *
+* @param[in] data pointer to the data
+* @param[in] len  length of the data
+* @param[in] crc  initial value, 0xFFFF or the CRC of the data before
+*
+* @retval CRC of the data
+*/
+static uint16_t crc16(const uint8_t *data, uint16_t len, uint16_t crc)
+{
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+/**
+* @brief CRC of the advertising data and scan response
+ *
+* @param[in] data advertising data and scan response
+*
+* @retval CRC of the data
+*/
+static uint16_t cache_crc(const fast_start_cache_t *data)
+{
+  uint16_t crc = crc16(&data->adv_len, 1, 0xFFFF);
+
+  crc = crc16(data->adv_data, data->adv_len, crc);
+  crc = crc16(&data->scan_rsp_len, 1, crc);
+  return crc16(data->scan_rsp_data, data->scan_rsp_len, crc);
+}
+/**
+* @brief Build the advertising data and scan response of the server
+*
+* The advertising data carries the flags and the service UUID, the scan
+* response the device name of the GATT database.
+ *
+* @param[out] data         advertising data and scan response
+* @param[in]  service_uuid advertised 16-bit service UUID
+*
+* @retval None
+*/
+static void build_adv_data(fast_start_cache_t *data, uint16_t service_uuid)
+{
+  size_t name_len = 0;
+  sl_status_t sc;
+
+  memset(data, 0, sizeof(*data));
+  data->version = CACHE_VERSION;
+  data->adv_data[0] = 2;
+  data->adv_data[1] = AD_TYPE_FLAGS;
+  data->adv_data[2] = AD_FLAGS;
+  data->adv_data[3] = 3;
+  data->adv_data[4] = AD_TYPE_UUID16_COMPLETE;
+  data->adv_data[5] = (uint8_t)service_uuid;
+  data->adv_data[6] = (uint8_t)(service_uuid >> 8);
+  data->adv_len = 7;
+
+  /* One byte more than fits tells a name that has to be shortened */
+  sc = sl_bt_gatt_server_read_attribute_value(gattdb_device_name,
+                                              0,
+                                              LCI_FAST_START_ADV_DATA_MAX - 1,
+                                              &name_len,
+                                              &data->scan_rsp_data[2]);
+  if (sc != SL_STATUS_OK) {
+    name_len = 0;
+  }
+  if (name_len != 0) {
+    data->scan_rsp_data[1] = AD_TYPE_NAME_COMPLETE;
+    if (name_len > LCI_FAST_START_ADV_DATA_MAX - 2) {
+      name_len = LCI_FAST_START_ADV_DATA_MAX - 2;
+      data->scan_rsp_data[1] = AD_TYPE_NAME_SHORT;
+    }
+    data->scan_rsp_data[0] = (uint8_t)(name_len + 1);
+    data->scan_rsp_len = (uint8_t)(name_len + 2);
+  }
+  data->crc = cache_crc(data);
+}
+/**
+* @brief Build the System ID from the identity address
+ *
+* @param[out] system_id System ID
+*
+* @retval None
+*/
+static void build_system_id(uint8_t *system_id)
+{
+  bd_addr address;
+  uint8_t address_type;
+  sl_status_t sc;
+
+  /* Extract unique ID from BT Address */
+  sc = sl_bt_system_get_identity_address(&address, &address_type);
+  app_assert_status(sc);
+
+  /* Pad and reverse unique ID to get System ID */
+  system_id[0] = address.addr[5];
+  system_id[1] = address.addr[4];
+  system_id[2] = address.addr[3];
+  system_id[3] = 0xFF;
+  system_id[4] = 0xFE;
+  system_id[5] = address.addr[2];
+  system_id[6] = address.addr[1];
+  system_id[7] = address.addr[0];
+}
+/**
+* @brief Record the boot of the stack and load the cache
+ *
+* @param[in] service_uuid advertised 16-bit service UUID
+*
+* @retval None
+*/
+void lci_fast_start_init(uint16_t service_uuid)
+{
+  times.boot_ms = now_ms();
+  adv_service_uuid = service_uuid;
+  cache_loaded = false;
+#if LCI_FAST_START
+  if ((nvm3_readData(nvm3_defaultHandle,
+                     LCI_FAST_START_NVM3_KEY,
+                     &cache,
+                     sizeof(cache)) == ECODE_NVM3_OK)
+      && (cache.version == CACHE_VERSION)
+      && (cache.adv_len <= LCI_FAST_START_ADV_DATA_MAX)
+      && (cache.scan_rsp_len <= LCI_FAST_START_ADV_DATA_MAX)
+      && (cache.crc == cache_crc(&cache))) {
+    cache_loaded = true;
+    return;
+  }
+#endif
+  build_adv_data(&cache, service_uuid);
+}
+/**
+* @brief Set the advertising data and scan response of an advertising set
+*
+* The set has to be started with sl_bt_advertiser_user_data.
+ *
+* @param[in] advertising_set advertising set handle
+*
+* @retval SL_STATUS_OK if set, error code otherwise
+*/
+sl_status_t lci_fast_start_set_adv_data(uint8_t advertising_set)
+{
+  sl_status_t sc;
+
+  sc = sl_bt_advertiser_set_data(advertising_set,
+                                 PACKET_ADVERTISING,
+                                 cache.adv_len,
+                                 cache.adv_data);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  return sl_bt_advertiser_set_data(advertising_set,
+                                   PACKET_SCAN_RESPONSE,
+                                   cache.scan_rsp_len,
+                                   cache.scan_rsp_data);
+}
+/**
+* @brief Record the first start of the advertising
+ *
+* @param[in] None
+*
+* @retval true on the first successful start, when the completion is due
+*/
+bool lci_fast_start_on_advertising(void)
+{
+  if (times.advertising_ms != 0) {
+    return false;
+  }
+  times.advertising_ms = now_ms();
+  return true;
+}
+/**
+* @brief Record the first connection
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_fast_start_on_connection(void)
+{
+  if (times.connection_ms != 0) {
+    return;
+  }
+  times.connection_ms = now_ms();
+  app_log_info("Boot to first connection: %lu ms\n", (unsigned long)times.connection_ms);
+}
+/**
+* @brief Initialization left for after the first advertisement
+*
+* Writes the System ID characteristic and builds the advertising data
+* again. Data that differs from the cached copy is advertised from now on
+* and replaces the copy.
+ *
+* @param[in] advertising_set advertising set of the cached data
+*
+* @retval None
+*/
+void lci_fast_start_complete(uint8_t advertising_set)
+{
+  uint8_t system_id[LCI_FAST_START_SYSTEM_ID_LEN];
+  sl_status_t sc;
+#if LCI_FAST_START
+  fast_start_cache_t built;
+  bool store = !cache_loaded;
+#endif
+
+  build_system_id(system_id);
+  sc = sl_bt_gatt_server_write_attribute_value(gattdb_system_id,
+                                               0,
+                                               sizeof(system_id),
+                                               system_id);
+  app_assert_status(sc);
+#if LCI_FAST_START
+  if (cache_loaded) {
+    build_adv_data(&built, adv_service_uuid);
+    if (built.crc != cache.crc) {
+      app_log_info("Advertising data changed, cache rebuilt\n");
+      cache = built;
+      store = true;
+      sc = lci_fast_start_set_adv_data(advertising_set);
+      app_assert_status(sc);
+    }
+  }
+  if (store) {
+    Ecode_t ec = nvm3_writeData(nvm3_defaultHandle,
+                                LCI_FAST_START_NVM3_KEY,
+                                &cache,
+                                sizeof(cache));
+    if (ec != ECODE_NVM3_OK) {
+      app_log_warning("Failed to store fast start data: 0x%lx\n", (unsigned long)ec);
+    }
+  }
+#else
+  (void)advertising_set;
+#endif
+  app_log_info("Boot to first advertisement: %lu ms (stack ready %lu ms, %s)\n",
+               (unsigned long)times.advertising_ms,
+               (unsigned long)times.boot_ms,
+               cache_loaded ? "cached" : "built");
+}
+/**
+* @brief Boot timestamps
+ *
+* @param[in] None
+*
+* @retval pointer to the timestamps
+*/
+const lci_fast_start_times_t *lci_fast_start_get_times(void)
+{
+  return &times;
+}
@@ -0,0 +1,276 @@
+/**
+ * @file lci_gatt_caching.c
+ * @brief Change-aware state of the bonded clients for the GATT caching
+ *
+ * With the Service Changed, Client Supported Features and Database Hash
+ * characteristics in the Generic Attribute service a client can cache the
+ * discovered database and skip the discovery on the next connection. The
+ * stack computes the hash of the database, answers the reads of the hash
+ * and handles the robust caching a client enables in Client Supported
+ * Features.
+ *
+ * The database changes with a firmware update. A bonded client keeps its
+ * cache across the update and only learns about the change from a Service
+ * Changed indication. The hash of the database is stored in NVM3 with a
+ * change-aware flag per bond: after a boot with a new hash all the bonds
+ * are change-unaware, and every bonded client that reconnects is indicated
+ * the whole handle range once its link is encrypted. The confirmation of
+ * the client makes its bond change-aware. A new bond is change-aware, the
+ * client has just discovered the database.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdbool.h>
+#include <string.h>
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "gatt_db.h"
+#include "nvm3.h"
+#include "nvm3_default.h"
+#include "lci_gatt_caching.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Affected handle range of the Service Changed indication, the whole
+ * database */
+#define HANDLE_FIRST                  0x0001
+#define HANDLE_LAST                   0xFFFF
+/* Persistent state */
+typedef struct {
+  uint8_t hash[LCI_GATT_CACHING_HASH_SIZE];
+  /* Bit n set if the client of bond n knows the database */
+  uint32_t aware;
+} state_t;
+/* Connection of a client */
+typedef struct {
+  uint8_t connection;
+  uint8_t bonding;
+  /* Service Changed indicated, waiting for the confirmation */
+  bool indicating;
+  bool encrypted;
+} link_t;
+static state_t state;
+static link_t links[SL_BT_CONFIG_MAX_CONNECTIONS];
+/* Local functions */
+static link_t *find_link(uint8_t connection);
+static bool is_aware(uint8_t bonding);
+static void set_aware(uint8_t bonding);
+static void store_state(void);
+/**
+* @brief Find a client connection
+ *
+* @param[in] connection connection handle
+*
+* @retval link, NULL if not known
+*/
+static link_t *find_link(uint8_t connection)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == connection) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Whether the client of a bond knows the current database
+ *
+* @param[in] bonding bonding handle
+*
+* @retval true if change-aware, or the bond is not tracked
+*/
+static bool is_aware(uint8_t bonding)
+{
+  if (bonding >= LCI_GATT_CACHING_BONDS_MAX) {
+    return true;
+  }
+  return (state.aware & (1ul << bonding)) != 0;
+}
+/**
+* @brief Mark the client of a bond change-aware
+ *
+* @param[in] bonding bonding handle
+*
+* @retval None
+*/
+static void set_aware(uint8_t bonding)
+{
+  if (is_aware(bonding)) {
+    return;
+  }
+  state.aware |= (1ul << bonding);
+  store_state();
+}
+/**
+* @brief Store the hash and the change-aware bonds
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void store_state(void)
+{
+  Ecode_t ec = nvm3_writeData(nvm3_defaultHandle, LCI_GATT_CACHING_NVM3_KEY, &state, sizeof(state));
+
+  if (ec != ECODE_NVM3_OK) {
+    app_log_warning("Failed to store GATT caching state: 0x%lx\n", (unsigned long)ec);
+  }
+}
+/**
+* @brief Compare the database hash with the one of the last boot
+*
+* A new database, or a first boot, makes all the bonds change-unaware.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_gatt_caching_init(void)
+{
+  uint8_t hash[LCI_GATT_CACHING_HASH_SIZE];
+  size_t len = 0;
+  sl_status_t sc;
+
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    links[i].connection = CONNECTION_HANDLE_INVALID;
+  }
+  sc = sl_bt_gatt_server_read_attribute_value(gattdb_database_hash, 0, sizeof(hash), &len, hash);
+  if ((sc != SL_STATUS_OK) || (len != sizeof(hash))) {
+    app_log_status_warning_f(sc, "Database Hash not readable, GATT caching disabled\n");
+    /* Nothing is indicated */
+    state.aware = UINT32_MAX;
+    return;
+  }
+  if ((nvm3_readData(nvm3_defaultHandle,
+                     LCI_GATT_CACHING_NVM3_KEY,
+                     &state,
+                     sizeof(state)) == ECODE_NVM3_OK)
+      && (memcmp(state.hash, hash, sizeof(hash)) == 0)) {
+    return;
+  }
+  app_log_info("GATT database changed, bonded clients are indicated on reconnect\n");
+  memcpy(state.hash, hash, sizeof(hash));
+  state.aware = 0;
+  store_state();
+}
+/**
+* @brief A client connected
+ *
+* @param[in] connection connection handle
+* @param[in] bonding    bond of the client, LCI_BONDING_NONE if not bonded
+*
+* @retval None
+*/
+void lci_gatt_caching_on_opened(uint8_t connection, uint8_t bonding)
+{
+  link_t *link = find_link(CONNECTION_HANDLE_INVALID);
+
+  if (link == NULL) {
+    return;
+  }
+  link->connection = connection;
+  link->bonding = bonding;
+  link->indicating = false;
+  link->encrypted = false;
+}
+/**
+* @brief A client paired and bonded, it discovered the current database
+ *
+* @param[in] connection connection handle
+* @param[in] bonding    new bond
+*
+* @retval None
+*/
+void lci_gatt_caching_on_bonded(uint8_t connection, uint8_t bonding)
+{
+  link_t *link = find_link(connection);
+
+  if (link != NULL) {
+    link->bonding = bonding;
+  }
+  set_aware(bonding);
+}
+/**
+* @brief Indicate the change to a change-unaware client once encrypted
+*
+* The stack restores the client configuration of a bonded client when the
+* link is encrypted, the indication can only go out from then on.
+ *
+* @param[in] connection    connection handle
+* @param[in] security_mode security mode of the link
+*
+* @retval None
+*/
+void lci_gatt_caching_on_parameters(uint8_t connection, uint8_t security_mode)
+{
+  link_t *link = find_link(connection);
+  uint8_t range[4] = {
+    (uint8_t)HANDLE_FIRST, (uint8_t)(HANDLE_FIRST >> 8),
+    (uint8_t)HANDLE_LAST, (uint8_t)(HANDLE_LAST >> 8)
+  };
+  sl_status_t sc;
+
+  if ((link == NULL) || link->encrypted || (security_mode == sl_bt_connection_mode1_level1)) {
+    return;
+  }
+  link->encrypted = true;
+  if ((link->bonding == LCI_BONDING_NONE) || is_aware(link->bonding)) {
+    return;
+  }
+  sc = sl_bt_gatt_server_send_indication(connection, gattdb_service_changed_char, sizeof(range), range);
+  if (sc == SL_STATUS_OK) {
+    link->indicating = true;
+    app_log_info("Connection %u: Service Changed indicated, bond %u\n", connection, link->bonding);
+  } else {
+    /* Not subscribed, the client relies on the Database Hash */
+    app_log_debug("Connection %u: Service Changed not indicated: 0x%04lx\n",
+                  connection,
+                  (unsigned long)sc);
+  }
+}
+/**
+* @brief Status of the Service Changed characteristic of a client
+ *
+* @param[in] connection          connection handle
+* @param[in] status_flags        confirmation or client configuration
+* @param[in] client_config_flags client configuration
+*
+* @retval None
+*/
+void lci_gatt_caching_on_status(uint8_t connection, uint8_t status_flags, uint16_t client_config_flags)
+{
+  link_t *link = find_link(connection);
+
+  if (link == NULL) {
+    return;
+  }
+  if (status_flags == sl_bt_gatt_server_client_config) {
+    app_log_debug("Connection %u: Service Changed indications %s\n",
+                  connection,
+                  ((client_config_flags & sl_bt_gatt_indication) != 0) ? "enabled" : "disabled");
+    return;
+  }
+  if ((status_flags == sl_bt_gatt_server_confirmation) && link->indicating) {
+    link->indicating = false;
+    if (link->bonding != LCI_BONDING_NONE) {
+      set_aware(link->bonding);
+    }
+    app_log_info("Connection %u: client change-aware\n", connection);
+  }
+}
+/**
+* @brief A client disconnected
+ *
+* @param[in] connection closed connection handle
+*
+* @retval None
+*/
+void lci_gatt_caching_on_closed(uint8_t connection)
+{
+  link_t *link = find_link(connection);
+
+  if (link != NULL) {
+    link->connection = CONNECTION_HANDLE_INVALID;
+  }
+}
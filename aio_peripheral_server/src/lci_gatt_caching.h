@@ -0,0 +1,34 @@
+/**
+ * @file lci_gatt_caching.h
+ * @brief Change-aware state of the bonded clients for the GATT caching
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_GATT_CACHING_H_
+#define LCI_GATT_CACHING_H_
+
+#include <stdint.h>
+#include "lci_bonding.h"
+/* The change-aware state is kept per bond, set to 0 to leave the bonded
+ * clients to the Database Hash alone */
+#ifndef LCI_GATT_CACHING
+#define LCI_GATT_CACHING              LCI_BONDING
+#endif
+/* NVM3 key of the database hash and the change-aware bonds, application
+ * key range 0x00000-0x0FFFF */
+#define LCI_GATT_CACHING_NVM3_KEY     0x01240
+/* Size of the Database Hash characteristic */
+#define LCI_GATT_CACHING_HASH_SIZE    16
+/* Bonds tracked, bonding handles of the stack from 0 */
+#define LCI_GATT_CACHING_BONDS_MAX    32
+
+void lci_gatt_caching_init(void);
+void lci_gatt_caching_on_opened(uint8_t connection, uint8_t bonding);
+void lci_gatt_caching_on_bonded(uint8_t connection, uint8_t bonding);
+void lci_gatt_caching_on_parameters(uint8_t connection, uint8_t security_mode);
+void lci_gatt_caching_on_status(uint8_t connection, uint8_t status_flags, uint16_t client_config_flags);
+void lci_gatt_caching_on_closed(uint8_t connection);
+
+#endif /* LCI_GATT_CACHING_H_ */
@@ -0,0 +1,223 @@
+/**
+ * @file delta_cli.cpp
+ * @brief Command line generator and checker of differential firmware updates
+ *
+ *   lci_delta create --old OLD --new NEW -o PATCH [--old-base ADDR]
+ *       Write the patch that rebuilds the GBL file NEW from the application
+ *       installed by OLD, a GBL file or, with --old-base, a raw flash image.
+ *       The patch is applied back through the firmware applier before it
+ *       is written.
+ *
+ *   lci_delta apply --old OLD --patch PATCH -o OUT [--old-base ADDR]
+ *       Rebuild the new GBL file from a raw patch or from a GBL container
+ *       carrying the patch in its metadata tag, in chunks of the size of a
+ *       GATT write like the device does.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "delta_codec.hpp"
+#include "lci_delta.h"
+
+using namespace lci::delta;
+
+namespace {
+
+/* ATT payload of a write without response at the maximum MTU */
+constexpr uint32_t kChunkSize = 244;
+
+void usage()
+{
+  std::fprintf(stderr,
+               "usage: lci_delta create --old OLD --new NEW -o PATCH [--old-base ADDR]\n"
+               "       lci_delta apply --old OLD --patch PATCH -o OUT [--old-base ADDR]\n");
+}
+
+bool read_file(const std::string &path, std::vector<uint8_t> &data)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::fprintf(stderr, "cannot read %s\n", path.c_str());
+    return false;
+  }
+  data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool write_file(const std::string &path, const std::vector<uint8_t> &data)
+{
+  std::ofstream out(path, std::ios::binary);
+  out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+  if (!out) {
+    std::fprintf(stderr, "cannot write %s\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+/* Installed application: the program data of a GBL file or a raw image */
+bool load_installed(const std::string &path, bool raw, uint32_t base, Image &image)
+{
+  std::vector<uint8_t> data;
+  if (!read_file(path, data)) {
+    return false;
+  }
+  if (raw) {
+    image.base = base;
+    image.data = std::move(data);
+    return true;
+  }
+  if (!gbl_image(data, image)) {
+    std::fprintf(stderr, "%s is not a GBL file, use --old-base for a raw image\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool collect(uint32_t offset, const uint8_t *data, uint32_t len, void *context)
+{
+  auto *out = static_cast<std::vector<uint8_t> *>(context);
+  if (offset != out->size()) {
+    return false;
+  }
+  out->insert(out->end(), data, data + len);
+  return true;
+}
+
+const char *status_name(lci_delta_status_t status)
+{
+  switch (status) {
+    case lci_delta_ok: return "ok";
+    case lci_delta_done: return "done";
+    case lci_delta_bad_format: return "bad format";
+    case lci_delta_wrong_base: return "wrong installed application";
+    case lci_delta_write_error: return "write error";
+    case lci_delta_bad_size: return "bad size";
+    case lci_delta_bad_crc: return "bad CRC";
+  }
+  return "unknown";
+}
+
+/* Run the firmware applier over the patch or container */
+lci_delta_status_t apply(const Image &installed, const std::vector<uint8_t> &patch, std::vector<uint8_t> &out)
+{
+  lci_delta_t delta;
+  bool container = patch.size() >= 4 && patch[0] == 0xEB && patch[1] == 0x17 && patch[2] == 0xA6 && patch[3] == 0x03;
+  lci_delta_status_t status = lci_delta_ok;
+
+  out.clear();
+  lci_delta_init(&delta, installed.data.data(), installed.base, static_cast<uint32_t>(installed.data.size()),
+                 collect, &out);
+  for (size_t pos = 0; pos < patch.size(); pos += kChunkSize) {
+    if (status != lci_delta_ok && status != lci_delta_done) {
+      break;
+    }
+    auto len = static_cast<uint32_t>(std::min<size_t>(kChunkSize, patch.size() - pos));
+    status = container ? lci_delta_push_container(&delta, &patch[pos], len)
+                       : lci_delta_push_patch(&delta, &patch[pos], len);
+  }
+  if (status == lci_delta_ok || status == lci_delta_done) {
+    status = lci_delta_finish(&delta);
+  }
+  return status;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+  std::string command = argv[1];
+  std::string old_path;
+  std::string new_path;
+  std::string patch_path;
+  std::string out_path;
+  bool raw = false;
+  uint32_t base = 0;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--old" && i + 1 < argc) {
+      old_path = argv[++i];
+    } else if (arg == "--new" && i + 1 < argc) {
+      new_path = argv[++i];
+    } else if (arg == "--patch" && i + 1 < argc) {
+      patch_path = argv[++i];
+    } else if (arg == "-o" && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (arg == "--old-base" && i + 1 < argc) {
+      raw = true;
+      base = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  Image installed;
+  if (old_path.empty() || out_path.empty() || !load_installed(old_path, raw, base, installed)) {
+    usage();
+    return 2;
+  }
+
+  if (command == "create" && !new_path.empty()) {
+    std::vector<uint8_t> target;
+    if (!read_file(new_path, target)) {
+      return 1;
+    }
+    Stats stats;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> patch = create(installed, target, &stats);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::vector<uint8_t> rebuilt;
+    lci_delta_status_t status = apply(installed, patch, rebuilt);
+    if (status != lci_delta_ok || rebuilt != target) {
+      std::fprintf(stderr, "patch check failed: %s\n", status_name(status));
+      return 1;
+    }
+    if (!write_file(out_path, patch)) {
+      return 1;
+    }
+    std::printf("installed %zu bytes at 0x%08X, new %zu bytes, patch %zu bytes (%.1f%%) in %.2f s\n",
+                installed.data.size(), installed.base, target.size(), patch.size(),
+                100.0 * static_cast<double>(patch.size()) / static_cast<double>(target.size()), elapsed);
+    std::printf("copy %zu ops %zu bytes, diff %zu ops %zu bytes %zu literals, add %zu ops %zu bytes\n",
+                stats.copies, stats.copied_bytes, stats.diffs, stats.diff_bytes, stats.diff_literals,
+                stats.adds, stats.added_bytes);
+    return 0;
+  }
+
+  if (command == "apply" && !patch_path.empty()) {
+    std::vector<uint8_t> patch;
+    std::vector<uint8_t> rebuilt;
+    if (!read_file(patch_path, patch)) {
+      return 1;
+    }
+    lci_delta_status_t status = apply(installed, patch, rebuilt);
+    if (status != lci_delta_ok) {
+      std::fprintf(stderr, "apply failed: %s\n", status_name(status));
+      return 1;
+    }
+    if (!write_file(out_path, rebuilt)) {
+      return 1;
+    }
+    std::printf("rebuilt %zu bytes\n", rebuilt.size());
+    return 0;
+  }
+
+  usage();
+  return 2;
+}
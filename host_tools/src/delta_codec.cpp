@@ -0,0 +1,289 @@
+/**
+ * @file delta_codec.cpp
+ * @brief Host side generator of differential firmware updates
+ *
+ * Firmware changes move code, so most of a new image is the old image at
+ * another offset, with the branch and literal pool words that point across
+ * the move slightly different. The generator follows bsdiff: an exact seed
+ * match of at least kSeedSize bytes, found through a hash chain over the
+ * old image, starts an alignment that is extended while it matches more
+ * bytes than it misses. An alignment without a difference is a copy, any
+ * other a diff, whose bytes are mostly zero and stored as zero runs. Bytes
+ * outside of any alignment are added as literals.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "delta_codec.hpp"
+
+#include <algorithm>
+
+#include "lci_delta.h"
+
+namespace lci::delta {
+
+namespace {
+
+constexpr size_t kSeedSize = 12;
+constexpr size_t kHashBits = 16;
+constexpr size_t kChainDepth = 64;
+/* An alignment ends after losing this many matches against its best point */
+constexpr int kGiveUp = 16;
+
+uint32_t get_le32(const uint8_t *src)
+{
+  return static_cast<uint32_t>(src[0]) | (static_cast<uint32_t>(src[1]) << 8)
+         | (static_cast<uint32_t>(src[2]) << 16) | (static_cast<uint32_t>(src[3]) << 24);
+}
+
+void put_le32(std::vector<uint8_t> &dst, uint32_t value)
+{
+  for (int i = 0; i < 4; ++i) {
+    dst.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+void put_varint(std::vector<uint8_t> &dst, uint32_t value)
+{
+  while (value >= 0x80) {
+    dst.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  dst.push_back(static_cast<uint8_t>(value));
+}
+
+void put_offset(std::vector<uint8_t> &dst, int64_t offset)
+{
+  auto value = static_cast<int32_t>(offset);
+  put_varint(dst, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+}
+
+uint32_t seed_hash(const uint8_t *p)
+{
+  uint64_t v = 0;
+  for (size_t i = 0; i < kSeedSize; ++i) {
+    v = v * 0x100000001B3ull + p[i];
+  }
+  return static_cast<uint32_t>((v * 0x9E3779B97F4A7C15ull) >> (64 - kHashBits));
+}
+
+/* Hash chains over every seed of the old image, newest position first */
+class SeedIndex {
+public:
+  explicit SeedIndex(const std::vector<uint8_t> &old) : old_(old), head_(size_t{1} << kHashBits, -1), next_(old.size(), -1)
+  {
+    for (size_t i = 0; i + kSeedSize <= old.size(); ++i) {
+      uint32_t h = seed_hash(&old[i]);
+      next_[i] = head_[h];
+      head_[h] = static_cast<int32_t>(i);
+    }
+  }
+
+  /* Longest exact match of target at pos, preferring the expected offset */
+  size_t best_match(const std::vector<uint8_t> &target, size_t pos, size_t expected, size_t &old_pos) const
+  {
+    size_t best = 0;
+    auto match_length = [&](size_t o) {
+      size_t n = 0;
+      while (o + n < old_.size() && pos + n < target.size() && old_[o + n] == target[pos + n]) {
+        ++n;
+      }
+      return n;
+    };
+    if (expected < old_.size()) {
+      best = match_length(expected);
+      old_pos = expected;
+    }
+    if (best >= kSeedSize || pos + kSeedSize > target.size()) {
+      return best;
+    }
+    size_t depth = 0;
+    for (int32_t o = head_[seed_hash(&target[pos])]; o >= 0 && depth < kChainDepth; o = next_[o], ++depth) {
+      size_t n = match_length(static_cast<size_t>(o));
+      if (n > best) {
+        best = n;
+        old_pos = static_cast<size_t>(o);
+      }
+    }
+    return best;
+  }
+
+private:
+  const std::vector<uint8_t> &old_;
+  std::vector<int32_t> head_;
+  std::vector<int32_t> next_;
+};
+
+/* Length of the alignment of target at pos with old at old_pos */
+size_t extend(const std::vector<uint8_t> &old, size_t old_pos, const std::vector<uint8_t> &target, size_t pos)
+{
+  int score = 0;
+  int best_score = 0;
+  size_t best_len = 0;
+  for (size_t n = 0; old_pos + n < old.size() && pos + n < target.size(); ++n) {
+    score += old[old_pos + n] == target[pos + n] ? 1 : -1;
+    if (score > best_score) {
+      best_score = score;
+      best_len = n + 1;
+    } else if (score < best_score - kGiveUp) {
+      break;
+    }
+  }
+  return best_len;
+}
+
+void emit_add(std::vector<uint8_t> &patch, const std::vector<uint8_t> &target, size_t begin, size_t end, Stats &stats)
+{
+  if (begin == end) {
+    return;
+  }
+  patch.push_back(LCI_DELTA_OP_ADD);
+  put_varint(patch, static_cast<uint32_t>(end - begin));
+  patch.insert(patch.end(), target.begin() + static_cast<std::ptrdiff_t>(begin),
+               target.begin() + static_cast<std::ptrdiff_t>(end));
+  ++stats.adds;
+  stats.added_bytes += end - begin;
+}
+
+void emit_aligned(std::vector<uint8_t> &patch, const std::vector<uint8_t> &old, size_t old_pos,
+                  const std::vector<uint8_t> &target, size_t pos, size_t len, size_t &old_cursor, Stats &stats)
+{
+  bool same = std::equal(target.begin() + static_cast<std::ptrdiff_t>(pos),
+                         target.begin() + static_cast<std::ptrdiff_t>(pos + len),
+                         old.begin() + static_cast<std::ptrdiff_t>(old_pos));
+  patch.push_back(same ? LCI_DELTA_OP_COPY : LCI_DELTA_OP_DIFF);
+  put_varint(patch, static_cast<uint32_t>(len));
+  put_offset(patch, static_cast<int64_t>(old_pos) - static_cast<int64_t>(old_cursor));
+  old_cursor = old_pos + len;
+  if (same) {
+    ++stats.copies;
+    stats.copied_bytes += len;
+    return;
+  }
+  ++stats.diffs;
+  stats.diff_bytes += len;
+  /* Segments: zero run, literal count, literals */
+  size_t i = 0;
+  while (i < len) {
+    size_t zeros = 0;
+    while (i + zeros < len && target[pos + i + zeros] == old[old_pos + i + zeros]) {
+      ++zeros;
+    }
+    put_varint(patch, static_cast<uint32_t>(zeros));
+    i += zeros;
+    if (i == len) {
+      break;
+    }
+    /* Literals up to the next run of at least two equal bytes */
+    size_t count = 0;
+    while (i + count < len) {
+      size_t k = i + count;
+      if (target[pos + k] == old[old_pos + k] && k + 1 < len && target[pos + k + 1] == old[old_pos + k + 1]) {
+        break;
+      }
+      ++count;
+    }
+    put_varint(patch, static_cast<uint32_t>(count));
+    for (size_t k = 0; k < count; ++k) {
+      patch.push_back(static_cast<uint8_t>(target[pos + i + k] - old[old_pos + i + k]));
+    }
+    stats.diff_literals += count;
+    i += count;
+  }
+}
+
+}  // namespace
+
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc)
+{
+  return lci_delta_crc32(crc, data, static_cast<uint32_t>(len));
+}
+
+bool gbl_image(const std::vector<uint8_t> &gbl, Image &image)
+{
+  uint32_t low = UINT32_MAX;
+  uint32_t high = 0;
+  if (gbl.size() < 8 || get_le32(gbl.data()) != kGblTagHeader) {
+    return false;
+  }
+  /* Two passes: extent of the program data, then the contents */
+  for (int pass = 0; pass < 2; ++pass) {
+    size_t pos = 0;
+    while (pos + 8 <= gbl.size()) {
+      uint32_t tag = get_le32(&gbl[pos]);
+      uint32_t len = get_le32(&gbl[pos + 4]);
+      if (pos + 8 + len > gbl.size()) {
+        return false;
+      }
+      if ((tag == kGblTagProgram || tag == kGblTagProgramLegacy) && len >= 4) {
+        uint32_t address = get_le32(&gbl[pos + 8]);
+        if (pass == 0) {
+          low = std::min(low, address);
+          high = std::max(high, address + len - 4);
+        } else {
+          std::copy(gbl.begin() + static_cast<std::ptrdiff_t>(pos + 12),
+                    gbl.begin() + static_cast<std::ptrdiff_t>(pos + 8 + len),
+                    image.data.begin() + (address - image.base));
+        }
+      }
+      pos += 8 + len;
+      if (tag == kGblTagEnd) {
+        break;
+      }
+    }
+    if (pass == 0) {
+      if (low >= high) {
+        return false;
+      }
+      image.base = low;
+      image.data.assign(high - low, 0xFF);
+    }
+  }
+  return true;
+}
+
+std::vector<uint8_t> create(const Image &installed, const std::vector<uint8_t> &target, Stats *stats)
+{
+  Stats local;
+  Stats &s = stats ? *stats : local;
+  const std::vector<uint8_t> &old = installed.data;
+  std::vector<uint8_t> patch;
+
+  put_le32(patch, LCI_DELTA_MAGIC);
+  patch.push_back(LCI_DELTA_VERSION);
+  patch.insert(patch.end(), 3, 0);
+  put_le32(patch, installed.base);
+  put_le32(patch, static_cast<uint32_t>(old.size()));
+  put_le32(patch, crc32(old.data(), old.size()));
+  put_le32(patch, static_cast<uint32_t>(target.size()));
+  put_le32(patch, crc32(target.data(), target.size()));
+
+  SeedIndex index(old);
+  size_t old_cursor = 0;
+  size_t literal_start = 0;
+  size_t pos = 0;
+  while (pos < target.size()) {
+    size_t old_pos = 0;
+    size_t n = index.best_match(target, pos, old_cursor + (pos - literal_start), old_pos);
+    if (n < kSeedSize) {
+      ++pos;
+      continue;
+    }
+    /* Take back the literals that still match the alignment */
+    while (pos > literal_start && old_pos > 0 && old[old_pos - 1] == target[pos - 1]) {
+      --pos;
+      --old_pos;
+    }
+    emit_add(patch, target, literal_start, pos, s);
+    size_t len = std::max(n, extend(old, old_pos, target, pos));
+    emit_aligned(patch, old, old_pos, target, pos, len, old_cursor, s);
+    pos += len;
+    literal_start = pos;
+  }
+  emit_add(patch, target, literal_start, target.size(), s);
+  patch.push_back(LCI_DELTA_OP_END);
+  return patch;
+}
+
+}  // namespace lci::delta
@@ -0,0 +1,55 @@
+/**
+ * @file delta_codec.hpp
+ * @brief Host side generator of differential firmware updates
+ *
+ * The patch layout is defined by si7021_peripheral_server/src/lci_delta.h,
+ * the firmware applier lci_delta.c is built into the host tool as is.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_DELTA_CODEC_HPP_
+#define LCI_DELTA_CODEC_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lci::delta {
+
+constexpr uint32_t kGblTagHeader = 0x03A617EB;
+constexpr uint32_t kGblTagEnd = 0xFC0404FC;
+constexpr uint32_t kGblTagProgramLegacy = 0xFE0101FE;
+constexpr uint32_t kGblTagProgram = 0xFD0303FD;
+
+/* Flash contents starting at a flash address */
+struct Image {
+  uint32_t base = 0;
+  std::vector<uint8_t> data;
+};
+
+/* Operation mix of a patch */
+struct Stats {
+  size_t copies = 0;
+  size_t copied_bytes = 0;
+  size_t diffs = 0;
+  size_t diff_bytes = 0;
+  size_t diff_literals = 0;
+  size_t adds = 0;
+  size_t added_bytes = 0;
+};
+
+/* Flash image written by the program data tags of a GBL file, gaps are
+ * erased flash. Returns false if the file is not a GBL file. */
+bool gbl_image(const std::vector<uint8_t> &gbl, Image &image);
+
+/* Patch that rebuilds target, the new GBL file, from the installed image */
+std::vector<uint8_t> create(const Image &installed, const std::vector<uint8_t> &target, Stats *stats = nullptr);
+
+/* CRC-32 of the GBL format */
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc = 0);
+
+}  // namespace lci::delta
+
+#endif /* LCI_DELTA_CODEC_HPP_ */
@@ -0,0 +1,386 @@
+/**
+ * @file ecdsa_p256.cpp
+ * @brief ECDSA-P256 signature check of signed GBL files
+ *
+ * Field and scalar elements are four 64-bit limbs, least significant
+ * first, kept in Montgomery form. Points are in Jacobian coordinates and
+ * u1 * G + u2 * Q is computed in one pass of doublings (Shamir's trick).
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "ecdsa_p256.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace lci::crypto {
+
+namespace {
+
+using U256 = std::array<uint64_t, 4>;
+using U128 = unsigned __int128;
+
+constexpr U256 kP = {0xFFFFFFFFFFFFFFFFull, 0x00000000FFFFFFFFull, 0x0000000000000000ull, 0xFFFFFFFF00000001ull};
+constexpr U256 kN = {0xF3B9CAC2FC632551ull, 0xBCE6FAADA7179E84ull, 0xFFFFFFFFFFFFFFFFull, 0xFFFFFFFF00000000ull};
+constexpr U256 kB = {0x3BCE3C3E27D2604Bull, 0x651D06B0CC53B0F6ull, 0xB3EBBD55769886BCull, 0x5AC635D8AA3A93E7ull};
+constexpr U256 kGx = {0xF4A13945D898C296ull, 0x77037D812DEB33A0ull, 0xF8BCE6E563A440F2ull, 0x6B17D1F2E12C4247ull};
+constexpr U256 kGy = {0xCBB6406837BF51F5ull, 0x2BCE33576B315ECEull, 0x8EE7EB4A7C0F9E16ull, 0x4FE342E2FE1A7F9Bull};
+
+/* DER SubjectPublicKeyInfo of a P-256 key up to the uncompressed point */
+constexpr uint8_t kSpkiPrefix[] = {0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x02, 0x01,
+                                   0x06, 0x08, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x03, 0x01, 0x07, 0x03, 0x42, 0x00,
+                                   0x04};
+
+bool is_zero(const U256 &a)
+{
+  return (a[0] | a[1] | a[2] | a[3]) == 0;
+}
+
+/* a >= b */
+bool geq(const U256 &a, const U256 &b)
+{
+  for (int i = 3; i >= 0; --i) {
+    if (a[i] != b[i]) {
+      return a[i] > b[i];
+    }
+  }
+  return true;
+}
+
+/* a - b, returns the borrow */
+uint64_t sub_raw(U256 &r, const U256 &a, const U256 &b)
+{
+  uint64_t borrow = 0;
+  for (int i = 0; i < 4; ++i) {
+    U128 d = static_cast<U128>(a[i]) - b[i] - borrow;
+    r[i] = static_cast<uint64_t>(d);
+    borrow = static_cast<uint64_t>(d >> 64) & 1;
+  }
+  return borrow;
+}
+
+U256 from_be(const uint8_t *p)
+{
+  U256 r{};
+  for (int i = 0; i < 32; ++i) {
+    r[3 - i / 8] = (r[3 - i / 8] << 8) | p[i];
+  }
+  return r;
+}
+
+/* Arithmetic modulo an odd 256-bit modulus in Montgomery form, R = 2^256 */
+class Modulus {
+ public:
+  explicit Modulus(const U256 &m) : m_(m)
+  {
+    /* -m^-1 mod 2^64 by Newton iteration */
+    uint64_t inv = 1;
+    for (int i = 0; i < 6; ++i) {
+      inv *= 2 - m[0] * inv;
+    }
+    neg_inv_ = ~inv + 1;
+    /* R^2 mod m by doubling 1 512 times */
+    U256 r{1, 0, 0, 0};
+    for (int i = 0; i < 512; ++i) {
+      r = add(r, r);
+    }
+    r2_ = r;
+    one_ = to(U256{1, 0, 0, 0});
+  }
+
+  U256 add(const U256 &a, const U256 &b) const
+  {
+    U256 r;
+    uint64_t carry = 0;
+    for (int i = 0; i < 4; ++i) {
+      U128 s = static_cast<U128>(a[i]) + b[i] + carry;
+      r[i] = static_cast<uint64_t>(s);
+      carry = static_cast<uint64_t>(s >> 64);
+    }
+    if (carry || geq(r, m_)) {
+      sub_raw(r, r, m_);
+    }
+    return r;
+  }
+
+  U256 sub(const U256 &a, const U256 &b) const
+  {
+    U256 r;
+    if (sub_raw(r, a, b)) {
+      uint64_t carry = 0;
+      for (int i = 0; i < 4; ++i) {
+        U128 s = static_cast<U128>(r[i]) + m_[i] + carry;
+        r[i] = static_cast<uint64_t>(s);
+        carry = static_cast<uint64_t>(s >> 64);
+      }
+    }
+    return r;
+  }
+
+  /* a * b / R mod m */
+  U256 mul(const U256 &a, const U256 &b) const
+  {
+    uint64_t t[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 4; ++i) {
+      uint64_t carry = 0;
+      for (int j = 0; j < 4; ++j) {
+        U128 p = static_cast<U128>(a[j]) * b[i] + t[j] + carry;
+        t[j] = static_cast<uint64_t>(p);
+        carry = static_cast<uint64_t>(p >> 64);
+      }
+      U128 s = static_cast<U128>(t[4]) + carry;
+      t[4] = static_cast<uint64_t>(s);
+      t[5] = static_cast<uint64_t>(s >> 64);
+
+      uint64_t q = t[0] * neg_inv_;
+      U128 p = static_cast<U128>(q) * m_[0] + t[0];
+      carry = static_cast<uint64_t>(p >> 64);
+      for (int j = 1; j < 4; ++j) {
+        p = static_cast<U128>(q) * m_[j] + t[j] + carry;
+        t[j - 1] = static_cast<uint64_t>(p);
+        carry = static_cast<uint64_t>(p >> 64);
+      }
+      s = static_cast<U128>(t[4]) + carry;
+      t[3] = static_cast<uint64_t>(s);
+      t[4] = t[5] + static_cast<uint64_t>(s >> 64);
+    }
+    U256 r = {t[0], t[1], t[2], t[3]};
+    if (t[4] || geq(r, m_)) {
+      sub_raw(r, r, m_);
+    }
+    return r;
+  }
+
+  U256 to(const U256 &a) const { return mul(a, r2_); }
+  U256 from(const U256 &a) const { return mul(a, U256{1, 0, 0, 0}); }
+  const U256 &one() const { return one_; }
+
+  /* a^(m-2), the inverse for a prime modulus */
+  U256 inverse(const U256 &a) const
+  {
+    U256 e;
+    sub_raw(e, m_, U256{2, 0, 0, 0});
+    U256 r = one_;
+    for (int i = 255; i >= 0; --i) {
+      r = mul(r, r);
+      if ((e[i / 64] >> (i % 64)) & 1) {
+        r = mul(r, a);
+      }
+    }
+    return r;
+  }
+
+ private:
+  U256 m_;
+  U256 r2_;
+  U256 one_;
+  uint64_t neg_inv_;
+};
+
+const Modulus &field()
+{
+  static const Modulus p(kP);
+  return p;
+}
+
+const Modulus &order()
+{
+  static const Modulus n(kN);
+  return n;
+}
+
+/* Jacobian point, the point at infinity has Z = 0 */
+struct Point {
+  U256 x{};
+  U256 y{};
+  U256 z{};
+};
+
+/* dbl-2001-b, a = -3 */
+Point dbl(const Point &p)
+{
+  const Modulus &f = field();
+  if (is_zero(p.z)) {
+    return p;
+  }
+  U256 delta = f.mul(p.z, p.z);
+  U256 gamma = f.mul(p.y, p.y);
+  U256 beta = f.mul(p.x, gamma);
+  U256 t = f.mul(f.sub(p.x, delta), f.add(p.x, delta));
+  U256 alpha = f.add(f.add(t, t), t);
+  U256 beta4 = f.add(beta, beta);
+  beta4 = f.add(beta4, beta4);
+  Point r;
+  r.x = f.sub(f.mul(alpha, alpha), f.add(beta4, beta4));
+  U256 yz = f.add(p.y, p.z);
+  r.z = f.sub(f.sub(f.mul(yz, yz), gamma), delta);
+  U256 gamma8 = f.mul(gamma, gamma);
+  gamma8 = f.add(gamma8, gamma8);
+  gamma8 = f.add(gamma8, gamma8);
+  gamma8 = f.add(gamma8, gamma8);
+  r.y = f.sub(f.mul(alpha, f.sub(beta4, r.x)), gamma8);
+  return r;
+}
+
+Point add(const Point &p, const Point &q)
+{
+  const Modulus &f = field();
+  if (is_zero(p.z)) {
+    return q;
+  }
+  if (is_zero(q.z)) {
+    return p;
+  }
+  U256 z1z1 = f.mul(p.z, p.z);
+  U256 z2z2 = f.mul(q.z, q.z);
+  U256 u1 = f.mul(p.x, z2z2);
+  U256 u2 = f.mul(q.x, z1z1);
+  U256 s1 = f.mul(p.y, f.mul(q.z, z2z2));
+  U256 s2 = f.mul(q.y, f.mul(p.z, z1z1));
+  U256 h = f.sub(u2, u1);
+  U256 r = f.sub(s2, s1);
+  if (is_zero(h)) {
+    return is_zero(r) ? dbl(p) : Point{};
+  }
+  U256 h2 = f.mul(h, h);
+  U256 h3 = f.mul(h, h2);
+  U256 u1h2 = f.mul(u1, h2);
+  Point out;
+  out.x = f.sub(f.sub(f.mul(r, r), h3), f.add(u1h2, u1h2));
+  out.y = f.sub(f.mul(r, f.sub(u1h2, out.x)), f.mul(s1, h3));
+  out.z = f.mul(f.mul(p.z, q.z), h);
+  return out;
+}
+
+/* Affine point of the key in Montgomery form, false if not on the curve */
+bool load_point(const P256PublicKey &key, Point &point)
+{
+  const Modulus &f = field();
+  U256 x = from_be(key.data());
+  U256 y = from_be(key.data() + 32);
+  if (geq(x, kP) || geq(y, kP)) {
+    return false;
+  }
+  point.x = f.to(x);
+  point.y = f.to(y);
+  point.z = f.one();
+  /* y^2 = x^3 - 3x + b */
+  U256 rhs = f.mul(f.mul(point.x, point.x), point.x);
+  U256 x3 = f.add(f.add(point.x, point.x), point.x);
+  rhs = f.add(f.sub(rhs, x3), f.to(kB));
+  return f.mul(point.y, point.y) == rhs;
+}
+
+int base64_value(char c)
+{
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  }
+  if (c == '+') {
+    return 62;
+  }
+  if (c == '/') {
+    return 63;
+  }
+  return -1;
+}
+
+}  // namespace
+
+bool parse_public_key_pem(const std::string &pem, P256PublicKey &key)
+{
+  static const std::string kBegin = "-----BEGIN PUBLIC KEY-----";
+  static const std::string kEnd = "-----END PUBLIC KEY-----";
+  size_t begin = pem.find(kBegin);
+  size_t end = pem.find(kEnd);
+  if (begin == std::string::npos || end == std::string::npos || end < begin) {
+    return false;
+  }
+  std::vector<uint8_t> der;
+  uint32_t bits = 0;
+  int count = 0;
+  for (size_t i = begin + kBegin.size(); i < end; ++i) {
+    int v = base64_value(pem[i]);
+    if (v < 0) {
+      continue;
+    }
+    bits = (bits << 6) | static_cast<uint32_t>(v);
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      der.push_back(static_cast<uint8_t>(bits >> count));
+    }
+  }
+  if (der.size() != sizeof(kSpkiPrefix) + key.size()
+      || std::memcmp(der.data(), kSpkiPrefix, sizeof(kSpkiPrefix)) != 0) {
+    return false;
+  }
+  std::memcpy(key.data(), der.data() + sizeof(kSpkiPrefix), key.size());
+  return p256_public_key_valid(key);
+}
+
+bool p256_public_key_valid(const P256PublicKey &key)
+{
+  Point q;
+  return load_point(key, q);
+}
+
+bool ecdsa_p256_verify(const P256PublicKey &key, const Sha256Digest &digest, const P256Signature &signature)
+{
+  const Modulus &f = field();
+  const Modulus &n = order();
+  Point q;
+  if (!load_point(key, q)) {
+    return false;
+  }
+  U256 r = from_be(signature.data());
+  U256 s = from_be(signature.data() + 32);
+  if (is_zero(r) || is_zero(s) || geq(r, kN) || geq(s, kN)) {
+    return false;
+  }
+  U256 e = from_be(digest.data());
+  if (geq(e, kN)) {
+    sub_raw(e, e, kN);
+  }
+
+  /* u1 = e / s, u2 = r / s mod n, plain form for the bit scan */
+  U256 w = n.inverse(n.to(s));
+  U256 u1 = n.from(n.mul(n.to(e), w));
+  U256 u2 = n.from(n.mul(n.to(r), w));
+
+  Point g{f.to(kGx), f.to(kGy), f.one()};
+  Point gq = add(g, q);
+  Point acc;
+  for (int i = 255; i >= 0; --i) {
+    acc = dbl(acc);
+    bool b1 = (u1[i / 64] >> (i % 64)) & 1;
+    bool b2 = (u2[i / 64] >> (i % 64)) & 1;
+    if (b1 && b2) {
+      acc = add(acc, gq);
+    } else if (b1) {
+      acc = add(acc, g);
+    } else if (b2) {
+      acc = add(acc, q);
+    }
+  }
+  if (is_zero(acc.z)) {
+    return false;
+  }
+  /* Affine x = X / Z^2, reduced mod n */
+  U256 zinv = f.inverse(acc.z);
+  U256 x = f.from(f.mul(acc.x, f.mul(zinv, zinv)));
+  if (geq(x, kN)) {
+    sub_raw(x, x, kN);
+  }
+  return x == r;
+}
+
+}  // namespace lci::crypto
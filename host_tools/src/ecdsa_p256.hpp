@@ -0,0 +1,41 @@
+/**
+ * @file ecdsa_p256.hpp
+ * @brief ECDSA-P256 signature check of signed GBL files
+ *
+ * Only verification is done here, on public data, so the arithmetic is
+ * plain Montgomery multiplication without constant time measures.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_ECDSA_P256_HPP_
+#define LCI_ECDSA_P256_HPP_
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "sha256.hpp"
+
+namespace lci::crypto {
+
+/* Uncompressed point without the 0x04 prefix: X then Y, big-endian */
+using P256PublicKey = std::array<uint8_t, 64>;
+/* r then s, big-endian, as in the GBL signature tag */
+using P256Signature = std::array<uint8_t, 64>;
+
+/* Public key from a PEM SubjectPublicKeyInfo ("BEGIN PUBLIC KEY"), as
+ * written by commander or openssl. Returns false if it is not a P-256 key
+ * or the point is not on the curve. */
+bool parse_public_key_pem(const std::string &pem, P256PublicKey &key);
+
+/* True if the point is on the curve */
+bool p256_public_key_valid(const P256PublicKey &key);
+
+/* True if signature is a valid signature of the SHA-256 digest by key */
+bool ecdsa_p256_verify(const P256PublicKey &key, const Sha256Digest &digest, const P256Signature &signature);
+
+}  // namespace lci::crypto
+
+#endif /* LCI_ECDSA_P256_HPP_ */
@@ -0,0 +1,166 @@
+/**
+ * @file fixed_point_bench.cpp
+ * @brief Equivalence check and benchmark of the firmware fixed point layer
+ *
+ *   lci_fixed_point_bench [--iterations N]
+ *
+ * Runs lci_fixed_point.c of the firmware samples on the host against the
+ * floating point code it replaces, exhaustively over the value ranges of
+ * the firmware:
+ *
+ *   - every 0.01 unit GATT value (int16 temperature, uint16 humidity)
+ *     formatted by the central, against printf("%.2f", (float)v / 100.0f)
+ *   - every 0.001 unit SI7021 driver value from -50 to 150 formatted by the
+ *     peripheral, against printf("%.2f", (float)v / 1000.0f) and against the
+ *     exact decimal value rounded half away from zero
+ *
+ * The float path can only differ on exact ties, where the binary error of
+ * the float decides the rounding, and print "-0.00" for small negative
+ * values. Any other difference fails the check. The time per conversion of
+ * both paths is printed at the end.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "lci_fixed_point.h"
+
+namespace {
+
+struct Result {
+  uint64_t values = 0;
+  uint64_t equal = 0;
+  uint64_t ties = 0;
+  uint64_t negative_zero = 0;
+  uint64_t failures = 0;
+};
+
+/* Exact reference, the decimal value of milli rounded half away from zero */
+std::string exact_centi(int32_t milli)
+{
+  int64_t magnitude = milli < 0 ? -static_cast<int64_t>(milli) : milli;
+  int64_t centi = (magnitude * 2 + 10) / 20;
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%s%lld.%02lld", (milli < 0 && centi != 0) ? "-" : "",
+                static_cast<long long>(centi / 100), static_cast<long long>(centi % 100));
+  return buf;
+}
+
+void report(const char *name, const Result &r)
+{
+  std::printf("%-34s %9llu values, %9llu equal, %6llu ties, %4llu -0.00, %llu failures\n", name,
+              static_cast<unsigned long long>(r.values), static_cast<unsigned long long>(r.equal),
+              static_cast<unsigned long long>(r.ties),
+              static_cast<unsigned long long>(r.negative_zero),
+              static_cast<unsigned long long>(r.failures));
+}
+
+Result check_centi(int32_t first, int32_t last)
+{
+  Result r;
+  char fixed[LCI_FP_STR_SIZE];
+  char fp[32];
+  for (int32_t v = first; v <= last; v++) {
+    lci_fp_format(fixed, v, LCI_FP_CENTI);
+    std::snprintf(fp, sizeof(fp), "%3.2f", static_cast<float>(v) / 100.0f);
+    r.values++;
+    if (std::strcmp(fixed, fp) == 0) {
+      r.equal++;
+    } else {
+      r.failures++;
+      if (r.failures <= 5) {
+        std::printf("  centi %d: fixed \"%s\" float \"%s\"\n", v, fixed, fp);
+      }
+    }
+  }
+  return r;
+}
+
+Result check_milli(int32_t first, int32_t last)
+{
+  Result r;
+  char fixed[LCI_FP_STR_SIZE];
+  char fp[32];
+  for (int32_t v = first; v <= last; v++) {
+    lci_fp_format(fixed, lci_fp_milli_to_centi(v), LCI_FP_CENTI);
+    std::snprintf(fp, sizeof(fp), "%3.2f", static_cast<float>(v) / 1000.0f);
+    r.values++;
+    if (exact_centi(v) != fixed) {
+      r.failures++;
+      if (r.failures <= 5) {
+        std::printf("  milli %d: fixed \"%s\" exact \"%s\"\n", v, fixed, exact_centi(v).c_str());
+      }
+    } else if (std::strcmp(fixed, fp) == 0) {
+      r.equal++;
+    } else if (std::strcmp(fp, "-0.00") == 0 && std::strcmp(fixed, "0.00") == 0) {
+      r.negative_zero++;
+    } else if (std::abs(v) % 10 == 5) {
+      r.ties++;
+    } else {
+      r.failures++;
+      if (r.failures <= 5) {
+        std::printf("  milli %d: fixed \"%s\" float \"%s\"\n", v, fixed, fp);
+      }
+    }
+  }
+  return r;
+}
+
+template <typename Fn>
+double ns_per_value(uint32_t iterations, Fn &&fn)
+{
+  volatile size_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++) {
+    sink = sink + fn(static_cast<int32_t>(i % 165000) - 40000);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  uint32_t iterations = 5000000;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    } else {
+      std::fprintf(stderr, "usage: lci_fixed_point_bench [--iterations N]\n");
+      return 2;
+    }
+  }
+  if (iterations == 0) {
+    iterations = 1;
+  }
+
+  Result temp = check_centi(INT16_MIN, INT16_MAX);
+  Result hum = check_centi(0, UINT16_MAX);
+  Result milli = check_milli(-50000, 150000);
+  report("central temperature (int16 0.01)", temp);
+  report("central humidity (uint16 0.01)", hum);
+  report("peripheral driver (0.001)", milli);
+
+  double fixed_ns = ns_per_value(iterations, [](int32_t v) {
+    char buf[LCI_FP_STR_SIZE];
+    return static_cast<size_t>(lci_fp_format(buf, lci_fp_milli_to_centi(v), LCI_FP_CENTI));
+  });
+  double float_ns = ns_per_value(iterations, [](int32_t v) {
+    char buf[32];
+    return static_cast<size_t>(std::snprintf(buf, sizeof(buf), "%3.2f", static_cast<float>(v) / 1000.0f));
+  });
+  std::printf("fixed point %.1f ns/value, float printf %.1f ns/value (%.1fx)\n", fixed_ns, float_ns,
+              fixed_ns > 0 ? float_ns / fixed_ns : 0.0);
+
+  bool ok = temp.failures == 0 && hum.failures == 0 && milli.failures == 0;
+  std::printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
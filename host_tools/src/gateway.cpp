@@ -0,0 +1,591 @@
+/**
+ * @file gateway.cpp
+ * @brief Multi-port gateway for the SI7021 central client output
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "gateway.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "serial_port.hpp"
+
+namespace lci::gateway {
+
+namespace {
+
+constexpr size_t kReadBufferSize = 8192;
+constexpr size_t kLineMax = 160;
+constexpr int kMaxEvents = 16;
+
+constexpr std::string_view kTemperature = "Temperature [degree celsius] - ";
+constexpr std::string_view kHumidity = "Humidity [relative humidity as a percentage] - ";
+
+uint64_t now_ms()
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+bool consume(std::string_view &s, std::string_view prefix)
+{
+  if (s.substr(0, prefix.size()) != prefix) {
+    return false;
+  }
+  s.remove_prefix(prefix.size());
+  return true;
+}
+
+/* "[XXXX] " hexadecimal tag */
+bool parse_tag(std::string_view &s, uint16_t &value)
+{
+  if (s.size() < 7 || s[0] != '[' || s[5] != ']' || s[6] != ' ') {
+    return false;
+  }
+  uint16_t v = 0;
+  for (size_t i = 1; i < 5; i++) {
+    char c = s[i];
+    int digit = (c >= '0' && c <= '9') ? c - '0'
+                : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+                : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+    if (digit < 0) {
+      return false;
+    }
+    v = static_cast<uint16_t>((v << 4) | digit);
+  }
+  value = v;
+  s.remove_prefix(7);
+  return true;
+}
+
+/* Decimal with up to two fraction digits, in 0.01 units */
+bool parse_centi(std::string_view &s, int32_t &value)
+{
+  size_t i = 0;
+  while (i < s.size() && s[i] == ' ') {
+    i++;
+  }
+  bool negative = i < s.size() && s[i] == '-';
+  if (negative) {
+    i++;
+  }
+  int32_t integer = 0;
+  size_t digits = 0;
+  while (i < s.size() && s[i] >= '0' && s[i] <= '9' && digits < 6) {
+    integer = integer * 10 + (s[i++] - '0');
+    digits++;
+  }
+  if (digits == 0) {
+    return false;
+  }
+  int32_t fraction = 0;
+  if (i < s.size() && s[i] == '.') {
+    i++;
+    for (int scale = 10; scale > 0 && i < s.size() && s[i] >= '0' && s[i] <= '9'; scale /= 10) {
+      fraction += (s[i++] - '0') * scale;
+    }
+  }
+  value = integer * 100 + fraction;
+  if (negative) {
+    value = -value;
+  }
+  s.remove_prefix(i);
+  return true;
+}
+
+/* Sampling instant of a synchronized server, " at <ms> ms" after the value,
+ * or time a relay heard a server out of range, " relayed at <ms> ms".
+ * Returns the flag of the timestamp, 0 if the line has none. */
+uint8_t parse_stamp(std::string_view s, uint32_t &ms)
+{
+  constexpr std::string_view kRelayed = " relayed";
+  size_t at = s.find(" at ");
+  if (at == std::string_view::npos) {
+    return 0;
+  }
+  uint8_t flag = telemetry::kFlagSynced;
+  if (at >= kRelayed.size() && s.substr(at - kRelayed.size(), kRelayed.size()) == kRelayed) {
+    flag = telemetry::kFlagRelayed;
+  }
+  s.remove_prefix(at + 4);
+  uint64_t v = 0;
+  size_t digits = 0;
+  while (digits < s.size() && s[digits] >= '0' && s[digits] <= '9' && digits < 10) {
+    v = v * 10 + static_cast<uint64_t>(s[digits] - '0');
+    digits++;
+  }
+  if (digits == 0 || v > UINT32_MAX || s.substr(digits) != " ms") {
+    return 0;
+  }
+  ms = static_cast<uint32_t>(v);
+  return flag;
+}
+
+int format_centi(char *buf, size_t size, int32_t value)
+{
+  uint32_t magnitude = static_cast<uint32_t>(value < 0 ? -value : value);
+  return std::snprintf(buf, size, "%s%u.%02u", value < 0 ? "-" : "", magnitude / 100, magnitude % 100);
+}
+
+}  // namespace
+
+bool parse_log_line(std::string_view line, Reading &reading)
+{
+  while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+    line.remove_suffix(1);
+  }
+  /* Log level prefix of the Log component */
+  if (line.size() >= 4 && line[0] == '[' && line[2] == ']' && line[3] == ' ') {
+    line.remove_prefix(4);
+  }
+  uint16_t sensor_id = 0;
+  bool has_sensor_id = parse_tag(line, sensor_id);
+  int32_t value = 0;
+  if (consume(line, kTemperature)) {
+    if (!parse_centi(line, value) || value < INT16_MIN || value > INT16_MAX) {
+      return false;
+    }
+    reading.flags = telemetry::kFlagTemperature;
+    reading.temperature = static_cast<int16_t>(value);
+  } else if (consume(line, kHumidity)) {
+    if (!parse_centi(line, value) || value < 0 || value > UINT16_MAX) {
+      return false;
+    }
+    reading.flags = telemetry::kFlagHumidity;
+    reading.humidity = static_cast<uint16_t>(value);
+  } else {
+    return false;
+  }
+  reading.has_sensor_id = has_sensor_id;
+  reading.sensor_id = sensor_id;
+  reading.device_time_ms = 0;
+  reading.flags |= parse_stamp(line, reading.device_time_ms);
+  return true;
+}
+
+size_t format_json(const Reading &reading, const std::string &port_name, char *buf, size_t size)
+{
+  char sensor[8] = "null";
+  char temperature[16] = "null";
+  char humidity[16] = "null";
+  if (reading.has_sensor_id) {
+    std::snprintf(sensor, sizeof(sensor), "\"%04X\"", reading.sensor_id);
+  }
+  if (reading.flags & telemetry::kFlagTemperature) {
+    format_centi(temperature, sizeof(temperature), reading.temperature);
+  }
+  if (reading.flags & telemetry::kFlagHumidity) {
+    format_centi(humidity, sizeof(humidity), reading.humidity);
+  }
+  int n = std::snprintf(buf, size,
+                        "{\"port\":\"%s\",\"sensor\":%s,\"time_ms\":%llu,\"device_ms\":%u,"
+                        "\"temperature\":%s,\"humidity\":%s,\"synced\":%s,\"relayed\":%s}\n",
+                        port_name.c_str(), sensor,
+                        static_cast<unsigned long long>(reading.gateway_time_ms),
+                        reading.device_time_ms, temperature, humidity,
+                        (reading.flags & telemetry::kFlagSynced) ? "true" : "false",
+                        (reading.flags & telemetry::kFlagRelayed) ? "true" : "false");
+  return n < 0 ? 0 : std::min(static_cast<size_t>(n), size - 1);
+}
+
+FileSink::FileSink(const std::string &path)
+{
+  if (path == "-") {
+    file_ = stdout;
+  } else {
+    file_ = std::fopen(path.c_str(), "a");
+    owned_ = true;
+  }
+}
+
+FileSink::~FileSink()
+{
+  if (file_ != nullptr && owned_) {
+    std::fclose(file_);
+  }
+}
+
+void FileSink::publish(const Reading &reading, const std::string &port_name)
+{
+  char line[256];
+  size_t len = format_json(reading, port_name, line, sizeof(line));
+  std::fwrite(line, 1, len, file_);
+}
+
+void FileSink::flush()
+{
+  std::fflush(file_);
+}
+
+UnixSocketSink::UnixSocketSink(const std::string &path) : path_(path)
+{
+  fd_ = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+}
+
+UnixSocketSink::~UnixSocketSink()
+{
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+void UnixSocketSink::publish(const Reading &reading, const std::string &port_name)
+{
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+  char line[256];
+  size_t len = format_json(reading, port_name, line, sizeof(line));
+  if (::sendto(fd_, line, len, 0, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+    dropped_++;
+  }
+}
+
+/* Serial port of one central client */
+struct Gateway::Port {
+  int fd = -1;
+  uint32_t index = 0;
+  std::string name;
+  /* Time the port was closed, for the next attempt to open it again */
+  uint64_t closed_ms = 0;
+  /* Read buffer, parsed in place */
+  std::array<char, kReadBufferSize> buffer{};
+  /* Head of a log line split across two reads */
+  std::array<char, kLineMax> line{};
+  size_t line_len = 0;
+  bool line_overflow = false;
+  telemetry::StreamDecoder decoder;
+};
+
+/* Reader thread with its own epoll set */
+struct Gateway::Reader {
+  int epoll_fd = -1;
+  int stop_fd = -1;
+  std::vector<Port *> ports;
+  std::thread thread;
+};
+
+Gateway::Gateway(Options options, Sink &sink) : options_(std::move(options)), sink_(sink)
+{
+}
+
+Gateway::~Gateway()
+{
+  stop();
+}
+
+bool Gateway::start(std::string &error)
+{
+  for (size_t i = 0; i < options_.ports.size(); i++) {
+    auto port = std::make_unique<Port>();
+    port->index = static_cast<uint32_t>(i);
+    port->name = options_.ports[i];
+    port->fd = open_serial(port->name, true);
+    if (port->fd < 0) {
+      error = port->name + ": " + std::strerror(errno);
+      ports_.clear();
+      return false;
+    }
+    ports_.push_back(std::move(port));
+  }
+  unsigned threads = options_.threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(ports_.size())));
+
+  running_ = true;
+  for (unsigned t = 0; t < threads; t++) {
+    auto reader = std::make_unique<Reader>();
+    reader->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    reader->stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    ::epoll_ctl(reader->epoll_fd, EPOLL_CTL_ADD, reader->stop_fd, &ev);
+    readers_.push_back(std::move(reader));
+  }
+  /* Spread the ports round robin over the readers */
+  for (size_t i = 0; i < ports_.size(); i++) {
+    Reader &reader = *readers_[i % readers_.size()];
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = ports_[i].get();
+    ::epoll_ctl(reader.epoll_fd, EPOLL_CTL_ADD, ports_[i]->fd, &ev);
+    reader.ports.push_back(ports_[i].get());
+  }
+  publisher_ = std::thread(&Gateway::publisher_loop, this);
+  for (auto &reader : readers_) {
+    reader->thread = std::thread(&Gateway::reader_loop, this, std::ref(*reader));
+  }
+  return true;
+}
+
+void Gateway::stop()
+{
+  if (!running_.exchange(false)) {
+    return;
+  }
+  for (auto &reader : readers_) {
+    uint64_t one = 1;
+    (void)::write(reader->stop_fd, &one, sizeof(one));
+  }
+  for (auto &reader : readers_) {
+    reader->thread.join();
+    ::close(reader->epoll_fd);
+    ::close(reader->stop_fd);
+  }
+  cv_.notify_all();
+  publisher_.join();
+  for (auto &port : ports_) {
+    if (port->fd >= 0) {
+      ::close(port->fd);
+      port->fd = -1;
+    }
+  }
+  readers_.clear();
+}
+
+void Gateway::reader_loop(Reader &reader)
+{
+  struct epoll_event events[kMaxEvents];
+  std::vector<Reading> batch;
+
+  while (running_) {
+    int n = ::epoll_wait(reader.epoll_fd, events, kMaxEvents, reopen_ports(reader));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      Port *port = static_cast<Port *>(events[i].data.ptr);
+      if (port == nullptr) {
+        return;
+      }
+      read_port(*port, batch);
+      if (port->fd < 0) {
+        port->closed_ms = now_ms();
+        stats_.closed_ports++;
+      }
+    }
+    if (!batch.empty()) {
+      submit(batch);
+    }
+  }
+}
+
+/* Open the closed ports of a reader again once their period elapsed, a
+ * replugged central shows up under the same path. Returns the epoll timeout
+ * until the next attempt, -1 while all the ports are open. */
+int Gateway::reopen_ports(Reader &reader)
+{
+  uint64_t now = now_ms();
+  int timeout = -1;
+
+  if (options_.reopen_ms == 0) {
+    return -1;
+  }
+  for (Port *port : reader.ports) {
+    if (port->fd >= 0) {
+      continue;
+    }
+    uint64_t due = port->closed_ms + options_.reopen_ms;
+    if (now >= due) {
+      port->fd = open_serial(port->name, true);
+      if (port->fd >= 0) {
+        /* The central starts over, nothing of the old stream is kept */
+        port->line_len = 0;
+        port->line_overflow = false;
+        port->decoder = telemetry::StreamDecoder();
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = port;
+        ::epoll_ctl(reader.epoll_fd, EPOLL_CTL_ADD, port->fd, &ev);
+        stats_.reopened_ports++;
+        continue;
+      }
+      port->closed_ms = now;
+      due = now + options_.reopen_ms;
+    }
+    int wait = static_cast<int>(due - now);
+    if (timeout < 0 || wait < timeout) {
+      timeout = wait;
+    }
+  }
+  return timeout;
+}
+
+void Gateway::read_port(Port &port, std::vector<Reading> &out)
+{
+  uint64_t received = now_ms();
+  size_t first = out.size();
+
+  while (true) {
+    ssize_t n = ::read(port.fd, port.buffer.data(), port.buffer.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN) {
+      break;
+    }
+    if (n <= 0) {
+      /* Device unplugged or pty closed */
+      ::close(port.fd);
+      port.fd = -1;
+      break;
+    }
+    stats_.bytes += static_cast<uint64_t>(n);
+    const char *data = port.buffer.data();
+    size_t len = static_cast<size_t>(n);
+
+    /* Binary frames, decoded in the decoder buffer */
+    port.decoder.feed(reinterpret_cast<const uint8_t *>(data), len,
+                      [&](const telemetry::FrameView &frame) {
+      for (size_t i = 0; i < frame.count; i++) {
+        telemetry::Sample s = frame.sample(i);
+        Reading r;
+        r.port = port.index;
+        r.has_sensor_id = true;
+        r.sensor_id = s.sensor_id;
+        r.flags = s.flags;
+        r.temperature = s.temperature;
+        r.humidity = s.humidity;
+        r.device_time_ms = s.timestamp_ms;
+        out.push_back(r);
+      }
+      stats_.frames++;
+      /* Best effort, a stalled port must not block the reader thread */
+      std::vector<uint8_t> ack = telemetry::encode_ack(frame.seq, options_.credits);
+      (void)!::write(port.fd, ack.data(), ack.size());
+    });
+
+    /* Log lines, parsed in the read buffer. Only the head of a line split
+     * across two reads is copied. */
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+      char c = data[i];
+      if (c != '\n' && c != '\0') {
+        continue;
+      }
+      Reading r;
+      bool parsed = false;
+      if (port.line_len != 0 || port.line_overflow) {
+        size_t tail = i - start;
+        if (!port.line_overflow && port.line_len + tail <= port.line.size()) {
+          std::memcpy(&port.line[port.line_len], data + start, tail);
+          parsed = c == '\n'
+                   && parse_log_line(std::string_view(port.line.data(), port.line_len + tail), r);
+        }
+        port.line_len = 0;
+        port.line_overflow = false;
+      } else {
+        parsed = c == '\n' && parse_log_line(std::string_view(data + start, i - start), r);
+      }
+      if (parsed) {
+        r.port = port.index;
+        out.push_back(r);
+      }
+      start = i + 1;
+    }
+    size_t tail = len - start;
+    if (port.line_len + tail <= port.line.size()) {
+      std::memcpy(&port.line[port.line_len], data + start, tail);
+      port.line_len += tail;
+    } else {
+      port.line_overflow = true;
+    }
+  }
+  for (size_t i = first; i < out.size(); i++) {
+    out[i].gateway_time_ms = received;
+  }
+}
+
+void Gateway::submit(std::vector<Reading> &batch)
+{
+  stats_.readings += batch.size();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty()) {
+      pending_.swap(batch);
+    } else {
+      pending_.insert(pending_.end(), batch.begin(), batch.end());
+    }
+  }
+  batch.clear();
+  cv_.notify_one();
+}
+
+void Gateway::publisher_loop()
+{
+  struct Last {
+    uint32_t port;
+    uint8_t flags;
+    int16_t temperature;
+    uint16_t humidity;
+    uint64_t time_ms;
+  };
+  std::unordered_map<uint16_t, Last> last;
+  std::vector<Reading> batch;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [&] { return !pending_.empty() || !running_; });
+      if (pending_.empty() && !running_) {
+        break;
+      }
+      batch.swap(pending_);
+    }
+    for (const Reading &r : batch) {
+      if (r.has_sensor_id) {
+        auto it = last.find(r.sensor_id);
+        if (it != last.end()) {
+          const Last &l = it->second;
+          bool same_values = ((r.flags & telemetry::kFlagTemperature) == 0
+                              || ((l.flags & telemetry::kFlagTemperature) && l.temperature == r.temperature))
+                             && ((r.flags & telemetry::kFlagHumidity) == 0
+                                 || ((l.flags & telemetry::kFlagHumidity) && l.humidity == r.humidity));
+          /* Another central reporting the same value of the sensor */
+          if (l.port != r.port && same_values && r.gateway_time_ms - l.time_ms < options_.dedupe_window_ms) {
+            stats_.duplicates++;
+            continue;
+          }
+        }
+        Last &l = last[r.sensor_id];
+        if (l.port != r.port || l.time_ms == 0) {
+          l.flags = 0;
+        }
+        l.port = r.port;
+        l.flags |= r.flags;
+        if (r.flags & telemetry::kFlagTemperature) {
+          l.temperature = r.temperature;
+        }
+        if (r.flags & telemetry::kFlagHumidity) {
+          l.humidity = r.humidity;
+        }
+        l.time_ms = r.gateway_time_ms;
+      }
+      sink_.publish(r, options_.ports[r.port]);
+      stats_.published++;
+    }
+    sink_.flush();
+    batch.clear();
+  }
+}
+
+}  // namespace lci::gateway
@@ -0,0 +1,148 @@
+/**
+ * @file gateway.hpp
+ * @brief Multi-port gateway for the SI7021 central client output
+ *
+ * Reader threads multiplex the serial ports of several central clients
+ * with epoll and parse their output in place: the log lines of the default
+ * build as well as the binary telemetry frames (lci_telemetry.h). A single
+ * publisher thread drops duplicate readings of a sensor heard by more than
+ * one central and hands the rest to a sink.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_GATEWAY_HPP_
+#define LCI_GATEWAY_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "telemetry_codec.hpp"
+
+namespace lci::gateway {
+
+/* One reading of a sensor, temperature and humidity in 0.01 units */
+struct Reading {
+  uint32_t port = 0;
+  bool has_sensor_id = false;
+  uint16_t sensor_id = 0;
+  uint8_t flags = 0;
+  int16_t temperature = 0;
+  uint16_t humidity = 0;
+  /* Central clock for binary frames, 0 for log lines */
+  uint32_t device_time_ms = 0;
+  /* Gateway receive time */
+  uint64_t gateway_time_ms = 0;
+};
+
+/* Parse one log line of the central client, without the line terminator.
+ * Accepts an optional "[I] " log level and "[XXXX] " sensor tag. */
+bool parse_log_line(std::string_view line, Reading &reading);
+
+/* Destination of the published readings, called by the publisher thread */
+class Sink {
+ public:
+  virtual ~Sink() = default;
+  virtual void publish(const Reading &reading, const std::string &port_name) = 0;
+  virtual void flush() {}
+};
+
+/* JSON lines appended to a file, "-" is stdout */
+class FileSink : public Sink {
+ public:
+  explicit FileSink(const std::string &path);
+  ~FileSink() override;
+  bool ok() const { return file_ != nullptr; }
+  void publish(const Reading &reading, const std::string &port_name) override;
+  void flush() override;
+
+ private:
+  std::FILE *file_ = nullptr;
+  bool owned_ = false;
+};
+
+/* JSON lines sent as datagrams to a local (AF_UNIX) socket, a missing or
+ * slow receiver drops the datagrams instead of stalling the gateway */
+class UnixSocketSink : public Sink {
+ public:
+  explicit UnixSocketSink(const std::string &path);
+  ~UnixSocketSink() override;
+  bool ok() const { return fd_ >= 0; }
+  void publish(const Reading &reading, const std::string &port_name) override;
+  uint64_t dropped() const { return dropped_; }
+
+ private:
+  int fd_ = -1;
+  std::string path_;
+  uint64_t dropped_ = 0;
+};
+
+/* Format a reading as a JSON line, returns the length written to buf */
+size_t format_json(const Reading &reading, const std::string &port_name, char *buf, size_t size);
+
+struct Options {
+  std::vector<std::string> ports;
+  /* Reader threads, 0 selects one per port up to the hardware concurrency */
+  unsigned threads = 0;
+  /* Same sensor and value from another central within this window is a duplicate */
+  uint32_t dedupe_window_ms = 2000;
+  /* Credits granted in the acknowledgements of binary frames */
+  uint8_t credits = 4;
+  /* A closed port (central unplugged) is opened again at this period, 0 to
+   * leave it closed */
+  uint32_t reopen_ms = 1000;
+};
+
+struct Stats {
+  std::atomic<uint64_t> bytes{ 0 };
+  std::atomic<uint64_t> readings{ 0 };
+  std::atomic<uint64_t> published{ 0 };
+  std::atomic<uint64_t> duplicates{ 0 };
+  std::atomic<uint64_t> frames{ 0 };
+  std::atomic<uint64_t> closed_ports{ 0 };
+  std::atomic<uint64_t> reopened_ports{ 0 };
+};
+
+class Gateway {
+ public:
+  Gateway(Options options, Sink &sink);
+  ~Gateway();
+
+  /* Open the ports and start the threads, false if a port cannot be opened */
+  bool start(std::string &error);
+  void stop();
+  const Stats &stats() const { return stats_; }
+
+ private:
+  struct Port;
+  struct Reader;
+
+  void reader_loop(Reader &reader);
+  void publisher_loop();
+  void read_port(Port &port, std::vector<Reading> &out);
+  int reopen_ports(Reader &reader);
+  void submit(std::vector<Reading> &batch);
+
+  Options options_;
+  Sink &sink_;
+  Stats stats_;
+  std::vector<std::unique_ptr<Port>> ports_;
+  std::vector<std::unique_ptr<Reader>> readers_;
+  std::thread publisher_;
+  std::atomic<bool> running_{ false };
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<Reading> pending_;
+};
+
+}  // namespace lci::gateway
+
+#endif  // LCI_GATEWAY_HPP_
@@ -0,0 +1,210 @@
+/**
+ * @file gateway_bench.cpp
+ * @brief Throughput benchmark of the gateway over pseudo terminals
+ *
+ *   lci_gateway_bench [--ports N] [--threads N] [--mode text|binary]
+ *                     [--capture FILE] [--repeat N] [--shared-sensors]
+ *
+ * Every port is a pseudo terminal pair. One writer thread per port replays
+ * the capture (a raw dump of a central client serial port, or synthetic
+ * traffic of the selected mode) as fast as the pty accepts it, while the
+ * gateway parses and publishes to a counting sink.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "gateway.hpp"
+#include "serial_port.hpp"
+
+using namespace lci;
+using namespace lci::gateway;
+
+namespace {
+
+class CountingSink : public Sink {
+ public:
+  void publish(const Reading &reading, const std::string &port_name) override
+  {
+    char line[256];
+    bytes_ += format_json(reading, port_name, line, sizeof(line));
+    count_++;
+  }
+  uint64_t count() const { return count_; }
+
+ private:
+  uint64_t count_ = 0;
+  uint64_t bytes_ = 0;
+};
+
+/* Synthetic output of one central client with 8 sensors */
+std::vector<uint8_t> synthesize(bool binary, unsigned port, bool shared_sensors)
+{
+  std::vector<uint8_t> out;
+  uint16_t base = shared_sensors ? 0x1000 : static_cast<uint16_t>(0x1000 + port * 0x10);
+  const unsigned rounds = 512;
+  if (binary) {
+    telemetry::Sample batch[telemetry::kBatchMax];
+    for (unsigned r = 0; r < rounds; r++) {
+      for (unsigned s = 0; s < telemetry::kBatchMax; s++) {
+        batch[s].sensor_id = static_cast<uint16_t>(base + s);
+        batch[s].timestamp_ms = r * 1000;
+        batch[s].temperature = static_cast<int16_t>(2000 + r);
+        batch[s].humidity = static_cast<uint16_t>(4000 + s);
+        batch[s].flags = telemetry::kFlagTemperature | telemetry::kFlagHumidity;
+      }
+      std::vector<uint8_t> frame = telemetry::encode_samples(static_cast<uint8_t>(r), batch,
+                                                             telemetry::kBatchMax);
+      out.insert(out.end(), frame.begin(), frame.end());
+    }
+    return out;
+  }
+  char line[128];
+  for (unsigned r = 0; r < rounds; r++) {
+    for (unsigned s = 0; s < 8; s++) {
+      int n = std::snprintf(line, sizeof(line),
+                            "[I] [%04X] Humidity [relative humidity as a percentage] - %u.%02u %%RH\r\n"
+                            "[I] [%04X] Temperature [degree celsius] - %u.%02u \xF8" "C\r\n",
+                            base + s, 40 + s, r % 100, base + s, 20 + r % 10, s);
+      out.insert(out.end(), line, line + n);
+    }
+  }
+  return out;
+}
+
+void replay(int fd, const std::vector<uint8_t> &data, unsigned repeat)
+{
+  uint8_t discard[256];
+  for (unsigned r = 0; r < repeat; r++) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+      /* Drain the acknowledgements so the gateway never blocks on them */
+      while (::read(fd, discard, sizeof(discard)) > 0) {
+      }
+      ssize_t n = ::write(fd, data.data() + offset, std::min<size_t>(4096, data.size() - offset));
+      if (n > 0) {
+        offset += static_cast<size_t>(n);
+      } else {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        (void)::poll(&pfd, 1, 10);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  unsigned ports = 4;
+  unsigned threads = 0;
+  unsigned repeat = 20;
+  bool binary = false;
+  bool shared_sensors = false;
+  std::string capture;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--ports" && has_value) {
+      ports = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--threads" && has_value) {
+      threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--repeat" && has_value) {
+      repeat = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--mode" && has_value) {
+      binary = std::string(argv[++i]) == "binary";
+    } else if (arg == "--capture" && has_value) {
+      capture = argv[++i];
+    } else if (arg == "--shared-sensors") {
+      shared_sensors = true;
+    } else {
+      std::fprintf(stderr,
+                   "usage: lci_gateway_bench [--ports N] [--threads N] [--mode text|binary]\n"
+                   "                         [--capture FILE] [--repeat N] [--shared-sensors]\n");
+      return 2;
+    }
+  }
+  if (ports == 0) {
+    return 2;
+  }
+
+  std::vector<int> masters(ports, -1);
+  std::vector<int> slaves(ports, -1);
+  std::vector<std::vector<uint8_t>> traffic(ports);
+  Options options;
+  options.threads = threads;
+  for (unsigned p = 0; p < ports; p++) {
+    std::string path;
+    if (!open_pty_pair(masters[p], slaves[p], path)) {
+      std::perror("pty");
+      return 1;
+    }
+    ::fcntl(masters[p], F_SETFL, O_NONBLOCK);
+    options.ports.push_back(path);
+    if (capture.empty()) {
+      traffic[p] = synthesize(binary, p, shared_sensors);
+    } else {
+      std::ifstream in(capture, std::ios::binary);
+      traffic[p].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+  }
+
+  CountingSink sink;
+  Gateway gw(options, sink);
+  std::string error;
+  if (!gw.start(error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> writers;
+  for (unsigned p = 0; p < ports; p++) {
+    writers.emplace_back(replay, masters[p], std::cref(traffic[p]), repeat);
+  }
+  for (auto &w : writers) {
+    w.join();
+  }
+  /* Wait until the gateway has drained the ptys */
+  uint64_t last = 0;
+  auto last_change = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - last_change < std::chrono::milliseconds(300)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    uint64_t now = gw.stats().readings + gw.stats().bytes;
+    if (now != last) {
+      last = now;
+      last_change = std::chrono::steady_clock::now();
+    }
+  }
+  double seconds = std::chrono::duration<double>(last_change - start).count();
+  gw.stop();
+  for (unsigned p = 0; p < ports; p++) {
+    ::close(masters[p]);
+    ::close(slaves[p]);
+  }
+
+  const Stats &st = gw.stats();
+  std::printf("%u ports, %s traffic, %.3f s\n", ports,
+              capture.empty() ? (binary ? "binary" : "text") : capture.c_str(), seconds);
+  std::printf("%llu bytes (%.1f MB/s), %llu readings (%.0f readings/s)\n",
+              static_cast<unsigned long long>(st.bytes.load()), st.bytes / seconds / 1e6,
+              static_cast<unsigned long long>(st.readings.load()), st.readings / seconds);
+  std::printf("%llu published, %llu duplicates, %llu frames\n",
+              static_cast<unsigned long long>(sink.count()),
+              static_cast<unsigned long long>(st.duplicates.load()),
+              static_cast<unsigned long long>(st.frames.load()));
+  return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file gateway_main.cpp
+ * @brief Gateway daemon for several SI7021 central clients
+ *
+ *   lci_gateway [--threads N] [--dedupe-ms N] [--credits N] [--reopen-ms N]
+ *               [--sink file:PATH | --sink unix:PATH] [--stats-s N] PORT...
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+#include "gateway.hpp"
+
+using namespace lci::gateway;
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_signal(int)
+{
+  stop_requested = 1;
+}
+
+void usage()
+{
+  std::fprintf(stderr,
+               "usage: lci_gateway [--threads N] [--dedupe-ms N] [--credits N] [--reopen-ms N]\n"
+               "                   [--sink file:PATH | --sink unix:PATH] [--stats-s N] PORT...\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  std::string sink_spec = "file:-";
+  unsigned stats_s = 0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--threads" && has_value) {
+      options.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--dedupe-ms" && has_value) {
+      options.dedupe_window_ms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--credits" && has_value) {
+      options.credits = static_cast<uint8_t>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--reopen-ms" && has_value) {
+      options.reopen_ms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--sink" && has_value) {
+      sink_spec = argv[++i];
+    } else if (arg == "--stats-s" && has_value) {
+      stats_s = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (!arg.empty() && arg[0] != '-') {
+      options.ports.push_back(arg);
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (options.ports.empty()) {
+    usage();
+    return 2;
+  }
+
+  std::unique_ptr<Sink> sink;
+  if (sink_spec.rfind("file:", 0) == 0) {
+    auto file = std::make_unique<FileSink>(sink_spec.substr(5));
+    if (!file->ok()) {
+      std::perror(sink_spec.c_str());
+      return 1;
+    }
+    sink = std::move(file);
+  } else if (sink_spec.rfind("unix:", 0) == 0) {
+    auto socket = std::make_unique<UnixSocketSink>(sink_spec.substr(5));
+    if (!socket->ok()) {
+      std::perror("socket");
+      return 1;
+    }
+    sink = std::move(socket);
+  } else {
+    usage();
+    return 2;
+  }
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  Gateway gateway(options, *sink);
+  std::string error;
+  if (!gateway.start(error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  unsigned elapsed = 0;
+  /* Without reopening the daemon ends once all the ports are closed */
+  while (!stop_requested
+         && (options.reopen_ms != 0 || gateway.stats().closed_ports < options.ports.size())) {
+    ::sleep(1);
+    if (stats_s != 0 && ++elapsed % stats_s == 0) {
+      const Stats &st = gateway.stats();
+      std::fprintf(stderr, "bytes %llu readings %llu published %llu duplicates %llu frames %llu "
+                   "closed %llu reopened %llu\n",
+                   static_cast<unsigned long long>(st.bytes.load()),
+                   static_cast<unsigned long long>(st.readings.load()),
+                   static_cast<unsigned long long>(st.published.load()),
+                   static_cast<unsigned long long>(st.duplicates.load()),
+                   static_cast<unsigned long long>(st.frames.load()),
+                   static_cast<unsigned long long>(st.closed_ports.load()),
+                   static_cast<unsigned long long>(st.reopened_ports.load()));
+    }
+  }
+  gateway.stop();
+  return 0;
+}
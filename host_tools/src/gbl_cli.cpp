@@ -0,0 +1,256 @@
+/**
+ * @file gbl_cli.cpp
+ * @brief Command line check of GBL files before a rollout
+ *
+ *   lci_gbl verify [--key PEM] [--threads N] [--require-signed] [--tags] FILE...
+ *       Parse every file, check its CRC-32 and, with a key, its ECDSA-P256
+ *       signature, then print the metadata and the SHA-256 of the files.
+ *       Exits with 1 if any file is malformed or has an invalid signature,
+ *       or with --require-signed is not signed.
+ *
+ *   lci_gbl bench [--key PEM] [--threads N] [--iterations N] FILE...
+ *       Check the files over and over with 1 to N threads and print the
+ *       throughput.
+ *
+ * The files are checked in parallel, each thread maps a file and parses
+ * and hashes it in place.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gbl_parser.hpp"
+
+using namespace lci::gbl;
+
+namespace {
+
+void usage()
+{
+  std::fprintf(stderr,
+               "usage: lci_gbl verify [--key PEM] [--threads N] [--require-signed] [--tags] FILE...\n"
+               "       lci_gbl bench [--key PEM] [--threads N] [--iterations N] FILE...\n");
+}
+
+bool read_key(const std::string &path, lci::crypto::P256PublicKey &key)
+{
+  std::ifstream in(path);
+  if (!in) {
+    std::fprintf(stderr, "cannot read %s\n", path.c_str());
+    return false;
+  }
+  std::string pem((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (!lci::crypto::parse_public_key_pem(pem, key)) {
+    std::fprintf(stderr, "%s: not a P-256 public key\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+/* Run work(0 .. count - 1) on threads pulling the next index */
+void run_parallel(size_t count, unsigned threads, const std::function<void(size_t)> &work)
+{
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      work(i);
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : pool) {
+    thread.join();
+  }
+}
+
+std::string hex(const uint8_t *data, size_t len)
+{
+  static const char kDigits[] = "0123456789abcdef";
+  std::string s;
+  for (size_t i = 0; i < len; ++i) {
+    s += kDigits[data[i] >> 4];
+    s += kDigits[data[i] & 0x0F];
+  }
+  return s;
+}
+
+const char *signature_name(Signature signature)
+{
+  switch (signature) {
+    case Signature::none: return "none";
+    case Signature::unchecked: return "not checked, no key";
+    case Signature::valid: return "valid";
+    case Signature::invalid: return "INVALID";
+  }
+  return "unknown";
+}
+
+void print_report(const std::string &path, const Report &report, bool tags)
+{
+  if (!report.ok) {
+    std::printf("%s: %s\n", path.c_str(), report.error.c_str());
+    return;
+  }
+  const Gbl &gbl = report.gbl;
+  std::printf("%s: %zu bytes, GBL version 0x%08x%s%s\n", path.c_str(), report.size, gbl.version,
+              (gbl.type & kTypeEncrypted) ? ", encrypted" : "", (gbl.type & kTypeSigned) ? ", signed" : "");
+  if (gbl.has_application) {
+    std::printf("  application  type 0x%x, version %u, capabilities 0x%x, product %s\n", gbl.app_type,
+                gbl.app_version, gbl.app_capabilities, hex(gbl.product_id.data(), gbl.product_id.size()).c_str());
+  }
+  if (gbl.has_bootloader) {
+    std::printf("  bootloader   version 0x%08x\n", gbl.bootloader_version);
+  }
+  if (gbl.has_se_upgrade) {
+    std::printf("  SE upgrade   present\n");
+  }
+  if (gbl.program_tags > 0) {
+    std::printf("  program      %zu tag(s), %zu bytes from 0x%08x\n", gbl.program_tags, gbl.program_bytes,
+                gbl.program_address);
+  }
+  std::printf("  crc32        0x%08x\n", gbl.crc);
+  std::printf("  sha256       %s\n", hex(report.sha256.data(), report.sha256.size()).c_str());
+  if (gbl.has_signature) {
+    std::printf("  signed       %s over %zu bytes\n", hex(report.signed_sha256.data(), report.signed_sha256.size()).c_str(),
+                gbl.signed_length);
+  }
+  std::printf("  signature    %s\n", signature_name(report.signature));
+  if (tags) {
+    for (const TagView &tag : gbl.tags) {
+      std::printf("  tag 0x%08x %-18s at %8zu, %8u bytes\n", tag.id, tag_name(tag.id), tag.offset, tag.length);
+    }
+  }
+}
+
+int verify(const std::vector<std::string> &files, const lci::crypto::P256PublicKey *key, unsigned threads,
+           bool require_signed, bool tags)
+{
+  std::vector<Report> reports(files.size());
+  run_parallel(files.size(), threads, [&](size_t i) { reports[i] = check_file(files[i], key); });
+
+  int result = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const Report &report = reports[i];
+    print_report(files[i], report, tags);
+    if (!report.ok || report.signature == Signature::invalid
+        || (require_signed && report.signature != Signature::valid)) {
+      result = 1;
+    }
+  }
+  return result;
+}
+
+int bench(const std::vector<std::string> &files, const lci::crypto::P256PublicKey *key, unsigned threads,
+          unsigned iterations)
+{
+  std::vector<Report> expected(files.size());
+  size_t bytes = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    expected[i] = check_file(files[i], key);
+    if (!expected[i].ok) {
+      std::fprintf(stderr, "%s: %s\n", files[i].c_str(), expected[i].error.c_str());
+      return 1;
+    }
+    bytes += expected[i].size;
+  }
+
+  std::printf("%zu files, %zu bytes, %u iterations, signatures %s\n", files.size(), bytes, iterations,
+              key ? "checked" : "not checked");
+  std::printf("%8s %10s %10s %10s\n", "threads", "ms", "files/s", "MB/s");
+  std::vector<unsigned> counts;
+  for (unsigned t = 1; t < threads; t *= 2) {
+    counts.push_back(t);
+  }
+  counts.push_back(threads);
+  for (unsigned t : counts) {
+    size_t jobs = files.size() * iterations;
+    std::atomic<bool> mismatch{false};
+    auto start = std::chrono::steady_clock::now();
+    run_parallel(jobs, t, [&](size_t job) {
+      size_t i = job % files.size();
+      Report report = check_file(files[i], key);
+      if (report.sha256 != expected[i].sha256 || report.signature != expected[i].signature) {
+        mismatch = true;
+      }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (mismatch) {
+      std::fprintf(stderr, "results differ between runs\n");
+      return 1;
+    }
+    std::printf("%8u %10.1f %10.0f %10.1f\n", t, seconds * 1000.0, static_cast<double>(jobs) / seconds,
+                static_cast<double>(bytes) * iterations / seconds / 1e6);
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+  std::string command = argv[1];
+  std::vector<std::string> files;
+  std::string key_path;
+  unsigned threads = std::thread::hardware_concurrency();
+  unsigned iterations = 50;
+  bool require_signed = false;
+  bool tags = false;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--key" && i + 1 < argc) {
+      key_path = argv[++i];
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--iterations" && i + 1 < argc) {
+      iterations = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--require-signed") {
+      require_signed = true;
+    } else if (arg == "--tags") {
+      tags = true;
+    } else if (!arg.empty() && arg[0] != '-') {
+      files.push_back(arg);
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (threads == 0) {
+    threads = 1;
+  }
+  if (files.empty()) {
+    usage();
+    return 2;
+  }
+  lci::crypto::P256PublicKey key;
+  if (!key_path.empty() && !read_key(key_path, key)) {
+    return 1;
+  }
+  const lci::crypto::P256PublicKey *key_ptr = key_path.empty() ? nullptr : &key;
+
+  if (command == "verify") {
+    return verify(files, key_ptr, threads, require_signed, tags);
+  }
+  if (command == "bench" && iterations > 0) {
+    return bench(files, key_ptr, threads, iterations);
+  }
+  usage();
+  return 2;
+}
@@ -0,0 +1,268 @@
+/**
+ * @file gbl_parser.cpp
+ * @brief Zero-copy parser and signature check of GBL files
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "gbl_parser.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lci::gbl {
+
+namespace {
+
+constexpr size_t kTagHeaderSize = 8;
+constexpr size_t kApplicationSize = 28;
+
+uint32_t get_le32(const uint8_t *p)
+{
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16)
+         | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+struct CrcTable {
+  uint32_t entries[256];
+  CrcTable()
+  {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+      }
+      entries[i] = c;
+    }
+  }
+};
+
+bool is_program(uint32_t id)
+{
+  return id == kTagProgram || id == kTagProgramLegacy || id == kTagProgramLz4 || id == kTagProgramLzma;
+}
+
+}  // namespace
+
+MappedFile::~MappedFile()
+{
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+}
+
+bool MappedFile::open(const std::string &path, std::string &error)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    error = std::string("cannot open: ") + std::strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    error = "empty or unreadable file";
+    close(fd);
+    return false;
+  }
+  void *map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    error = std::string("cannot map: ") + std::strerror(errno);
+    return false;
+  }
+  data_ = static_cast<const uint8_t *>(map);
+  size_ = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+bool parse(const uint8_t *data, size_t size, Gbl &gbl, std::string &error)
+{
+  gbl = Gbl{};
+  size_t pos = 0;
+  bool end = false;
+  while (!end) {
+    if (size - pos < kTagHeaderSize) {
+      error = "missing end tag";
+      return false;
+    }
+    TagView tag;
+    tag.id = get_le32(&data[pos]);
+    tag.length = get_le32(&data[pos + 4]);
+    tag.offset = pos;
+    tag.data = &data[pos + kTagHeaderSize];
+    if (tag.length > size - pos - kTagHeaderSize) {
+      error = "tag " + std::to_string(gbl.tags.size()) + " runs past the end of the file";
+      return false;
+    }
+    if (gbl.tags.empty() && tag.id != kTagHeader) {
+      error = "not a GBL file";
+      return false;
+    }
+    if (gbl.has_signature && tag.id != kTagEnd) {
+      error = "tag after the signature";
+      return false;
+    }
+
+    switch (tag.id) {
+      case kTagHeader:
+        if (!gbl.tags.empty() || tag.length < 8) {
+          error = "bad header tag";
+          return false;
+        }
+        gbl.version = get_le32(tag.data);
+        gbl.type = get_le32(tag.data + 4);
+        break;
+      case kTagApplication:
+        if (tag.length < kApplicationSize) {
+          error = "short application tag";
+          return false;
+        }
+        gbl.has_application = true;
+        gbl.app_type = get_le32(tag.data);
+        gbl.app_version = get_le32(tag.data + 4);
+        gbl.app_capabilities = get_le32(tag.data + 8);
+        std::memcpy(gbl.product_id.data(), tag.data + 12, gbl.product_id.size());
+        break;
+      case kTagBootloader:
+        if (tag.length < 8) {
+          error = "short bootloader tag";
+          return false;
+        }
+        gbl.has_bootloader = true;
+        gbl.bootloader_version = get_le32(tag.data);
+        break;
+      case kTagSeUpgrade:
+        gbl.has_se_upgrade = true;
+        break;
+      case kTagSignature:
+        if (tag.length != gbl.signature.size()) {
+          error = "bad signature tag";
+          return false;
+        }
+        gbl.has_signature = true;
+        gbl.signed_length = pos;
+        std::memcpy(gbl.signature.data(), tag.data, gbl.signature.size());
+        break;
+      case kTagEnd:
+        if (tag.length != 4) {
+          error = "bad end tag";
+          return false;
+        }
+        gbl.crc = get_le32(tag.data);
+        if (crc32(data, pos + kTagHeaderSize) != gbl.crc) {
+          error = "CRC mismatch";
+          return false;
+        }
+        end = true;
+        break;
+      default:
+        if (is_program(tag.id)) {
+          if (tag.length < 4) {
+            error = "short program tag";
+            return false;
+          }
+          uint32_t address = get_le32(tag.data);
+          if (gbl.program_tags == 0 || address < gbl.program_address) {
+            gbl.program_address = address;
+          }
+          gbl.program_tags++;
+          gbl.program_bytes += tag.length - 4;
+        }
+        break;
+    }
+    gbl.tags.push_back(tag);
+    pos += kTagHeaderSize + tag.length;
+  }
+  if ((gbl.type & kTypeSigned) && !gbl.has_signature) {
+    error = "header announces a signature, none found";
+    return false;
+  }
+  return true;
+}
+
+Report check(const uint8_t *data, size_t size, const crypto::P256PublicKey *key)
+{
+  Report report;
+  report.size = size;
+  if (!parse(data, size, report.gbl, report.error)) {
+    return report;
+  }
+  report.ok = true;
+
+  /* One pass: the state at the signature tag gives the signed digest */
+  crypto::Sha256 sha;
+  if (report.gbl.has_signature) {
+    sha.update(data, report.gbl.signed_length);
+    crypto::Sha256 signed_sha = sha;
+    report.signed_sha256 = signed_sha.finish();
+    sha.update(data + report.gbl.signed_length, size - report.gbl.signed_length);
+  } else {
+    sha.update(data, size);
+  }
+  report.sha256 = sha.finish();
+
+  if (!report.gbl.has_signature) {
+    report.signature = Signature::none;
+  } else if (key == nullptr) {
+    report.signature = Signature::unchecked;
+  } else {
+    report.signature = crypto::ecdsa_p256_verify(*key, report.signed_sha256, report.gbl.signature)
+                       ? Signature::valid
+                       : Signature::invalid;
+  }
+  return report;
+}
+
+Report check_file(const std::string &path, const crypto::P256PublicKey *key)
+{
+  MappedFile file;
+  std::string error;
+  if (!file.open(path, error)) {
+    Report report;
+    report.error = error;
+    return report;
+  }
+  Report report = check(file.data(), file.size(), key);
+  /* The mapping goes away, keep the tag IDs and offsets only */
+  for (TagView &tag : report.gbl.tags) {
+    tag.data = nullptr;
+  }
+  return report;
+}
+
+const char *tag_name(uint32_t id)
+{
+  switch (id) {
+    case kTagHeader: return "header";
+    case kTagSeUpgrade: return "SE upgrade";
+    case kTagApplication: return "application";
+    case kTagBootloader: return "bootloader";
+    case kTagMetadata: return "metadata";
+    case kTagProgramLegacy: return "program";
+    case kTagProgram: return "erase and program";
+    case kTagProgramLz4: return "program LZ4";
+    case kTagProgramLzma: return "program LZMA";
+    case kTagCertificate: return "certificate";
+    case kTagSignature: return "signature";
+    case kTagEnd: return "end";
+  }
+  return "unknown";
+}
+
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc)
+{
+  static const CrcTable table;
+  crc = ~crc;
+  for (size_t i = 0; i < len; ++i) {
+    crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+}  // namespace lci::gbl
@@ -0,0 +1,140 @@
+/**
+ * @file gbl_parser.hpp
+ * @brief Zero-copy parser and signature check of GBL files
+ *
+ * A GBL file is a sequence of tags: ID (4 bytes), length (4 bytes) and the
+ * data, all little-endian. It starts with the header tag and ends with the
+ * end tag, whose data is the CRC-32 of the file before it. A signed file
+ * has an ECDSA-P256 signature tag before the end tag; the signature is the
+ * one of the SHA-256 of every byte before the signature tag.
+ *
+ * The parser walks the tags in place, over a memory-mapped file or any
+ * other buffer, the tag views point into it.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_GBL_PARSER_HPP_
+#define LCI_GBL_PARSER_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ecdsa_p256.hpp"
+#include "sha256.hpp"
+
+namespace lci::gbl {
+
+constexpr uint32_t kTagHeader = 0x03A617EB;
+constexpr uint32_t kTagSeUpgrade = 0x5EA617EB;
+constexpr uint32_t kTagApplication = 0xF40A0AF4;
+constexpr uint32_t kTagBootloader = 0xF50909F5;
+constexpr uint32_t kTagMetadata = 0xF60808F6;
+constexpr uint32_t kTagProgramLegacy = 0xFE0101FE;
+constexpr uint32_t kTagProgram = 0xFD0303FD;
+constexpr uint32_t kTagProgramLz4 = 0xFD0505FD;
+constexpr uint32_t kTagProgramLzma = 0xFD0707FD;
+constexpr uint32_t kTagCertificate = 0xF30B0BF3;
+constexpr uint32_t kTagSignature = 0xF70A0AF7;
+constexpr uint32_t kTagEnd = 0xFC0404FC;
+
+/* Type flags of the header tag */
+constexpr uint32_t kTypeEncrypted = 0x00000001;
+constexpr uint32_t kTypeSigned = 0x00000100;
+
+/* Read-only mapping of a whole file */
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /* Returns false and sets error if the file can not be mapped */
+  bool open(const std::string &path, std::string &error);
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+/* One tag, data points into the parsed buffer */
+struct TagView {
+  uint32_t id = 0;
+  size_t offset = 0;
+  const uint8_t *data = nullptr;
+  uint32_t length = 0;
+};
+
+/* Tags and metadata of a GBL file */
+struct Gbl {
+  std::vector<TagView> tags;
+  uint32_t version = 0;
+  uint32_t type = 0;
+  /* Application tag */
+  bool has_application = false;
+  uint32_t app_type = 0;
+  uint32_t app_version = 0;
+  uint32_t app_capabilities = 0;
+  std::array<uint8_t, 16> product_id{};
+  /* Bootloader tag */
+  bool has_bootloader = false;
+  uint32_t bootloader_version = 0;
+  bool has_se_upgrade = false;
+  /* Program data tags, lowest flash address and bytes programmed */
+  size_t program_tags = 0;
+  uint32_t program_address = 0;
+  size_t program_bytes = 0;
+  /* Signature tag, signed_length is the number of bytes signed */
+  bool has_signature = false;
+  size_t signed_length = 0;
+  crypto::P256Signature signature{};
+  uint32_t crc = 0;
+};
+
+/* Walk the tags of a GBL file and check its CRC-32. Returns false and sets
+ * error if the file is not a well formed GBL file. */
+bool parse(const uint8_t *data, size_t size, Gbl &gbl, std::string &error);
+
+enum class Signature {
+  /* No signature tag */
+  none,
+  /* Signed, no key to check it */
+  unchecked,
+  valid,
+  invalid
+};
+
+/* Parse, hash and signature check of one file */
+struct Report {
+  bool ok = false;
+  std::string error;
+  size_t size = 0;
+  Gbl gbl;
+  crypto::Sha256Digest sha256{};
+  /* SHA-256 of the signed bytes, the digest the signature covers */
+  crypto::Sha256Digest signed_sha256{};
+  Signature signature = Signature::none;
+};
+
+/* Check a GBL file in memory, key may be nullptr to only parse and hash */
+Report check(const uint8_t *data, size_t size, const crypto::P256PublicKey *key);
+
+/* Map and check a GBL file */
+Report check_file(const std::string &path, const crypto::P256PublicKey *key);
+
+/* Name of a tag ID, "unknown" for the IDs the parser does not interpret */
+const char *tag_name(uint32_t id);
+
+/* CRC-32 of the GBL format */
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc = 0);
+
+}  // namespace lci::gbl
+
+#endif /* LCI_GBL_PARSER_HPP_ */
@@ -0,0 +1,234 @@
+/**
+ * @file lz4_cli.cpp
+ * @brief Command line compressor and benchmark of LZ4 compressed updates
+ *
+ *   lci_lz4 compress IN -o OUT [--depth N]
+ *       Compress a GBL file for the streaming decompressor of the firmware.
+ *       The stream is decompressed back before it is written.
+ *
+ *   lci_lz4 decompress IN -o OUT
+ *       Decompress a stream through the firmware decompressor.
+ *
+ *   lci_lz4 bench [--depth N] [--iterations N] FILE...
+ *       Print the compression ratio, the compression time and the speed of
+ *       the firmware decompressor on the host for every file.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "lci_lz4.h"
+#include "lz4_codec.hpp"
+
+using namespace lci::lz4;
+
+namespace {
+
+/* ATT payload of a write without response at the maximum MTU */
+constexpr uint32_t kChunkSize = 244;
+
+void usage()
+{
+  std::fprintf(stderr,
+               "usage: lci_lz4 compress IN -o OUT [--depth N]\n"
+               "       lci_lz4 decompress IN -o OUT\n"
+               "       lci_lz4 bench [--depth N] [--iterations N] FILE...\n");
+}
+
+bool read_file(const std::string &path, std::vector<uint8_t> &data)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::fprintf(stderr, "cannot read %s\n", path.c_str());
+    return false;
+  }
+  data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool write_file(const std::string &path, const std::vector<uint8_t> &data)
+{
+  std::ofstream out(path, std::ios::binary);
+  out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+  if (!out) {
+    std::fprintf(stderr, "cannot write %s\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+/* Storage slot of the host, writes must not go past it */
+struct Slot {
+  std::vector<uint8_t> flash;
+  uint32_t writes = 0;
+};
+
+bool slot_write(uint32_t offset, const uint8_t *data, uint32_t len, void *context)
+{
+  auto *slot = static_cast<Slot *>(context);
+  if (offset + len > slot->flash.size()) {
+    return false;
+  }
+  std::memcpy(&slot->flash[offset], data, len);
+  slot->writes++;
+  return true;
+}
+
+/* Raw size from the stream header, 0 if the stream is too short */
+uint32_t raw_size(const std::vector<uint8_t> &stream)
+{
+  if (stream.size() < LCI_LZ4_HEADER_SIZE) {
+    return 0;
+  }
+  return static_cast<uint32_t>(stream[8]) | (static_cast<uint32_t>(stream[9]) << 8)
+         | (static_cast<uint32_t>(stream[10]) << 16) | (static_cast<uint32_t>(stream[11]) << 24);
+}
+
+/* Run the firmware decompressor over the stream in GATT write sized chunks */
+lci_lz4_status_t decompress(const std::vector<uint8_t> &stream, Slot &slot)
+{
+  lci_lz4_t lz4;
+  lci_lz4_status_t status = lci_lz4_ok;
+
+  slot.flash.assign(raw_size(stream), 0xFF);
+  slot.writes = 0;
+  lci_lz4_init(&lz4, slot.flash.data(), slot_write, &slot);
+  for (size_t pos = 0; pos < stream.size(); pos += kChunkSize) {
+    auto len = static_cast<uint32_t>(std::min<size_t>(kChunkSize, stream.size() - pos));
+    status = lci_lz4_push(&lz4, &stream[pos], len);
+    if (status != lci_lz4_ok && status != lci_lz4_done) {
+      return status;
+    }
+  }
+  return lci_lz4_finish(&lz4);
+}
+
+const char *status_name(lci_lz4_status_t status)
+{
+  switch (status) {
+    case lci_lz4_ok: return "ok";
+    case lci_lz4_done: return "done";
+    case lci_lz4_bad_format: return "bad format";
+    case lci_lz4_write_error: return "write error";
+    case lci_lz4_bad_size: return "bad size";
+    case lci_lz4_bad_crc: return "bad CRC";
+  }
+  return "unknown";
+}
+
+int bench(const std::vector<std::string> &files, unsigned depth, unsigned iterations)
+{
+  int result = 0;
+  std::printf("%-44s %8s %8s %6s %9s %10s\n", "file", "raw", "lz4", "ratio", "comp ms", "dec MB/s");
+  for (const std::string &path : files) {
+    std::vector<uint8_t> raw;
+    if (!read_file(path, raw)) {
+      return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> stream = compress(raw, depth);
+    double compress_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Slot slot;
+    lci_lz4_status_t status = lci_lz4_ok;
+    start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations && status == lci_lz4_ok; ++i) {
+      status = decompress(stream, slot);
+    }
+    double decompress_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (status != lci_lz4_ok || slot.flash != raw) {
+      std::fprintf(stderr, "%s: decompression failed: %s\n", path.c_str(), status_name(status));
+      result = 1;
+      continue;
+    }
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    std::printf("%-44s %8zu %8zu %5.1f%% %9.1f %10.1f\n", name.c_str(), raw.size(), stream.size(),
+                100.0 * static_cast<double>(stream.size()) / static_cast<double>(raw.size()), compress_s * 1000.0,
+                static_cast<double>(raw.size()) * iterations / decompress_s / 1e6);
+  }
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+  std::string command = argv[1];
+  std::vector<std::string> files;
+  std::string out_path;
+  unsigned depth = kDefaultDepth;
+  unsigned iterations = 20;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (arg == "--depth" && i + 1 < argc) {
+      depth = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--iterations" && i + 1 < argc) {
+      iterations = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (!arg.empty() && arg[0] != '-') {
+      files.push_back(arg);
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  if (command == "bench" && !files.empty() && iterations > 0) {
+    return bench(files, depth, iterations);
+  }
+  if (files.size() != 1 || out_path.empty()) {
+    usage();
+    return 2;
+  }
+  std::vector<uint8_t> in;
+  if (!read_file(files[0], in)) {
+    return 1;
+  }
+
+  if (command == "compress") {
+    std::vector<uint8_t> stream = compress(in, depth);
+    Slot slot;
+    lci_lz4_status_t status = decompress(stream, slot);
+    if (status != lci_lz4_ok || slot.flash != in) {
+      std::fprintf(stderr, "stream check failed: %s\n", status_name(status));
+      return 1;
+    }
+    if (!write_file(out_path, stream)) {
+      return 1;
+    }
+    std::printf("%zu bytes compressed to %zu bytes (%.1f%%)\n", in.size(), stream.size(),
+                100.0 * static_cast<double>(stream.size()) / static_cast<double>(in.size()));
+    return 0;
+  }
+
+  if (command == "decompress") {
+    Slot slot;
+    lci_lz4_status_t status = decompress(in, slot);
+    if (status != lci_lz4_ok) {
+      std::fprintf(stderr, "decompression failed: %s\n", status_name(status));
+      return 1;
+    }
+    if (!write_file(out_path, slot.flash)) {
+      return 1;
+    }
+    std::printf("%zu bytes decompressed to %zu bytes\n", in.size(), slot.flash.size());
+    return 0;
+  }
+
+  usage();
+  return 2;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file lz4_codec.cpp
+ * @brief Host side LZ4 compressor of firmware updates
+ *
+ * Compression runs once per release on the host, so the compressor spends
+ * its time on the ratio like LZ4 HC: hash chains over every position of
+ * the last 64 KB, the longest match is taken, and a match is deferred by
+ * one byte when the next position has a longer one. The output is a
+ * standard LZ4 block, decompressed by the same fast decoder.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "lz4_codec.hpp"
+
+#include <cstring>
+
+#include "lci_delta.h"
+#include "lci_lz4.h"
+
+namespace lci::lz4 {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxOffset = 65535;
+/* The last match starts at least 12 bytes before the end, the last 5 bytes
+ * are literals */
+constexpr size_t kMatchLimit = 12;
+constexpr size_t kLastLiterals = 5;
+constexpr unsigned kHashBits = 16;
+
+uint32_t hash4(const uint8_t *p)
+{
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+void put_le32(std::vector<uint8_t> &dst, uint32_t value)
+{
+  for (int i = 0; i < 4; ++i) {
+    dst.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+void put_length(std::vector<uint8_t> &dst, size_t length)
+{
+  for (; length >= 255; length -= 255) {
+    dst.push_back(255);
+  }
+  dst.push_back(static_cast<uint8_t>(length));
+}
+
+/* One sequence: literals [anchor, pos) and a match, or literals only */
+void put_sequence(std::vector<uint8_t> &dst, const uint8_t *anchor, size_t literals, size_t offset, size_t match)
+{
+  size_t match_code = match ? match - kMinMatch : 0;
+  uint8_t token = static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+  token = static_cast<uint8_t>(token | (match_code < 15 ? match_code : 15));
+  dst.push_back(token);
+  if (literals >= 15) {
+    put_length(dst, literals - 15);
+  }
+  dst.insert(dst.end(), anchor, anchor + literals);
+  if (match == 0) {
+    return;
+  }
+  dst.push_back(static_cast<uint8_t>(offset));
+  dst.push_back(static_cast<uint8_t>(offset >> 8));
+  if (match_code >= 15) {
+    put_length(dst, match_code - 15);
+  }
+}
+
+class MatchFinder {
+public:
+  MatchFinder(const std::vector<uint8_t> &raw, unsigned depth)
+      : raw_(raw), depth_(depth), head_(size_t{1} << kHashBits, -1), chain_(raw.size(), -1)
+  {
+  }
+
+  /* Add every position before pos to the chains */
+  void insert_until(size_t pos)
+  {
+    for (; next_ < pos; ++next_) {
+      uint32_t h = hash4(&raw_[next_]);
+      chain_[next_] = head_[h];
+      head_[h] = static_cast<int32_t>(next_);
+    }
+  }
+
+  /* Longest match at pos, 0 if none */
+  size_t find(size_t pos, size_t &offset)
+  {
+    size_t limit = raw_.size() - kLastLiterals;
+    size_t best = 0;
+    insert_until(pos);
+    unsigned depth = 0;
+    for (int32_t c = head_[hash4(&raw_[pos])]; c >= 0 && depth < depth_; c = chain_[c], ++depth) {
+      auto candidate = static_cast<size_t>(c);
+      if (pos - candidate > kMaxOffset) {
+        break;
+      }
+      if (raw_[candidate + best] != raw_[pos + best]) {
+        continue;
+      }
+      size_t n = 0;
+      while (pos + n < limit && raw_[candidate + n] == raw_[pos + n]) {
+        ++n;
+      }
+      if (n > best) {
+        best = n;
+        offset = pos - candidate;
+      }
+    }
+    return best >= kMinMatch ? best : 0;
+  }
+
+private:
+  const std::vector<uint8_t> &raw_;
+  unsigned depth_;
+  std::vector<int32_t> head_;
+  std::vector<int32_t> chain_;
+  size_t next_ = 0;
+};
+
+}  // namespace
+
+std::vector<uint8_t> compress(const std::vector<uint8_t> &raw, unsigned depth)
+{
+  std::vector<uint8_t> out;
+  put_le32(out, LCI_LZ4_MAGIC);
+  out.push_back(LCI_LZ4_VERSION);
+  out.insert(out.end(), 3, 0);
+  put_le32(out, static_cast<uint32_t>(raw.size()));
+  put_le32(out, lci_delta_crc32(0, raw.data(), static_cast<uint32_t>(raw.size())));
+
+  MatchFinder finder(raw, depth);
+  size_t anchor = 0;
+  size_t pos = 0;
+  while (raw.size() > kMatchLimit && pos + kMatchLimit <= raw.size()) {
+    size_t offset = 0;
+    size_t match = finder.find(pos, offset);
+    if (match == 0) {
+      ++pos;
+      continue;
+    }
+    /* Lazy matching: a longer match at the next byte wins */
+    size_t next_offset = 0;
+    if (pos + 1 + kMatchLimit <= raw.size() && finder.find(pos + 1, next_offset) > match + 1) {
+      ++pos;
+      continue;
+    }
+    put_sequence(out, &raw[anchor], pos - anchor, offset, match);
+    pos += match;
+    anchor = pos;
+  }
+  put_sequence(out, raw.data() + anchor, raw.size() - anchor, 0, 0);
+  return out;
+}
+
+}  // namespace lci::lz4
@@ -0,0 +1,29 @@
+/**
+ * @file lz4_codec.hpp
+ * @brief Host side LZ4 compressor of firmware updates
+ *
+ * The stream layout is defined by si7021_peripheral_server/src/lci_lz4.h,
+ * the firmware decompressor lci_lz4.c is built into the host tool as is.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_LZ4_CODEC_HPP_
+#define LCI_LZ4_CODEC_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lci::lz4 {
+
+/* Default number of earlier positions tried for every match */
+constexpr unsigned kDefaultDepth = 256;
+
+/* Compressed stream of a whole file, header and one LZ4 block */
+std::vector<uint8_t> compress(const std::vector<uint8_t> &raw, unsigned depth = kDefaultDepth);
+
+}  // namespace lci::lz4
+
+#endif /* LCI_LZ4_CODEC_HPP_ */
@@ -0,0 +1,90 @@
+/**
+ * @file serial_port.cpp
+ * @brief Serial port and pseudo terminal helpers of the host tools
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "serial_port.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace lci {
+
+int open_serial(const std::string &path, bool non_blocking)
+{
+  int fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC | (non_blocking ? O_NONBLOCK : 0));
+  if (fd < 0) {
+    return -1;
+  }
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool open_pty_pair(int &master, int &slave, std::string &slave_path)
+{
+  master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (master < 0) {
+    return false;
+  }
+  if (grantpt(master) != 0 || unlockpt(master) != 0) {
+    ::close(master);
+    return false;
+  }
+  const char *name = ptsname(master);
+  if (name == nullptr) {
+    ::close(master);
+    return false;
+  }
+  slave_path = name;
+  slave = open_serial(slave_path);
+  if (slave < 0) {
+    ::close(master);
+    return false;
+  }
+  return true;
+}
+
+bool write_all(int fd, const void *data, size_t len)
+{
+  const char *p = static_cast<const char *>(data);
+  while (len > 0) {
+    ssize_t n = ::write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN) {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        (void)::poll(&pfd, 1, 100);
+        continue;
+      }
+      return false;
+    }
+    p += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+}  // namespace lci
@@ -0,0 +1,28 @@
+/**
+ * @file serial_port.hpp
+ * @brief Serial port and pseudo terminal helpers of the host tools
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_SERIAL_PORT_HPP_
+#define LCI_SERIAL_PORT_HPP_
+
+#include <string>
+
+namespace lci {
+
+/* Open a serial device in raw mode at 115200 baud, returns -1 on error */
+int open_serial(const std::string &path, bool non_blocking = false);
+
+/* Create a pseudo terminal pair, the slave side is opened through
+ * open_serial() so it is configured exactly like a real port */
+bool open_pty_pair(int &master, int &slave, std::string &slave_path);
+
+/* Write the whole buffer, retrying on short writes */
+bool write_all(int fd, const void *data, size_t len);
+
+}  // namespace lci
+
+#endif  // LCI_SERIAL_PORT_HPP_
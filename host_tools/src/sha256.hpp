@@ -0,0 +1,40 @@
+/**
+ * @file sha256.hpp
+ * @brief SHA-256 of the GBL signature check
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_SHA256_HPP_
+#define LCI_SHA256_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace lci::crypto {
+
+using Sha256Digest = std::array<uint8_t, 32>;
+
+/* Incremental SHA-256 (FIPS 180-4) */
+class Sha256 {
+ public:
+  Sha256();
+  void update(const uint8_t *data, size_t len);
+  Sha256Digest finish();
+
+ private:
+  void compress(const uint8_t *block);
+
+  std::array<uint32_t, 8> state_;
+  std::array<uint8_t, 64> block_{};
+  size_t buffered_ = 0;
+  uint64_t length_ = 0;
+};
+
+Sha256Digest sha256(const uint8_t *data, size_t len);
+
+}  // namespace lci::crypto
+
+#endif /* LCI_SHA256_HPP_ */
@@ -0,0 +1,543 @@
+/**
+ * @file telemetry_cli.cpp
+ * @brief Command line decoder of the central client binary telemetry
+ *
+ *   lci_telemetry monitor <device> [--credits N]
+ *       Decode the frames of a central client, print one line per sample
+ *       and acknowledge every frame with N credits. Link statistics are
+ *       printed to stderr.
+ *
+ *   lci_telemetry loopback [--samples N] [--sensors N] [--credits N]
+ *       Run a firmware emulator on a pseudo terminal pair, decode its
+ *       frames through the serial port path and check every sample.
+ *
+ *   lci_telemetry ota <device> FILE [--targets ID,...] [--reload]
+ *       Check the GBL file, load it into the cache of a central client
+ *       unless it is cached already, then update the servers with the given
+ *       IDs, or every connected server with the OTA service, and print
+ *       their progress. Exits with 1 unless every server was updated.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "gbl_parser.hpp"
+#include "serial_port.hpp"
+#include "telemetry_codec.hpp"
+
+using namespace lci::telemetry;
+
+namespace {
+
+constexpr uint8_t kDefaultCredits = 4;
+/* Out of credits for this long, the emulated firmware sends a probe frame
+ * (LCI_TELEMETRY_CREDIT_TIMEOUT_MS) */
+constexpr int kCreditTimeoutMs = 2000;
+/* Time to wait for the answer of a command and attempts per command */
+constexpr int kAnswerTimeoutMs = 500;
+constexpr int kCommandAttempts = 10;
+/* The update is given up when the central stops reporting */
+constexpr int kReportTimeoutMs = 30000;
+
+void usage()
+{
+  std::fprintf(stderr,
+               "usage: lci_telemetry monitor <device> [--credits N]\n"
+               "       lci_telemetry loopback [--samples N] [--sensors N] [--credits N]\n"
+               "       lci_telemetry ota <device> FILE [--targets ID,...] [--reload]\n");
+}
+
+/* Deterministic sample of the loopback emulator */
+Sample expected_sample(uint32_t index, uint32_t sensors)
+{
+  Sample s;
+  s.sensor_id = static_cast<uint16_t>(0x1000 + index % sensors);
+  s.timestamp_ms = index * 10;
+  s.temperature = static_cast<int16_t>(static_cast<int32_t>(index % 8000) - 4000);
+  s.humidity = static_cast<uint16_t>(index % 10000);
+  s.flags = kFlagTemperature | kFlagHumidity;
+  return s;
+}
+
+bool same_sample(const Sample &a, const Sample &b)
+{
+  return a.sensor_id == b.sensor_id && a.timestamp_ms == b.timestamp_ms
+         && a.temperature == b.temperature && a.humidity == b.humidity && a.flags == b.flags;
+}
+
+/* Firmware side of the loopback: batches samples, interleaves log text and
+ * honours the credits of the acknowledgements like lci_telemetry.c */
+void emulate_firmware(int fd, uint32_t samples, uint32_t sensors, std::atomic<bool> &stop)
+{
+  static const char log_line[] = "[I] Bluetooth stack booted: v4.0.0-b212\r\n";
+  std::vector<uint8_t> rx;
+  uint8_t rx_buf[64];
+  uint8_t decoded[16];
+  bool flow_control = false;
+  uint8_t acked_seq = 0;
+  uint8_t credits = 0;
+  uint8_t next_seq = 0;
+  uint32_t index = 0;
+  auto ack_time = std::chrono::steady_clock::now();
+
+  while (!stop.load() && index < samples) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int wait_ms = flow_control && static_cast<uint8_t>(next_seq - acked_seq - 1) >= credits ? 100 : 0;
+    if (::poll(&pfd, 1, wait_ms) > 0 && (pfd.revents & POLLIN)) {
+      ssize_t n = ::read(fd, rx_buf, sizeof(rx_buf));
+      for (ssize_t i = 0; i < n; i++) {
+        if (rx_buf[i] != 0) {
+          rx.push_back(rx_buf[i]);
+          continue;
+        }
+        if (!rx.empty() && rx.size() <= sizeof(decoded)) {
+          size_t len = cobs_decode(rx.data(), rx.size(), decoded);
+          if (parse_ack(decoded, len, acked_seq, credits)) {
+            flow_control = true;
+            ack_time = std::chrono::steady_clock::now();
+          }
+        }
+        rx.clear();
+      }
+    }
+    if (flow_control && static_cast<uint8_t>(next_seq - acked_seq - 1) >= credits) {
+      if (std::chrono::steady_clock::now() - ack_time < std::chrono::milliseconds(kCreditTimeoutMs)) {
+        continue;
+      }
+      ack_time = std::chrono::steady_clock::now();
+    }
+    Sample batch[kBatchMax];
+    size_t count = 0;
+    while (count < kBatchMax && index < samples) {
+      batch[count++] = expected_sample(index++, sensors);
+    }
+    std::vector<uint8_t> frame = encode_samples(next_seq++, batch, count);
+    if (next_seq % 16 == 0) {
+      lci::write_all(fd, log_line, sizeof(log_line) - 1);
+    }
+    if (next_seq % 64 == 0) {
+      LinkStats link;
+      link.sensor_id = 0x1000;
+      link.rssi = -60;
+      link.phy = 1;
+      link.delivered = index;
+      std::vector<uint8_t> links = encode_links(&link, 1);
+      lci::write_all(fd, links.data(), links.size());
+    }
+    lci::write_all(fd, frame.data(), frame.size());
+  }
+}
+
+int run_monitor(const std::string &device, uint8_t credits)
+{
+  int fd = lci::open_serial(device);
+  if (fd < 0) {
+    std::perror(device.c_str());
+    return 1;
+  }
+  StreamDecoder decoder;
+  uint8_t buf[4096];
+  std::printf("sensor,timestamp_ms,temperature_c,humidity_rh\n");
+  while (true) {
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+    decoder.feed(buf, static_cast<size_t>(n), [&](const FrameView &frame) {
+      for (size_t i = 0; i < frame.count; i++) {
+        Sample s = frame.sample(i);
+        std::printf("%04X,%u", s.sensor_id, s.timestamp_ms);
+        if (s.flags & kFlagTemperature) {
+          std::printf(",%s%d.%02d", s.temperature < 0 ? "-" : "",
+                      std::abs(s.temperature) / 100, std::abs(s.temperature) % 100);
+        } else {
+          std::printf(",");
+        }
+        if (s.flags & kFlagHumidity) {
+          std::printf(",%u.%02u\n", s.humidity / 100u, s.humidity % 100u);
+        } else {
+          std::printf(",\n");
+        }
+      }
+      std::fflush(stdout);
+      std::vector<uint8_t> ack = encode_ack(frame.seq, credits);
+      lci::write_all(fd, ack.data(), ack.size());
+    }, [](const LinksView &links) {
+      for (size_t i = 0; i < links.count; i++) {
+        LinkStats l = links.link(i);
+        std::fprintf(stderr,
+                     "link %04X: rssi %d dBm, phy %u, samples %u/%u, supervision timeouts %u, "
+                     "gatt timeouts %u, retries %u, reconnects %u\n",
+                     l.sensor_id, l.rssi, l.phy, l.delivered, l.expected, l.supervision_timeouts,
+                     l.gatt_timeouts, l.retries, l.reconnects);
+      }
+    });
+  }
+  ::close(fd);
+  return 0;
+}
+
+int run_loopback(uint32_t samples, uint32_t sensors, uint8_t credits)
+{
+  int master = -1;
+  int slave = -1;
+  std::string slave_path;
+  if (!lci::open_pty_pair(master, slave, slave_path)) {
+    std::perror("pty");
+    return 1;
+  }
+  std::atomic<bool> stop{ false };
+  auto start = std::chrono::steady_clock::now();
+  std::thread firmware(emulate_firmware, master, samples, sensors, std::ref(stop));
+
+  StreamDecoder decoder;
+  uint8_t buf[4096];
+  uint32_t received = 0;
+  uint32_t mismatches = 0;
+  uint32_t link_errors = 0;
+  uint64_t bytes = 0;
+  auto deadline = start + std::chrono::seconds(30);
+  while (received < samples && std::chrono::steady_clock::now() < deadline) {
+    struct pollfd pfd = { slave, POLLIN, 0 };
+    if (::poll(&pfd, 1, 100) <= 0) {
+      continue;
+    }
+    ssize_t n = ::read(slave, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+    bytes += static_cast<uint64_t>(n);
+    decoder.feed(buf, static_cast<size_t>(n), [&](const FrameView &frame) {
+      for (size_t i = 0; i < frame.count; i++) {
+        if (!same_sample(frame.sample(i), expected_sample(received, sensors))) {
+          mismatches++;
+        }
+        received++;
+      }
+      std::vector<uint8_t> ack = encode_ack(frame.seq, credits);
+      lci::write_all(slave, ack.data(), ack.size());
+    }, [&](const LinksView &links) {
+      if (links.count != 1 || links.link(0).sensor_id != 0x1000 || links.link(0).rssi != -60) {
+        link_errors++;
+      }
+    });
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  stop.store(true);
+  firmware.join();
+  ::close(slave);
+  ::close(master);
+
+  const StreamDecoder::Stats &st = decoder.stats();
+  std::printf("pty %s: %u/%u samples, %llu frames, %llu bytes, %.2f bytes/sample\n",
+              slave_path.c_str(), received, samples,
+              static_cast<unsigned long long>(st.frames),
+              static_cast<unsigned long long>(bytes),
+              received ? static_cast<double>(bytes) / received : 0.0);
+  std::printf("crc errors %llu, skipped bytes %llu, lost frames %llu, mismatches %u\n",
+              static_cast<unsigned long long>(st.crc_errors),
+              static_cast<unsigned long long>(st.skipped_bytes),
+              static_cast<unsigned long long>(st.lost_frames), mismatches);
+  std::printf("link frames %llu, link errors %u\n",
+              static_cast<unsigned long long>(st.link_frames), link_errors);
+  std::printf("%.0f samples/s, %.1f s at 115200 baud\n",
+              seconds > 0 ? received / seconds : 0.0, bytes * 10.0 / 115200.0);
+  bool ok = received == samples && mismatches == 0 && st.crc_errors == 0 && st.lost_frames == 0
+            && link_errors == 0;
+  std::printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+const char *status_name(OtaStatus status)
+{
+  switch (status) {
+    case OtaStatus::ok: return "ok";
+    case OtaStatus::bad_command: return "bad command";
+    case OtaStatus::bad_state: return "not allowed now";
+    case OtaStatus::too_large: return "image larger than the storage slot";
+    case OtaStatus::storage_error: return "storage error";
+    case OtaStatus::bad_offset: return "bad offset";
+    case OtaStatus::crc_error: return "CRC mismatch";
+    case OtaStatus::no_image: return "no image cached";
+    case OtaStatus::no_target: return "no server to update";
+    case OtaStatus::not_gbl: return "not a GBL file";
+  }
+  return "unknown";
+}
+
+const char *phase_name(OtaPhase phase)
+{
+  switch (phase) {
+    case OtaPhase::queued: return "queued";
+    case OtaPhase::reboot: return "rebooting";
+    case OtaPhase::wait_apploader: return "wait apploader";
+    case OtaPhase::start: return "starting";
+    case OtaPhase::streaming: return "streaming";
+    case OtaPhase::finish: return "verifying";
+    case OtaPhase::done: return "done";
+    case OtaPhase::failed: return "failed";
+  }
+  return "unknown";
+}
+
+const char *result_name(uint8_t result)
+{
+  static const char *const kNames[] = { "", "link lost", "timeout", "write rejected",
+                                        "image rejected", "no apploader", "aborted",
+                                        "storage error" };
+  return result < sizeof(kNames) / sizeof(kNames[0]) ? kNames[result] : "unknown";
+}
+
+/* Command and answer exchange with the fleet OTA of a central client */
+class OtaSession {
+ public:
+  explicit OtaSession(int fd) : fd_(fd) {}
+
+  /* Wait for a status frame answering command, 0 for a periodic one */
+  bool wait(uint8_t command, int timeout_ms, OtaReport &report)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    uint8_t buf[512];
+    bool answered = false;
+    while (!answered) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) {
+        return false;
+      }
+      struct pollfd pfd = { fd_, POLLIN, 0 };
+      if (::poll(&pfd, 1, static_cast<int>(left.count())) <= 0) {
+        continue;
+      }
+      ssize_t n = ::read(fd_, buf, sizeof(buf));
+      if (n <= 0) {
+        return false;
+      }
+      decoder_.feed(buf, static_cast<size_t>(n), [](const FrameView &) {}, [](const LinksView &) {},
+                    [&](const OtaReport &r) {
+                      if (!answered && r.command == command) {
+                        report = r;
+                        answered = true;
+                      }
+                    });
+    }
+    return true;
+  }
+
+  /* Send a command until it is answered */
+  bool transact(const std::vector<uint8_t> &frame, OtaReport &report)
+  {
+    /* Delimiter and COBS code, then the type, which is never 0 */
+    uint8_t command = frame[2];
+    for (int attempt = 0; attempt < kCommandAttempts; attempt++) {
+      if (!lci::write_all(fd_, frame.data(), frame.size())) {
+        return false;
+      }
+      if (wait(command, kAnswerTimeoutMs, report)) {
+        return true;
+      }
+    }
+    std::fprintf(stderr, "no answer to command 0x%02x\n", command);
+    return false;
+  }
+
+ private:
+  int fd_;
+  StreamDecoder decoder_;
+};
+
+bool load_cache(OtaSession &session, const std::vector<uint8_t> &image, uint32_t crc)
+{
+  OtaReport report;
+  if (!session.transact(encode_cache_begin(static_cast<uint32_t>(image.size()), crc), report)) {
+    return false;
+  }
+  if (report.status != OtaStatus::ok) {
+    std::fprintf(stderr, "cache begin: %s\n", status_name(report.status));
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  size_t offset = 0;
+  while (offset < image.size()) {
+    size_t len = std::min(kCacheChunkMax, image.size() - offset);
+    if (!session.transact(encode_cache_data(static_cast<uint32_t>(offset), &image[offset], len), report)) {
+      return false;
+    }
+    if (report.status == OtaStatus::bad_offset) {
+      /* An answer was lost, continue where the cache is */
+      offset = report.cached;
+      continue;
+    }
+    if (report.status != OtaStatus::ok) {
+      std::fprintf(stderr, "cache data at %zu: %s\n", offset, status_name(report.status));
+      return false;
+    }
+    offset += len;
+    if ((offset / kCacheChunkMax) % 64 == 0 || offset == image.size()) {
+      std::fprintf(stderr, "\rcaching %zu/%zu bytes", offset, image.size());
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::fprintf(stderr, " in %.1f s\n", seconds);
+  if (!session.transact(encode_command(kCommandCacheEnd), report)) {
+    return false;
+  }
+  if (report.status != OtaStatus::ok) {
+    std::fprintf(stderr, "cache end: %s\n", status_name(report.status));
+    return false;
+  }
+  return true;
+}
+
+int run_ota(const std::string &device, const std::string &path, const std::vector<uint16_t> &targets,
+            bool reload)
+{
+  std::ifstream in(path, std::ios::binary);
+  std::vector<uint8_t> image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  lci::gbl::Gbl gbl;
+  std::string error;
+  if (image.empty() || !lci::gbl::parse(image.data(), image.size(), gbl, error)) {
+    std::fprintf(stderr, "%s: %s\n", path.c_str(), image.empty() ? "empty or unreadable file" : error.c_str());
+    return 1;
+  }
+  uint32_t crc = lci::gbl::crc32(image.data(), image.size());
+
+  int fd = lci::open_serial(device);
+  if (fd < 0) {
+    std::perror(device.c_str());
+    return 1;
+  }
+  OtaSession session(fd);
+  OtaReport report;
+  int result = 1;
+  if (!session.transact(encode_command(kCommandOtaQuery), report)) {
+    ::close(fd);
+    return 1;
+  }
+  if (!reload && report.size == image.size() && report.crc == crc && report.cached == image.size()) {
+    std::fprintf(stderr, "%s already cached\n", path.c_str());
+  } else if (!load_cache(session, image, crc)) {
+    ::close(fd);
+    return 1;
+  }
+
+  if (!session.transact(encode_ota_update(targets.data(), targets.size()), report)) {
+    ::close(fd);
+    return 1;
+  }
+  if (report.status != OtaStatus::ok) {
+    std::fprintf(stderr, "update: %s\n", status_name(report.status));
+    ::close(fd);
+    return 1;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::printf("updating %u servers with %zu bytes\n", report.count, image.size());
+  while (session.wait(0, kReportTimeoutMs, report)) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t finished = 0;
+    size_t done = 0;
+    for (size_t i = 0; i < report.count; i++) {
+      const OtaTarget &t = report.targets[i];
+      std::printf("%6.1f s %04X %-14s %6.1f%% %s\n", seconds, t.sensor_id, phase_name(t.phase),
+                  100.0 * t.offset / image.size(), result_name(t.result));
+      finished += (t.phase == OtaPhase::done || t.phase == OtaPhase::failed) ? 1 : 0;
+      done += t.phase == OtaPhase::done ? 1 : 0;
+    }
+    std::fflush(stdout);
+    if (finished == report.count) {
+      std::printf("%zu of %u servers updated in %.1f s\n", done, report.count, seconds);
+      result = done == report.count ? 0 : 1;
+      break;
+    }
+  }
+  ::close(fd);
+  return result;
+}
+
+bool parse_targets(const std::string &list, std::vector<uint16_t> &targets)
+{
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    std::string id = list.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    char *stop = nullptr;
+    unsigned long value = std::strtoul(id.c_str(), &stop, 16);
+    if (id.empty() || *stop != '\0' || value > 0xFFFF || targets.size() >= kOtaTargetsMax) {
+      return false;
+    }
+    targets.push_back(static_cast<uint16_t>(value));
+    pos = end == std::string::npos ? list.size() : end + 1;
+  }
+  return !targets.empty();
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+  std::string command = argv[1];
+  std::string device;
+  uint32_t samples = 10000;
+  uint32_t sensors = 16;
+  uint8_t credits = kDefaultCredits;
+  std::string file;
+  std::vector<uint16_t> targets;
+  bool reload = false;
+
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--credits" && i + 1 < argc) {
+      credits = static_cast<uint8_t>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--samples" && i + 1 < argc) {
+      samples = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--sensors" && i + 1 < argc) {
+      sensors = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+    } else if (arg == "--targets" && i + 1 < argc) {
+      if (!parse_targets(argv[++i], targets)) {
+        usage();
+        return 2;
+      }
+    } else if (arg == "--reload") {
+      reload = true;
+    } else if (device.empty() && arg[0] != '-') {
+      device = arg;
+    } else if (file.empty() && arg[0] != '-') {
+      file = arg;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (credits == 0 || sensors == 0) {
+    usage();
+    return 2;
+  }
+  if (command == "monitor" && !device.empty()) {
+    return run_monitor(device, credits);
+  }
+  if (command == "ota" && !device.empty() && !file.empty()) {
+    return run_ota(device, file, targets, reload);
+  }
+  if (command == "loopback") {
+    return run_loopback(samples, sensors, credits);
+  }
+  usage();
+  return 2;
+}
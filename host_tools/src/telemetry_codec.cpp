@@ -0,0 +1,371 @@
+/**
+ * @file telemetry_codec.cpp
+ * @brief Host side codec of the central client binary telemetry frames
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "telemetry_codec.hpp"
+
+namespace lci::telemetry {
+
+namespace {
+
+uint16_t get_le16(const uint8_t *src)
+{
+  return static_cast<uint16_t>(src[0] | (src[1] << 8));
+}
+
+uint32_t get_le32(const uint8_t *src)
+{
+  return static_cast<uint32_t>(get_le16(src)) | (static_cast<uint32_t>(get_le16(src + 2)) << 16);
+}
+
+void put_le16(uint8_t *dst, uint16_t value)
+{
+  dst[0] = static_cast<uint8_t>(value);
+  dst[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put_le32(uint8_t *dst, uint32_t value)
+{
+  put_le16(dst, static_cast<uint16_t>(value));
+  put_le16(dst + 2, static_cast<uint16_t>(value >> 16));
+}
+
+std::vector<uint8_t> delimit(const uint8_t *frame, size_t len)
+{
+  std::vector<uint8_t> out(len + len / 254 + 3);
+  out[0] = 0;
+  size_t encoded = cobs_encode(frame, len, &out[1]);
+  out[encoded + 1] = 0;
+  out.resize(encoded + 2);
+  return out;
+}
+
+}  // namespace
+
+Sample FrameView::sample(size_t index) const
+{
+  const uint8_t *src = samples + index * kSampleSize;
+  Sample s;
+  s.sensor_id = get_le16(src);
+  s.timestamp_ms = get_le32(src + 2);
+  s.temperature = static_cast<int16_t>(get_le16(src + 6));
+  s.humidity = get_le16(src + 8);
+  s.flags = src[10];
+  return s;
+}
+
+LinkStats LinksView::link(size_t index) const
+{
+  const uint8_t *src = records + index * kLinkSize;
+  LinkStats l;
+  l.sensor_id = get_le16(src);
+  l.rssi = static_cast<int8_t>(src[2]);
+  l.phy = src[3];
+  l.delivered = get_le32(src + 4);
+  l.expected = get_le32(src + 8);
+  l.supervision_timeouts = get_le16(src + 12);
+  l.gatt_timeouts = get_le16(src + 14);
+  l.retries = get_le16(src + 16);
+  l.reconnects = get_le16(src + 18);
+  return l;
+}
+
+uint16_t crc16(const uint8_t *data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+
+  while (len--) {
+    crc ^= static_cast<uint16_t>(*data++) << 8;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021)
+                           : static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+  size_t code_index = 0;
+  size_t out = 1;
+  uint8_t code = 1;
+
+  for (size_t i = 0; i < len; i++) {
+    if (src[i] != 0) {
+      dst[out++] = src[i];
+      code++;
+    }
+    if (src[i] == 0 || code == 0xFF) {
+      dst[code_index] = code;
+      code_index = out++;
+      code = 1;
+    }
+  }
+  dst[code_index] = code;
+  return out;
+}
+
+size_t cobs_decode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+  size_t in = 0;
+  size_t out = 0;
+
+  while (in < len) {
+    uint8_t code = src[in++];
+    if (code == 0 || in + code - 1 > len) {
+      return 0;
+    }
+    for (uint8_t i = 1; i < code; i++) {
+      dst[out++] = src[in++];
+    }
+    if (code != 0xFF && in < len) {
+      dst[out++] = 0;
+    }
+  }
+  return out;
+}
+
+std::vector<uint8_t> encode_samples(uint8_t seq, const Sample *samples, size_t count)
+{
+  std::array<uint8_t, kFrameMaxSize> frame{};
+  if (count > kBatchMax) {
+    count = kBatchMax;
+  }
+  frame[0] = kFrameSamples;
+  frame[1] = seq;
+  frame[2] = static_cast<uint8_t>(count);
+  uint8_t *dst = &frame[kHeaderSize];
+  for (size_t i = 0; i < count; i++, dst += kSampleSize) {
+    put_le16(dst, samples[i].sensor_id);
+    put_le32(dst + 2, samples[i].timestamp_ms);
+    put_le16(dst + 6, static_cast<uint16_t>(samples[i].temperature));
+    put_le16(dst + 8, samples[i].humidity);
+    dst[10] = samples[i].flags;
+  }
+  size_t len = kHeaderSize + count * kSampleSize;
+  put_le16(&frame[len], crc16(frame.data(), len));
+  return delimit(frame.data(), len + kCrcSize);
+}
+
+std::vector<uint8_t> encode_ack(uint8_t seq, uint8_t credits)
+{
+  uint8_t frame[kAckSize] = { kFrameAck, seq, credits, 0, 0 };
+  put_le16(&frame[3], crc16(frame, kAckSize - kCrcSize));
+  return delimit(frame, kAckSize);
+}
+
+std::vector<uint8_t> encode_links(const LinkStats *links, size_t count)
+{
+  std::array<uint8_t, kLinksFrameMaxSize> frame{};
+  if (count > kLinksMax) {
+    count = kLinksMax;
+  }
+  frame[0] = kFrameLinks;
+  frame[1] = static_cast<uint8_t>(count);
+  uint8_t *dst = &frame[kLinksHeaderSize];
+  for (size_t i = 0; i < count; i++, dst += kLinkSize) {
+    put_le16(dst, links[i].sensor_id);
+    dst[2] = static_cast<uint8_t>(links[i].rssi);
+    dst[3] = links[i].phy;
+    put_le32(dst + 4, links[i].delivered);
+    put_le32(dst + 8, links[i].expected);
+    put_le16(dst + 12, links[i].supervision_timeouts);
+    put_le16(dst + 14, links[i].gatt_timeouts);
+    put_le16(dst + 16, links[i].retries);
+    put_le16(dst + 18, links[i].reconnects);
+  }
+  size_t len = kLinksHeaderSize + count * kLinkSize;
+  put_le16(&frame[len], crc16(frame.data(), len));
+  return delimit(frame.data(), len + kCrcSize);
+}
+
+std::vector<uint8_t> encode_cache_begin(uint32_t size, uint32_t crc)
+{
+  uint8_t frame[1 + 8 + kCrcSize] = { kCommandCacheBegin };
+  put_le32(&frame[1], size);
+  put_le32(&frame[5], crc);
+  put_le16(&frame[9], crc16(frame, 9));
+  return delimit(frame, sizeof(frame));
+}
+
+std::vector<uint8_t> encode_cache_data(uint32_t offset, const uint8_t *data, size_t len)
+{
+  std::array<uint8_t, 1 + 4 + kCacheChunkMax + kCrcSize> frame{};
+  if (len > kCacheChunkMax) {
+    len = kCacheChunkMax;
+  }
+  frame[0] = kCommandCacheData;
+  put_le32(&frame[1], offset);
+  std::copy(data, data + len, &frame[5]);
+  put_le16(&frame[5 + len], crc16(frame.data(), 5 + len));
+  return delimit(frame.data(), 5 + len + kCrcSize);
+}
+
+std::vector<uint8_t> encode_ota_update(const uint16_t *sensor_ids, size_t count)
+{
+  std::array<uint8_t, 2 + 2 * kOtaTargetsMax + kCrcSize> frame{};
+  if (count > kOtaTargetsMax) {
+    count = kOtaTargetsMax;
+  }
+  frame[0] = kCommandOtaUpdate;
+  frame[1] = static_cast<uint8_t>(count);
+  for (size_t i = 0; i < count; i++) {
+    put_le16(&frame[2 + 2 * i], sensor_ids[i]);
+  }
+  size_t len = 2 + 2 * count;
+  put_le16(&frame[len], crc16(frame.data(), len));
+  return delimit(frame.data(), len + kCrcSize);
+}
+
+std::vector<uint8_t> encode_command(uint8_t type)
+{
+  uint8_t frame[1 + kCrcSize] = { type };
+  put_le16(&frame[1], crc16(frame, 1));
+  return delimit(frame, sizeof(frame));
+}
+
+std::vector<uint8_t> encode_ota_report(const OtaReport &report)
+{
+  std::array<uint8_t, kOtaFrameMaxSize> frame{};
+  size_t count = std::min<size_t>(report.count, kOtaTargetsMax);
+  frame[0] = kFrameOta;
+  frame[1] = report.command;
+  frame[2] = static_cast<uint8_t>(report.status);
+  put_le32(&frame[3], report.size);
+  put_le32(&frame[7], report.crc);
+  put_le32(&frame[11], report.cached);
+  frame[15] = static_cast<uint8_t>(count);
+  uint8_t *dst = &frame[kOtaHeaderSize];
+  for (size_t i = 0; i < count; i++, dst += kOtaTargetSize) {
+    put_le16(dst, report.targets[i].sensor_id);
+    dst[2] = static_cast<uint8_t>(report.targets[i].phase);
+    dst[3] = report.targets[i].result;
+    put_le32(dst + 4, report.targets[i].offset);
+  }
+  size_t len = kOtaHeaderSize + count * kOtaTargetSize;
+  put_le16(&frame[len], crc16(frame.data(), len));
+  return delimit(frame.data(), len + kCrcSize);
+}
+
+bool parse_frame(const uint8_t *data, size_t len, FrameView &frame)
+{
+  if (len < kHeaderSize + kCrcSize || data[0] != kFrameSamples) {
+    return false;
+  }
+  size_t count = data[2];
+  if (count > kBatchMax || len != kHeaderSize + count * kSampleSize + kCrcSize) {
+    return false;
+  }
+  if (crc16(data, len - kCrcSize) != get_le16(data + len - kCrcSize)) {
+    return false;
+  }
+  frame.type = data[0];
+  frame.seq = data[1];
+  frame.count = static_cast<uint8_t>(count);
+  frame.samples = data + kHeaderSize;
+  return true;
+}
+
+bool parse_ack(const uint8_t *data, size_t len, uint8_t &seq, uint8_t &credits)
+{
+  if (len != kAckSize || data[0] != kFrameAck
+      || crc16(data, kAckSize - kCrcSize) != get_le16(data + kAckSize - kCrcSize)) {
+    return false;
+  }
+  seq = data[1];
+  credits = data[2];
+  return true;
+}
+
+bool parse_links(const uint8_t *data, size_t len, LinksView &links)
+{
+  if (len < kLinksHeaderSize + kCrcSize || data[0] != kFrameLinks) {
+    return false;
+  }
+  size_t count = data[1];
+  if (count > kLinksMax || len != kLinksHeaderSize + count * kLinkSize + kCrcSize) {
+    return false;
+  }
+  if (crc16(data, len - kCrcSize) != get_le16(data + len - kCrcSize)) {
+    return false;
+  }
+  links.count = static_cast<uint8_t>(count);
+  links.records = data + kLinksHeaderSize;
+  return true;
+}
+
+bool parse_ota_report(const uint8_t *data, size_t len, OtaReport &report)
+{
+  if (len < kOtaHeaderSize + kCrcSize || data[0] != kFrameOta) {
+    return false;
+  }
+  size_t count = data[15];
+  if (count > kOtaTargetsMax || len != kOtaHeaderSize + count * kOtaTargetSize + kCrcSize) {
+    return false;
+  }
+  if (crc16(data, len - kCrcSize) != get_le16(data + len - kCrcSize)) {
+    return false;
+  }
+  report.command = data[1];
+  report.status = static_cast<OtaStatus>(data[2]);
+  report.size = get_le32(data + 3);
+  report.crc = get_le32(data + 7);
+  report.cached = get_le32(data + 11);
+  report.count = static_cast<uint8_t>(count);
+  const uint8_t *src = data + kOtaHeaderSize;
+  for (size_t i = 0; i < count; i++, src += kOtaTargetSize) {
+    report.targets[i].sensor_id = get_le16(src);
+    report.targets[i].phase = static_cast<OtaPhase>(src[2]);
+    report.targets[i].result = src[3];
+    report.targets[i].offset = get_le32(src + 4);
+  }
+  return true;
+}
+
+uint8_t StreamDecoder::finish(FrameView &frame, LinksView &links, OtaReport &ota)
+{
+  size_t len = pending_;
+  pending_ = 0;
+  if (len == 0) {
+    return 0;
+  }
+  if (len > encoded_.size()) {
+    stats_.skipped_bytes += len;
+    return 0;
+  }
+  size_t decoded = cobs_decode(encoded_.data(), len, decoded_.data());
+  if (decoded != 0 && parse_links(decoded_.data(), decoded, links)) {
+    stats_.link_frames++;
+    return kFrameLinks;
+  }
+  if (decoded != 0 && parse_ota_report(decoded_.data(), decoded, ota)) {
+    stats_.ota_frames++;
+    return kFrameOta;
+  }
+  if (decoded == 0 || !parse_frame(decoded_.data(), decoded, frame)) {
+    /* A frame of the right shape with a bad CRC is a transmission error,
+     * anything else is foreign data such as log text */
+    bool shaped = decoded >= kHeaderSize + kCrcSize && decoded_[0] == kFrameSamples
+                  && decoded == kHeaderSize + decoded_[2] * kSampleSize + kCrcSize;
+    if (shaped) {
+      stats_.crc_errors++;
+    } else {
+      stats_.skipped_bytes += len;
+    }
+    return 0;
+  }
+  if (have_seq_) {
+    stats_.lost_frames += static_cast<uint8_t>(frame.seq - last_seq_ - 1);
+  }
+  have_seq_ = true;
+  last_seq_ = frame.seq;
+  stats_.frames++;
+  stats_.samples += frame.count;
+  return kFrameSamples;
+}
+
+}  // namespace lci::telemetry
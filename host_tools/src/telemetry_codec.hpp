@@ -0,0 +1,266 @@
+/**
+ * @file telemetry_codec.hpp
+ * @brief Host side codec of the central client binary telemetry frames
+ *
+ * The frame layout is defined by si7021_central_client/src/lci_telemetry.h.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_TELEMETRY_CODEC_HPP_
+#define LCI_TELEMETRY_CODEC_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lci::telemetry {
+
+constexpr uint8_t kFrameSamples = 0x01;
+constexpr uint8_t kFrameAck = 0x02;
+constexpr uint8_t kFrameLinks = 0x03;
+constexpr uint8_t kFrameOta = 0x04;
+
+/* Fleet OTA commands sent to the firmware */
+constexpr uint8_t kCommandCacheBegin = 0x10;
+constexpr uint8_t kCommandCacheData = 0x11;
+constexpr uint8_t kCommandCacheEnd = 0x12;
+constexpr uint8_t kCommandOtaUpdate = 0x13;
+constexpr uint8_t kCommandOtaAbort = 0x14;
+constexpr uint8_t kCommandOtaQuery = 0x15;
+
+constexpr uint8_t kFlagTemperature = 0x01;
+constexpr uint8_t kFlagHumidity = 0x02;
+/* The timestamp is the sampling instant of a server synchronized to the
+ * central clock */
+constexpr uint8_t kFlagSynced = 0x04;
+/* The reading of a server out of range came through a relay, the timestamp
+ * is the time the relay heard it */
+constexpr uint8_t kFlagRelayed = 0x08;
+
+constexpr size_t kHeaderSize = 3;
+constexpr size_t kSampleSize = 11;
+constexpr size_t kCrcSize = 2;
+constexpr size_t kAckSize = 5;
+constexpr size_t kBatchMax = 8;
+constexpr size_t kFrameMaxSize = kHeaderSize + kBatchMax * kSampleSize + kCrcSize;
+constexpr size_t kLinksHeaderSize = 2;
+constexpr size_t kLinkSize = 20;
+constexpr size_t kLinksMax = 8;
+constexpr size_t kLinksFrameMaxSize = kLinksHeaderSize + kLinksMax * kLinkSize + kCrcSize;
+constexpr size_t kCacheChunkMax = 128;
+constexpr size_t kOtaHeaderSize = 16;
+constexpr size_t kOtaTargetSize = 8;
+constexpr size_t kOtaTargetsMax = 8;
+constexpr size_t kOtaFrameMaxSize = kOtaHeaderSize + kOtaTargetsMax * kOtaTargetSize + kCrcSize;
+constexpr size_t kAnyFrameMaxSize = std::max({kFrameMaxSize, kLinksFrameMaxSize, kOtaFrameMaxSize});
+
+/* Status of a fleet OTA command, lci_fleet_ota_status_t */
+enum class OtaStatus : uint8_t {
+  ok = 0x00,
+  bad_command = 0x01,
+  bad_state = 0x02,
+  too_large = 0x03,
+  storage_error = 0x04,
+  bad_offset = 0x05,
+  crc_error = 0x06,
+  no_image = 0x07,
+  no_target = 0x08,
+  not_gbl = 0x09
+};
+
+/* Phase of a fleet OTA target, lci_fleet_ota_phase_t */
+enum class OtaPhase : uint8_t {
+  queued = 0x00,
+  reboot = 0x01,
+  wait_apploader = 0x02,
+  start = 0x03,
+  streaming = 0x04,
+  finish = 0x05,
+  done = 0x06,
+  failed = 0x07
+};
+
+/* One sensor sample, temperature and humidity in 0.01 units */
+struct Sample {
+  uint16_t sensor_id = 0;
+  uint32_t timestamp_ms = 0;
+  int16_t temperature = 0;
+  uint16_t humidity = 0;
+  uint8_t flags = 0;
+};
+
+/* Statistics of one central to sensor link */
+struct LinkStats {
+  uint16_t sensor_id = 0;
+  int8_t rssi = 0;
+  uint8_t phy = 0;
+  uint32_t delivered = 0;
+  uint32_t expected = 0;
+  uint16_t supervision_timeouts = 0;
+  uint16_t gatt_timeouts = 0;
+  uint16_t retries = 0;
+  uint16_t reconnects = 0;
+};
+
+/* Decoded link statistics frame, the records stay in the decoder buffer */
+struct LinksView {
+  uint8_t count = 0;
+  const uint8_t *records = nullptr;
+
+  LinkStats link(size_t index) const;
+};
+
+/* Progress of one server in a fleet OTA update */
+struct OtaTarget {
+  uint16_t sensor_id = 0;
+  OtaPhase phase = OtaPhase::queued;
+  /* lci_fleet_ota_result_t, 0 unless failed */
+  uint8_t result = 0;
+  uint32_t offset = 0;
+};
+
+/* Decoded fleet OTA status frame */
+struct OtaReport {
+  /* Command answered, 0 for a periodic report */
+  uint8_t command = 0;
+  OtaStatus status = OtaStatus::ok;
+  uint32_t size = 0;
+  uint32_t crc = 0;
+  uint32_t cached = 0;
+  uint8_t count = 0;
+  std::array<OtaTarget, kOtaTargetsMax> targets{};
+};
+
+/* Decoded samples frame, the samples stay in the decoder buffer */
+struct FrameView {
+  uint8_t type = 0;
+  uint8_t seq = 0;
+  uint8_t count = 0;
+  const uint8_t *samples = nullptr;
+
+  Sample sample(size_t index) const;
+};
+
+/* CRC-16/CCITT-FALSE */
+uint16_t crc16(const uint8_t *data, size_t len);
+
+/* COBS encoder, dst must hold len + len / 254 + 1 bytes, no delimiter */
+size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst);
+
+/* COBS decoder, dst must hold len bytes, returns 0 on invalid input */
+size_t cobs_decode(const uint8_t *src, size_t len, uint8_t *dst);
+
+/* Delimited, encoded samples frame as the firmware sends it */
+std::vector<uint8_t> encode_samples(uint8_t seq, const Sample *samples, size_t count);
+
+/* Delimited, encoded acknowledgement frame sent back to the firmware */
+std::vector<uint8_t> encode_ack(uint8_t seq, uint8_t credits);
+
+/* Delimited, encoded link statistics frame as the firmware sends it */
+std::vector<uint8_t> encode_links(const LinkStats *links, size_t count);
+
+/* Delimited, encoded fleet OTA commands sent to the firmware */
+std::vector<uint8_t> encode_cache_begin(uint32_t size, uint32_t crc);
+std::vector<uint8_t> encode_cache_data(uint32_t offset, const uint8_t *data, size_t len);
+std::vector<uint8_t> encode_ota_update(const uint16_t *sensor_ids, size_t count);
+/* Cache end, abort and query, the commands without payload */
+std::vector<uint8_t> encode_command(uint8_t type);
+
+/* Delimited, encoded fleet OTA status frame as the firmware sends it */
+std::vector<uint8_t> encode_ota_report(const OtaReport &report);
+
+/* Parse a decoded frame, returns false if the length, type or CRC is wrong */
+bool parse_frame(const uint8_t *data, size_t len, FrameView &frame);
+
+/* Parse a decoded acknowledgement frame */
+bool parse_ack(const uint8_t *data, size_t len, uint8_t &seq, uint8_t &credits);
+
+/* Parse a decoded link statistics frame */
+bool parse_links(const uint8_t *data, size_t len, LinksView &links);
+
+/* Parse a decoded fleet OTA status frame */
+bool parse_ota_report(const uint8_t *data, size_t len, OtaReport &report);
+
+/* Incremental stream decoder.
+ * Bytes are fed as they come from the serial port. Every 0x00 delimited
+ * chunk is decoded into a fixed buffer and reported to the handler without
+ * further copies. Link statistics frames go to the optional second handler,
+ * fleet OTA status frames to the optional third one.
+ * Chunks that are not valid frames, such as log text sharing the stream, are
+ * counted and skipped. */
+class StreamDecoder {
+ public:
+  struct Stats {
+    uint64_t frames = 0;
+    uint64_t samples = 0;
+    uint64_t crc_errors = 0;
+    uint64_t skipped_bytes = 0;
+    uint64_t lost_frames = 0;
+    uint64_t link_frames = 0;
+    uint64_t ota_frames = 0;
+  };
+
+  template <typename Handler>
+  void feed(const uint8_t *data, size_t len, Handler &&handler)
+  {
+    feed(data, len, handler, [](const LinksView &) {});
+  }
+
+  template <typename Handler, typename LinksHandler>
+  void feed(const uint8_t *data, size_t len, Handler &&handler, LinksHandler &&links_handler)
+  {
+    feed(data, len, handler, links_handler, [](const OtaReport &) {});
+  }
+
+  template <typename Handler, typename LinksHandler, typename OtaHandler>
+  void feed(const uint8_t *data, size_t len, Handler &&handler, LinksHandler &&links_handler,
+            OtaHandler &&ota_handler)
+  {
+    for (size_t i = 0; i < len; i++) {
+      if (data[i] != 0) {
+        if (pending_ < encoded_.size()) {
+          encoded_[pending_] = data[i];
+        }
+        pending_++;
+        continue;
+      }
+      FrameView frame;
+      LinksView links;
+      switch (finish(frame, links, ota_)) {
+        case kFrameSamples:
+          handler(frame);
+          break;
+        case kFrameLinks:
+          links_handler(links);
+          break;
+        case kFrameOta:
+          ota_handler(ota_);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  const Stats &stats() const { return stats_; }
+
+ private:
+  /* Returns the type of the valid frame decoded, 0 if none */
+  uint8_t finish(FrameView &frame, LinksView &links, OtaReport &ota);
+
+  std::array<uint8_t, kAnyFrameMaxSize + kAnyFrameMaxSize / 254 + 1> encoded_{};
+  std::array<uint8_t, kAnyFrameMaxSize + kAnyFrameMaxSize / 254 + 1> decoded_{};
+  size_t pending_ = 0;
+  OtaReport ota_;
+  bool have_seq_ = false;
+  uint8_t last_seq_ = 0;
+  Stats stats_;
+};
+
+}  // namespace lci::telemetry
+
+#endif  // LCI_TELEMETRY_CODEC_HPP_
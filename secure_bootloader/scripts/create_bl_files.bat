@@ -27,6 +27,15 @@ set UARTDFU_FULL_NAME=full
 set GBL_SIGING_KEY_FILE=app-sign-key.pem
 set GBL_ENCRYPT_KEY_FILE=app-encrypt-key.txt
 
+:: public key of the sign key file, checks the signed GBL files when present,
+:: PATH_LCI_GBL env var to set path for the lci_gbl host tool
+set GBL_VERIFY_KEY_FILE=signing-key.pub
+if "%PATH_LCI_GBL%"=="" (
+  set LCI_GBL=lci_gbl
+) else (
+  set LCI_GBL=%PATH_LCI_GBL%
+)
+
 :: bootlader file name
 set BOOTLOADER_FILE=bootloader-second-stage.s37
 
@@ -275,6 +284,18 @@ echo.
   )
 )
 
+:: check the signatures of all signed GBL files at once
+if exist %GBL_VERIFY_KEY_FILE% (
+  echo.
+  echo **********************************************************************
+  echo Verifying signed .gbl files
+  echo **********************************************************************
+  echo.
+  set GBL_SIGNED_FILES=
+  for %%f in ("%PATH_GBL%\*-signed*.gbl") do call set GBL_SIGNED_FILES=%%GBL_SIGNED_FILES%% "%%f"
+  call "%LCI_GBL%" verify --require-signed --key %GBL_VERIFY_KEY_FILE% %%GBL_SIGNED_FILES%%
+)
+
 :: clean up output dir
 del "%PATH_GBL%\*.srec"
 
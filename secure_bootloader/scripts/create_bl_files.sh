@@ -31,6 +31,25 @@ GBL_ENCRYPT_KEY_FILE="app-encrypt-key.txt"
 # bootlader file name
 BOOTLOADER_FILE="bootloader-second-stage.s37"
 
+# signed application GBL file installed on the devices, base of the delta update
+DELTA_BASE_FILE="previous-application-signed.gbl"
+
+# use PATH_LCI_DELTA env var to set path for the lci_delta host tool
+LCI_DELTA="${PATH_LCI_DELTA:-lci_delta}"
+
+# use GBL_COMPRESS=lz4 env var to create LZ4 compressed files for OTA,
+# PATH_LCI_LZ4 env var to set path for the lci_lz4 host tool
+LCI_LZ4="${PATH_LCI_LZ4:-lci_lz4}"
+if [[ "${GBL_COMPRESS}" == "lz4" ]]; then
+  # encrypted data does not compress, commander compresses before encrypting
+  GBL_ENCRYPT_COMPRESS="--compress lz4"
+fi
+
+# public key of the sign key file, checks the signed GBL files when present,
+# PATH_LCI_GBL env var to set path for the lci_gbl host tool
+GBL_VERIFY_KEY_FILE="signing-key.pub"
+LCI_GBL="${PATH_LCI_GBL:-lci_gbl}"
+
 # project path
 PATH_PROJ="$1"
 
@@ -107,6 +126,19 @@ else
   echo
 fi
 
+if [[ -f "$DELTA_BASE_FILE" ]]; then
+  echo "Delta base file was found"
+else
+  echo "Delta base file was not found"
+  echo "---- DELTA GBL FILE GENERATION ---------------------------------------"
+  echo "To generate a signed delta update file, copy the signed application"
+  echo "GBL file installed on the devices into the root folder of the project,"
+  echo "rename it to 'previous-application-signed.gbl', build lci_delta from"
+  echo "the host_tools folder and rerun the script file."
+  echo "----------------------------------------------------------------------"
+  echo
+fi
+
 echo "**********************************************************************"
 echo "Converting .out to .gbl files"
 echo "**********************************************************************"
@@ -171,14 +203,14 @@ if [[ -f $GBL_ENCRYPT_KEY_FILE ]]; then
   echo
   if [[ -f $BOOTLOADER_FILE ]]; then
     echo "Bootloader file was found"
-    "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-bootloader-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} --bootloader ${BOOTLOADER_FILE}
+    "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-bootloader-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS} --bootloader ${BOOTLOADER_FILE}
   else
-    "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE}
+    "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS}
   fi
   echo
-  "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLI_NAME}-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLI_NAME}.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE}
+  "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLI_NAME}-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLI_NAME}.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS}
   echo
-  "${COMMANDER}" gbl create "${PATH_GBL}/${UARTDFU_FULL_NAME}-encrypted.gbl" --app "${PATH_GBL}/${UARTDFU_FULL_NAME}.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE}
+  "${COMMANDER}" gbl create "${PATH_GBL}/${UARTDFU_FULL_NAME}-encrypted.gbl" --app "${PATH_GBL}/${UARTDFU_FULL_NAME}.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS}
 fi
 
 # create signed GBL file for secure boot if sign-key file exists
@@ -201,6 +233,16 @@ if [[ -f $GBL_SIGING_KEY_FILE ]]; then
   "${COMMANDER}" convert "${PATH_GBL}/${OTA_APPLI_NAME}.srec" --secureboot --keyfile ${GBL_SIGING_KEY_FILE} -o "${PATH_GBL}/${OTA_APPLI_NAME}-signed.srec"
   "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLI_NAME}-signed.gbl" --app "${PATH_GBL}/${OTA_APPLI_NAME}-signed.srec" --sign ${GBL_SIGING_KEY_FILE}
   echo
+  # create signed delta GBL file if the installed application is known
+  if [[ -f $DELTA_BASE_FILE ]]; then
+    echo "Creating ${OTA_APPLI_NAME}-delta-signed.gbl from ${DELTA_BASE_FILE}"
+    "${LCI_DELTA}" create --old ${DELTA_BASE_FILE} --new "${PATH_GBL}/${OTA_APPLI_NAME}-signed.gbl" -o "${PATH_GBL}/${OTA_APPLI_NAME}.delta"
+    if [ $? -eq 0 ]; then
+      "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLI_NAME}-delta-signed.gbl" --metadata "${PATH_GBL}/${OTA_APPLI_NAME}.delta" --sign ${GBL_SIGING_KEY_FILE}
+      rm "${PATH_GBL}/${OTA_APPLI_NAME}.delta"
+    fi
+    echo
+  fi
   if [[ -f "${PATH_GBL}/${OTA_APPLO_NAME}-signed.srec" ]]; then
     "${COMMANDER}" convert "${PATH_GBL}/${OTA_APPLO_NAME}-signed.srec" "${PATH_GBL}/${OTA_APPLI_NAME}-signed.srec" -o "${PATH_GBL}/${UARTDFU_FULL_NAME}-signed.srec"
   else
@@ -218,15 +260,15 @@ if [[ -f $GBL_SIGING_KEY_FILE ]]; then
     if [[ -f "${PATH_GBL}/${OTA_APPLO_NAME}-signed.srec" ]]; then
       if [[ -f $BOOTLOADER_FILE ]]; then
         echo "Bootloader file was found"
-        "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-bootloader-signed-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}-signed.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} --sign ${GBL_SIGING_KEY_FILE} --bootloader ${BOOTLOADER_FILE}
+        "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-bootloader-signed-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}-signed.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS} --sign ${GBL_SIGING_KEY_FILE} --bootloader ${BOOTLOADER_FILE}
       else
-        "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-signed-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}-signed.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} --sign ${GBL_SIGING_KEY_FILE}
+        "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-signed-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}-signed.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS} --sign ${GBL_SIGING_KEY_FILE}
       fi
       echo
     fi
-    "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLI_NAME}-signed-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLI_NAME}-signed.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} --sign ${GBL_SIGING_KEY_FILE}
+    "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLI_NAME}-signed-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLI_NAME}-signed.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS} --sign ${GBL_SIGING_KEY_FILE}
     echo
-    "${COMMANDER}" gbl create "${PATH_GBL}/${UARTDFU_FULL_NAME}-signed-encrypted.gbl" --app "${PATH_GBL}/${UARTDFU_FULL_NAME}-signed.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} --sign ${GBL_SIGING_KEY_FILE}
+    "${COMMANDER}" gbl create "${PATH_GBL}/${UARTDFU_FULL_NAME}-signed-encrypted.gbl" --app "${PATH_GBL}/${UARTDFU_FULL_NAME}-signed.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS} --sign ${GBL_SIGING_KEY_FILE}
   fi
 else
   echo
@@ -264,18 +306,43 @@ else
     if [[ -f "${PATH_GBL}/${OTA_APPLO_NAME}-crc.srec" ]]; then
       if [[ -f $BOOTLOADER_FILE ]]; then
         echo "Bootloader file was found"
-        "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-bootloader-crc-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}-crc.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} --bootloader ${BOOTLOADER_FILE}
+        "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-bootloader-crc-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}-crc.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS} --bootloader ${BOOTLOADER_FILE}
       else
-        "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-crc-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}-crc.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE}
+        "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLO_NAME}-crc-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLO_NAME}-crc.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS}
       fi
       echo
     fi
-    "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLI_NAME}-crc-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLI_NAME}-crc.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE}
+    "${COMMANDER}" gbl create "${PATH_GBL}/${OTA_APPLI_NAME}-crc-encrypted.gbl" --app "${PATH_GBL}/${OTA_APPLI_NAME}-crc.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS}
     echo
-    "${COMMANDER}" gbl create "${PATH_GBL}/${UARTDFU_FULL_NAME}-crc-encrypted.gbl" --app "${PATH_GBL}/${UARTDFU_FULL_NAME}-crc.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE}
+    "${COMMANDER}" gbl create "${PATH_GBL}/${UARTDFU_FULL_NAME}-crc-encrypted.gbl" --app "${PATH_GBL}/${UARTDFU_FULL_NAME}-crc.srec" --encrypt ${GBL_ENCRYPT_KEY_FILE} ${GBL_ENCRYPT_COMPRESS}
   fi
 fi
 
+# compress the GBL files as a whole for the in-application OTA decompressor
+if [[ "${GBL_COMPRESS}" == "lz4" ]]; then
+  echo
+  echo "**********************************************************************"
+  echo "Creating LZ4 compressed .gbl.lz4 files"
+  echo "**********************************************************************"
+  echo
+  for GBL_FILE in "${PATH_GBL}"/*.gbl; do
+    case "${GBL_FILE}" in
+      *-encrypted.gbl) ;;
+      *) "${LCI_LZ4}" compress "${GBL_FILE}" -o "${GBL_FILE}.lz4" ;;
+    esac
+  done
+fi
+
+# check the signatures of all signed GBL files at once
+if [[ -f $GBL_VERIFY_KEY_FILE ]]; then
+  echo
+  echo "**********************************************************************"
+  echo "Verifying signed .gbl files"
+  echo "**********************************************************************"
+  echo
+  "${LCI_GBL}" verify --require-signed --key ${GBL_VERIFY_KEY_FILE} "${PATH_GBL}"/*-signed*.gbl
+fi
+
 # clean up output dir
 rm "${PATH_GBL}"/*.srec
 
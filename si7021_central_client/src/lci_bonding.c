@@ -0,0 +1,316 @@
+/**
+ * @file lci_bonding.c
+ * @brief Bonding with LE Secure Connections for encrypted reconnects
+ *
+ * The central pairs once with each server, Just Works with LE Secure
+ * Connections, and both sides keep the long term key. The stack stores the
+ * bonds in NVM3, so a reconnect of a bonded server, also after a reset of
+ * either side, is encrypted with the stored key by a single encryption
+ * procedure of the controller: no new key exchange, no new pairing. The
+ * bonding table holds LCI_BONDING_MAX bonds, a new server replaces the one
+ * seen the longest time ago.
+ *
+ * The central starts the encryption as soon as a link opens and holds the
+ * reads of the readings until the link is encrypted. A server that lost the
+ * bond (erased or replaced) rejects the stored key: the stale bond is
+ * deleted and the server paired again once. Links that cannot be encrypted
+ * carry on unencrypted rather than losing the readings.
+ *
+ * The time from the connection to the encryption is kept for the resumed
+ * bonds and the new pairings, and logged with the link statistics.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "sl_sleeptimer.h"
+#include "lci_bonding.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Encryption of a link */
+typedef enum {
+  link_encrypting,
+  link_encrypted,
+  link_unencrypted
+} link_state_t;
+/* Connection of a server */
+typedef struct {
+  uint8_t connection;
+  uint16_t server_id;
+  /* Bond found when the connection opened */
+  uint8_t bonding;
+  link_state_t state;
+  /* The stale bond was deleted and the server paired again */
+  bool repaired;
+  uint32_t opened_ms;
+} link_t;
+/* Time from the connection to the encryption */
+typedef struct {
+  uint32_t count;
+  uint32_t total_ms;
+  uint32_t max_ms;
+} setup_stats_t;
+static link_t links[SL_BT_CONFIG_MAX_CONNECTIONS];
+static setup_stats_t resumed_stats;
+static setup_stats_t paired_stats;
+static uint32_t failed_count;
+static uint32_t repaired_count;
+/* Local functions */
+static uint32_t local_ms(void);
+static link_t *find_link(uint8_t connection);
+static void add_setup_time(setup_stats_t *stats, uint32_t ms);
+static void log_setup_time(const char *what, const setup_stats_t *stats);
+/**
+* @brief Local time in milliseconds since the boot
+ *
+* @param[in] None
+*
+* @retval milliseconds, wrapping at 32 bits
+*/
+static uint32_t local_ms(void)
+{
+  uint64_t ms = 0;
+
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return (uint32_t)ms;
+}
+/**
+* @brief Find a server connection
+ *
+* @param[in] connection connection handle
+*
+* @retval link, NULL if not known
+*/
+static link_t *find_link(uint8_t connection)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == connection) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Account the time a link took to be encrypted
+ *
+* @param[in] stats statistics to update
+* @param[in] ms    time from the connection to the encryption
+*
+* @retval None
+*/
+static void add_setup_time(setup_stats_t *stats, uint32_t ms)
+{
+  stats->count++;
+  stats->total_ms += ms;
+  if (ms > stats->max_ms) {
+    stats->max_ms = ms;
+  }
+}
+/**
+* @brief Log the encryption times of the links
+ *
+* @param[in] what  kind of encryption
+* @param[in] stats statistics to log
+*
+* @retval None
+*/
+static void log_setup_time(const char *what, const setup_stats_t *stats)
+{
+  app_log_info("Bonding: %lu %s, %lu ms average, %lu ms max\n",
+               (unsigned long)stats->count,
+               what,
+               (unsigned long)((stats->count != 0) ? (stats->total_ms / stats->count) : 0),
+               (unsigned long)stats->max_ms);
+}
+/**
+* @brief Configure the security manager, before the first connection
+ *
+* @param[in] None
+*
+* @retval SL_STATUS_OK if configured, error code otherwise
+*/
+sl_status_t lci_bonding_init(void)
+{
+  sl_status_t sc;
+
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    links[i].connection = CONNECTION_HANDLE_INVALID;
+  }
+  sc = sl_bt_sm_configure(LCI_BONDING_SM_FLAGS, sl_bt_sm_io_capability_noinputnooutput);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  sc = sl_bt_sm_store_bonding_configuration(LCI_BONDING_MAX, LCI_BONDING_POLICY_LRU);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  return sl_bt_sm_set_bondable_mode(1);
+}
+/**
+* @brief Start the encryption of a new server connection
+*
+* The encryption resumes the bond of a known server, or pairs a new one.
+ *
+* @param[in] connection connection handle
+* @param[in] server_id  last two bytes of the server address
+* @param[in] bonding    bond of the server, LCI_BONDING_NONE if not bonded
+*
+* @retval None
+*/
+void lci_bonding_on_opened(uint8_t connection, uint16_t server_id, uint8_t bonding)
+{
+  link_t *link = find_link(CONNECTION_HANDLE_INVALID);
+  sl_status_t sc;
+
+  if (link == NULL) {
+    return;
+  }
+  link->connection = connection;
+  link->server_id = server_id;
+  link->bonding = bonding;
+  link->state = link_encrypting;
+  link->repaired = false;
+  link->opened_ms = local_ms();
+  sc = sl_bt_sm_increase_security(connection);
+  if (sc != SL_STATUS_OK) {
+    app_log_status_warning_f(sc, "[%04X] Encryption not started\n", server_id);
+    link->state = link_unencrypted;
+    failed_count++;
+  }
+}
+/**
+* @brief The security mode of a link may have changed
+ *
+* @param[in] connection    connection handle
+* @param[in] security_mode security mode of the link
+*
+* @retval true if the link was just encrypted, the held reads can start
+*/
+bool lci_bonding_on_parameters(uint8_t connection, uint8_t security_mode)
+{
+  link_t *link = find_link(connection);
+  uint32_t ms;
+
+  if ((link == NULL) || (link->state != link_encrypting)
+      || (security_mode == sl_bt_connection_mode1_level1)) {
+    return false;
+  }
+  link->state = link_encrypted;
+  ms = local_ms() - link->opened_ms;
+  if ((link->bonding != LCI_BONDING_NONE) && !link->repaired) {
+    add_setup_time(&resumed_stats, ms);
+  } else {
+    add_setup_time(&paired_stats, ms);
+  }
+  app_log_debug("[%04X] Encrypted in %lu ms\n", link->server_id, (unsigned long)ms);
+  return true;
+}
+/**
+* @brief A server paired and bonded
+ *
+* @param[in] connection connection handle
+* @param[in] bonding    new bond
+*
+* @retval None
+*/
+void lci_bonding_on_bonded(uint8_t connection, uint8_t bonding)
+{
+  link_t *link = find_link(connection);
+
+  if (link != NULL) {
+    app_log_info("[%04X] Bonded, bond %u\n", link->server_id, bonding);
+    link->bonding = bonding;
+  }
+}
+/**
+* @brief Pairing or encryption of a link failed
+*
+* A server without the keys of the bond is paired again once, after the
+* stale bond is deleted. Any other failure leaves the link unencrypted.
+ *
+* @param[in] connection connection handle
+* @param[in] reason     result of the procedure
+*
+* @retval true if the link stays unencrypted, the held reads can start
+*/
+bool lci_bonding_on_failed(uint8_t connection, uint16_t reason)
+{
+  link_t *link = find_link(connection);
+  sl_status_t sc;
+
+  if ((link == NULL) || (link->state != link_encrypting)) {
+    return false;
+  }
+  if ((reason == SL_STATUS_BT_CTRL_PIN_OR_KEY_MISSING)
+      && (link->bonding != LCI_BONDING_NONE) && !link->repaired) {
+    link->repaired = true;
+    sc = sl_bt_sm_delete_bonding(link->bonding);
+    if (sc == SL_STATUS_OK) {
+      link->bonding = LCI_BONDING_NONE;
+      sc = sl_bt_sm_increase_security(connection);
+    }
+    if (sc == SL_STATUS_OK) {
+      app_log_info("[%04X] Bond lost by the server, pairing again\n", link->server_id);
+      repaired_count++;
+      return false;
+    }
+    reason = (uint16_t)sc;
+  }
+  app_log_status_warning_f(reason, "[%04X] Bonding failed, link not encrypted\n", link->server_id);
+  link->state = link_unencrypted;
+  failed_count++;
+  return true;
+}
+/**
+* @brief A server disconnected
+*
+* A link closed because the server lost the keys drops the stale bond, the
+* next connection pairs again.
+ *
+* @param[in] connection closed connection handle
+* @param[in] reason     reason of the disconnection
+*
+* @retval None
+*/
+void lci_bonding_on_closed(uint8_t connection, uint16_t reason)
+{
+  link_t *link = find_link(connection);
+
+  if (link == NULL) {
+    return;
+  }
+  if ((reason == SL_STATUS_BT_CTRL_PIN_OR_KEY_MISSING) && (link->bonding != LCI_BONDING_NONE)) {
+    (void)sl_bt_sm_delete_bonding(link->bonding);
+  }
+  link->connection = CONNECTION_HANDLE_INVALID;
+}
+/**
+* @brief Whether the readings of a link can be read
+ *
+* @param[in] connection connection handle
+*
+* @retval false while the link is being encrypted
+*/
+bool lci_bonding_ready(uint8_t connection)
+{
+  link_t *link = find_link(connection);
+
+  return (link == NULL) || (link->state != link_encrypting);
+}
+/**
+* @brief Log the bonding statistics
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_bonding_log(void)
+{
+  log_setup_time("bonds resumed", &resumed_stats);
+  log_setup_time("new pairings", &paired_stats);
+  app_log_info("Bonding: %lu failed, %lu paired again\n",
+               (unsigned long)failed_count,
+               (unsigned long)repaired_count);
+}
@@ -0,0 +1,305 @@
+/**
+ * @file lci_conn_scheduler.c
+ * @brief Connection event scheduling of the central client links
+ *
+ * With many links on the same interval and unbounded connection events the
+ * link layer cannot interleave the links and exchanges get missed. Every
+ * link gets the longest power of two multiple of the base interval that
+ * still carries its sample rate, so the anchors of all links repeat within
+ * the longest interval, and its connection events are limited to a fair
+ * share of the base interval. Connections are opened at least one base
+ * interval apart to let the link layer place every new anchor next to the
+ * existing ones. The share of the connection events a link uses is
+ * tracked from its GATT exchanges.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "app_assert.h"
+#include "app_log.h"
+#include "sl_sleeptimer.h"
+#include "lci_conn_scheduler.h"
+/* Invalid connection handle */
+#define CONNECTION_INVALID            ((uint8_t)0xFFu)
+/* Connection events per exchange, request and response */
+#define EVENTS_PER_EXCHANGE           2
+/* Fair share of the base interval per link in 0.625 ms units */
+#define CE_LENGTH_SHARE               ((LCI_CONN_BASE_INTERVAL * 2) / SL_BT_CONFIG_MAX_CONNECTIONS)
+/* Scheduling of a link */
+typedef struct {
+  uint8_t connection;
+  lci_conn_slot_t slot;
+  uint16_t exchanges;
+} link_slot_t;
+/* Links of the central */
+static link_slot_t links[SL_BT_CONFIG_MAX_CONNECTIONS];
+/* Parameters set for the next connection */
+static lci_conn_slot_t next_slot;
+/* Time of the last connection opened */
+static uint64_t last_open_ms;
+static bool opened_once;
+/* Local functions */
+static uint64_t get_time_ms(void);
+static link_slot_t *find_link(uint8_t connection);
+static uint16_t harmonic_interval(uint8_t sample_rate_hz);
+/**
+* @brief Read the system time
+ *
+* @param[in] None
+*
+* @retval time since boot in milliseconds
+*/
+static uint64_t get_time_ms(void)
+{
+  uint64_t ms = 0;
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return ms;
+}
+/**
+* @brief Find the scheduling of a link
+ *
+* @param[in] connection connection handle
+*
+* @retval link scheduling, NULL if the link is not known
+*/
+static link_slot_t *find_link(uint8_t connection)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == connection) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Longest harmonic interval carrying a sample rate
+ *
+* @param[in] sample_rate_hz samples per second
+*
+* @retval connection interval in 1.25 ms units
+*/
+static uint16_t harmonic_interval(uint8_t sample_rate_hz)
+{
+  uint32_t limit;
+  uint16_t interval = LCI_CONN_BASE_INTERVAL;
+
+  if (sample_rate_hz == 0) {
+    return LCI_CONN_MAX_INTERVAL;
+  }
+  /* Interval giving the events of the sample rate, in 1.25 ms units */
+  limit = 800u / ((uint32_t)sample_rate_hz * LCI_CONN_EVENTS_PER_SAMPLE);
+  while (((uint32_t)interval * 2 <= limit) && (interval * 2 <= LCI_CONN_MAX_INTERVAL)) {
+    interval *= 2;
+  }
+  return interval;
+}
+/**
+* @brief Initialize the connection scheduler
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_conn_scheduler_init(void)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    links[i].connection = CONNECTION_INVALID;
+  }
+  opened_once = false;
+}
+/**
+* @brief Check whether a connection can be opened now
+ *
+* @param[in] None
+*
+* @retval true if the last connection was opened at least a base interval ago
+*/
+bool lci_conn_scheduler_open_allowed(void)
+{
+  /* Base interval in milliseconds */
+  return !opened_once
+         || ((get_time_ms() - last_open_ms) >= ((LCI_CONN_BASE_INTERVAL * 5u) / 4u));
+}
+/**
+* @brief Set the parameters of the next connection
+ *
+* @param[in] sample_rate_hz samples per second wanted from the server
+* @param[in] latency        responder latency
+* @param[in] timeout        supervision timeout in 10 ms units
+*
+* @retval SL_STATUS_OK if set, error code otherwise
+*/
+sl_status_t lci_conn_scheduler_prepare_open(uint8_t sample_rate_hz,
+                                            uint16_t latency,
+                                            uint16_t timeout)
+{
+  next_slot.interval = harmonic_interval(sample_rate_hz);
+  next_slot.max_ce_length = (CE_LENGTH_SHARE > LCI_CONN_MIN_CE_LENGTH)
+                            ? CE_LENGTH_SHARE : LCI_CONN_MIN_CE_LENGTH;
+  next_slot.utilisation = 0;
+  return sl_bt_connection_set_default_parameters(next_slot.interval,
+                                                 next_slot.interval,
+                                                 latency,
+                                                 timeout,
+                                                 0,
+                                                 next_slot.max_ce_length);
+}
+/**
+* @brief A connection was opened with the prepared parameters
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_conn_scheduler_on_opened(uint8_t connection)
+{
+  link_slot_t *link = find_link(CONNECTION_INVALID);
+  uint8_t count = 0;
+
+  last_open_ms = get_time_ms();
+  opened_once = true;
+  if (link == NULL) {
+    return;
+  }
+  link->connection = connection;
+  link->slot = next_slot;
+  link->exchanges = 0;
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection != CONNECTION_INVALID) {
+      count++;
+    }
+  }
+  app_log_info("Connection %u scheduled as link %u of %u: interval %u, CE length %u\n",
+               connection,
+               count,
+               SL_BT_CONFIG_MAX_CONNECTIONS,
+               link->slot.interval,
+               link->slot.max_ce_length);
+}
+/**
+* @brief The interval of a connection was set or changed
+ *
+* @param[in] connection connection handle
+* @param[in] interval   connection interval in 1.25 ms units
+*
+* @retval None
+*/
+void lci_conn_scheduler_on_parameters(uint8_t connection, uint16_t interval)
+{
+  link_slot_t *link = find_link(connection);
+
+  if ((link != NULL) && (interval != 0)) {
+    link->slot.interval = interval;
+  }
+}
+/**
+* @brief A connection was closed
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_conn_scheduler_on_closed(uint8_t connection)
+{
+  link_slot_t *link = find_link(connection);
+
+  if (link != NULL) {
+    link->connection = CONNECTION_INVALID;
+  }
+}
+/**
+* @brief A GATT exchange of a connection completed
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_conn_scheduler_on_exchange(uint8_t connection)
+{
+  link_slot_t *link = find_link(connection);
+
+  if (link != NULL) {
+    link->exchanges++;
+  }
+}
+/**
+* @brief Characteristic reads a link can deliver per second
+ *
+* Four fifths of the reads its connection events allow.
+ *
+* @param[in] connection connection handle
+*
+* @retval expected reads per second
+*/
+uint16_t lci_conn_scheduler_expected_samples(uint8_t connection)
+{
+  link_slot_t *link = find_link(connection);
+  uint16_t interval = (link != NULL) ? link->slot.interval : harmonic_interval(LCI_CONN_SAMPLE_RATE_HZ);
+  uint16_t expected = 320u / interval;
+
+  return (expected != 0) ? expected : 1;
+}
+/**
+* @brief Update the connection event utilisation of the links
+ *
+* @param[in] period_ms time since the last update in milliseconds
+*
+* @retval None
+*/
+void lci_conn_scheduler_update(uint32_t period_ms)
+{
+  uint32_t events;
+  uint32_t used;
+
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == CONNECTION_INVALID) {
+      continue;
+    }
+    events = (period_ms * 4u) / ((uint32_t)links[i].slot.interval * 5u);
+    used = (uint32_t)links[i].exchanges * EVENTS_PER_EXCHANGE;
+    links[i].exchanges = 0;
+    if (events == 0) {
+      continue;
+    }
+    links[i].slot.utilisation = (used >= events) ? 100 : (uint8_t)((used * 100u) / events);
+  }
+}
+/**
+* @brief Log the scheduling of the links
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_conn_scheduler_log(void)
+{
+  uint32_t airtime = 0;
+
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == CONNECTION_INVALID) {
+      continue;
+    }
+    /* Share of the time reserved for the connection events of the link */
+    airtime += ((uint32_t)links[i].slot.max_ce_length * 100u) / ((uint32_t)links[i].slot.interval * 2u);
+    app_log_debug("Connection %u: interval %u, CE length %u, %u%% of the events used\n",
+                  links[i].connection,
+                  links[i].slot.interval,
+                  links[i].slot.max_ce_length,
+                  links[i].slot.utilisation);
+  }
+  app_log_debug("Connection events reserve %lu%% of the air time\n", (unsigned long)airtime);
+}
+/**
+* @brief Scheduling of a link
+ *
+* @param[in] connection connection handle
+*
+* @retval link scheduling, NULL if the link is not known
+*/
+const lci_conn_slot_t *lci_conn_scheduler_get_slot(uint8_t connection)
+{
+  link_slot_t *link = find_link(connection);
+
+  return (link != NULL) ? &link->slot : NULL;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file lci_conn_scheduler.h
+ * @brief Connection event scheduling of the central client links
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_CONN_SCHEDULER_H_
+#define LCI_CONN_SCHEDULER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+/* Base connection interval, every link uses a power of two multiple of it,
+ * in 1.25 ms units */
+#define LCI_CONN_BASE_INTERVAL        40   /* 50 milliseconds */
+/* Longest connection interval, keeps the supervision timeout valid */
+#define LCI_CONN_MAX_INTERVAL         320  /* 400 milliseconds */
+/* Connection events needed for one sample, a read request and response
+ * for each of the two characteristics */
+#define LCI_CONN_EVENTS_PER_SAMPLE    4
+/* Samples per second wanted from every sensor */
+#ifndef LCI_CONN_SAMPLE_RATE_HZ
+#define LCI_CONN_SAMPLE_RATE_HZ       2
+#endif
+/* Shortest connection event length in 0.625 ms units, one read exchange */
+#define LCI_CONN_MIN_CE_LENGTH        4
+/* Scheduling of a link */
+typedef struct {
+  uint16_t interval;
+  uint16_t max_ce_length;
+  uint8_t utilisation;
+} lci_conn_slot_t;
+
+void lci_conn_scheduler_init(void);
+bool lci_conn_scheduler_open_allowed(void);
+sl_status_t lci_conn_scheduler_prepare_open(uint8_t sample_rate_hz,
+                                            uint16_t latency,
+                                            uint16_t timeout);
+void lci_conn_scheduler_on_opened(uint8_t connection);
+void lci_conn_scheduler_on_parameters(uint8_t connection, uint16_t interval);
+void lci_conn_scheduler_on_closed(uint8_t connection);
+void lci_conn_scheduler_on_exchange(uint8_t connection);
+uint16_t lci_conn_scheduler_expected_samples(uint8_t connection);
+void lci_conn_scheduler_update(uint32_t period_ms);
+void lci_conn_scheduler_log(void);
+const lci_conn_slot_t *lci_conn_scheduler_get_slot(uint8_t connection);
+
+#endif /* LCI_CONN_SCHEDULER_H_ */
@@ -0,0 +1,98 @@
+/**
+ * @file lci_fixed_point.c
+ * @brief Integer scaling and decimal formatting of sensor values
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "lci_fixed_point.h"
+/* Powers of ten up to the largest supported number of decimal places */
+static const uint32_t pow10[] = { 1u, 10u, 100u, 1000u, 10000u, 100000u };
+#define POW10_MAX  ((uint8_t)(sizeof(pow10) / sizeof(pow10[0]) - 1))
+/**
+* @brief Change the number of decimal places of a fixed point value
+ *
+* Ties are rounded away from zero, the result saturates at the 32-bit range.
+ *
+* @param[in] value         fixed point value
+* @param[in] from_decimals decimal places of value
+* @param[in] to_decimals   decimal places of the result
+*
+* @retval rescaled value
+*/
+int32_t lci_fp_rescale(int32_t value, uint8_t from_decimals, uint8_t to_decimals)
+{
+  uint32_t magnitude = (value < 0) ? (0u - (uint32_t)value) : (uint32_t)value;
+  uint32_t divisor;
+  uint32_t factor;
+
+  if (from_decimals > POW10_MAX) {
+    from_decimals = POW10_MAX;
+  }
+  if (to_decimals > POW10_MAX) {
+    to_decimals = POW10_MAX;
+  }
+  if (from_decimals > to_decimals) {
+    divisor = pow10[from_decimals - to_decimals];
+    magnitude = (magnitude / divisor) + (((magnitude % divisor) >= ((divisor + 1u) / 2u)) ? 1u : 0u);
+  } else {
+    factor = pow10[to_decimals - from_decimals];
+    magnitude = (magnitude > (0x7FFFFFFFu / factor)) ? 0x80000000u : (magnitude * factor);
+  }
+  if (value < 0) {
+    return (int32_t)(0u - magnitude);
+  }
+  return (magnitude > 0x7FFFFFFFu) ? INT32_MAX : (int32_t)magnitude;
+}
+/**
+* @brief Scale a driver value to GATT units
+ *
+* @param[in] milli value in 0.001 units
+*
+* @retval value in 0.01 units, rounded to nearest, ties away from zero
+*/
+int32_t lci_fp_milli_to_centi(int32_t milli)
+{
+  return lci_fp_rescale(milli, LCI_FP_MILLI, LCI_FP_CENTI);
+}
+/**
+* @brief Format a fixed point value as decimal number
+ *
+* The output matches printf "%.Nf" of the exact value, e.g. 2345 with two
+* decimal places gives "23.45" and -5 gives "-0.05".
+ *
+* @param[out] buf      destination, at least LCI_FP_STR_SIZE bytes
+* @param[in]  value    fixed point value
+* @param[in]  decimals decimal places of value, at most 5
+*
+* @retval length of the string, without terminator
+*/
+uint8_t lci_fp_format(char *buf, int32_t value, uint8_t decimals)
+{
+  char digits[LCI_FP_STR_SIZE];
+  uint32_t magnitude = (value < 0) ? (0u - (uint32_t)value) : (uint32_t)value;
+  uint8_t count = 0;
+  uint8_t len = 0;
+
+  if (decimals > POW10_MAX) {
+    decimals = POW10_MAX;
+  }
+  /* Digits in reverse order, at least one before the decimal point */
+  do {
+    digits[count++] = (char)('0' + (magnitude % 10u));
+    magnitude /= 10u;
+  } while ((magnitude != 0) || (count <= decimals));
+
+  if (value < 0) {
+    buf[len++] = '-';
+  }
+  while (count > 0) {
+    if (count == decimals) {
+      buf[len++] = '.';
+    }
+    buf[len++] = digits[--count];
+  }
+  buf[len] = '\0';
+  return len;
+}
@@ -0,0 +1,1182 @@
+/**
+ * @file lci_fleet_ota.c
+ * @brief Concurrent OTA update of the connected servers through their apploader
+ *
+ * The host loads a GBL file into the storage slot of the central's
+ * bootloader, the cache, and then starts the update of some or all of the
+ * connected servers. Each target goes through the OTA flow of the
+ * Silicon Labs apploader on its own:
+ *
+ *   1. 0x00 written to the OTA control of the application, the server
+ *      reboots into its apploader
+ *   2. the apploader advertises the OTA service with the address of the
+ *      server, or that address plus one, and is connected
+ *   3. 0x00 written to the OTA control of the apploader starts the upload
+ *   4. the image is written without response to the OTA data
+ *   5. 0x03 written to the OTA control ends the upload, the apploader
+ *      verifies the image and answers the write with an error if it fails
+ *   6. the connection is closed, the server boots the new application and
+ *      is reconnected as a sensor
+ *
+ * The targets run the steps concurrently. While streaming, the data of all
+ * targets is queued round-robin, one write per target and turn, until the
+ * stack runs out of buffers, so the links share the air time of the central
+ * and a slow server does not hold the others back.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "app_log.h"
+#include "btl_interface.h"
+#include "em_device.h"
+#include "nvm3.h"
+#include "nvm3_default.h"
+#include "sl_simple_timer.h"
+#include "sl_sleeptimer.h"
+#include "lci_conn_scheduler.h"
+#include "lci_telemetry.h"
+#include "lci_fleet_ota.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Flash write unit of the storage slot */
+#define WRITE_ALIGN                   4
+/* ATT MTU before the exchange and the header of a write */
+#define ATT_MTU_DEFAULT               23
+#define ATT_WRITE_HEADER              3
+/* Largest data write */
+#define DATA_CHUNK_MAX                (LCI_FLEET_OTA_MTU - ATT_WRITE_HEADER)
+/* Data writes queued per timer tick at most, keeps the event loop going */
+#define BURST_MAX                     32
+/* First tag of a GBL file */
+#define GBL_TAG_HEADER                0x03A617EBu
+/* Timer ticks between two status reports */
+#define REPORT_TICKS                  (LCI_FLEET_OTA_REPORT_MS / LCI_FLEET_OTA_TICK_MS)
+/* Server connected with the OTA service */
+typedef struct {
+  uint8_t connection;
+  uint16_t server_address;
+  uint16_t mtu;
+  uint16_t control;
+  uint16_t data;
+  /* Only the OTA service, the server runs its apploader */
+  bool apploader;
+} link_t;
+/* Server being updated */
+typedef struct {
+  uint16_t server_address;
+  /* Link to the application or the apploader, invalid in between */
+  uint8_t connection;
+  lci_fleet_ota_phase_t phase;
+  lci_fleet_ota_result_t result;
+  /* Bytes written to the apploader */
+  uint32_t offset;
+  uint64_t deadline_ms;
+  uint64_t start_ms;
+} target_t;
+/* Image in the cache, stored in NVM3 once complete and checked */
+typedef struct {
+  uint32_t size;
+  uint32_t crc;
+} image_t;
+/* Storage slot */
+static BootloaderStorageSlot_t storage;
+static bool storage_ready;
+/* Complete image, size 0 if the cache is empty */
+static image_t image;
+/* Image being loaded by the host */
+static image_t loading;
+static bool caching;
+static uint32_t cached;
+static uint32_t cached_crc;
+/* Servers connected with the OTA service */
+static link_t links[SL_BT_CONFIG_MAX_CONNECTIONS];
+/* Update */
+static target_t targets[SL_BT_CONFIG_MAX_CONNECTIONS];
+static uint8_t target_count;
+static bool updating;
+static uint8_t first_target;
+static uint16_t report_ticks;
+static uint64_t update_start_ms;
+static sl_simple_timer_t tick_timer;
+/* Host command handed over to the Bluetooth context */
+static uint8_t command[LCI_TELEMETRY_COMMAND_MAX_SIZE];
+static volatile uint16_t command_len;
+/* Data of one write, or of one read of the cache */
+static uint8_t chunk[DATA_CHUNK_MAX];
+/* Local functions */
+static void hdl_tick_timer_event(sl_simple_timer_t *timer, void *data);
+static uint64_t get_time_ms(void);
+static uint32_t crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+static uint32_t get_le32(const uint8_t *src);
+static link_t *find_link(uint8_t connection);
+static link_t *find_link_by_address(uint16_t server_address);
+static target_t *find_target(uint8_t connection);
+static bool matches(const target_t *target, uint16_t server_address);
+static bool is_apploader(const lci_gatt_client_t *client);
+static void report(uint8_t cmd, lci_fleet_ota_status_t status);
+static bool cache_write(uint32_t offset, const uint8_t *data, uint32_t len);
+static lci_fleet_ota_status_t cache_begin(const uint8_t *data, uint16_t len);
+static lci_fleet_ota_status_t cache_data(const uint8_t *data, uint16_t len);
+static lci_fleet_ota_status_t cache_end(uint16_t len);
+static lci_fleet_ota_status_t update(const uint8_t *data, uint16_t len);
+static void abort_update(void);
+static void end_update(void);
+static void set_phase(target_t *target, lci_fleet_ota_phase_t phase, uint32_t timeout_ms);
+static void fail(target_t *target, lci_fleet_ota_result_t result);
+static void write_control(target_t *target, const link_t *link, uint8_t value);
+static void request_fast_link(const link_t *link);
+static void pump(void);
+static void check_timeouts(void);
+/**
+* @brief Transfer timer handler, the transfers run in the Bluetooth context
+ *
+* @param[in] timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_tick_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+  sl_bt_external_signal(LCI_FLEET_OTA_SIGNAL_TICK);
+}
+/**
+* @brief Read the system time
+ *
+* @param[in] None
+*
+* @retval time since boot in milliseconds
+*/
+static uint64_t get_time_ms(void)
+{
+  uint64_t ms = 0;
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return ms;
+}
+/**
+* @brief CRC-32 of the GBL format, as computed by the host
+ *
+* @param[in] crc  CRC of the previous bytes, 0 to start
+* @param[in] data bytes
+* @param[in] len  number of bytes
+*
+* @retval CRC of the previous bytes and data
+*/
+static uint32_t crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+  static const uint32_t table[16] = {
+    0x00000000u, 0x1DB71064u, 0x3B6E20C8u, 0x26D930ACu,
+    0x76DC4190u, 0x6B6B51F4u, 0x4DB26158u, 0x5005713Cu,
+    0xEDB88320u, 0xF00F9344u, 0xD6D6A3E8u, 0xCB61B38Cu,
+    0x9B64C2B0u, 0x86D3D2D4u, 0xA00AE278u, 0xBDBDF21Cu
+  };
+
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+  }
+  return ~crc;
+}
+/**
+* @brief Load a 32-bit little endian value
+ *
+* @param[in] src source
+*
+* @retval value
+*/
+static uint32_t get_le32(const uint8_t *src)
+{
+  return (uint32_t)src[0] | ((uint32_t)src[1] << 8)
+         | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+/**
+* @brief Find a server connected with the OTA service
+ *
+* @param[in] connection connection handle
+*
+* @retval link, NULL if not known
+*/
+static link_t *find_link(uint8_t connection)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == connection) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Find a connected server with the OTA characteristics by address
+ *
+* @param[in] server_address last two bytes of the server address
+*
+* @retval link, NULL if not connected
+*/
+static link_t *find_link_by_address(uint16_t server_address)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if ((links[i].connection != CONNECTION_HANDLE_INVALID)
+        && (links[i].server_address == server_address)
+        && (links[i].control != LCI_GATT_CLIENT_HANDLE_NONE)) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Find the target of a connection
+ *
+* @param[in] connection connection handle
+*
+* @retval target, NULL if the link is not updated
+*/
+static target_t *find_target(uint8_t connection)
+{
+  if (connection == CONNECTION_HANDLE_INVALID) {
+    return NULL;
+  }
+  for (uint8_t i = 0; i < target_count; i++) {
+    if (targets[i].connection == connection) {
+      return &targets[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Check whether a server address is the one of a target's apploader
+*
+* The apploader uses the address of the application, or that address plus
+* one depending on its configuration.
+ *
+* @param[in] target         target
+* @param[in] server_address last two bytes of the server address
+*
+* @retval true if the address is the target's
+*/
+static bool matches(const target_t *target, uint16_t server_address)
+{
+  return (server_address == target->server_address)
+         || (server_address == (uint16_t)(target->server_address + 1));
+}
+/**
+* @brief Check whether a server runs its apploader
+ *
+* @param[in] client client of the connection
+*
+* @retval true if the OTA service is the only supported service
+*/
+static bool is_apploader(const lci_gatt_client_t *client)
+{
+  for (uint8_t i = 0; i < client->char_count; i++) {
+    if (client->chars[i].profile != LCI_GATT_PROFILE_OTA) {
+      return false;
+    }
+  }
+  return client->char_count != 0;
+}
+/**
+* @brief Report the cache and the progress of the targets
+ *
+* @param[in] cmd    command answered, 0 for a periodic report
+* @param[in] status status of the command
+*
+* @retval None
+*/
+static void report(uint8_t cmd, lci_fleet_ota_status_t status)
+{
+#if LCI_TELEMETRY_BINARY
+  lci_telemetry_ota_t ota;
+
+  ota.command = cmd;
+  ota.status = (uint8_t)status;
+  ota.size = caching ? loading.size : image.size;
+  ota.crc = caching ? loading.crc : image.crc;
+  ota.cached = caching ? cached : image.size;
+  ota.count = 0;
+  for (uint8_t i = 0; (i < target_count) && (i < LCI_TELEMETRY_OTA_TARGETS_MAX); i++) {
+    ota.targets[i].sensor_id = targets[i].server_address;
+    ota.targets[i].phase = (uint8_t)targets[i].phase;
+    ota.targets[i].result = (uint8_t)targets[i].result;
+    ota.targets[i].offset = targets[i].offset;
+    ota.count++;
+  }
+  (void)lci_telemetry_report_ota(&ota);
+#else
+  if (cmd != 0) {
+    app_log_info("Fleet OTA command 0x%02X: status %u\n", cmd, (unsigned)status);
+  }
+  for (uint8_t i = 0; i < target_count; i++) {
+    app_log_info("[%04X] OTA phase %u, result %u, %lu bytes\n",
+                 targets[i].server_address,
+                 (unsigned)targets[i].phase,
+                 (unsigned)targets[i].result,
+                 (unsigned long)targets[i].offset);
+  }
+#endif
+}
+/**
+* @brief Write to the storage slot, erasing its pages on the way
+*
+* A write starting on a page erases it, so no write crosses a page.
+ *
+* @param[in] offset offset in the slot, consecutive writes only
+* @param[in] data   bytes
+* @param[in] len    number of bytes, padded with 0xFF to the write unit
+*
+* @retval true if written
+*/
+static bool cache_write(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+  uint8_t tail[WRITE_ALIGN];
+  uint32_t part;
+  uint32_t aligned;
+
+  while (len > 0) {
+    part = FLASH_PAGE_SIZE - (offset % FLASH_PAGE_SIZE);
+    if (part > len) {
+      part = len;
+    }
+    aligned = part & ~(uint32_t)(WRITE_ALIGN - 1);
+    if ((aligned > 0)
+        && (bootloader_eraseWriteStorage(LCI_FLEET_OTA_SLOT, offset, (uint8_t *)data, aligned) != BOOTLOADER_OK)) {
+      return false;
+    }
+    if (aligned < part) {
+      /* Only the last write of an image ends unaligned */
+      memset(tail, 0xFF, sizeof(tail));
+      memcpy(tail, &data[aligned], part - aligned);
+      if (bootloader_eraseWriteStorage(LCI_FLEET_OTA_SLOT, offset + aligned, tail, sizeof(tail)) != BOOTLOADER_OK) {
+        return false;
+      }
+    }
+    offset += part;
+    data += part;
+    len -= part;
+  }
+  return true;
+}
+/**
+* @brief Start loading a new image into the cache
+ *
+* @param[in] data command frame
+* @param[in] len  command frame length
+*
+* @retval status of the command
+*/
+static lci_fleet_ota_status_t cache_begin(const uint8_t *data, uint16_t len)
+{
+  if (len != 9) {
+    return lci_fleet_ota_bad_command;
+  }
+  if (updating) {
+    return lci_fleet_ota_bad_state;
+  }
+  if (!storage_ready) {
+    return lci_fleet_ota_storage_error;
+  }
+  loading.size = get_le32(&data[1]);
+  loading.crc = get_le32(&data[5]);
+  if ((loading.size == 0) || (loading.size > storage.length)) {
+    return lci_fleet_ota_too_large;
+  }
+  /* The cached image is overwritten from here on */
+  image.size = 0;
+  (void)nvm3_deleteObject(nvm3_defaultHandle, LCI_FLEET_OTA_NVM3_KEY);
+  caching = true;
+  cached = 0;
+  cached_crc = 0;
+  app_log_info("Fleet OTA caching %lu bytes\n", (unsigned long)loading.size);
+  return lci_fleet_ota_ok;
+}
+/**
+* @brief Write the next bytes of the image into the cache
+*
+* A repeated command, sent again because its answer was lost, is answered
+* without writing.
+ *
+* @param[in] data command frame
+* @param[in] len  command frame length
+*
+* @retval status of the command
+*/
+static lci_fleet_ota_status_t cache_data(const uint8_t *data, uint16_t len)
+{
+  uint32_t offset;
+  uint32_t count;
+
+  if (len < 6) {
+    return lci_fleet_ota_bad_command;
+  }
+  if (!caching) {
+    return lci_fleet_ota_bad_state;
+  }
+  offset = get_le32(&data[1]);
+  count = (uint32_t)len - 5;
+  if ((offset < cached) && ((offset + count) <= cached)) {
+    return lci_fleet_ota_ok;
+  }
+  if ((offset != cached) || ((cached % WRITE_ALIGN) != 0)) {
+    return lci_fleet_ota_bad_offset;
+  }
+  if (count > (loading.size - cached)) {
+    return lci_fleet_ota_too_large;
+  }
+  if (!cache_write(offset, &data[5], count)) {
+    caching = false;
+    return lci_fleet_ota_storage_error;
+  }
+  cached += count;
+  cached_crc = crc32(cached_crc, &data[5], count);
+  return lci_fleet_ota_ok;
+}
+/**
+* @brief Check the loaded image and keep it
+ *
+* @param[in] len command frame length
+*
+* @retval status of the command
+*/
+static lci_fleet_ota_status_t cache_end(uint16_t len)
+{
+  uint32_t crc = 0;
+  uint32_t offset;
+  uint32_t count;
+  Ecode_t ec;
+
+  if (len != 1) {
+    return lci_fleet_ota_bad_command;
+  }
+  if (!caching) {
+    return lci_fleet_ota_bad_state;
+  }
+  if (cached != loading.size) {
+    return lci_fleet_ota_bad_offset;
+  }
+  caching = false;
+  /* The bytes received, then the bytes in the flash */
+  if (cached_crc != loading.crc) {
+    return lci_fleet_ota_crc_error;
+  }
+  for (offset = 0; offset < loading.size; offset += count) {
+    count = loading.size - offset;
+    if (count > sizeof(chunk)) {
+      count = sizeof(chunk);
+    }
+    if (bootloader_readStorage(LCI_FLEET_OTA_SLOT, offset, chunk, count) != BOOTLOADER_OK) {
+      return lci_fleet_ota_storage_error;
+    }
+    if ((offset == 0) && ((count < 4) || (get_le32(chunk) != GBL_TAG_HEADER))) {
+      return lci_fleet_ota_not_gbl;
+    }
+    crc = crc32(crc, chunk, count);
+  }
+  if (crc != loading.crc) {
+    return lci_fleet_ota_crc_error;
+  }
+  ec = nvm3_writeData(nvm3_defaultHandle, LCI_FLEET_OTA_NVM3_KEY, &loading, sizeof(loading));
+  if (ec != ECODE_NVM3_OK) {
+    app_log_warning("Fleet OTA image not stored: 0x%lx\n", (unsigned long)ec);
+  }
+  image = loading;
+  app_log_info("Fleet OTA image cached: %lu bytes, CRC-32 %08lX\n",
+               (unsigned long)image.size,
+               (unsigned long)image.crc);
+  return lci_fleet_ota_ok;
+}
+/**
+* @brief Start the update of the requested servers with the cached image
+*
+* Without a list every connected server with the OTA service is updated.
+* A listed server that is not connected is looked for in its apploader,
+* e.g. after an interrupted update.
+ *
+* @param[in] data command frame
+* @param[in] len  command frame length
+*
+* @retval status of the command
+*/
+static lci_fleet_ota_status_t update(const uint8_t *data, uint16_t len)
+{
+  uint16_t server_address;
+  target_t *target;
+  link_t *link;
+  sl_status_t sc;
+
+  if ((len < 2) || (len != (2 + (2 * data[1])))
+      || (data[1] > SL_BT_CONFIG_MAX_CONNECTIONS)) {
+    return lci_fleet_ota_bad_command;
+  }
+  /* One target per server */
+  for (uint8_t i = 1; i < data[1]; i++) {
+    for (uint8_t j = 0; j < i; j++) {
+      if ((data[2 + (2 * i)] == data[2 + (2 * j)])
+          && (data[3 + (2 * i)] == data[3 + (2 * j)])) {
+        return lci_fleet_ota_bad_command;
+      }
+    }
+  }
+  if (updating || caching) {
+    return lci_fleet_ota_bad_state;
+  }
+  if (image.size == 0) {
+    return lci_fleet_ota_no_image;
+  }
+  target_count = 0;
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    link = NULL;
+    if (data[1] == 0) {
+      /* Every server running its application with the OTA service */
+      if ((links[i].connection != CONNECTION_HANDLE_INVALID)
+          && (links[i].control != LCI_GATT_CLIENT_HANDLE_NONE)
+          && !links[i].apploader) {
+        link = &links[i];
+        server_address = link->server_address;
+      } else {
+        continue;
+      }
+    } else if (i < data[1]) {
+      server_address = (uint16_t)(data[2 + (2 * i)] | (data[3 + (2 * i)] << 8));
+      link = find_link_by_address(server_address);
+    } else {
+      break;
+    }
+    target = &targets[target_count++];
+    memset(target, 0, sizeof(*target));
+    target->server_address = server_address;
+    target->connection = CONNECTION_HANDLE_INVALID;
+    if (link == NULL) {
+      set_phase(target, lci_fleet_ota_wait_apploader, LCI_FLEET_OTA_REBOOT_TIMEOUT_MS);
+    } else {
+      target->connection = link->connection;
+      set_phase(target, lci_fleet_ota_queued, LCI_FLEET_OTA_STEP_TIMEOUT_MS);
+    }
+  }
+  if (target_count == 0) {
+    return lci_fleet_ota_no_target;
+  }
+  updating = true;
+  first_target = 0;
+  report_ticks = 0;
+  update_start_ms = get_time_ms();
+  sc = sl_simple_timer_start(&tick_timer,
+                             LCI_FLEET_OTA_TICK_MS,
+                             hdl_tick_timer_event,
+                             NULL,
+                             true);
+  if (sc != SL_STATUS_OK) {
+    updating = false;
+    target_count = 0;
+    return lci_fleet_ota_bad_state;
+  }
+  app_log_info("Fleet OTA of %u servers, %lu bytes\n", target_count, (unsigned long)image.size);
+  /* A link without a GATT procedure running is taken over at once, the
+   * others when their procedure completes */
+  for (uint8_t i = 0; i < target_count; i++) {
+    link = find_link(targets[i].connection);
+    if (link == NULL) {
+      continue;
+    }
+    if (link->apploader) {
+      set_phase(&targets[i], lci_fleet_ota_wait_apploader, LCI_FLEET_OTA_STEP_TIMEOUT_MS);
+      write_control(&targets[i], link, LCI_FLEET_OTA_CONTROL_START);
+    } else {
+      write_control(&targets[i], link, LCI_FLEET_OTA_CONTROL_START);
+    }
+  }
+  return lci_fleet_ota_ok;
+}
+/**
+* @brief Stop the update, the apploader links are closed
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void abort_update(void)
+{
+  for (uint8_t i = 0; i < target_count; i++) {
+    if ((targets[i].phase != lci_fleet_ota_done) && (targets[i].phase != lci_fleet_ota_failed)) {
+      fail(&targets[i], lci_fleet_ota_result_aborted);
+    }
+  }
+  end_update();
+}
+/**
+* @brief All targets are done or failed
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void end_update(void)
+{
+  uint8_t done = 0;
+
+  if (!updating) {
+    return;
+  }
+  updating = false;
+  (void)sl_simple_timer_stop(&tick_timer);
+  for (uint8_t i = 0; i < target_count; i++) {
+    if (targets[i].phase == lci_fleet_ota_done) {
+      done++;
+    }
+  }
+  app_log_info("Fleet OTA: %u of %u servers updated in %lu ms\n",
+               done,
+               target_count,
+               (unsigned long)(get_time_ms() - update_start_ms));
+}
+/**
+* @brief Move a target to a phase
+ *
+* @param[in] target     target
+* @param[in] phase      new phase
+* @param[in] timeout_ms time the phase may take
+*
+* @retval None
+*/
+static void set_phase(target_t *target, lci_fleet_ota_phase_t phase, uint32_t timeout_ms)
+{
+  target->phase = phase;
+  target->deadline_ms = get_time_ms() + timeout_ms;
+}
+/**
+* @brief Give a target up, its apploader link is closed
+*
+* The server stays in its apploader until it is updated again. A server
+* still running its application is left to the link quality policy, which
+* reconnects it as it delivers no samples.
+ *
+* @param[in] target target
+* @param[in] result reason
+*
+* @retval None
+*/
+static void fail(target_t *target, lci_fleet_ota_result_t result)
+{
+  link_t *link = find_link(target->connection);
+  sl_status_t sc;
+
+  app_log_warning("[%04X] OTA failed in phase %u, result %u, %lu bytes sent\n",
+                  target->server_address,
+                  (unsigned)target->phase,
+                  (unsigned)result,
+                  (unsigned long)target->offset);
+  target->phase = lci_fleet_ota_failed;
+  target->result = result;
+  if ((link != NULL) && link->apploader) {
+    sc = sl_bt_connection_close(link->connection);
+    if (sc != SL_STATUS_OK) {
+      app_log_status_warning_f(sc, "[%04X] OTA close failed\n", target->server_address);
+    }
+  }
+  target->connection = CONNECTION_HANDLE_INVALID;
+}
+/**
+* @brief Write the OTA control of a target and move it to the next phase
+*
+* The write is retried on the next completed procedure or timer tick if a
+* GATT procedure of the link is still running.
+ *
+* @param[in] target target
+* @param[in] link   link of the target
+* @param[in] value  control value
+*
+* @retval None
+*/
+static void write_control(target_t *target, const link_t *link, uint8_t value)
+{
+  sl_status_t sc;
+
+  sc = sl_bt_gatt_write_characteristic_value(link->connection, link->control, 1, &value);
+  if ((sc == SL_STATUS_INVALID_STATE) || (sc == SL_STATUS_BUSY)
+      || (sc == SL_STATUS_NO_MORE_RESOURCE)) {
+    return;
+  }
+  if (sc != SL_STATUS_OK) {
+    app_log_status_warning_f(sc, "[%04X] OTA control write failed\n", target->server_address);
+    fail(target, lci_fleet_ota_result_link_lost);
+    return;
+  }
+  switch (target->phase) {
+    case lci_fleet_ota_queued:
+      app_log_info("[%04X] OTA rebooting into the apploader\n", target->server_address);
+      set_phase(target, lci_fleet_ota_reboot, LCI_FLEET_OTA_STEP_TIMEOUT_MS);
+      break;
+    case lci_fleet_ota_wait_apploader:
+      set_phase(target, lci_fleet_ota_start, LCI_FLEET_OTA_STEP_TIMEOUT_MS);
+      break;
+    case lci_fleet_ota_streaming:
+      set_phase(target, lci_fleet_ota_finish, LCI_FLEET_OTA_STEP_TIMEOUT_MS);
+      break;
+    default:
+      break;
+  }
+}
+/**
+* @brief Ask for the 2M PHY and the base connection interval while streaming
+*
+* The connection events keep the share of the base interval set by the
+* connection scheduler, so the links of all targets interleave.
+ *
+* @param[in] link link of a target
+*
+* @retval None
+*/
+static void request_fast_link(const link_t *link)
+{
+  const lci_conn_slot_t *conn_slot = lci_conn_scheduler_get_slot(link->connection);
+  sl_status_t sc;
+
+  sc = sl_bt_connection_set_preferred_phy(link->connection, sl_bt_gap_phy_2m, sl_bt_gap_phy_any);
+  if (sc != SL_STATUS_OK) {
+    app_log_status_warning_f(sc, "[%04X] OTA PHY request failed\n", link->server_address);
+  }
+  if (conn_slot == NULL) {
+    return;
+  }
+  sc = sl_bt_connection_set_parameters(link->connection,
+                                       LCI_CONN_BASE_INTERVAL,
+                                       LCI_CONN_BASE_INTERVAL,
+                                       0,
+                                       LCI_FLEET_OTA_CONN_TIMEOUT,
+                                       0,
+                                       conn_slot->max_ce_length);
+  if (sc != SL_STATUS_OK) {
+    app_log_status_warning_f(sc, "[%04X] OTA connection parameters failed\n", link->server_address);
+  }
+}
+/**
+* @brief Queue the data of the streaming targets, one write per target and
+* turn, until the stack runs out of buffers
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void pump(void)
+{
+  uint32_t blocked = 0;
+  uint8_t burst = 0;
+  bool queued = true;
+  target_t *target;
+  link_t *link;
+  uint16_t count;
+  uint16_t sent;
+  uint8_t index;
+  sl_status_t sc;
+
+  while (queued && (burst < BURST_MAX)) {
+    queued = false;
+    for (uint8_t i = 0; i < target_count; i++) {
+      index = (uint8_t)((first_target + i) % target_count);
+      target = &targets[index];
+      link = find_link(target->connection);
+      if ((target->phase != lci_fleet_ota_streaming) || (link == NULL)
+          || ((blocked & (1u << index)) != 0)) {
+        continue;
+      }
+      if (target->offset >= image.size) {
+        write_control(target, link, LCI_FLEET_OTA_CONTROL_END);
+        continue;
+      }
+      count = (uint16_t)(link->mtu - ATT_WRITE_HEADER);
+      if (count > sizeof(chunk)) {
+        count = sizeof(chunk);
+      }
+      if (count > (image.size - target->offset)) {
+        count = (uint16_t)(image.size - target->offset);
+      }
+      if (bootloader_readStorage(LCI_FLEET_OTA_SLOT, target->offset, chunk, count) != BOOTLOADER_OK) {
+        fail(target, lci_fleet_ota_result_storage_error);
+        continue;
+      }
+      sc = sl_bt_gatt_write_characteristic_value_without_response(link->connection,
+                                                                  link->data,
+                                                                  count,
+                                                                  chunk,
+                                                                  &sent);
+      if (sc == SL_STATUS_NO_MORE_RESOURCE) {
+        blocked |= 1u << index;
+        continue;
+      }
+      if (sc != SL_STATUS_OK) {
+        app_log_status_warning_f(sc, "[%04X] OTA data write failed\n", target->server_address);
+        fail(target, lci_fleet_ota_result_link_lost);
+        continue;
+      }
+      target->offset += sent;
+      queued = true;
+      burst++;
+    }
+  }
+  /* The next tick starts with the next target */
+  first_target = (uint8_t)((first_target + 1) % target_count);
+}
+/**
+* @brief Give up the targets whose phase took too long
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void check_timeouts(void)
+{
+  uint64_t now = get_time_ms();
+  link_t *link;
+
+  for (uint8_t i = 0; i < target_count; i++) {
+    switch (targets[i].phase) {
+      case lci_fleet_ota_queued:
+        /* Retry the reboot request of an idle link */
+        link = find_link(targets[i].connection);
+        if (link != NULL) {
+          write_control(&targets[i], link, LCI_FLEET_OTA_CONTROL_START);
+        }
+        break;
+      case lci_fleet_ota_streaming:
+      case lci_fleet_ota_done:
+      case lci_fleet_ota_failed:
+        continue;
+      default:
+        break;
+    }
+    if ((targets[i].phase != lci_fleet_ota_failed) && (now >= targets[i].deadline_ms)) {
+      fail(&targets[i], lci_fleet_ota_result_timeout);
+    }
+  }
+}
+/**
+* @brief Initialize the fleet OTA update, the cached image is kept across
+* resets
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_fleet_ota_init(void)
+{
+  uint16_t mtu;
+  sl_status_t sc;
+
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    links[i].connection = CONNECTION_HANDLE_INVALID;
+  }
+  target_count = 0;
+  updating = false;
+  caching = false;
+  command_len = 0;
+  sc = sl_bt_gatt_set_max_mtu(LCI_FLEET_OTA_MTU, &mtu);
+  if (sc != SL_STATUS_OK) {
+    app_log_status_warning_f(sc, "Fleet OTA MTU setting failed\n");
+  }
+  storage_ready = (bootloader_init() == BOOTLOADER_OK)
+                  && (bootloader_getStorageSlotInfo(LCI_FLEET_OTA_SLOT, &storage) == BOOTLOADER_OK);
+  if (!storage_ready) {
+    app_log_warning("Fleet OTA: no storage slot to cache an image\n");
+    image.size = 0;
+  } else if ((nvm3_readData(nvm3_defaultHandle,
+                            LCI_FLEET_OTA_NVM3_KEY,
+                            &image,
+                            sizeof(image)) != ECODE_NVM3_OK)
+             || (image.size > storage.length)) {
+    image.size = 0;
+  } else {
+    app_log_info("Fleet OTA image cached: %lu bytes, CRC-32 %08lX\n",
+                 (unsigned long)image.size,
+                 (unsigned long)image.crc);
+  }
+#if LCI_TELEMETRY_BINARY
+  lci_telemetry_set_command_handler(lci_fleet_ota_on_command);
+#endif
+}
+/**
+* @brief Take a command frame of the host over
+*
+* Called from the context receiving the telemetry, the command runs in the
+* Bluetooth context. A command arriving before the previous one ran is
+* dropped, the host sends it again after the answer timeout.
+ *
+* @param[in] frame command frame without its CRC
+* @param[in] len   command frame length
+*
+* @retval None
+*/
+void lci_fleet_ota_on_command(const uint8_t *frame, uint16_t len)
+{
+  if ((command_len != 0) || (len == 0) || (len > sizeof(command))) {
+    return;
+  }
+  memcpy(command, frame, len);
+  command_len = len;
+  sl_bt_external_signal(LCI_FLEET_OTA_SIGNAL_COMMAND);
+}
+/**
+* @brief Check whether an advertiser is the apploader of a target
+ *
+* @param[in] address advertiser address
+*
+* @retval true if it should be connected
+*/
+bool lci_fleet_ota_wants(const bd_addr *address)
+{
+  uint16_t server_address = (uint16_t)(address->addr[1] << 8) + address->addr[0];
+
+  for (uint8_t i = 0; i < target_count; i++) {
+    if ((targets[i].phase == lci_fleet_ota_wait_apploader)
+        && (targets[i].connection == CONNECTION_HANDLE_INVALID)
+        && matches(&targets[i], server_address)) {
+      return true;
+    }
+  }
+  return false;
+}
+/**
+* @brief Check whether a target waits for its apploader to be connected
+ *
+* @param[in] None
+*
+* @retval true if the central has to scan for it
+*/
+bool lci_fleet_ota_waiting(void)
+{
+  for (uint8_t i = 0; i < target_count; i++) {
+    if ((targets[i].phase == lci_fleet_ota_wait_apploader)
+        && (targets[i].connection == CONNECTION_HANDLE_INVALID)) {
+      return true;
+    }
+  }
+  return false;
+}
+/**
+* @brief Check whether the update owns the GATT procedures of a link
+ *
+* @param[in] connection connection handle
+*
+* @retval true if the link is updated, the application does not read it
+*/
+bool lci_fleet_ota_owns(uint8_t connection)
+{
+  return find_target(connection) != NULL;
+}
+/**
+* @brief A connection was opened
+ *
+* @param[in] connection     connection handle
+* @param[in] server_address last two bytes of the server address
+*
+* @retval None
+*/
+void lci_fleet_ota_on_opened(uint8_t connection, uint16_t server_address)
+{
+  link_t *link = find_link(CONNECTION_HANDLE_INVALID);
+
+  if (link == NULL) {
+    return;
+  }
+  link->connection = connection;
+  link->server_address = server_address;
+  link->mtu = ATT_MTU_DEFAULT;
+  link->control = LCI_GATT_CLIENT_HANDLE_NONE;
+  link->data = LCI_GATT_CLIENT_HANDLE_NONE;
+  link->apploader = false;
+}
+/**
+* @brief The ATT MTU of a connection was exchanged
+ *
+* @param[in] connection connection handle
+* @param[in] mtu        ATT MTU
+*
+* @retval None
+*/
+void lci_fleet_ota_on_mtu(uint8_t connection, uint16_t mtu)
+{
+  link_t *link = find_link(connection);
+
+  if (link != NULL) {
+    link->mtu = mtu;
+  }
+}
+/**
+* @brief Run the next step of a target after a GATT procedure completed
+*
+* The OTA characteristics of a server are learnt once its GATT client runs.
+* An apploader that connects is bound to the target it belongs to.
+ *
+* @param[in] connection connection handle
+* @param[in] client     GATT client of the connection
+* @param[in] result     result of the procedure
+*
+* @retval true if the update owns the link, the application must not start
+*         a read
+*/
+bool lci_fleet_ota_on_procedure_completed(uint8_t connection,
+                                          const lci_gatt_client_t *client,
+                                          uint16_t result)
+{
+  link_t *link = find_link(connection);
+  target_t *target;
+
+  if (link == NULL) {
+    return false;
+  }
+  if ((link->control == LCI_GATT_CLIENT_HANDLE_NONE) && lci_gatt_client_running(client)) {
+    link->control = lci_gatt_client_find_handle(client, LCI_GATT_PROFILE_OTA, LCI_GATT_OTA_CONTROL);
+    link->data = lci_gatt_client_find_handle(client, LCI_GATT_PROFILE_OTA, LCI_GATT_OTA_DATA);
+    link->apploader = is_apploader(client);
+    if (link->data == LCI_GATT_CLIENT_HANDLE_NONE) {
+      link->control = LCI_GATT_CLIENT_HANDLE_NONE;
+    }
+  }
+  target = find_target(connection);
+  if ((target == NULL) && updating && (link->control != LCI_GATT_CLIENT_HANDLE_NONE)) {
+    for (uint8_t i = 0; i < target_count; i++) {
+      if ((targets[i].phase == lci_fleet_ota_wait_apploader)
+          && (targets[i].connection == CONNECTION_HANDLE_INVALID)
+          && matches(&targets[i], link->server_address)) {
+        target = &targets[i];
+        target->connection = connection;
+        break;
+      }
+    }
+  }
+  if (target == NULL) {
+    return false;
+  }
+  switch (target->phase) {
+    case lci_fleet_ota_queued:
+      write_control(target, link, LCI_FLEET_OTA_CONTROL_START);
+      break;
+    case lci_fleet_ota_reboot:
+      /* The server closes the connection to reboot */
+      if (result != 0) {
+        fail(target, lci_fleet_ota_result_write_error);
+      }
+      break;
+    case lci_fleet_ota_wait_apploader:
+      if (!link->apploader) {
+        fail(target, lci_fleet_ota_result_no_apploader);
+        return false;
+      }
+      app_log_info("[%04X] OTA apploader connected\n", target->server_address);
+      write_control(target, link, LCI_FLEET_OTA_CONTROL_START);
+      break;
+    case lci_fleet_ota_start:
+      if (result != 0) {
+        fail(target, lci_fleet_ota_result_write_error);
+        break;
+      }
+      target->start_ms = get_time_ms();
+      target->phase = lci_fleet_ota_streaming;
+      request_fast_link(link);
+      break;
+    case lci_fleet_ota_finish:
+      if (result != 0) {
+        fail(target, lci_fleet_ota_result_verify_error);
+        break;
+      }
+      app_log_info("[%04X] OTA verified, %lu bytes in %lu ms\n",
+                   target->server_address,
+                   (unsigned long)target->offset,
+                   (unsigned long)(get_time_ms() - target->start_ms));
+      target->phase = lci_fleet_ota_done;
+      /* The apploader boots the new application */
+      (void)sl_bt_connection_close(connection);
+      target->connection = CONNECTION_HANDLE_INVALID;
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+/**
+* @brief A connection was closed
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_fleet_ota_on_closed(uint8_t connection)
+{
+  link_t *link = find_link(connection);
+  target_t *target = find_target(connection);
+
+  if (link != NULL) {
+    link->connection = CONNECTION_HANDLE_INVALID;
+  }
+  if (target == NULL) {
+    return;
+  }
+  if (target->phase == lci_fleet_ota_reboot) {
+    target->connection = CONNECTION_HANDLE_INVALID;
+    set_phase(target, lci_fleet_ota_wait_apploader, LCI_FLEET_OTA_REBOOT_TIMEOUT_MS);
+    return;
+  }
+  target->connection = CONNECTION_HANDLE_INVALID;
+  fail(target, lci_fleet_ota_result_link_lost);
+}
+/**
+* @brief Run the host commands and the transfers
+ *
+* @param[in] signals external signals
+*
+* @retval None
+*/
+void lci_fleet_ota_on_signal(uint32_t signals)
+{
+  lci_fleet_ota_status_t status = lci_fleet_ota_bad_command;
+  bool finished = true;
+
+  if ((signals & LCI_FLEET_OTA_SIGNAL_COMMAND) && (command_len != 0)) {
+    switch (command[0]) {
+      case LCI_TELEMETRY_FRAME_CACHE_BEGIN:
+        status = cache_begin(command, command_len);
+        break;
+      case LCI_TELEMETRY_FRAME_CACHE_DATA:
+        status = cache_data(command, command_len);
+        break;
+      case LCI_TELEMETRY_FRAME_CACHE_END:
+        status = cache_end(command_len);
+        break;
+      case LCI_TELEMETRY_FRAME_OTA_UPDATE:
+        status = update(command, command_len);
+        break;
+      case LCI_TELEMETRY_FRAME_OTA_ABORT:
+        caching = false;
+        abort_update();
+        status = lci_fleet_ota_ok;
+        break;
+      case LCI_TELEMETRY_FRAME_OTA_QUERY:
+        status = lci_fleet_ota_ok;
+        break;
+      default:
+        break;
+    }
+    report(command[0], status);
+    command_len = 0;
+  }
+  if (((signals & LCI_FLEET_OTA_SIGNAL_TICK) == 0) || !updating) {
+    return;
+  }
+  pump();
+  if (++report_ticks >= REPORT_TICKS) {
+    report_ticks = 0;
+    check_timeouts();
+    report(0, lci_fleet_ota_ok);
+  }
+  for (uint8_t i = 0; i < target_count; i++) {
+    if ((targets[i].phase != lci_fleet_ota_done) && (targets[i].phase != lci_fleet_ota_failed)) {
+      finished = false;
+    }
+  }
+  if (finished) {
+    end_update();
+    report(0, lci_fleet_ota_ok);
+  }
+}
@@ -0,0 +1,105 @@
+/**
+ * @file lci_fleet_ota.h
+ * @brief Concurrent OTA update of the connected servers through their apploader
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_FLEET_OTA_H_
+#define LCI_FLEET_OTA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+#include "lci_gatt_client.h"
+/* Storage slot of the bootloader caching the image */
+#define LCI_FLEET_OTA_SLOT            0
+/* NVM3 key of the cached image size and CRC, application key range */
+#define LCI_FLEET_OTA_NVM3_KEY        0x01200
+/* External signals, a host command and the transfer timer */
+#define LCI_FLEET_OTA_SIGNAL_COMMAND  (1u << 6)
+#define LCI_FLEET_OTA_SIGNAL_TICK     (1u << 7)
+/* Period of the transfer timer in milliseconds, the data of every target
+ * is queued until the stack runs out of buffers */
+#define LCI_FLEET_OTA_TICK_MS         10
+/* Period of the status report and the timeout check in milliseconds */
+#define LCI_FLEET_OTA_REPORT_MS       1000
+/* Time a server has to come back in its apploader in milliseconds */
+#define LCI_FLEET_OTA_REBOOT_TIMEOUT_MS 15000
+/* Time any other step of a target may take in milliseconds */
+#define LCI_FLEET_OTA_STEP_TIMEOUT_MS 10000
+/* ATT MTU requested from the servers */
+#define LCI_FLEET_OTA_MTU             247
+/* Supervision timeout of a link while streaming, 2 s */
+#define LCI_FLEET_OTA_CONN_TIMEOUT    200
+/* OTA control values: reboot into the apploader or start the upload, and
+ * end of the upload */
+#define LCI_FLEET_OTA_CONTROL_START   0x00
+#define LCI_FLEET_OTA_CONTROL_END     0x03
+/* Status of a host command */
+typedef enum {
+  lci_fleet_ota_ok = 0x00,
+  /* Unknown command or wrong length */
+  lci_fleet_ota_bad_command = 0x01,
+  /* Command not allowed while an update runs, or cache data without begin */
+  lci_fleet_ota_bad_state = 0x02,
+  /* Image larger than the storage slot */
+  lci_fleet_ota_too_large = 0x03,
+  lci_fleet_ota_storage_error = 0x04,
+  /* Cache data not at the next offset, the status carries the bytes cached */
+  lci_fleet_ota_bad_offset = 0x05,
+  /* The cached image differs from the CRC-32 of the cache begin */
+  lci_fleet_ota_crc_error = 0x06,
+  /* No complete image in the cache */
+  lci_fleet_ota_no_image = 0x07,
+  /* None of the requested servers is connected with the OTA service */
+  lci_fleet_ota_no_target = 0x08,
+  /* The cached image does not start with a GBL header */
+  lci_fleet_ota_not_gbl = 0x09
+} lci_fleet_ota_status_t;
+/* Phase of a target */
+typedef enum {
+  /* Waiting for the GATT procedure of the link to complete */
+  lci_fleet_ota_queued = 0x00,
+  /* Reboot into the apploader requested */
+  lci_fleet_ota_reboot = 0x01,
+  /* Waiting for the apploader to advertise and to be connected */
+  lci_fleet_ota_wait_apploader = 0x02,
+  /* Upload start requested */
+  lci_fleet_ota_start = 0x03,
+  lci_fleet_ota_streaming = 0x04,
+  /* Upload end requested, the apploader verifies the image */
+  lci_fleet_ota_finish = 0x05,
+  lci_fleet_ota_done = 0x06,
+  lci_fleet_ota_failed = 0x07
+} lci_fleet_ota_phase_t;
+/* Result of a target */
+typedef enum {
+  lci_fleet_ota_result_none = 0x00,
+  lci_fleet_ota_result_link_lost = 0x01,
+  lci_fleet_ota_result_timeout = 0x02,
+  /* The server rejected a write of the OTA control */
+  lci_fleet_ota_result_write_error = 0x03,
+  /* The apploader rejected the image, e.g. a wrong signature */
+  lci_fleet_ota_result_verify_error = 0x04,
+  /* The server came back with its application instead of the apploader */
+  lci_fleet_ota_result_no_apploader = 0x05,
+  lci_fleet_ota_result_aborted = 0x06,
+  lci_fleet_ota_result_storage_error = 0x07
+} lci_fleet_ota_result_t;
+
+void lci_fleet_ota_init(void);
+void lci_fleet_ota_on_command(const uint8_t *frame, uint16_t len);
+bool lci_fleet_ota_wants(const bd_addr *address);
+bool lci_fleet_ota_waiting(void);
+bool lci_fleet_ota_owns(uint8_t connection);
+void lci_fleet_ota_on_opened(uint8_t connection, uint16_t server_address);
+void lci_fleet_ota_on_mtu(uint8_t connection, uint16_t mtu);
+bool lci_fleet_ota_on_procedure_completed(uint8_t connection,
+                                          const lci_gatt_client_t *client,
+                                          uint16_t result);
+void lci_fleet_ota_on_closed(uint8_t connection);
+void lci_fleet_ota_on_signal(uint32_t signals);
+
+#endif /* LCI_FLEET_OTA_H_ */
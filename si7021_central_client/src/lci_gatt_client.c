@@ -0,0 +1,374 @@
+/**
+ * @file lci_gatt_client.c
+ * @brief Table-driven GATT client of one connection
+ *
+ * The client finds the supported services of a server by their full UUID,
+ * discovers their characteristics, subscribes to the ones whose policy and
+ * properties allow it and then reads the readable ones in turns, one read
+ * per completed GATT procedure. Everything it needs to know about a
+ * service comes from the profile table (lci_gatt_profiles.c), so any mix
+ * of servers is handled by the same code.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "app_log.h"
+#include "lci_gatt_client.h"
+/* Advertising data types of the service UUID lists */
+#define AD_TYPE_UUID16_INCOMPLETE     0x02
+#define AD_TYPE_UUID16_COMPLETE       0x03
+#define AD_TYPE_UUID128_INCOMPLETE    0x06
+#define AD_TYPE_UUID128_COMPLETE      0x07
+/* Characteristic properties */
+#define PROPERTY_READ                 0x02
+#define PROPERTY_NOTIFY               0x10
+#define PROPERTY_INDICATE             0x20
+/* ATT opcode of a handle value indication */
+#define ATT_OPCODE_INDICATION         0x1D
+/* Local functions */
+static uint8_t subscription_flags(const lci_gatt_client_char_t *entry);
+static bool is_polled(const lci_gatt_client_char_t *entry);
+static sl_status_t discover_next_service(lci_gatt_client_t *client);
+static sl_status_t subscribe_next(lci_gatt_client_t *client);
+static uint16_t next_read(lci_gatt_client_t *client);
+/**
+* @brief Subscription wanted by the policy and allowed by the properties
+ *
+* @param[in] entry characteristic
+*
+* @retval sl_bt_gatt_notification, sl_bt_gatt_indication or sl_bt_gatt_disable
+*/
+static uint8_t subscription_flags(const lci_gatt_client_char_t *entry)
+{
+  const lci_gatt_char_desc_t *desc = lci_gatt_profiles_get_char(entry->profile, entry->desc);
+
+  if ((desc->policy & LCI_GATT_POLICY_NOTIFY) && (entry->properties & PROPERTY_NOTIFY)) {
+    return sl_bt_gatt_notification;
+  }
+  if ((desc->policy & LCI_GATT_POLICY_INDICATE) && (entry->properties & PROPERTY_INDICATE)) {
+    return sl_bt_gatt_indication;
+  }
+  return sl_bt_gatt_disable;
+}
+/**
+* @brief The characteristic is read in turns
+ *
+* @param[in] entry characteristic
+*
+* @retval true if read by the policy and readable
+*/
+static bool is_polled(const lci_gatt_client_char_t *entry)
+{
+  const lci_gatt_char_desc_t *desc = lci_gatt_profiles_get_char(entry->profile, entry->desc);
+
+  return ((desc->policy & LCI_GATT_POLICY_READ) != 0)
+         && ((entry->properties & PROPERTY_READ) != 0);
+}
+/**
+* @brief Discover the characteristics of the next supported service
+ *
+* @param[in] client client of the connection
+*
+* @retval SL_STATUS_OK if a discovery started or all services are done,
+*         error code of the stack otherwise
+*/
+static sl_status_t discover_next_service(lci_gatt_client_t *client)
+{
+  if (client->cursor >= client->service_count) {
+    client->stage = lci_gatt_stage_subscribe;
+    client->cursor = 0;
+    return subscribe_next(client);
+  }
+  client->stage = lci_gatt_stage_discover_characteristics;
+  return sl_bt_gatt_discover_characteristics(client->connection,
+                                             client->services[client->cursor++].handle);
+}
+/**
+* @brief Enable the notifications or indications of the next characteristic
+ *
+* @param[in] client client of the connection
+*
+* @retval SL_STATUS_OK if a subscription started or all are done,
+*         error code of the stack otherwise
+*/
+static sl_status_t subscribe_next(lci_gatt_client_t *client)
+{
+  uint8_t flags;
+
+  while (client->cursor < client->char_count) {
+    flags = subscription_flags(&client->chars[client->cursor++]);
+    if (flags != sl_bt_gatt_disable) {
+      return sl_bt_gatt_set_characteristic_notification(client->connection,
+                                                        client->chars[client->cursor - 1].handle,
+                                                        flags);
+    }
+  }
+  client->stage = lci_gatt_stage_running;
+  client->cursor = 0;
+  return SL_STATUS_OK;
+}
+/**
+* @brief Next characteristic to read, in turns
+ *
+* @param[in] client client of the connection
+*
+* @retval characteristic handle, LCI_GATT_CLIENT_HANDLE_NONE if none is read
+*/
+static uint16_t next_read(lci_gatt_client_t *client)
+{
+  lci_gatt_client_char_t *entry;
+
+  for (uint8_t i = 0; i < client->char_count; i++) {
+    entry = &client->chars[client->cursor];
+    client->cursor = (uint8_t)((client->cursor + 1) % client->char_count);
+    if (is_polled(entry)) {
+      return entry->handle;
+    }
+  }
+  return LCI_GATT_CLIENT_HANDLE_NONE;
+}
+/**
+* @brief Parse advertisements looking for a supported service
+ *
+* @param[in] data pointer to advertising data
+* @param[in] len  length of advertising data
+*
+* @retval profile index of the first supported service,
+*         LCI_GATT_PROFILE_NONE otherwise
+*/
+uint8_t lci_gatt_client_match_advertisement(const uint8_t *data, uint8_t len)
+{
+  uint8_t ad_field_length;
+  uint8_t ad_field_type;
+  uint8_t uuid_len;
+  uint8_t profile;
+  uint8_t i = 0;
+
+  /* Parse advertisement packet */
+  while ((i + 1) < len) {
+    ad_field_length = data[i];
+    ad_field_type = data[i + 1];
+    if ((ad_field_length == 0) || ((i + ad_field_length) >= len)) {
+      break;
+    }
+    uuid_len = 0;
+    if ((ad_field_type == AD_TYPE_UUID16_INCOMPLETE) || (ad_field_type == AD_TYPE_UUID16_COMPLETE)) {
+      uuid_len = 2;
+    } else if ((ad_field_type == AD_TYPE_UUID128_INCOMPLETE) || (ad_field_type == AD_TYPE_UUID128_COMPLETE)) {
+      uuid_len = 16;
+    }
+    /* Compare every UUID of the list to the supported services */
+    for (uint8_t j = 2; (uuid_len != 0) && ((j + uuid_len) <= (ad_field_length + 1)); j += uuid_len) {
+      profile = lci_gatt_profiles_find_service(&data[i + j], uuid_len);
+      if (profile != LCI_GATT_PROFILE_NONE) {
+        return profile;
+      }
+    }
+    /* Advance to the next AD structure */
+    i = (uint8_t)(i + ad_field_length + 1);
+  }
+  return LCI_GATT_PROFILE_NONE;
+}
+/**
+* @brief Forget everything about the server
+ *
+* @param[in] client client of the connection
+*
+* @retval None
+*/
+void lci_gatt_client_reset(lci_gatt_client_t *client)
+{
+  client->stage = lci_gatt_stage_idle;
+  client->cursor = 0;
+  client->service_count = 0;
+  client->char_count = 0;
+}
+/**
+* @brief Start the discovery of the supported services of a new connection
+*
+* All primary services are discovered, so a server reconnected without its
+* advertisement, e.g. through the filter accept list, is handled the same.
+ *
+* @param[in] client     client of the connection
+* @param[in] connection connection's handle
+*
+* @retval SL_STATUS_OK if started, error code of the stack otherwise
+*/
+sl_status_t lci_gatt_client_open(lci_gatt_client_t *client, uint8_t connection)
+{
+  lci_gatt_client_reset(client);
+  client->connection = connection;
+  client->stage = lci_gatt_stage_discover_services;
+  return sl_bt_gatt_discover_primary_services(connection);
+}
+/**
+* @brief Keep a discovered service if the profile table supports it
+ *
+* @param[in] client  client of the connection
+* @param[in] service service event
+*
+* @retval None
+*/
+void lci_gatt_client_on_service(lci_gatt_client_t *client,
+                                const sl_bt_evt_gatt_service_t *service)
+{
+  uint8_t profile = lci_gatt_profiles_find_service(service->uuid.data, service->uuid.len);
+
+  if ((profile == LCI_GATT_PROFILE_NONE)
+      || (client->service_count >= LCI_GATT_CLIENT_SERVICES_MAX)) {
+    return;
+  }
+  client->services[client->service_count].handle = service->service;
+  client->services[client->service_count].profile = profile;
+  client->service_count++;
+}
+/**
+* @brief Keep a discovered characteristic if its profile describes it
+ *
+* @param[in] client         client of the connection
+* @param[in] characteristic characteristic event
+*
+* @retval None
+*/
+void lci_gatt_client_on_characteristic(lci_gatt_client_t *client,
+                                       const sl_bt_evt_gatt_characteristic_t *characteristic)
+{
+  lci_gatt_client_char_t *entry;
+  uint8_t profile;
+  uint8_t desc;
+
+  if ((client->stage != lci_gatt_stage_discover_characteristics) || (client->cursor == 0)) {
+    return;
+  }
+  /* Characteristics of one service at a time */
+  profile = client->services[client->cursor - 1].profile;
+  desc = lci_gatt_profiles_find_char(profile,
+                                     characteristic->uuid.data,
+                                     characteristic->uuid.len);
+  if ((desc == LCI_GATT_PROFILE_NONE) || (client->char_count >= LCI_GATT_CLIENT_CHARS_MAX)) {
+    return;
+  }
+  entry = &client->chars[client->char_count];
+  entry->handle = characteristic->characteristic;
+  entry->profile = profile;
+  entry->desc = desc;
+  entry->properties = characteristic->properties;
+  entry->instance = 0;
+  for (uint8_t i = 0; i < client->char_count; i++) {
+    if ((client->chars[i].profile == profile) && (client->chars[i].desc == desc)) {
+      entry->instance++;
+    }
+  }
+  client->char_count++;
+}
+/**
+* @brief Run the next step after a GATT procedure completed
+*
+* A failed subscription only costs the notifications of that characteristic,
+* the client carries on.
+ *
+* @param[in]  client              client of the connection
+* @param[out] read_characteristic characteristic to read next,
+*                                 LCI_GATT_CLIENT_HANDLE_NONE if none
+*
+* @retval SL_STATUS_OK if the client carries on,
+*         SL_STATUS_NOT_FOUND if the server has nothing supported,
+*         error code of the stack otherwise
+*/
+sl_status_t lci_gatt_client_on_procedure_completed(lci_gatt_client_t *client,
+                                                   uint16_t *read_characteristic)
+{
+  const lci_gatt_profile_t *profile;
+  sl_status_t sc = SL_STATUS_OK;
+
+  *read_characteristic = LCI_GATT_CLIENT_HANDLE_NONE;
+  switch (client->stage) {
+    case lci_gatt_stage_discover_services:
+      if (client->service_count == 0) {
+        return SL_STATUS_NOT_FOUND;
+      }
+      for (uint8_t i = 0; i < client->service_count; i++) {
+        profile = lci_gatt_profiles_get(client->services[i].profile);
+        app_log_debug("Connection %d: %s service\n", client->connection, profile->name);
+      }
+      client->cursor = 0;
+      sc = discover_next_service(client);
+      break;
+    case lci_gatt_stage_discover_characteristics:
+      sc = discover_next_service(client);
+      if ((client->stage == lci_gatt_stage_running) && (client->char_count == 0)) {
+        return SL_STATUS_NOT_FOUND;
+      }
+      break;
+    case lci_gatt_stage_subscribe:
+      sc = subscribe_next(client);
+      break;
+    default:
+      break;
+  }
+  if ((sc == SL_STATUS_OK) && (client->stage == lci_gatt_stage_running)) {
+    *read_characteristic = next_read(client);
+  }
+  return sc;
+}
+/**
+* @brief Find the characteristic of a value read, notified or indicated
+*
+* An indication is confirmed here.
+ *
+* @param[in] client client of the connection
+* @param[in] value  characteristic value event
+*
+* @retval pointer to the characteristic, NULL if not supported
+*/
+const lci_gatt_client_char_t *lci_gatt_client_on_value(lci_gatt_client_t *client,
+                                                       const sl_bt_evt_gatt_characteristic_value_t *value)
+{
+  sl_status_t sc;
+
+  if (value->att_opcode == ATT_OPCODE_INDICATION) {
+    sc = sl_bt_gatt_send_characteristic_confirmation(client->connection);
+    if (sc != SL_STATUS_OK) {
+      app_log_status_warning_f(sc, "Indication confirmation failed\n");
+    }
+  }
+  for (uint8_t i = 0; i < client->char_count; i++) {
+    if (client->chars[i].handle == value->characteristic) {
+      return &client->chars[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief The client delivers values
+ *
+* @param[in] client client of the connection
+*
+* @retval true if discovery and subscription are done
+*/
+bool lci_gatt_client_running(const lci_gatt_client_t *client)
+{
+  return (client->stage == lci_gatt_stage_running) && (client->char_count != 0);
+}
+/**
+* @brief Find the handle of a characteristic of a profile
+ *
+* @param[in] client  client of the connection
+* @param[in] profile profile index
+* @param[in] desc    characteristic index in the profile
+*
+* @retval handle of the first instance, LCI_GATT_CLIENT_HANDLE_NONE if the
+*         server does not have it
+*/
+uint16_t lci_gatt_client_find_handle(const lci_gatt_client_t *client,
+                                     uint8_t profile,
+                                     uint8_t desc)
+{
+  for (uint8_t i = 0; i < client->char_count; i++) {
+    if ((client->chars[i].profile == profile) && (client->chars[i].desc == desc)) {
+      return client->chars[i].handle;
+    }
+  }
+  return LCI_GATT_CLIENT_HANDLE_NONE;
+}
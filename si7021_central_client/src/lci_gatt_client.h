@@ -0,0 +1,74 @@
+/**
+ * @file lci_gatt_client.h
+ * @brief Table-driven GATT client of one connection
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_GATT_CLIENT_H_
+#define LCI_GATT_CLIENT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+#include "lci_gatt_profiles.h"
+/* Supported services of one server */
+#define LCI_GATT_CLIENT_SERVICES_MAX  5
+/* Supported characteristics of one server, all services */
+#define LCI_GATT_CLIENT_CHARS_MAX     8
+/* Invalidated characteristic handle */
+#define LCI_GATT_CLIENT_HANDLE_NONE   ((uint16_t)0xFFFFu)
+/* Stage of the client */
+typedef enum {
+  lci_gatt_stage_idle,
+  lci_gatt_stage_discover_services,
+  lci_gatt_stage_discover_characteristics,
+  lci_gatt_stage_subscribe,
+  lci_gatt_stage_running
+} lci_gatt_client_stage_t;
+/* Supported service found on the server */
+typedef struct {
+  uint32_t handle;
+  uint8_t profile;
+} lci_gatt_client_service_t;
+/* Supported characteristic found on the server */
+typedef struct {
+  uint16_t handle;
+  uint8_t profile;
+  /* Index in the characteristics of the profile */
+  uint8_t desc;
+  /* Characteristic properties reported by the server */
+  uint8_t properties;
+  /* Instance number among the characteristics with the same UUID */
+  uint8_t instance;
+} lci_gatt_client_char_t;
+/* Client state of one connection */
+typedef struct {
+  uint8_t connection;
+  lci_gatt_client_stage_t stage;
+  /* Service or characteristic the current stage works on */
+  uint8_t cursor;
+  uint8_t service_count;
+  lci_gatt_client_service_t services[LCI_GATT_CLIENT_SERVICES_MAX];
+  uint8_t char_count;
+  lci_gatt_client_char_t chars[LCI_GATT_CLIENT_CHARS_MAX];
+} lci_gatt_client_t;
+
+uint8_t lci_gatt_client_match_advertisement(const uint8_t *data, uint8_t len);
+void lci_gatt_client_reset(lci_gatt_client_t *client);
+sl_status_t lci_gatt_client_open(lci_gatt_client_t *client, uint8_t connection);
+void lci_gatt_client_on_service(lci_gatt_client_t *client,
+                                const sl_bt_evt_gatt_service_t *service);
+void lci_gatt_client_on_characteristic(lci_gatt_client_t *client,
+                                       const sl_bt_evt_gatt_characteristic_t *characteristic);
+sl_status_t lci_gatt_client_on_procedure_completed(lci_gatt_client_t *client,
+                                                   uint16_t *read_characteristic);
+const lci_gatt_client_char_t *lci_gatt_client_on_value(lci_gatt_client_t *client,
+                                                       const sl_bt_evt_gatt_characteristic_value_t *value);
+bool lci_gatt_client_running(const lci_gatt_client_t *client);
+uint16_t lci_gatt_client_find_handle(const lci_gatt_client_t *client,
+                                     uint8_t profile,
+                                     uint8_t desc);
+
+#endif /* LCI_GATT_CLIENT_H_ */
@@ -0,0 +1,282 @@
+/**
+ * @file lci_gatt_profiles.c
+ * @brief Services and characteristics the central client talks to
+ *
+ * Every supported server is described by one entry of the profile table:
+ * the service UUID, and per characteristic the full UUID, the decoder of
+ * its value and the subscription policy. The client engine runs discovery,
+ * subscription and decoding from this table only, so a new kind of server
+ * needs a new entry here and no code in the application.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "lci_gatt_profiles.h"
+/* 16-bit UUID defined by Bluetooth SIG, little-endian */
+#define UUID16(uuid)                  { 2, { (uint8_t)(uuid), (uint8_t)((uuid) >> 8) } }
+/* 128-bit UUID, bytes little-endian */
+#define UUID128(...)                  { 16, { __VA_ARGS__ } }
+/* Number of entries of a table */
+#define COUNT_OF(table)               ((uint8_t)(sizeof(table) / sizeof((table)[0])))
+/* Local functions */
+static bool decode_sint16(const uint8_t *data, uint8_t len, int32_t *value);
+static bool decode_uint16(const uint8_t *data, uint8_t len, int32_t *value);
+static bool decode_uint8(const uint8_t *data, uint8_t len, int32_t *value);
+/* Environmental Sensing characteristics, 0.01 units */
+static const lci_gatt_char_desc_t envsens_chars[] = {
+  {
+    UUID16(0x2A6E), lci_gatt_temperature, decode_sint16, LCI_GATT_POLICY_READ,
+    "Temperature [degree celsius]", "\370C", 2
+  },
+  {
+    UUID16(0x2A6F), lci_gatt_humidity, decode_uint16, LCI_GATT_POLICY_READ,
+    "Humidity [relative humidity as a percentage]", "%RH", 2
+  }
+};
+/* Automation IO characteristics: digital states in the first byte, analog
+ * inputs in millivolts. The button is notified, the analog inputs are read
+ * and notified on threshold crossings. */
+static const lci_gatt_char_desc_t aio_chars[] = {
+  {
+    UUID16(0x2A56), lci_gatt_digital, decode_uint8,
+    LCI_GATT_POLICY_READ | LCI_GATT_POLICY_NOTIFY,
+    "Digital", "", 0
+  },
+  {
+    UUID16(0x2A58), lci_gatt_analog, decode_uint16,
+    LCI_GATT_POLICY_READ | LCI_GATT_POLICY_NOTIFY,
+    "Analog", "mV", 0
+  }
+};
+/* Silicon Labs OTA characteristics, written by the fleet OTA update only:
+ * OTA control f7bf3564-fb6d-4e53-88a4-5e37e0326063 and
+ * OTA data 984227f3-34fc-4045-a5d0-2c581f81a153 */
+static const lci_gatt_char_desc_t ota_chars[] = {
+  {
+    UUID128(0x63, 0x60, 0x32, 0xE0, 0x37, 0x5E, 0xA4, 0x88,
+            0x53, 0x4E, 0x6D, 0xFB, 0x64, 0x35, 0xBF, 0xF7),
+    lci_gatt_ota, NULL, 0,
+    "OTA control", "", 0
+  },
+  {
+    UUID128(0x53, 0xA1, 0x81, 0x1F, 0x58, 0x2C, 0xD0, 0xA5,
+            0x45, 0x40, 0xFC, 0x34, 0xF3, 0x27, 0x42, 0x98),
+    lci_gatt_ota, NULL, 0,
+    "OTA data", "", 0
+  }
+};
+/* LCI Time Sync characteristics of the SI7021 peripheral server: sync
+ * 7a5c0002-3f2b-4e8a-9c61-0d5e8f4b2a17, written by the time sync, and timed
+ * sample 7a5c0003-3f2b-4e8a-9c61-0d5e8f4b2a17, notified */
+static const lci_gatt_char_desc_t time_sync_chars[] = {
+  {
+    UUID128(0x17, 0x2A, 0x4B, 0x8F, 0x5E, 0x0D, 0x61, 0x9C,
+            0x8A, 0x4E, 0x2B, 0x3F, 0x02, 0x00, 0x5C, 0x7A),
+    lci_gatt_time_sync, NULL, 0,
+    "Time sync", "", 0
+  },
+  {
+    UUID128(0x17, 0x2A, 0x4B, 0x8F, 0x5E, 0x0D, 0x61, 0x9C,
+            0x8A, 0x4E, 0x2B, 0x3F, 0x03, 0x00, 0x5C, 0x7A),
+    lci_gatt_timed_rht, NULL, LCI_GATT_POLICY_NOTIFY,
+    "Timed sample", "", 0
+  }
+};
+/* LCI Relay characteristic of the SI7021 peripheral server built as a
+ * relay: batch 7a5c0011-3f2b-4e8a-9c61-0d5e8f4b2a17, notified */
+static const lci_gatt_char_desc_t relay_chars[] = {
+  {
+    UUID128(0x17, 0x2A, 0x4B, 0x8F, 0x5E, 0x0D, 0x61, 0x9C,
+            0x8A, 0x4E, 0x2B, 0x3F, 0x11, 0x00, 0x5C, 0x7A),
+    lci_gatt_relay_batch, NULL, LCI_GATT_POLICY_NOTIFY,
+    "Relay batch", "", 0
+  }
+};
+/* Supported profiles, the OTA profile at LCI_GATT_PROFILE_OTA: service
+ * 1d14d6ee-fd63-4fa1-bfa4-8f47b42119f0 of the applications and the apploader,
+ * the time sync profile at LCI_GATT_PROFILE_TIME_SYNC: service
+ * 7a5c0001-3f2b-4e8a-9c61-0d5e8f4b2a17, the relay profile at
+ * LCI_GATT_PROFILE_RELAY: service 7a5c0010-3f2b-4e8a-9c61-0d5e8f4b2a17 */
+static const lci_gatt_profile_t profiles[] = {
+  { "Environmental Sensing", UUID16(0x181A), envsens_chars, COUNT_OF(envsens_chars) },
+  { "Automation IO", UUID16(0x1815), aio_chars, COUNT_OF(aio_chars) },
+  {
+    "Silicon Labs OTA",
+    UUID128(0xF0, 0x19, 0x21, 0xB4, 0x47, 0x8F, 0xA4, 0xBF,
+            0xA1, 0x4F, 0x63, 0xFD, 0xEE, 0xD6, 0x14, 0x1D),
+    ota_chars, COUNT_OF(ota_chars)
+  },
+  {
+    "LCI Time Sync",
+    UUID128(0x17, 0x2A, 0x4B, 0x8F, 0x5E, 0x0D, 0x61, 0x9C,
+            0x8A, 0x4E, 0x2B, 0x3F, 0x01, 0x00, 0x5C, 0x7A),
+    time_sync_chars, COUNT_OF(time_sync_chars)
+  },
+  {
+    "LCI Relay",
+    UUID128(0x17, 0x2A, 0x4B, 0x8F, 0x5E, 0x0D, 0x61, 0x9C,
+            0x8A, 0x4E, 0x2B, 0x3F, 0x10, 0x00, 0x5C, 0x7A),
+    relay_chars, COUNT_OF(relay_chars)
+  }
+};
+/**
+* @brief Decode a signed 16-bit little-endian value
+ *
+* @param[in]  data  characteristic value
+* @param[in]  len   characteristic value length
+* @param[out] value decoded value
+*
+* @retval true if decoded, false if the value is too short
+*/
+static bool decode_sint16(const uint8_t *data, uint8_t len, int32_t *value)
+{
+  if (len < sizeof(int16_t)) {
+    return false;
+  }
+  *value = (int16_t)(data[0] | (data[1] << 8));
+  return true;
+}
+/**
+* @brief Decode an unsigned 16-bit little-endian value
+ *
+* @param[in]  data  characteristic value
+* @param[in]  len   characteristic value length
+* @param[out] value decoded value
+*
+* @retval true if decoded, false if the value is too short
+*/
+static bool decode_uint16(const uint8_t *data, uint8_t len, int32_t *value)
+{
+  if (len < sizeof(uint16_t)) {
+    return false;
+  }
+  *value = (uint16_t)(data[0] | (data[1] << 8));
+  return true;
+}
+/**
+* @brief Decode an unsigned 8-bit value
+ *
+* @param[in]  data  characteristic value
+* @param[in]  len   characteristic value length
+* @param[out] value decoded value
+*
+* @retval true if decoded, false if the value is empty
+*/
+static bool decode_uint8(const uint8_t *data, uint8_t len, int32_t *value)
+{
+  if (len < sizeof(uint8_t)) {
+    return false;
+  }
+  *value = data[0];
+  return true;
+}
+/**
+* @brief Number of supported profiles
+ *
+* @param[in] None
+*
+* @retval number of profiles
+*/
+uint8_t lci_gatt_profiles_count(void)
+{
+  return COUNT_OF(profiles);
+}
+/**
+* @brief Get a profile
+ *
+* @param[in] profile profile index
+*
+* @retval pointer to the profile, NULL if the index is invalid
+*/
+const lci_gatt_profile_t *lci_gatt_profiles_get(uint8_t profile)
+{
+  if (profile >= COUNT_OF(profiles)) {
+    return NULL;
+  }
+  return &profiles[profile];
+}
+/**
+* @brief Find the profile of a service, the full UUID has to match
+ *
+* @param[in] uuid service UUID, little-endian
+* @param[in] len  UUID length
+*
+* @retval profile index, LCI_GATT_PROFILE_NONE if not supported
+*/
+uint8_t lci_gatt_profiles_find_service(const uint8_t *uuid, uint8_t len)
+{
+  for (uint8_t i = 0; i < COUNT_OF(profiles); i++) {
+    if ((profiles[i].service.len == len)
+        && (memcmp(profiles[i].service.data, uuid, len) == 0)) {
+      return i;
+    }
+  }
+  return LCI_GATT_PROFILE_NONE;
+}
+/**
+* @brief Find a characteristic of a profile, the full UUID has to match
+ *
+* @param[in] profile profile index
+* @param[in] uuid    characteristic UUID, little-endian
+* @param[in] len     UUID length
+*
+* @retval characteristic index, LCI_GATT_PROFILE_NONE if not in the profile
+*/
+uint8_t lci_gatt_profiles_find_char(uint8_t profile, const uint8_t *uuid, uint8_t len)
+{
+  const lci_gatt_profile_t *entry = lci_gatt_profiles_get(profile);
+
+  if (entry == NULL) {
+    return LCI_GATT_PROFILE_NONE;
+  }
+  for (uint8_t i = 0; i < entry->char_count; i++) {
+    if ((entry->chars[i].uuid.len == len)
+        && (memcmp(entry->chars[i].uuid.data, uuid, len) == 0)) {
+      return i;
+    }
+  }
+  return LCI_GATT_PROFILE_NONE;
+}
+/**
+* @brief Get a characteristic of a profile
+ *
+* @param[in] profile profile index
+* @param[in] desc    characteristic index
+*
+* @retval pointer to the characteristic, NULL if an index is invalid
+*/
+const lci_gatt_char_desc_t *lci_gatt_profiles_get_char(uint8_t profile, uint8_t desc)
+{
+  const lci_gatt_profile_t *entry = lci_gatt_profiles_get(profile);
+
+  if ((entry == NULL) || (desc >= entry->char_count)) {
+    return NULL;
+  }
+  return &entry->chars[desc];
+}
+/**
+* @brief Decode a characteristic value with the decoder of the table
+ *
+* @param[in]  profile profile index
+* @param[in]  desc    characteristic index
+* @param[in]  data    characteristic value
+* @param[in]  len     characteristic value length
+* @param[out] value   decoded value
+*
+* @retval true if decoded, false otherwise
+*/
+bool lci_gatt_profiles_decode(uint8_t profile,
+                              uint8_t desc,
+                              const uint8_t *data,
+                              uint8_t len,
+                              int32_t *value)
+{
+  const lci_gatt_char_desc_t *entry = lci_gatt_profiles_get_char(profile, desc);
+
+  if ((entry == NULL) || (entry->decode == NULL)) {
+    return false;
+  }
+  return entry->decode(data, len, value);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file lci_gatt_profiles.h
+ * @brief Services and characteristics the central client talks to
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_GATT_PROFILES_H_
+#define LCI_GATT_PROFILES_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+/* Longest UUID, 128-bit */
+#define LCI_GATT_UUID_MAX             16
+/* Longest characteristic value a decoder takes */
+#define LCI_GATT_VALUE_MAX            8
+/* Invalidated profile or characteristic index */
+#define LCI_GATT_PROFILE_NONE         ((uint8_t)0xFFu)
+/* Subscription policy of a characteristic, applied if the server's
+ * characteristic has the property */
+#define LCI_GATT_POLICY_READ          0x01
+#define LCI_GATT_POLICY_NOTIFY        0x02
+#define LCI_GATT_POLICY_INDICATE      0x04
+/* Index of the Environmental Sensing profile and of its characteristics,
+ * the kinds of the timed samples */
+#define LCI_GATT_PROFILE_ENVSENS      0
+#define LCI_GATT_ENVSENS_TEMPERATURE  0
+#define LCI_GATT_ENVSENS_HUMIDITY     1
+/* Index of the Silicon Labs OTA profile in the table and of its
+ * characteristics, used by the fleet OTA update */
+#define LCI_GATT_PROFILE_OTA          2
+#define LCI_GATT_OTA_CONTROL          0
+#define LCI_GATT_OTA_DATA             1
+/* Index of the LCI Time Sync profile and of its characteristics */
+#define LCI_GATT_PROFILE_TIME_SYNC    3
+#define LCI_GATT_TIME_SYNC_WRITE      0
+#define LCI_GATT_TIME_SYNC_SAMPLE     1
+/* Index of the LCI Relay profile and of its characteristic */
+#define LCI_GATT_PROFILE_RELAY        4
+#define LCI_GATT_RELAY_BATCH          0
+/* Kind of a decoded value */
+typedef enum {
+  lci_gatt_temperature,
+  lci_gatt_humidity,
+  lci_gatt_digital,
+  lci_gatt_analog,
+  /* Written by the fleet OTA update, never decoded */
+  lci_gatt_ota,
+  /* Written by the time sync, never decoded */
+  lci_gatt_time_sync,
+  /* Temperature and humidity sampled at an instant of the central clock,
+   * decoded by the time sync */
+  lci_gatt_timed_rht,
+  /* Readings of the neighbours of a relay, decoded by the relay */
+  lci_gatt_relay_batch
+} lci_gatt_kind_t;
+/* UUID as sent over the air, little-endian */
+typedef struct {
+  uint8_t len;
+  uint8_t data[LCI_GATT_UUID_MAX];
+} lci_gatt_uuid_t;
+/* Decoder of a characteristic value, NULL if the value is not decoded */
+typedef bool (*lci_gatt_decoder_t)(const uint8_t *data, uint8_t len, int32_t *value);
+/* Characteristic of a profile */
+typedef struct {
+  lci_gatt_uuid_t uuid;
+  lci_gatt_kind_t kind;
+  lci_gatt_decoder_t decode;
+  uint8_t policy;
+  /* Log label, unit and decimal places of the decoded value */
+  const char *label;
+  const char *unit;
+  uint8_t decimals;
+} lci_gatt_char_desc_t;
+/* Service and its characteristics */
+typedef struct {
+  const char *name;
+  lci_gatt_uuid_t service;
+  const lci_gatt_char_desc_t *chars;
+  uint8_t char_count;
+} lci_gatt_profile_t;
+
+uint8_t lci_gatt_profiles_count(void);
+const lci_gatt_profile_t *lci_gatt_profiles_get(uint8_t profile);
+uint8_t lci_gatt_profiles_find_service(const uint8_t *uuid, uint8_t len);
+uint8_t lci_gatt_profiles_find_char(uint8_t profile, const uint8_t *uuid, uint8_t len);
+const lci_gatt_char_desc_t *lci_gatt_profiles_get_char(uint8_t profile, uint8_t desc);
+bool lci_gatt_profiles_decode(uint8_t profile,
+                              uint8_t desc,
+                              const uint8_t *data,
+                              uint8_t len,
+                              int32_t *value);
+
+#endif /* LCI_GATT_PROFILES_H_ */
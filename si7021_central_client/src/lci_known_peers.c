@@ -0,0 +1,195 @@
+/**
+ * @file lci_known_peers.c
+ * @brief Known peripheral servers and filter accept list handling
+ *
+ * The central remembers the servers it was connected to, in RAM and in
+ * NVM3 so the table survives a reset. Servers that are not connected are
+ * loaded into the controller's filter accept list, which lets the link
+ * layer reconnect to them without the host parsing any advertisement.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "app_assert.h"
+#include "nvm3.h"
+#include "nvm3_default.h"
+#include "lci_known_peers.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Persistent part of a known peer */
+typedef struct {
+  bd_addr address;
+  uint8_t address_type;
+} known_peer_t;
+/* Persistent table */
+typedef struct {
+  uint8_t count;
+  uint8_t next;
+  known_peer_t peers[LCI_KNOWN_PEERS_MAX];
+} known_peers_table_t;
+/* Known peers */
+static known_peers_table_t table;
+/* Connection handle of every known peer, invalid if not connected */
+static uint8_t peer_connection[LCI_KNOWN_PEERS_MAX];
+/* Local functions */
+static uint8_t find_peer(const bd_addr *address, uint8_t address_type);
+static void store_table(void);
+/**
+* @brief Find a peer in the known peers table
+ *
+* @param[in] address      peer address
+* @param[in] address_type peer address type
+*
+* @retval index of the peer, LCI_KNOWN_PEERS_MAX if unknown
+*/
+static uint8_t find_peer(const bd_addr *address, uint8_t address_type)
+{
+  for (uint8_t i = 0; i < table.count; i++) {
+    if ((table.peers[i].address_type == address_type)
+        && (memcmp(&table.peers[i].address, address, sizeof(bd_addr)) == 0)) {
+      return i;
+    }
+  }
+  return LCI_KNOWN_PEERS_MAX;
+}
+/**
+* @brief Write the known peers table to NVM3
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void store_table(void)
+{
+  Ecode_t ec = nvm3_writeData(nvm3_defaultHandle,
+                              LCI_KNOWN_PEERS_NVM3_KEY,
+                              &table,
+                              sizeof(table));
+  if (ec != ECODE_NVM3_OK) {
+    app_log_warning("Failed to store known peers: 0x%lx\n", (unsigned long)ec);
+  }
+}
+/**
+* @brief Load the known peers table from NVM3
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_known_peers_init(void)
+{
+  Ecode_t ec = nvm3_readData(nvm3_defaultHandle,
+                             LCI_KNOWN_PEERS_NVM3_KEY,
+                             &table,
+                             sizeof(table));
+  if ((ec != ECODE_NVM3_OK) || (table.count > LCI_KNOWN_PEERS_MAX)) {
+    memset(&table, 0, sizeof(table));
+  }
+  table.next %= LCI_KNOWN_PEERS_MAX;
+  memset(peer_connection, CONNECTION_HANDLE_INVALID, sizeof(peer_connection));
+  app_log_info("Known peripheral servers: %d\n", table.count);
+}
+/**
+* @brief Remember a connected peer, the oldest entry is replaced if full
+ *
+* @param[in] address      peer address
+* @param[in] address_type peer address type
+* @param[in] connection   connection handle
+*
+* @retval None
+*/
+void lci_known_peers_on_opened(bd_addr address, uint8_t address_type, uint8_t connection)
+{
+  uint8_t index = find_peer(&address, address_type);
+
+  if (index == LCI_KNOWN_PEERS_MAX) {
+    if (table.count < LCI_KNOWN_PEERS_MAX) {
+      index = table.count++;
+    } else {
+      index = table.next;
+      table.next = (table.next + 1) % LCI_KNOWN_PEERS_MAX;
+    }
+    table.peers[index].address = address;
+    table.peers[index].address_type = address_type;
+    store_table();
+  }
+  peer_connection[index] = connection;
+}
+/**
+* @brief Mark the peer of a closed connection as not connected
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_known_peers_on_closed(uint8_t connection)
+{
+  for (uint8_t i = 0; i < LCI_KNOWN_PEERS_MAX; i++) {
+    if (peer_connection[i] == connection) {
+      peer_connection[i] = CONNECTION_HANDLE_INVALID;
+    }
+  }
+}
+/**
+* @brief Number of known peers that are not connected
+ *
+* @param[in] None
+*
+* @retval number of missing peers
+*/
+uint8_t lci_known_peers_missing(void)
+{
+  uint8_t missing = 0;
+
+  for (uint8_t i = 0; i < table.count; i++) {
+    if (peer_connection[i] == CONNECTION_HANDLE_INVALID) {
+      missing++;
+    }
+  }
+  return missing;
+}
+/**
+* @brief Load the missing known peers into the filter accept list
+ *
+* Must not be called while a connection is being initiated with the list.
+ *
+* @param[in] None
+*
+* @retval number of peers in the accept list
+*/
+uint8_t lci_known_peers_load_accept_list(void)
+{
+  sl_status_t sc;
+  uint8_t loaded = 0;
+
+  sc = sl_bt_accept_list_delete_all_devices();
+  app_assert_status(sc);
+  for (uint8_t i = 0; i < table.count; i++) {
+    if (peer_connection[i] != CONNECTION_HANDLE_INVALID) {
+      continue;
+    }
+    sc = sl_bt_accept_list_add_device_by_address(table.peers[i].address,
+                                                 table.peers[i].address_type);
+    if (sc != SL_STATUS_OK) {
+      app_log_status_warning_f(sc, "Accept list full\n");
+      break;
+    }
+    loaded++;
+  }
+  return loaded;
+}
+/**
+* @brief Forget all known peers
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_known_peers_forget_all(void)
+{
+  memset(&table, 0, sizeof(table));
+  memset(peer_connection, CONNECTION_HANDLE_INVALID, sizeof(peer_connection));
+  store_table();
+}
@@ -0,0 +1,26 @@
+/**
+ * @file lci_known_peers.h
+ * @brief Known peripheral servers and filter accept list handling
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_KNOWN_PEERS_H_
+#define LCI_KNOWN_PEERS_H_
+
+#include <stdint.h>
+#include "sl_bluetooth.h"
+/* Number of remembered peripheral servers */
+#define LCI_KNOWN_PEERS_MAX           8
+/* NVM3 key of the known peers table, application key range 0x00000-0x0FFFF */
+#define LCI_KNOWN_PEERS_NVM3_KEY      0x01100
+
+void lci_known_peers_init(void);
+void lci_known_peers_on_opened(bd_addr address, uint8_t address_type, uint8_t connection);
+void lci_known_peers_on_closed(uint8_t connection);
+uint8_t lci_known_peers_missing(void);
+uint8_t lci_known_peers_load_accept_list(void);
+void lci_known_peers_forget_all(void);
+
+#endif /* LCI_KNOWN_PEERS_H_ */
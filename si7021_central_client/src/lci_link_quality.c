@@ -0,0 +1,300 @@
+/**
+ * @file lci_link_quality.c
+ * @brief Link quality statistics and policy of the central client links
+ *
+ * Every link keeps its statistics in the connection table. Once per period
+ * the policy compares the samples delivered with the samples expected,
+ * checks for reads that did not complete and follows the RSSI trend, so a
+ * degrading link is moved to the coded PHY, given a longer supervision
+ * timeout or reconnected before it is lost to a supervision timeout.
+ * The counters of a server survive its reconnections.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "app_assert.h"
+#include "sl_sleeptimer.h"
+#include "sl_simple_timer.h"
+#include "lci_link_quality.h"
+/* Servers whose counters are remembered across reconnections */
+#define HISTORY_MAX                   (SL_BT_CONFIG_MAX_CONNECTIONS * 2)
+/* Periods without samples before a link is reconnected */
+#define STALLED_RECONNECT_PERIODS     3
+/* Periods with a weak RSSI before the coded PHY is requested */
+#define WEAK_PERIODS                  3
+/* Link timer */
+static sl_simple_timer_t link_timer;
+/* Counters of the servers seen, stored when their link closes */
+static lci_link_stats_t history[HISTORY_MAX];
+static uint8_t history_count;
+static uint8_t history_next;
+/* Local functions */
+static void hdl_link_timer_event(sl_simple_timer_t *timer, void *data);
+static uint64_t get_time_ms(void);
+static lci_link_stats_t *find_history(uint16_t server_id);
+/**
+* @brief Link timer handler, the policy runs in the Bluetooth context
+ *
+* @param[in] timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_link_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+  sl_bt_external_signal(LCI_LINK_SIGNAL);
+}
+/**
+* @brief Read the system time
+ *
+* @param[in] None
+*
+* @retval time since boot in milliseconds
+*/
+static uint64_t get_time_ms(void)
+{
+  uint64_t ms = 0;
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return ms;
+}
+/**
+* @brief Find the stored counters of a server
+ *
+* @param[in] server_id server identifier
+*
+* @retval stored counters, NULL if the server was not seen before
+*/
+static lci_link_stats_t *find_history(uint16_t server_id)
+{
+  for (uint8_t i = 0; i < history_count; i++) {
+    if (history[i].server_id == server_id) {
+      return &history[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Initialize the link quality monitor
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_link_quality_init(void)
+{
+  sl_status_t sc;
+
+  history_count = 0;
+  history_next = 0;
+  sc = sl_simple_timer_start(&link_timer,
+                             LCI_LINK_PERIOD_MS,
+                             hdl_link_timer_event,
+                             NULL,
+                             true);
+  app_assert_status(sc);
+}
+/**
+* @brief Start the statistics of a new link
+ *
+* @param[out] stats     link statistics
+* @param[in]  server_id server identifier
+*
+* @retval None
+*/
+void lci_link_quality_open(lci_link_stats_t *stats, uint16_t server_id)
+{
+  lci_link_stats_t *stored = find_history(server_id);
+
+  memset(stats, 0, sizeof(*stats));
+  if (stored != NULL) {
+    stats->delivered = stored->delivered;
+    stats->expected = stored->expected;
+    stats->supervision_timeouts = stored->supervision_timeouts;
+    stats->gatt_timeouts = stored->gatt_timeouts;
+    stats->retries = stored->retries;
+    stats->reconnects = stored->reconnects + 1;
+    stats->proactive_reconnects = stored->proactive_reconnects;
+  }
+  stats->server_id = server_id;
+  stats->phy = sl_bt_gap_phy_1m;
+}
+/**
+* @brief Close the statistics of a link and remember its counters
+ *
+* @param[in] stats  link statistics
+* @param[in] reason disconnection reason
+*
+* @retval None
+*/
+void lci_link_quality_close(lci_link_stats_t *stats, uint16_t reason)
+{
+  lci_link_stats_t *stored = find_history(stats->server_id);
+
+  if (reason == SL_STATUS_BT_CTRL_CONNECTION_TIMEOUT) {
+    stats->supervision_timeouts++;
+    app_log_warning("[%04X] Link lost after %u proactive reconnections\n",
+                    stats->server_id,
+                    stats->proactive_reconnects);
+  }
+  if (stored == NULL) {
+    stored = &history[history_next];
+    history_next = (history_next + 1) % HISTORY_MAX;
+    if (history_count < HISTORY_MAX) {
+      history_count++;
+    }
+  }
+  *stored = *stats;
+}
+/**
+* @brief RSSI read from a link
+ *
+* @param[in] stats link statistics
+* @param[in] rssi  RSSI in dBm
+*
+* @retval None
+*/
+void lci_link_quality_on_rssi(lci_link_stats_t *stats, int8_t rssi)
+{
+  if (!stats->rssi_valid) {
+    stats->rssi_q2 = rssi * 4;
+    stats->rssi_valid = true;
+  } else {
+    /* Exponential average, 1/4 weight of the new value */
+    stats->rssi_q2 += (rssi * 4 - stats->rssi_q2) / 4;
+  }
+}
+/**
+* @brief PHY of a link changed
+ *
+* @param[in] stats link statistics
+* @param[in] phy   new PHY
+*
+* @retval None
+*/
+void lci_link_quality_on_phy(lci_link_stats_t *stats, uint8_t phy)
+{
+  stats->phy = phy;
+}
+/**
+* @brief A characteristic read was started on a link
+ *
+* @param[in] stats link statistics
+*
+* @retval None
+*/
+void lci_link_quality_on_read_started(lci_link_stats_t *stats)
+{
+  stats->read_started_ms = get_time_ms();
+  stats->read_pending = true;
+}
+/**
+* @brief A GATT procedure of a link completed
+ *
+* @param[in] stats  link statistics
+* @param[in] result procedure result
+*
+* @retval None
+*/
+void lci_link_quality_on_read_completed(lci_link_stats_t *stats, uint16_t result)
+{
+  stats->read_pending = false;
+  if (result != SL_STATUS_OK) {
+    /* The next read of the loop repeats the failed one */
+    stats->retries++;
+  }
+}
+/**
+* @brief A sample was delivered by a link
+ *
+* @param[in] stats link statistics
+*
+* @retval None
+*/
+void lci_link_quality_on_sample(lci_link_stats_t *stats)
+{
+  stats->delivered++;
+  stats->period_delivered++;
+}
+/**
+* @brief Evaluate a link at the end of a period
+ *
+* @param[in] stats    link statistics
+* @param[in] running  true if the link is reading the sensor
+* @param[in] expected samples the link should deliver in a period
+*
+* @retval action to take on the link
+*/
+lci_link_action_t lci_link_quality_evaluate(lci_link_stats_t *stats,
+                                            bool running,
+                                            uint16_t expected)
+{
+  bool stalled = false;
+  uint16_t delivered = stats->period_delivered;
+  int16_t rssi = stats->rssi_q2 / 4;
+
+  stats->period_delivered = 0;
+  if (!running) {
+    return lci_link_none;
+  }
+  stats->expected += expected;
+  if (stats->read_pending
+      && ((get_time_ms() - stats->read_started_ms) >= LCI_LINK_GATT_TIMEOUT_MS)) {
+    stats->gatt_timeouts++;
+    stalled = true;
+  }
+  if (delivered == 0) {
+    stalled = true;
+  }
+  stats->stalled_periods = stalled ? stats->stalled_periods + 1 : 0;
+  if (stats->rssi_valid && (rssi < LCI_LINK_RSSI_WEAK)) {
+    stats->weak_periods++;
+  } else {
+    stats->weak_periods = 0;
+  }
+
+  if (stats->stalled_periods >= STALLED_RECONNECT_PERIODS) {
+    /* A fresh connection recovers faster than waiting for the timeout */
+    stats->stalled_periods = 0;
+    stats->proactive_reconnects++;
+    return lci_link_reconnect;
+  }
+  if ((stats->weak_periods >= WEAK_PERIODS) && (stats->phy != sl_bt_gap_phy_coded)) {
+    stats->weak_periods = 0;
+    return lci_link_use_coded_phy;
+  }
+  if (stats->rssi_valid && (rssi > LCI_LINK_RSSI_STRONG) && (stats->phy == sl_bt_gap_phy_coded)) {
+    return lci_link_use_1m_phy;
+  }
+  if (!stats->timeout_relaxed && (delivered < (expected / 2))) {
+    /* Ride out short fades instead of losing the link */
+    stats->timeout_relaxed = true;
+    return lci_link_relax_timeout;
+  }
+  return lci_link_none;
+}
+/**
+* @brief Log the statistics of a link
+ *
+* @param[in] stats link statistics
+*
+* @retval None
+*/
+void lci_link_quality_log(const lci_link_stats_t *stats)
+{
+  app_log_info("[%04X] Link - RSSI %d dBm, PHY %u, samples %lu/%lu, "
+               "supervision timeouts %u, GATT timeouts %u, retries %u, reconnects %u",
+               stats->server_id,
+               stats->rssi_q2 / 4,
+               stats->phy,
+               (unsigned long)stats->delivered,
+               (unsigned long)stats->expected,
+               stats->supervision_timeouts,
+               stats->gatt_timeouts,
+               stats->retries,
+               stats->reconnects);
+  app_log_nl();
+}
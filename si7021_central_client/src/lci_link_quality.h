@@ -0,0 +1,70 @@
+/**
+ * @file lci_link_quality.h
+ * @brief Link quality statistics and policy of the central client links
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_LINK_QUALITY_H_
+#define LCI_LINK_QUALITY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+/* Evaluation period of the link policy in milliseconds */
+#define LCI_LINK_PERIOD_MS            1000
+/* External signal raised by the link quality timer */
+#define LCI_LINK_SIGNAL               (1u << 3)
+/* Statistics are exported every n evaluation periods */
+#define LCI_LINK_EXPORT_PERIODS       10
+/* A read not completed within this time is a GATT timeout */
+#define LCI_LINK_GATT_TIMEOUT_MS      500
+/* RSSI levels switching to and back from the coded PHY in dBm */
+#define LCI_LINK_RSSI_WEAK            (-85)
+#define LCI_LINK_RSSI_STRONG          (-72)
+/* Actions of the link policy */
+typedef enum {
+  lci_link_none,
+  lci_link_use_coded_phy,
+  lci_link_use_1m_phy,
+  lci_link_relax_timeout,
+  lci_link_reconnect
+} lci_link_action_t;
+/* Statistics of a link, counters are kept across reconnections */
+typedef struct {
+  uint16_t server_id;
+  bool rssi_valid;
+  /* Averaged RSSI in 0.25 dBm units */
+  int16_t rssi_q2;
+  uint8_t phy;
+  bool timeout_relaxed;
+  uint32_t delivered;
+  uint32_t expected;
+  uint16_t supervision_timeouts;
+  uint16_t gatt_timeouts;
+  uint16_t retries;
+  uint16_t reconnects;
+  uint16_t proactive_reconnects;
+  /* Evaluation state */
+  uint64_t read_started_ms;
+  bool read_pending;
+  uint16_t period_delivered;
+  uint8_t stalled_periods;
+  uint8_t weak_periods;
+} lci_link_stats_t;
+
+void lci_link_quality_init(void);
+void lci_link_quality_open(lci_link_stats_t *stats, uint16_t server_id);
+void lci_link_quality_close(lci_link_stats_t *stats, uint16_t reason);
+void lci_link_quality_on_rssi(lci_link_stats_t *stats, int8_t rssi);
+void lci_link_quality_on_phy(lci_link_stats_t *stats, uint8_t phy);
+void lci_link_quality_on_read_started(lci_link_stats_t *stats);
+void lci_link_quality_on_read_completed(lci_link_stats_t *stats, uint16_t result);
+void lci_link_quality_on_sample(lci_link_stats_t *stats);
+lci_link_action_t lci_link_quality_evaluate(lci_link_stats_t *stats,
+                                            bool running,
+                                            uint16_t expected);
+void lci_link_quality_log(const lci_link_stats_t *stats);
+
+#endif /* LCI_LINK_QUALITY_H_ */
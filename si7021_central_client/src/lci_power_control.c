@@ -0,0 +1,419 @@
+/**
+ * @file lci_power_control.c
+ * @brief Closed-loop TX power control of the central client links
+ *
+ * The path loss of every link is estimated from the TX power reported by
+ * the server through LE Power Control and the RSSI read from the link.
+ * The central TX power is set to the lowest level that keeps the link with
+ * the highest path loss at the target margin above the receiver
+ * sensitivity. Failed GATT transfers raise the margin of their link, clean
+ * periods lower it again. Transfers and errors are accounted per TX power
+ * level to show the power versus packet error trade-off.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "app_assert.h"
+#include "sl_simple_timer.h"
+#include "lci_power_control.h"
+/* Power level values reported for an unknown or unmanaged TX power */
+#define POWER_LEVEL_UNMANAGED         126
+/* Margin added to a link for every period with errors and its limit in dB */
+#define BOOST_STEP_DB                 3
+#define BOOST_MAX_DB                  12
+/* Clean periods before the margin of a link is lowered by 1 dB */
+#define BOOST_DECAY_PERIODS           10
+/* The TX power is lowered only if it is this much above the need, in dB */
+#define LOWER_HYSTERESIS_DB           3
+/* Largest step down of the TX power per period in dB */
+#define LOWER_STEP_DB                 2
+/* Periods between two statistics logs */
+#define STATS_LOG_PERIODS             30
+/* Invalid connection handle */
+#define CONNECTION_INVALID            ((uint8_t)0xFFu)
+/* State of a link */
+typedef struct {
+  uint8_t connection;
+  bool rssi_valid;
+  /* Averaged RSSI in 0.25 dBm units */
+  int16_t rssi_q2;
+  int8_t remote_tx_power;
+  int8_t local_tx_power;
+  uint8_t boost_db;
+  uint8_t clean_periods;
+  uint16_t period_transfers;
+  uint16_t period_errors;
+} link_t;
+/* Links of the central */
+static link_t links[SL_BT_CONFIG_MAX_CONNECTIONS];
+/* Controller timer */
+static sl_simple_timer_t control_timer;
+/* TX power ceiling of the central in dBm */
+static int8_t tx_power;
+/* Periods since the last statistics log */
+static uint16_t stats_periods;
+/* Statistics */
+static lci_power_stats_t stats;
+/* Local functions */
+static void hdl_control_timer_event(sl_simple_timer_t *timer, void *data);
+static link_t *find_link(uint8_t connection);
+static uint8_t bucket_index(int8_t power_dbm);
+static void account(link_t *link, bool ok);
+static int8_t link_need(link_t *link);
+static void set_tx_power(int8_t power_dbm);
+static void log_stats(void);
+/**
+* @brief Controller timer handler, the controller runs in the Bluetooth context
+ *
+* @param[in] timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_control_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+  sl_bt_external_signal(LCI_POWER_CONTROL_SIGNAL);
+}
+/**
+* @brief Find the state of a link
+ *
+* @param[in] connection connection handle
+*
+* @retval link state, NULL if the link is not known
+*/
+static link_t *find_link(uint8_t connection)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == connection) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Statistics bucket of a TX power level
+ *
+* @param[in] power_dbm TX power in dBm
+*
+* @retval bucket index
+*/
+static uint8_t bucket_index(int8_t power_dbm)
+{
+  if (power_dbm <= LCI_POWER_MIN_DBM) {
+    return 0;
+  }
+  if (power_dbm >= LCI_POWER_MAX_DBM) {
+    return LCI_POWER_BUCKETS - 1;
+  }
+  return (uint8_t)((power_dbm - LCI_POWER_MIN_DBM) / LCI_POWER_BUCKET_DB);
+}
+/**
+* @brief Account a transfer at the TX power level of its link
+ *
+* @param[in] link link state
+* @param[in] ok   true if the transfer succeeded
+*
+* @retval None
+*/
+static void account(link_t *link, bool ok)
+{
+  int8_t level = (link->local_tx_power < POWER_LEVEL_UNMANAGED) ? link->local_tx_power : tx_power;
+  lci_power_bucket_t *bucket = &stats.buckets[bucket_index(level)];
+
+  bucket->transfers++;
+  if (!ok) {
+    bucket->errors++;
+  }
+}
+/**
+* @brief Update the margin of a link and compute the TX power it needs
+ *
+* @param[in] link link state
+*
+* @retval TX power needed by the link in dBm
+*/
+static int8_t link_need(link_t *link)
+{
+  int16_t path_loss;
+  int16_t need;
+
+  if (link->period_errors != 0) {
+    link->boost_db = (link->boost_db + BOOST_STEP_DB > BOOST_MAX_DB)
+                     ? BOOST_MAX_DB : link->boost_db + BOOST_STEP_DB;
+    link->clean_periods = 0;
+  } else if ((link->period_transfers != 0) && (link->boost_db != 0)
+             && (++link->clean_periods >= BOOST_DECAY_PERIODS)) {
+    link->boost_db--;
+    link->clean_periods = 0;
+  }
+  link->period_transfers = 0;
+  link->period_errors = 0;
+
+  if (!link->rssi_valid || (link->remote_tx_power >= POWER_LEVEL_UNMANAGED)) {
+    /* Path loss unknown yet */
+    return LCI_POWER_MAX_DBM;
+  }
+  /* Path loss of the server to central direction, assumed symmetric */
+  path_loss = link->remote_tx_power - (link->rssi_q2 / 4);
+  need = path_loss + LCI_POWER_SENSITIVITY_DBM + LCI_POWER_TARGET_MARGIN_DB + link->boost_db;
+  if (need > LCI_POWER_MAX_DBM) {
+    need = LCI_POWER_MAX_DBM;
+  }
+  if (need < LCI_POWER_MIN_DBM) {
+    need = LCI_POWER_MIN_DBM;
+  }
+  return (int8_t)need;
+}
+/**
+* @brief Set the TX power ceiling of the central
+ *
+* @param[in] power_dbm TX power in dBm
+*
+* @retval None
+*/
+static void set_tx_power(int8_t power_dbm)
+{
+  sl_status_t sc;
+  int16_t set_min;
+  int16_t set_max;
+
+  /* Power values in 0.1 dBm units */
+  sc = sl_bt_system_set_tx_power(LCI_POWER_MIN_DBM * 10,
+                                 power_dbm * 10,
+                                 &set_min,
+                                 &set_max);
+  if (sc != SL_STATUS_OK) {
+    stats.rejected++;
+    app_log_status_warning_f(sc, "TX power change failed\n");
+    return;
+  }
+  tx_power = (int8_t)(set_max / 10);
+  stats.tx_power_dbm = tx_power;
+  stats.adjustments++;
+  app_log_debug("TX power %d dBm\n", tx_power);
+}
+/**
+* @brief Log the power versus packet error statistics
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void log_stats(void)
+{
+  app_log_debug("TX power %d dBm, %lu adjustments, %lu link losses\n",
+                tx_power,
+                (unsigned long)stats.adjustments,
+                (unsigned long)stats.link_losses);
+  for (uint8_t i = 0; i < LCI_POWER_BUCKETS; i++) {
+    if (stats.buckets[i].transfers != 0) {
+      app_log_debug("  %3d dBm: %lu transfers, %lu errors\n",
+                    LCI_POWER_MIN_DBM + i * LCI_POWER_BUCKET_DB,
+                    (unsigned long)stats.buckets[i].transfers,
+                    (unsigned long)stats.buckets[i].errors);
+    }
+  }
+}
+/**
+* @brief Initialize the power controller, full power until links are known
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_power_control_init(void)
+{
+  sl_status_t sc;
+
+  memset(&stats, 0, sizeof(stats));
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    links[i].connection = CONNECTION_INVALID;
+  }
+  stats_periods = 0;
+  set_tx_power(LCI_POWER_MAX_DBM);
+  sc = sl_simple_timer_start(&control_timer,
+                             LCI_POWER_CONTROL_PERIOD_MS,
+                             hdl_control_timer_event,
+                             NULL,
+                             true);
+  app_assert_status(sc);
+}
+/**
+* @brief Start controlling a new link
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_power_control_on_opened(uint8_t connection)
+{
+  link_t *link = find_link(CONNECTION_INVALID);
+
+  if (link == NULL) {
+    return;
+  }
+  memset(link, 0, sizeof(*link));
+  link->connection = connection;
+  link->remote_tx_power = 127;
+  link->local_tx_power = 127;
+  /* Local TX power changes made on request of the server */
+  (void)sl_bt_connection_set_power_reporting(connection,
+                                             sl_bt_connection_power_reporting_enable);
+  /* Initial TX power of the server, later changes are reported */
+  (void)sl_bt_connection_get_remote_tx_power(connection, sl_bt_gap_phy_1m);
+}
+/**
+* @brief Stop controlling a closed link
+ *
+* @param[in] connection connection handle
+* @param[in] reason     disconnection reason
+*
+* @retval None
+*/
+void lci_power_control_on_closed(uint8_t connection, uint16_t reason)
+{
+  link_t *link = find_link(connection);
+
+  if (link == NULL) {
+    return;
+  }
+  if (reason == SL_STATUS_BT_CTRL_CONNECTION_TIMEOUT) {
+    /* Link lost at this power level */
+    stats.link_losses++;
+    account(link, false);
+  }
+  link->connection = CONNECTION_INVALID;
+}
+/**
+* @brief RSSI read from a link
+ *
+* @param[in] connection connection handle
+* @param[in] rssi       RSSI in dBm
+*
+* @retval None
+*/
+void lci_power_control_on_rssi(uint8_t connection, int8_t rssi)
+{
+  link_t *link = find_link(connection);
+
+  if (link == NULL) {
+    return;
+  }
+  if (!link->rssi_valid) {
+    link->rssi_q2 = rssi * 4;
+    link->rssi_valid = true;
+  } else {
+    /* Exponential average, 1/4 weight of the new value */
+    link->rssi_q2 += (rssi * 4 - link->rssi_q2) / 4;
+  }
+}
+/**
+* @brief Local TX power of a link changed
+ *
+* @param[in] connection  connection handle
+* @param[in] power_level TX power in dBm
+*
+* @retval None
+*/
+void lci_power_control_on_tx_power(uint8_t connection, int8_t power_level)
+{
+  link_t *link = find_link(connection);
+
+  if (link != NULL) {
+    link->local_tx_power = power_level;
+  }
+}
+/**
+* @brief TX power of the server on a link changed
+ *
+* @param[in] connection  connection handle
+* @param[in] power_level TX power in dBm
+*
+* @retval None
+*/
+void lci_power_control_on_remote_tx_power(uint8_t connection, int8_t power_level)
+{
+  link_t *link = find_link(connection);
+
+  if (link != NULL) {
+    link->remote_tx_power = power_level;
+  }
+}
+/**
+* @brief Result of a GATT transfer on a link
+ *
+* @param[in] connection connection handle
+* @param[in] ok         true if the transfer succeeded
+*
+* @retval None
+*/
+void lci_power_control_on_transfer(uint8_t connection, bool ok)
+{
+  link_t *link = find_link(connection);
+
+  if (link == NULL) {
+    return;
+  }
+  link->period_transfers++;
+  if (!ok) {
+    link->period_errors++;
+  }
+  account(link, ok);
+}
+/**
+* @brief Run the controller at the end of a period
+ *
+* @param[in] signals external signals
+*
+* @retval None
+*/
+void lci_power_control_on_signal(uint32_t signals)
+{
+  int8_t need = LCI_POWER_MIN_DBM;
+  int8_t link_power;
+  bool any_link = false;
+
+  if ((signals & LCI_POWER_CONTROL_SIGNAL) == 0) {
+    return;
+  }
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == CONNECTION_INVALID) {
+      continue;
+    }
+    any_link = true;
+    link_power = link_need(&links[i]);
+    if (link_power > need) {
+      need = link_power;
+    }
+    /* RSSI for the next period */
+    (void)sl_bt_connection_get_rssi(links[i].connection);
+  }
+  if (any_link) {
+    if (need > tx_power) {
+      /* Raise at once, the weakest link is losing margin */
+      set_tx_power(need);
+    } else if (need <= tx_power - LOWER_HYSTERESIS_DB) {
+      /* Lower in small steps */
+      set_tx_power((tx_power - LOWER_STEP_DB > need) ? tx_power - LOWER_STEP_DB : need);
+    }
+  }
+  if (++stats_periods >= STATS_LOG_PERIODS) {
+    stats_periods = 0;
+    log_stats();
+  }
+}
+/**
+* @brief Power controller statistics
+ *
+* @param[in] None
+*
+* @retval pointer to the statistics
+*/
+const lci_power_stats_t *lci_power_control_get_stats(void)
+{
+  return &stats;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file lci_power_control.h
+ * @brief Closed-loop TX power control of the central client links
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_POWER_CONTROL_H_
+#define LCI_POWER_CONTROL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+/* Evaluation period of the controller in milliseconds, RSSI is read from
+ * every link once per period */
+#define LCI_POWER_CONTROL_PERIOD_MS   1000
+/* External signal raised by the controller timer */
+#define LCI_POWER_CONTROL_SIGNAL      (1u << 2)
+/* TX power range of the central in dBm */
+#define LCI_POWER_MIN_DBM             (-10)
+#define LCI_POWER_MAX_DBM             8
+/* Receiver sensitivity assumed for the peer in dBm */
+#define LCI_POWER_SENSITIVITY_DBM     (-90)
+/* Link margin above the sensitivity the controller holds in dB */
+#define LCI_POWER_TARGET_MARGIN_DB    15
+/* Width of the statistics buckets in dB */
+#define LCI_POWER_BUCKET_DB           3
+/* Number of statistics buckets covering the TX power range */
+#define LCI_POWER_BUCKETS             ((LCI_POWER_MAX_DBM - LCI_POWER_MIN_DBM) / LCI_POWER_BUCKET_DB + 1)
+/* Transfers and errors seen at a TX power level */
+typedef struct {
+  uint32_t transfers;
+  uint32_t errors;
+} lci_power_bucket_t;
+/* Controller statistics */
+typedef struct {
+  int8_t tx_power_dbm;
+  uint32_t adjustments;
+  uint32_t rejected;
+  uint32_t link_losses;
+  lci_power_bucket_t buckets[LCI_POWER_BUCKETS];
+} lci_power_stats_t;
+
+void lci_power_control_init(void);
+void lci_power_control_on_opened(uint8_t connection);
+void lci_power_control_on_closed(uint8_t connection, uint16_t reason);
+void lci_power_control_on_rssi(uint8_t connection, int8_t rssi);
+void lci_power_control_on_tx_power(uint8_t connection, int8_t power_level);
+void lci_power_control_on_remote_tx_power(uint8_t connection, int8_t power_level);
+void lci_power_control_on_transfer(uint8_t connection, bool ok);
+void lci_power_control_on_signal(uint32_t signals);
+const lci_power_stats_t *lci_power_control_get_stats(void);
+
+#endif /* LCI_POWER_CONTROL_H_ */
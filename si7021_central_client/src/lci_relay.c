@@ -0,0 +1,387 @@
+/**
+ * @file lci_relay.c
+ * @brief Readings of servers out of range, relayed by connected servers
+ *
+ * A relay forwards every new reading it hears in the beacon of a neighbour.
+ * The same reading reaches the central through every relay in range of the
+ * origin, and through the origin itself if the central is connected to it,
+ * so every reading is checked against the beacon sequence number last seen
+ * of its origin. Readings of connected servers are dropped, their link
+ * reports them first hand.
+ *
+ * The central dates a relayed reading back to the time the relay heard it:
+ * by the age of the entry, the time it waited in the relay, and by the time
+ * of the last hop, from the send time of a relay synchronized to the central
+ * clock. Both are averaged per relay in the statistics.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "sl_sleeptimer.h"
+#include "lci_relay.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Origin of relayed readings */
+typedef struct {
+  bool used;
+  uint16_t id;
+  uint8_t seq;
+  uint32_t seen_ms;
+} origin_t;
+/* Server relaying readings */
+typedef struct {
+  uint8_t connection;
+  uint16_t relay_id;
+  bool started;
+  uint8_t batch_seq;
+  /* Statistics since the last log */
+  uint32_t batches;
+  uint32_t lost;
+  uint32_t readings;
+  uint32_t duplicates;
+  uint32_t direct;
+  uint32_t rejected;
+  uint32_t age_sum;
+  uint32_t transit_sum;
+  uint32_t transits;
+} relay_t;
+static relay_t relays[SL_BT_CONFIG_MAX_CONNECTIONS];
+static origin_t origins[LCI_RELAY_ORIGINS_MAX];
+/* Servers connected to the central */
+static uint16_t direct_ids[SL_BT_CONFIG_MAX_CONNECTIONS];
+static uint8_t direct_count;
+/* Local functions */
+static uint32_t get_time_ms(void);
+static relay_t *find_relay(uint8_t connection);
+static bool is_direct(uint16_t sensor_id);
+static bool is_duplicate(uint16_t id, uint8_t seq, uint32_t now);
+static uint16_t get_u16(const uint8_t *p);
+static uint32_t get_u32(const uint8_t *p);
+/**
+* @brief Read the system time
+ *
+* @param[in] None
+*
+* @retval milliseconds since the boot, wrapping at 32 bits
+*/
+static uint32_t get_time_ms(void)
+{
+  uint64_t ms = 0;
+
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return (uint32_t)ms;
+}
+/**
+* @brief Find a relay
+ *
+* @param[in] connection connection handle
+*
+* @retval relay, NULL if not known
+*/
+static relay_t *find_relay(uint8_t connection)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (relays[i].connection == connection) {
+      return &relays[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Check whether a server is connected to the central
+ *
+* @param[in] sensor_id sensor ID of the server
+*
+* @retval true if connected
+*/
+static bool is_direct(uint16_t sensor_id)
+{
+  for (uint8_t i = 0; i < direct_count; i++) {
+    if (direct_ids[i] == sensor_id) {
+      return true;
+    }
+  }
+  return false;
+}
+/**
+* @brief Check a reading against the last one of its origin
+*
+* The origin seen the longest ago makes room for a new one.
+ *
+* @param[in] id  sensor ID of the origin
+* @param[in] seq beacon sequence number of the reading
+* @param[in] now central time in milliseconds
+*
+* @retval true if the reading arrived already
+*/
+static bool is_duplicate(uint16_t id, uint8_t seq, uint32_t now)
+{
+  origin_t *origin = &origins[0];
+
+  for (uint8_t i = 0; i < LCI_RELAY_ORIGINS_MAX; i++) {
+    if (origins[i].used && (origins[i].id == id)) {
+      origin = &origins[i];
+      if ((origin->seq == seq) && ((now - origin->seen_ms) < LCI_RELAY_DEDUPE_MS)) {
+        return true;
+      }
+      break;
+    }
+    if (!origins[i].used) {
+      origin = &origins[i];
+    } else if (origin->used && ((now - origins[i].seen_ms) > (now - origin->seen_ms))) {
+      origin = &origins[i];
+    }
+  }
+  origin->used = true;
+  origin->id = id;
+  origin->seq = seq;
+  origin->seen_ms = now;
+  return false;
+}
+/**
+* @brief Read a 16-bit little-endian value
+ *
+* @param[in] p source
+*
+* @retval value
+*/
+static uint16_t get_u16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+/**
+* @brief Read a 32-bit little-endian value
+ *
+* @param[in] p source
+*
+* @retval value
+*/
+static uint32_t get_u32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+/**
+* @brief Initialize the relay tables
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_relay_init(void)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    relays[i].connection = CONNECTION_HANDLE_INVALID;
+  }
+  for (uint8_t i = 0; i < LCI_RELAY_ORIGINS_MAX; i++) {
+    origins[i].used = false;
+  }
+  direct_count = 0;
+}
+/**
+* @brief Track the servers connected to the central
+ *
+* @param[in] sensor_id sensor ID of the server
+* @param[in] direct    true when connected, false when disconnected
+*
+* @retval None
+*/
+void lci_relay_set_direct(uint16_t sensor_id, bool direct)
+{
+  for (uint8_t i = 0; i < direct_count; i++) {
+    if (direct_ids[i] == sensor_id) {
+      if (!direct) {
+        direct_ids[i] = direct_ids[--direct_count];
+      }
+      return;
+    }
+  }
+  if (direct && (direct_count < SL_BT_CONFIG_MAX_CONNECTIONS)) {
+    direct_ids[direct_count++] = sensor_id;
+  }
+}
+/**
+* @brief Handle a batch notified by a relay
+ *
+* @param[in]  connection connection handle of the relay
+* @param[in]  relay_id   sensor ID of the relay
+* @param[in]  data       batch
+* @param[in]  len        batch length
+* @param[out] readings   new readings, room for LCI_RELAY_BATCH_MAX
+*
+* @retval number of new readings
+*/
+uint8_t lci_relay_on_batch(uint8_t connection,
+                           uint16_t relay_id,
+                           const uint8_t *data,
+                           uint8_t len,
+                           lci_relay_reading_t *readings)
+{
+  relay_t *relay = find_relay(connection);
+  uint32_t now = get_time_ms();
+  uint32_t transit = 0;
+  uint8_t count;
+  uint8_t found = 0;
+
+  if (relay == NULL) {
+    relay = find_relay(CONNECTION_HANDLE_INVALID);
+    if (relay == NULL) {
+      return 0;
+    }
+    relay->connection = connection;
+    relay->relay_id = relay_id;
+    relay->started = false;
+    relay->batches = 0;
+    relay->lost = 0;
+    relay->readings = 0;
+    relay->duplicates = 0;
+    relay->direct = 0;
+    relay->rejected = 0;
+    relay->age_sum = 0;
+    relay->transit_sum = 0;
+    relay->transits = 0;
+  }
+  if (len < LCI_RELAY_HEADER_SIZE) {
+    return 0;
+  }
+  /* Batches lost on the way, the relay numbers every batch it sends */
+  if (relay->started) {
+    relay->lost += (uint8_t)(data[0] - relay->batch_seq - 1);
+  }
+  relay->started = true;
+  relay->batch_seq = data[0];
+  relay->batches++;
+  if (data[1] & LCI_RELAY_FLAG_SYNCED) {
+    /* A send time ahead of the arrival is the error of the sync */
+    int32_t hop = (int32_t)(now - get_u32(&data[2]));
+    transit = (hop > 0) ? (uint32_t)hop : 0;
+    relay->transit_sum += transit;
+    relay->transits++;
+  }
+  count = data[6];
+  if (count > ((len - LCI_RELAY_HEADER_SIZE) / LCI_RELAY_ENTRY_SIZE)) {
+    count = (uint8_t)((len - LCI_RELAY_HEADER_SIZE) / LCI_RELAY_ENTRY_SIZE);
+  }
+  if (count > LCI_RELAY_BATCH_MAX) {
+    count = LCI_RELAY_BATCH_MAX;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t *entry = &data[LCI_RELAY_HEADER_SIZE + (i * LCI_RELAY_ENTRY_SIZE)];
+    uint16_t origin = get_u16(&entry[0]);
+    uint16_t age = get_u16(&entry[4]);
+
+    if ((entry[3] == 0) || (entry[3] > LCI_RELAY_HOPS_MAX) || (origin == relay_id)) {
+      relay->rejected++;
+      continue;
+    }
+    if (is_direct(origin)) {
+      relay->direct++;
+      continue;
+    }
+    if (is_duplicate(origin, entry[2], now)) {
+      relay->duplicates++;
+      continue;
+    }
+    relay->readings++;
+    relay->age_sum += age;
+    readings[found].origin = origin;
+    readings[found].timestamp_ms = now - transit - age;
+    readings[found].temperature = (int16_t)get_u16(&entry[6]);
+    readings[found].humidity = get_u16(&entry[8]);
+    found++;
+  }
+  return found;
+}
+/**
+* @brief A relay disconnected
+ *
+* @param[in] connection closed connection handle
+*
+* @retval None
+*/
+void lci_relay_on_closed(uint8_t connection)
+{
+  relay_t *relay = find_relay(connection);
+
+  if (relay != NULL) {
+    relay->connection = CONNECTION_HANDLE_INVALID;
+  }
+}
+/**
+* @brief Log and restart the statistics of every relay
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_relay_log(void)
+{
+  relay_t *relay;
+
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    relay = &relays[i];
+    if ((relay->connection == CONNECTION_HANDLE_INVALID) || (relay->batches == 0)) {
+      continue;
+    }
+    app_log_info("[%04X] Relay: %lu readings in %lu batches, %lu lost, %lu duplicates, "
+                 "%lu direct, %lu rejected, buffered %lu ms, last hop %lu ms\n",
+                 relay->relay_id,
+                 (unsigned long)relay->readings,
+                 (unsigned long)relay->batches,
+                 (unsigned long)relay->lost,
+                 (unsigned long)relay->duplicates,
+                 (unsigned long)relay->direct,
+                 (unsigned long)relay->rejected,
+                 (unsigned long)((relay->readings != 0) ? (relay->age_sum / relay->readings) : 0),
+                 (unsigned long)((relay->transits != 0) ? (relay->transit_sum / relay->transits) : 0));
+    relay->batches = 0;
+    relay->lost = 0;
+    relay->readings = 0;
+    relay->duplicates = 0;
+    relay->direct = 0;
+    relay->rejected = 0;
+    relay->age_sum = 0;
+    relay->transit_sum = 0;
+    relay->transits = 0;
+  }
+}
+/**
+* @brief Pack a relayed reading for the queue of the acquisition task
+ *
+* @param[in]  reading relayed reading
+* @param[out] value   LCI_RELAY_READING_SIZE bytes
+*
+* @retval None
+*/
+void lci_relay_pack(const lci_relay_reading_t *reading, uint8_t *value)
+{
+  value[0] = (uint8_t)reading->timestamp_ms;
+  value[1] = (uint8_t)(reading->timestamp_ms >> 8);
+  value[2] = (uint8_t)(reading->timestamp_ms >> 16);
+  value[3] = (uint8_t)(reading->timestamp_ms >> 24);
+  value[4] = (uint8_t)reading->temperature;
+  value[5] = (uint8_t)(reading->temperature >> 8);
+  value[6] = (uint8_t)reading->humidity;
+  value[7] = (uint8_t)(reading->humidity >> 8);
+}
+/**
+* @brief Unpack a relayed reading, the origin is not part of it
+ *
+* @param[in]  value   packed reading
+* @param[in]  len     packed reading length
+* @param[out] reading relayed reading
+*
+* @retval true if unpacked, false if the value is too short
+*/
+bool lci_relay_unpack(const uint8_t *value, uint8_t len, lci_relay_reading_t *reading)
+{
+  if (len < LCI_RELAY_READING_SIZE) {
+    return false;
+  }
+  reading->timestamp_ms = get_u32(&value[0]);
+  reading->temperature = (int16_t)get_u16(&value[4]);
+  reading->humidity = get_u16(&value[6]);
+  return true;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file lci_relay.h
+ * @brief Readings of servers out of range, relayed by connected servers
+ *
+ * SI7021 servers built as relays notify the readings of the neighbours they
+ * hear in batches on the LCI Relay service, see the README of the SI7021
+ * peripheral server for the layout.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_RELAY_H_
+#define LCI_RELAY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+/* Batch layout */
+#define LCI_RELAY_HEADER_SIZE         7
+#define LCI_RELAY_ENTRY_SIZE          10
+#define LCI_RELAY_FLAG_SYNCED         0x01
+/* Entries of one batch at most */
+#define LCI_RELAY_BATCH_MAX           16
+/* Readings that went through more relays are dropped, relays only forward
+ * what they hear from the origin */
+#define LCI_RELAY_HOPS_MAX            1
+/* Origins tracked for their beacon sequence numbers */
+#define LCI_RELAY_ORIGINS_MAX         32
+/* The same reading of an origin arriving again within this time is a
+ * duplicate, a relay repeats an unchanged reading after 10 seconds */
+#define LCI_RELAY_DEDUPE_MS           5000
+/* Size of a relayed reading packed into a reading of the application */
+#define LCI_RELAY_READING_SIZE        8
+/* Reading of a server out of range */
+typedef struct {
+  uint16_t origin;
+  /* Central time the relay heard the reading */
+  uint32_t timestamp_ms;
+  /* 0.01 degree Celsius and 0.01 %RH */
+  int32_t temperature;
+  int32_t humidity;
+} lci_relay_reading_t;
+
+void lci_relay_init(void);
+void lci_relay_set_direct(uint16_t sensor_id, bool direct);
+uint8_t lci_relay_on_batch(uint8_t connection,
+                           uint16_t relay_id,
+                           const uint8_t *data,
+                           uint8_t len,
+                           lci_relay_reading_t *readings);
+void lci_relay_on_closed(uint8_t connection);
+void lci_relay_log(void);
+void lci_relay_pack(const lci_relay_reading_t *reading, uint8_t *value);
+bool lci_relay_unpack(const uint8_t *value, uint8_t len, lci_relay_reading_t *reading);
+
+#endif /* LCI_RELAY_H_ */
@@ -0,0 +1,301 @@
+/**
+ * @file lci_scan_scheduler.c
+ * @brief Adaptive duty-cycled scanner of the central client
+ *
+ * The scanner runs at full duty cycle only while fewer servers than
+ * expected are connected and new servers keep showing up. Once the
+ * expected servers are connected, or nothing new was heard for a while,
+ * the duty cycle is reduced. Passive scanning is used by default, active
+ * scanning and the coded PHY are tried in turns while nothing is found.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "app_assert.h"
+#include "sl_simple_timer.h"
+#include "lci_scan_scheduler.h"
+/* Scanning modes */
+#define SCAN_PASSIVE                  0
+#define SCAN_ACTIVE                   1
+/* Idle evaluation periods before the relaxed profile is used */
+#define SCAN_RELAX_WINDOWS            10
+/* Every n-th idle evaluation period is scanned actively */
+#define SCAN_ACTIVE_EVERY             4
+/* Size of the table of recently matched servers */
+#define SCAN_SEEN_MAX                 8
+/* Scan profile */
+typedef struct {
+  const char *name;
+  uint8_t phy;
+  uint8_t mode;
+  uint16_t interval;
+  uint16_t window;
+} scan_profile_t;
+/* Scan profiles, interval and window in 0.625 ms units */
+static const scan_profile_t scan_profiles[lci_scan_profile_num] = {
+  /* 10 ms / 10 ms, 100 % duty cycle */
+  [lci_scan_aggressive]        = { "aggressive", sl_bt_gap_1m_phy, SCAN_PASSIVE, 16, 16 },
+  /* 10 ms / 10 ms, scan responses requested */
+  [lci_scan_aggressive_active] = { "active", sl_bt_gap_1m_phy, SCAN_ACTIVE, 16, 16 },
+  /* 30 ms / 30 ms on the coded PHY */
+  [lci_scan_coded]             = { "coded", sl_bt_gap_coded_phy, SCAN_PASSIVE, 48, 48 },
+  /* 100 ms / 20 ms, 20 % duty cycle */
+  [lci_scan_relaxed]           = { "relaxed", sl_bt_gap_1m_phy, SCAN_PASSIVE, 160, 32 },
+  /* 1 s / 20 ms, 2 % duty cycle */
+  [lci_scan_backoff]           = { "backoff", sl_bt_gap_1m_phy, SCAN_PASSIVE, 1600, 32 },
+};
+/* Number of servers the central is expected to connect to */
+static uint8_t expected;
+/* Scanner state */
+static bool scanning;
+static lci_scan_profile_t profile;
+/* Evaluation timer */
+static sl_simple_timer_t eval_timer;
+/* Counters of the current evaluation period */
+static uint32_t period_reports;
+static uint16_t period_matches;
+static uint8_t period_new_devices;
+/* Evaluation periods without new servers */
+static uint16_t idle_windows;
+/* Recently matched servers, used to count new devices */
+static bd_addr seen[SCAN_SEEN_MAX];
+static uint8_t seen_count;
+static uint8_t seen_next;
+/* Statistics of the last evaluation period */
+static lci_scan_stats_t stats;
+/* Local functions */
+static void hdl_eval_timer_event(sl_simple_timer_t *timer, void *data);
+static lci_scan_profile_t select_profile(uint8_t active_connections);
+static sl_status_t apply_profile(lci_scan_profile_t new_profile);
+static bool remember_device(const bd_addr *address);
+/**
+* @brief Evaluation timer handler, the policy runs in the Bluetooth context
+ *
+* @param[in] timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_eval_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+  sl_bt_external_signal(LCI_SCAN_SIGNAL_EVAL);
+}
+/**
+* @brief Select the scan profile
+ *
+* @param[in] active_connections number of connected servers
+*
+* @retval scan profile
+*/
+static lci_scan_profile_t select_profile(uint8_t active_connections)
+{
+  if (active_connections >= expected) {
+    /* Only looking for additional servers */
+    return lci_scan_backoff;
+  }
+  if (idle_windows >= SCAN_RELAX_WINDOWS) {
+    return lci_scan_relaxed;
+  }
+  if ((idle_windows != 0) && ((idle_windows % SCAN_ACTIVE_EVERY) == 0)) {
+    /* The service UUID may only be in the scan response */
+    return lci_scan_aggressive_active;
+  }
+#if LCI_SCAN_CODED_PHY
+  if ((idle_windows % 2) != 0) {
+    /* Servers out of 1M range may be heard on the coded PHY */
+    return lci_scan_coded;
+  }
+#endif
+  return lci_scan_aggressive;
+}
+/**
+* @brief Configure the scanner for a profile and (re)start it
+ *
+* @param[in] new_profile scan profile
+*
+* @retval SL_STATUS_OK if scanning, error code otherwise
+*/
+static sl_status_t apply_profile(lci_scan_profile_t new_profile)
+{
+  sl_status_t sc;
+  const scan_profile_t *p = &scan_profiles[new_profile];
+
+  if (scanning) {
+    sc = sl_bt_scanner_stop();
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+    scanning = false;
+  }
+  sc = sl_bt_scanner_set_mode(p->phy, p->mode);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  sc = sl_bt_scanner_set_timing(p->phy, p->interval, p->window);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  sc = sl_bt_scanner_start(p->phy, sl_bt_scanner_discover_generic);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  if (new_profile != profile) {
+    app_log_debug("Scan profile %s\n", p->name);
+  }
+  profile = new_profile;
+  scanning = true;
+  return SL_STATUS_OK;
+}
+/**
+* @brief Remember a matched server
+ *
+* @param[in] address server address
+*
+* @retval true if the server was not matched recently
+*/
+static bool remember_device(const bd_addr *address)
+{
+  for (uint8_t i = 0; i < seen_count; i++) {
+    if (memcmp(&seen[i], address, sizeof(bd_addr)) == 0) {
+      return false;
+    }
+  }
+  seen[seen_next] = *address;
+  seen_next = (seen_next + 1) % SCAN_SEEN_MAX;
+  if (seen_count < SCAN_SEEN_MAX) {
+    seen_count++;
+  }
+  return true;
+}
+/**
+* @brief Initialize the scan scheduler
+ *
+* @param[in] expected_sensors number of servers the central should connect to
+*
+* @retval None
+*/
+void lci_scan_scheduler_init(uint8_t expected_sensors)
+{
+  expected = expected_sensors;
+  scanning = false;
+  profile = lci_scan_aggressive;
+  idle_windows = 0;
+  seen_count = 0;
+  seen_next = 0;
+  memset(&stats, 0, sizeof(stats));
+}
+/**
+* @brief Start scanning with the profile selected by the policy
+ *
+* @param[in] active_connections number of connected servers
+*
+* @retval SL_STATUS_OK if scanning, error code otherwise
+*/
+sl_status_t lci_scan_scheduler_start(uint8_t active_connections)
+{
+  sl_status_t sc;
+
+  period_reports = 0;
+  period_matches = 0;
+  period_new_devices = 0;
+  sc = apply_profile(select_profile(active_connections));
+  if (sc == SL_STATUS_OK) {
+    sc = sl_simple_timer_start(&eval_timer,
+                               LCI_SCAN_EVAL_PERIOD_MS,
+                               hdl_eval_timer_event,
+                               NULL,
+                               true);
+  }
+  return sc;
+}
+/**
+* @brief Stop scanning
+ *
+* @param[in] None
+*
+* @retval SL_STATUS_OK if stopped, error code otherwise
+*/
+sl_status_t lci_scan_scheduler_stop(void)
+{
+  (void)sl_simple_timer_stop(&eval_timer);
+  if (!scanning) {
+    return SL_STATUS_OK;
+  }
+  scanning = false;
+  return sl_bt_scanner_stop();
+}
+/**
+* @brief Account a scan report
+ *
+* @param[in] report scan report
+* @param[in] match  true if the report is from a supported server
+*
+* @retval None
+*/
+void lci_scan_scheduler_on_report(const sl_bt_evt_scanner_scan_report_t *report, bool match)
+{
+  period_reports++;
+  if (match) {
+    period_matches++;
+    if (remember_device(&report->address)) {
+      period_new_devices++;
+      idle_windows = 0;
+    }
+  }
+}
+/**
+* @brief Evaluate the policy at the end of an evaluation period
+ *
+* @param[in] signals            external signals
+* @param[in] active_connections number of connected servers
+*
+* @retval None
+*/
+void lci_scan_scheduler_on_signal(uint32_t signals, uint8_t active_connections)
+{
+  sl_status_t sc;
+  lci_scan_profile_t new_profile;
+
+  if (((signals & LCI_SCAN_SIGNAL_EVAL) == 0) || !scanning) {
+    return;
+  }
+  stats.profile = profile;
+  stats.reports_per_s = (period_reports * 1000u) / LCI_SCAN_EVAL_PERIOD_MS;
+  stats.matches = period_matches;
+  stats.new_devices = period_new_devices;
+  if (period_new_devices == 0) {
+    idle_windows++;
+  }
+  stats.idle_windows = idle_windows;
+  app_log_debug("Scan %s: %lu reports/s, %u matches, %u new devices\n",
+                scan_profiles[profile].name,
+                (unsigned long)stats.reports_per_s,
+                stats.matches,
+                stats.new_devices);
+  period_reports = 0;
+  period_matches = 0;
+  period_new_devices = 0;
+
+  new_profile = select_profile(active_connections);
+  if (new_profile != profile) {
+    sc = apply_profile(new_profile);
+    if (sc != SL_STATUS_OK) {
+      app_log_status_warning_f(sc, "Scan profile change failed\n");
+    }
+  }
+}
+/**
+* @brief Scan statistics of the last evaluation period
+ *
+* @param[in] None
+*
+* @retval pointer to the statistics
+*/
+const lci_scan_stats_t *lci_scan_scheduler_get_stats(void)
+{
+  return &stats;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file lci_scan_scheduler.h
+ * @brief Adaptive duty-cycled scanner of the central client
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_SCAN_SCHEDULER_H_
+#define LCI_SCAN_SCHEDULER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+/* Evaluation period of the scan policy in milliseconds */
+#define LCI_SCAN_EVAL_PERIOD_MS       1000
+/* External signal raised by the evaluation timer */
+#define LCI_SCAN_SIGNAL_EVAL          (1u << 1)
+/* Set to 1 to alternate with scanning on the coded PHY, needs servers
+ * that use extended advertising on the coded PHY */
+#ifndef LCI_SCAN_CODED_PHY
+#define LCI_SCAN_CODED_PHY            0
+#endif
+/* Scan profiles */
+typedef enum {
+  lci_scan_aggressive,
+  lci_scan_aggressive_active,
+  lci_scan_coded,
+  lci_scan_relaxed,
+  lci_scan_backoff,
+  lci_scan_profile_num
+} lci_scan_profile_t;
+/* Statistics of the last evaluation period */
+typedef struct {
+  lci_scan_profile_t profile;
+  uint32_t reports_per_s;
+  uint16_t matches;
+  uint8_t new_devices;
+  uint16_t idle_windows;
+} lci_scan_stats_t;
+
+void lci_scan_scheduler_init(uint8_t expected_sensors);
+sl_status_t lci_scan_scheduler_start(uint8_t active_connections);
+sl_status_t lci_scan_scheduler_stop(void);
+void lci_scan_scheduler_on_report(const sl_bt_evt_scanner_scan_report_t *report, bool match);
+void lci_scan_scheduler_on_signal(uint32_t signals, uint8_t active_connections);
+const lci_scan_stats_t *lci_scan_scheduler_get_stats(void);
+
+#endif /* LCI_SCAN_SCHEDULER_H_ */
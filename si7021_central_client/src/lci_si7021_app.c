@@ -12,29 +12,70 @@
 #include "app_assert.h"
 #include "sl_bluetooth.h"
 #include "gatt_db.h"
-/* Bluetooth Low Energy connection parameters */
-#define CONN_INTERVAL_MIN             80   /* 100 milliseconds */
-#define CONN_INTERVAL_MAX             80   /* 100 milliseconds */
+#include "sl_component_catalog.h"
+#include "lci_telemetry.h"
+#include "lci_fixed_point.h"
+#include "lci_known_peers.h"
+#include "lci_scan_scheduler.h"
+#include "lci_power_control.h"
+#include "lci_link_quality.h"
+#include "lci_conn_scheduler.h"
+#include "lci_error.h"
+#include "lci_gatt_client.h"
+#include "lci_fleet_ota.h"
+#include "lci_time_sync.h"
+#include "lci_relay.h"
+#include "lci_bonding.h"
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+#include "lci_rtos.h"
+#endif
+/* Bluetooth Low Energy connection parameters, the interval and connection
+ * event length of every link are set by the connection scheduler */
 #define CONN_RESPONDER_LATENCY        0    /* no latency */
 #define CONN_TIMEOUT                  100  /* 1000 milliseconds */
-#define CONN_MIN_CE_LENGTH            0
-#define CONN_MAX_CE_LENGTH            0xffff
-/* Bluetooth Low Energy scanning parameters */
-#define SCAN_INTERVAL                 16   /* 10 milliseconds */
-#define SCAN_WINDOW                   16   /* 10 milliseconds */
-#define SCAN_PASSIVE                  0
-/* Temperature and humidity invalidated values */
-#define TEMP_INVALID                  0
-#define HUM_INVALID                   0
+/* Supervision timeout of a link that keeps missing samples */
+#define CONN_RELAXED_TIMEOUT          400  /* 4000 milliseconds */
+/* Number of servers after which the scanner backs off */
+#ifndef SCAN_EXPECTED_SENSORS
+#define SCAN_EXPECTED_SENSORS         SL_BT_CONFIG_MAX_CONNECTIONS
+#endif
+/* Set to 1 to reconnect to known servers through the filter accept list */
+#ifndef ACCEPT_LIST_RECONNECT
+#define ACCEPT_LIST_RECONNECT         0
+#endif
+/* Time spent reconnecting to known servers before discovering new ones */
+#define ACCEPT_LIST_TIMEOUT_MS        3000
+/* Time spent discovering new servers while known servers are missing */
+#define DISCOVERY_TIMEOUT_MS          3000
+/* External signal raised by the reconnect timer */
+#define SIGNAL_RECONNECT_TIMEOUT      (1u << 0)
+/* External signals raised by the retry timers of failed calls */
+#define SIGNAL_CONNECT_RETRY          (1u << 4)
+#define SIGNAL_READ_RETRY             (1u << 5)
+#if ACCEPT_LIST_RECONNECT
+#include "sl_simple_timer.h"
+#endif
 /* Bluetooth Low Energy invalidated  handles */
 #define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
-#define SERVICE_HANDLE_INVALID        ((uint32_t)0xFFFFFFFFu)
-#define CHARACTERISTIC_HANDLE_INVALID ((uint16_t)0xFFFFu)
+#define CHARACTERISTIC_HANDLE_INVALID LCI_GATT_CLIENT_HANDLE_NONE
 #define TABLE_INDEX_INVALID           ((uint8_t)0xFFu)
 /* Minimum number of connections is one */
 #if SL_BT_CONFIG_MAX_CONNECTIONS < 1
   #error At least 1 connection has to be enabled!
 #endif
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/* Task stack sizes in StackType_t words */
+#define ACQUISITION_TASK_STACK_SIZE   (512 / sizeof(StackType_t))
+#define TELEMETRY_TASK_STACK_SIZE     (1024 / sizeof(StackType_t))
+/* Task priorities, both below the Bluetooth stack tasks */
+#define ACQUISITION_TASK_PRIO         (tskIDLE_PRIORITY + 2)
+#define TELEMETRY_TASK_PRIO           (tskIDLE_PRIORITY + 1)
+/* Telemetry task wake up period, polls the host acknowledgements */
+#define TELEMETRY_TASK_PERIOD_MS      100
+/* Queue capacities, power of two */
+#define READING_QUEUE_SIZE            16
+#define TELEMETRY_QUEUE_SIZE          16
+#endif
 /* Connection's states */
 typedef enum {
   scanning,
@@ -44,15 +85,26 @@ typedef enum {
   enable_indication,
   running
 } conn_state_t;
+/* Time a reading is dated with */
+typedef enum {
+  /* Arrival at the central */
+  stamp_arrival,
+  /* Sampling instant of a server synchronized to the central clock */
+  stamp_synced,
+  /* Time a relay heard the reading of a server out of range */
+  stamp_relayed
+} stamp_t;
 /* Connection's property structure */
 typedef struct {
   uint8_t  connection_handle;
   uint16_t server_address;
-  uint32_t envsens_service_handle;
-  uint16_t envsens_humidity_characteristic_handle;
-  uint16_t envsens_temp_characteristic_handle;
-  int16_t temp;
-  uint16_t humidity;
+  /* Services and characteristics of the server, from the profile table */
+  lci_gatt_client_t client;
+  /* Characteristic of a failed read waiting for its retry */
+  uint16_t retry_characteristic_handle;
+  /* Backoff of the failed reads of the link */
+  lci_error_retry_t read_retry;
+  lci_link_stats_t link;
 } conn_properties_t;
 /* Array for holding properties of multiple (parallel) connections */
 static conn_properties_t conn_properties[SL_BT_CONFIG_MAX_CONNECTIONS];
@@ -60,24 +112,93 @@ static conn_properties_t conn_properties[SL_BT_CONFIG_MAX_CONNECTIONS];
 static uint8_t active_connections_num;
 /* State of the connection under establishment */
 static conn_state_t conn_state;
-/* Environmental Sensing service UUID defined by Bluetooth SIG */
-static const uint8_t envsens_service[2] = { 0x1A, 0x18 };
-/* Environmental Sensing Humidity characteristic UUID defined by Bluetooth SIG */
-static const uint8_t envsens_humidity_char[2] = { 0x6f, 0x2a };
-/* Environmental Sensing Temperature characteristic UUID defined by Bluetooth SIG */
-static const uint8_t envsens_temp_char[2] = { 0x6e, 0x2a };
-/* GATT read temperature flag */
-static bool bf_read_temp;
-/* ASCII code for degree celsious sign */
-static const uint8_t celsious_ascii_code = 248;
+#if ACCEPT_LIST_RECONNECT
+/* Timer switching between accept list reconnection and discovery */
+static sl_simple_timer_t reconnect_timer;
+/* Handle of the connection initiated with the accept list */
+static uint8_t accept_list_connection = CONNECTION_HANDLE_INVALID;
+/* The last accept list attempt timed out, discover new servers next */
+static bool accept_list_expired;
+#endif
+/* Retries of a failed scanner start or connection open */
+static lci_error_retry_t connect_retry;
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/* Characteristic reading passed between the tasks */
+typedef struct {
+  uint16_t server_address;
+  uint8_t profile;
+  uint8_t desc;
+  uint8_t instance;
+  uint8_t len;
+  uint8_t value[LCI_GATT_VALUE_MAX];
+} reading_t;
+/* Decoded sample passed to the telemetry task */
+typedef struct {
+  uint16_t server_address;
+  uint8_t profile;
+  uint8_t desc;
+  uint8_t instance;
+  int32_t value;
+  stamp_t stamp;
+  uint32_t timestamp_ms;
+} sample_t;
+/* Bluetooth event task -> sensor acquisition task */
+static reading_t reading_queue_storage[READING_QUEUE_SIZE];
+static lci_spsc_queue_t reading_queue;
+/* Sensor acquisition task -> telemetry task */
+static sample_t telemetry_queue_storage[TELEMETRY_QUEUE_SIZE];
+static lci_spsc_queue_t telemetry_queue;
+/* Statically allocated tasks */
+static StackType_t acquisition_task_stack[ACQUISITION_TASK_STACK_SIZE];
+static lci_rtos_task_t acquisition_task;
+static StackType_t telemetry_task_stack[TELEMETRY_TASK_STACK_SIZE];
+static lci_rtos_task_t telemetry_task;
+/* Kernel task functions */
+static void acquisition_task_fn(void *arg);
+static void telemetry_task_fn(void *arg);
+static void queue_sample(const sample_t *sample);
+static void queue_rht(sample_t *sample, int32_t temperature, int32_t humidity);
+#endif
 /* Local functions for handling BLuetooth Low Energy scanning and connections */
 static void init_properties(void);
-static uint8_t find_service_in_advertisement(uint8_t *data, uint8_t len);
 static uint8_t find_index_by_connection_handle(uint8_t connection);
 static void add_connection(uint8_t connection, uint16_t address);
 static void remove_connection(uint8_t connection);
 static bd_addr *read_and_cache_bluetooth_address(uint8_t *address_type_out);
 static void print_bluetooth_address(void);
+static void start_connecting(void);
+static void teardown_connection(uint8_t connection);
+static void read_characteristic(uint8_t table_index, uint16_t characteristic);
+static void retry_reads(void);
+#if LCI_BONDING
+static void release_read(uint8_t connection);
+#endif
+static void scan_for_apploaders(void);
+static void continue_discovery(void);
+#if ACCEPT_LIST_RECONNECT
+static void hdl_reconnect_timer_event(sl_simple_timer_t *timer, void *data);
+#endif
+static void report_reading(uint16_t server_address,
+                           uint8_t profile,
+                           uint8_t desc,
+                           uint8_t instance,
+                           int32_t value,
+                           stamp_t stamp,
+                           uint32_t timestamp_ms);
+#if !defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+static void report_rht(uint16_t server_address,
+                       int32_t temperature,
+                       int32_t humidity,
+                       stamp_t stamp,
+                       uint32_t timestamp_ms);
+#endif
+static void handle_relay_batch(uint8_t table_index, const uint8_t *data, uint8_t len);
+static void handle_reading(uint8_t table_index,
+                           const lci_gatt_client_char_t *characteristic,
+                           uint8_t *data,
+                           uint8_t len);
+static void evaluate_links(void);
+static void export_link_stats(void);
 /**
 * @brief Initialize connection properties
  *
@@ -92,41 +213,9 @@ static void init_properties(void)
 
   for (i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
     conn_properties[i].connection_handle = CONNECTION_HANDLE_INVALID;
-    conn_properties[i].envsens_service_handle = SERVICE_HANDLE_INVALID;
-    conn_properties[i].envsens_humidity_characteristic_handle = CHARACTERISTIC_HANDLE_INVALID;
-    conn_properties[i].envsens_temp_characteristic_handle = CHARACTERISTIC_HANDLE_INVALID;
-    conn_properties[i].humidity = HUM_INVALID;
-    conn_properties[i].temp = TEMP_INVALID;
-  }
-}
-/**
-* @brief Parse advertisements looking for environment sensing service
- *
-* @param[in] data pointer to advertising data
-* @param[in] len  length of advertising data
-*
-* @retval 1 if Environmental sensing service UUID is found in advertising,
-*         0 otherwise
-*/
-static uint8_t find_service_in_advertisement(uint8_t *data, uint8_t len)
-{
-  uint8_t ad_field_length;
-  uint8_t ad_field_type;
-  uint8_t i = 0;
-  /* Parse advertisement packet */
-  while (i < len) {
-    ad_field_length = data[i];
-    ad_field_type = data[i + 1];
-    if (ad_field_type == 0x02 || ad_field_type == 0x03) {
-      /* Compare UUID to Environmental sensing service UUID */
-      if (memcmp(&data[i + 2], envsens_service, 2) == 0) {
-        return 1;
-      }
-    }
-    /* Advance to the next AD structure */
-    i = i + ad_field_length + 1;
+    lci_gatt_client_reset(&conn_properties[i].client);
+    conn_properties[i].retry_characteristic_handle = CHARACTERISTIC_HANDLE_INVALID;
   }
-  return 0;
 }
 /**
 * @brief Find the index of a given connection in the connection_properties array
@@ -156,8 +245,15 @@ static uint8_t find_index_by_connection_handle(uint8_t connection)
 */
 static void add_connection(uint8_t connection, uint16_t address)
 {
+  if (active_connections_num >= SL_BT_CONFIG_MAX_CONNECTIONS) {
+    return;
+  }
   conn_properties[active_connections_num].connection_handle = connection;
   conn_properties[active_connections_num].server_address    = address;
+  lci_error_retry_init(&conn_properties[active_connections_num].read_retry, SIGNAL_READ_RETRY);
+  lci_link_quality_open(&conn_properties[active_connections_num].link, address);
+  /* Its readings come first hand, not through a relay */
+  lci_relay_set_direct(address, true);
   active_connections_num++;
 }
 /**
@@ -173,6 +269,18 @@ static void remove_connection(uint8_t connection)
   uint8_t i;
   uint8_t table_index = find_index_by_connection_handle(connection);
 
+  /* A cancelled connection attempt was never added */
+  if (table_index == TABLE_INDEX_INVALID) {
+    return;
+  }
+  lci_relay_set_direct(conn_properties[table_index].server_address, false);
+  /* The retry timers must not move with the entries, the pending reads
+   * of the moved links are retried at once */
+  for (i = table_index; i < active_connections_num; i++) {
+    if (conn_properties[i].retry_characteristic_handle != CHARACTERISTIC_HANDLE_INVALID) {
+      lci_error_retry_expire(&conn_properties[i].read_retry);
+    }
+  }
   if (active_connections_num > 0) {
     active_connections_num--;
   }
@@ -181,11 +289,8 @@ static void remove_connection(uint8_t connection)
   }
   for (i = active_connections_num; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
     conn_properties[i].connection_handle = CONNECTION_HANDLE_INVALID;
-    conn_properties[i].envsens_service_handle = SERVICE_HANDLE_INVALID;
-    conn_properties[i].envsens_humidity_characteristic_handle = CHARACTERISTIC_HANDLE_INVALID;
-    conn_properties[i].humidity = HUM_INVALID;
-    conn_properties[i].envsens_temp_characteristic_handle = CHARACTERISTIC_HANDLE_INVALID;
-    conn_properties[i].temp = TEMP_INVALID;
+    lci_gatt_client_reset(&conn_properties[i].client);
+    conn_properties[i].retry_characteristic_handle = CHARACTERISTIC_HANDLE_INVALID;
   }
 }
 /**
@@ -236,6 +341,679 @@ static void print_bluetooth_address(void)
                address->addr[1],
                address->addr[0]);
 }
+#if ACCEPT_LIST_RECONNECT
+/**
+* @brief Reconnect timer handler, runs the policy in the Bluetooth context
+ *
+* @param[in] timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_reconnect_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+  sl_bt_external_signal(SIGNAL_RECONNECT_TIMEOUT);
+}
+#endif
+/**
+* @brief Start looking for servers to connect to
+*
+* Known servers that are not connected are reconnected by the controller
+* through the filter accept list, without parsing advertisements. Generic
+* discovery is only used if no server is known, or for a while after the
+* known servers could not be reached, to find new servers.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void start_connecting(void)
+{
+  sl_status_t sc;
+
+#if ACCEPT_LIST_RECONNECT
+  /* One connection attempt at a time, no free connection slot */
+  if ((accept_list_connection != CONNECTION_HANDLE_INVALID)
+      || (active_connections_num >= SL_BT_CONFIG_MAX_CONNECTIONS)) {
+    return;
+  }
+  if (!accept_list_expired && (lci_known_peers_missing() != 0)
+      && (lci_known_peers_load_accept_list() != 0)) {
+    sc = lci_conn_scheduler_prepare_open(LCI_CONN_SAMPLE_RATE_HZ,
+                                         CONN_RESPONDER_LATENCY,
+                                         CONN_TIMEOUT);
+    app_assert_status(sc);
+    sc = sl_bt_connection_open_with_accept_list(sl_bt_gap_1m_phy,
+                                                &accept_list_connection);
+    if (sc == SL_STATUS_OK) {
+      conn_state = opening;
+      sc = sl_simple_timer_start(&reconnect_timer,
+                                 ACCEPT_LIST_TIMEOUT_MS,
+                                 hdl_reconnect_timer_event,
+                                 NULL,
+                                 false);
+      app_assert_status(sc);
+      return;
+    }
+    app_log_status_warning_f(sc, "Accept list connection failed\n");
+  }
+  accept_list_expired = false;
+  if (lci_known_peers_missing() != 0) {
+    /* Retry the known servers after a discovery window */
+    sc = sl_simple_timer_start(&reconnect_timer,
+                               DISCOVERY_TIMEOUT_MS,
+                               hdl_reconnect_timer_event,
+                               NULL,
+                               false);
+    app_assert_status(sc);
+  }
+#endif
+  /* Start scanning - looking for environmental sensing devices, the scan
+   * scheduler selects the duty cycle */
+  sc = lci_scan_scheduler_start(active_connections_num);
+  conn_state = scanning;
+  if (lci_error_check(sc, "Start discovery") != lci_error_none) {
+    if (!lci_error_retry_schedule(&connect_retry)) {
+      app_assert_status_f(sc,
+                          "Failed to start discovery\n");
+    }
+    return;
+  }
+  lci_error_retry_done(&connect_retry);
+}
+/**
+* @brief Close a connection that cannot recover from a failed call
+*
+* The closed event removes the connection and reconnects the server.
+ *
+* @param[in] connection connection's handle
+*
+* @retval None
+*/
+static void teardown_connection(uint8_t connection)
+{
+  sl_status_t sc;
+
+  lci_error_count_teardown();
+  sc = sl_bt_connection_close(connection);
+  (void)lci_error_check(sc, "Close connection");
+}
+/**
+* @brief Read a characteristic, retry or tear the link down on failure
+ *
+* @param[in] table_index    connection's index
+* @param[in] characteristic characteristic handle
+*
+* @retval None
+*/
+static void read_characteristic(uint8_t table_index, uint16_t characteristic)
+{
+  conn_properties_t *conn = &conn_properties[table_index];
+  sl_status_t sc;
+
+#if LCI_BONDING
+  /* Held until the link is encrypted */
+  if (!lci_bonding_ready(conn->connection_handle)) {
+    conn->retry_characteristic_handle = characteristic;
+    return;
+  }
+#endif
+  sc = sl_bt_gatt_read_characteristic_value(conn->connection_handle, characteristic);
+  if (sc == SL_STATUS_OK) {
+    conn->retry_characteristic_handle = CHARACTERISTIC_HANDLE_INVALID;
+    lci_error_retry_done(&conn->read_retry);
+    lci_link_quality_on_read_started(&conn->link);
+    return;
+  }
+  if ((lci_error_check(sc, "Read characteristic") == lci_error_transient)
+      && lci_error_retry_schedule(&conn->read_retry)) {
+    conn->retry_characteristic_handle = characteristic;
+    return;
+  }
+  /* Broken link or the read keeps failing */
+  conn->retry_characteristic_handle = CHARACTERISTIC_HANDLE_INVALID;
+  teardown_connection(conn->connection_handle);
+}
+/**
+* @brief Retry the failed characteristic reads of the links whose backoff
+* expired
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void retry_reads(void)
+{
+  for (uint8_t i = 0; i < active_connections_num; i++) {
+    if (lci_error_retry_due(&conn_properties[i].read_retry)
+        && (conn_properties[i].retry_characteristic_handle != CHARACTERISTIC_HANDLE_INVALID)
+        && !lci_fleet_ota_owns(conn_properties[i].connection_handle)) {
+      read_characteristic(i, conn_properties[i].retry_characteristic_handle);
+    }
+  }
+}
+#if LCI_BONDING
+/**
+* @brief Start the read held while the link was being encrypted
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+static void release_read(uint8_t connection)
+{
+  uint8_t table_index = find_index_by_connection_handle(connection);
+
+  if ((table_index != TABLE_INDEX_INVALID)
+      && (conn_properties[table_index].retry_characteristic_handle != CHARACTERISTIC_HANDLE_INVALID)
+      && !lci_fleet_ota_owns(connection)) {
+    read_characteristic(table_index, conn_properties[table_index].retry_characteristic_handle);
+  }
+}
+#endif
+/**
+* @brief Scan for the apploaders of the servers being updated
+*
+* A server rebooting into its apploader closes its link, which restarts the
+* scanner; a server requested while not connected needs it started here.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void scan_for_apploaders(void)
+{
+  if (lci_fleet_ota_waiting()
+      && ((conn_state == discover_services) || (conn_state == running))) {
+    start_connecting();
+  }
+}
+/**
+* @brief Look for more servers once a link exchanges data
+*
+* While connection slots are free the scanner keeps running, the scan
+* scheduler scans aggressively below SCAN_EXPECTED_SENSORS servers and backs
+* off from there on. It is only stopped once every slot is taken.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void continue_discovery(void)
+{
+  if ((conn_state == scanning) || (conn_state == opening)) {
+    return;
+  }
+  if (active_connections_num < SL_BT_CONFIG_MAX_CONNECTIONS) {
+    start_connecting();
+    return;
+  }
+  if (conn_state != running) {
+    conn_state = running;
+    (void)lci_scan_scheduler_stop();
+  }
+}
+/**
+* @brief Report a decoded reading to the host
+ *
+* @param[in] server_address server address
+* @param[in] profile        profile index
+* @param[in] desc           characteristic index in the profile
+* @param[in] instance       instance among the characteristics with the same UUID
+* @param[in] value          decoded value
+* @param[in] stamp          time the value is dated with
+* @param[in] timestamp_ms   time in central milliseconds, unless the value is
+*                           timestamped on arrival
+*
+* @retval None
+*/
+static void report_reading(uint16_t server_address,
+                           uint8_t profile,
+                           uint8_t desc,
+                           uint8_t instance,
+                           int32_t value,
+                           stamp_t stamp,
+                           uint32_t timestamp_ms)
+{
+  const lci_gatt_char_desc_t *entry = lci_gatt_profiles_get_char(profile, desc);
+  char text[LCI_FP_STR_SIZE];
+#if LCI_TELEMETRY_BINARY
+  lci_telemetry_kind_t kind;
+#endif
+
+  if (entry == NULL) {
+    return;
+  }
+#if LCI_TELEMETRY_BINARY
+  /* The samples frame carries temperature and humidity, anything else is
+   * logged between the frames */
+  if ((entry->kind == lci_gatt_temperature) || (entry->kind == lci_gatt_humidity)) {
+    kind = (entry->kind == lci_gatt_temperature) ? lci_telemetry_temperature
+                                                 : lci_telemetry_humidity;
+    if (stamp == stamp_synced) {
+      (void)lci_telemetry_report_at(server_address, kind, value, timestamp_ms);
+    } else if (stamp == stamp_relayed) {
+      (void)lci_telemetry_report_relayed(server_address, kind, value, timestamp_ms);
+    } else {
+      (void)lci_telemetry_report(server_address, kind, value);
+    }
+    return;
+  }
+#endif
+  (void)lci_fp_format(text, value, entry->decimals);
+  /* The server address tag lets a host tell the sensors apart */
+  if (instance == 0) {
+    app_log_info("[%04X] %s - %s %s", server_address, entry->label, text, entry->unit);
+  } else {
+    app_log_info("[%04X] %s %d - %s %s", server_address, entry->label, instance, text, entry->unit);
+  }
+  /* Samples of the same instant line up across the servers */
+  if (stamp == stamp_synced) {
+    app_log_append(" at %lu ms", (unsigned long)timestamp_ms);
+  } else if (stamp == stamp_relayed) {
+    app_log_append(" relayed at %lu ms", (unsigned long)timestamp_ms);
+  }
+  app_log_nl();
+}
+#if !defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/**
+* @brief Report the temperature and humidity of one sample
+ *
+* @param[in] server_address server address
+* @param[in] temperature    temperature in 0.01 degree Celsius
+* @param[in] humidity       humidity in 0.01 %RH
+* @param[in] stamp          time the sample is dated with
+* @param[in] timestamp_ms   time in central milliseconds
+*
+* @retval None
+*/
+static void report_rht(uint16_t server_address,
+                       int32_t temperature,
+                       int32_t humidity,
+                       stamp_t stamp,
+                       uint32_t timestamp_ms)
+{
+  report_reading(server_address,
+                 LCI_GATT_PROFILE_ENVSENS,
+                 LCI_GATT_ENVSENS_TEMPERATURE,
+                 0,
+                 temperature,
+                 stamp,
+                 timestamp_ms);
+  report_reading(server_address,
+                 LCI_GATT_PROFILE_ENVSENS,
+                 LCI_GATT_ENVSENS_HUMIDITY,
+                 0,
+                 humidity,
+                 stamp,
+                 timestamp_ms);
+}
+#endif
+/**
+* @brief Handle a batch of readings of servers out of range
+*
+* The batch is checked in the Bluetooth context, where the central knows its
+* connected servers, only the new readings go on as readings of their origin.
+ *
+* @param[in] table_index connection's index of the relay
+* @param[in] data        batch
+* @param[in] len         batch length
+*
+* @retval None
+*/
+static void handle_relay_batch(uint8_t table_index, const uint8_t *data, uint8_t len)
+{
+  lci_relay_reading_t readings[LCI_RELAY_BATCH_MAX];
+  uint8_t count;
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  reading_t reading;
+  bool queued = false;
+#endif
+
+  count = lci_relay_on_batch(conn_properties[table_index].connection_handle,
+                             conn_properties[table_index].server_address,
+                             data,
+                             len,
+                             readings);
+  for (uint8_t i = 0; i < count; i++) {
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+    reading.server_address = readings[i].origin;
+    reading.profile = LCI_GATT_PROFILE_RELAY;
+    reading.desc = LCI_GATT_RELAY_BATCH;
+    reading.instance = 0;
+    reading.len = LCI_RELAY_READING_SIZE;
+    lci_relay_pack(&readings[i], reading.value);
+    queued |= lci_spsc_queue_push(&reading_queue, &reading);
+#else
+    report_rht(readings[i].origin,
+               readings[i].temperature,
+               readings[i].humidity,
+               stamp_relayed,
+               readings[i].timestamp_ms);
+#endif
+  }
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  if (queued) {
+    xTaskNotifyGive(acquisition_task.handle);
+  }
+#endif
+}
+/**
+* @brief Handle a characteristic value read or notified by a server
+ *
+* @param[in] table_index    connection's index
+* @param[in] characteristic characteristic of the value
+* @param[in] data           characteristic value
+* @param[in] len            characteristic value length
+*
+* @retval None
+*/
+static void handle_reading(uint8_t table_index,
+                           const lci_gatt_client_char_t *characteristic,
+                           uint8_t *data,
+                           uint8_t len)
+{
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  /* Leave decoding and logging to the other tasks */
+  reading_t reading;
+
+  if (characteristic->profile == LCI_GATT_PROFILE_RELAY) {
+    handle_relay_batch(table_index, data, len);
+    return;
+  }
+  reading.server_address = conn_properties[table_index].server_address;
+  reading.profile = characteristic->profile;
+  reading.desc = characteristic->desc;
+  reading.instance = characteristic->instance;
+  reading.len = (len < sizeof(reading.value)) ? len : sizeof(reading.value);
+  memcpy(reading.value, data, reading.len);
+  if (lci_spsc_queue_push(&reading_queue, &reading)) {
+    xTaskNotifyGive(acquisition_task.handle);
+  }
+#else
+  int32_t value;
+  lci_time_sync_sample_t timed;
+
+  if (characteristic->profile == LCI_GATT_PROFILE_RELAY) {
+    handle_relay_batch(table_index, data, len);
+    return;
+  }
+  /* A timed sample carries both readings of one sampling instant */
+  if (characteristic->profile == LCI_GATT_PROFILE_TIME_SYNC) {
+    if (!lci_time_sync_decode(data, len, &timed)) {
+      app_log_warning("Timed sample too short: %d\n", len);
+      return;
+    }
+    report_rht(conn_properties[table_index].server_address,
+               timed.temperature,
+               timed.humidity,
+               stamp_synced,
+               timed.instant);
+    return;
+  }
+  if (!lci_gatt_profiles_decode(characteristic->profile, characteristic->desc, data, len, &value)) {
+    app_log_warning("Characteristic value too short: %d\n", len);
+    return;
+  }
+  report_reading(conn_properties[table_index].server_address,
+                 characteristic->profile,
+                 characteristic->desc,
+                 characteristic->instance,
+                 value,
+                 stamp_arrival,
+                 0);
+#endif
+}
+/**
+* @brief Run the link quality policy on every link
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void evaluate_links(void)
+{
+  static uint8_t export_periods = 0;
+  sl_status_t sc = SL_STATUS_OK;
+  conn_properties_t *conn;
+  const lci_conn_slot_t *slot;
+  bool running;
+  uint16_t expected;
+
+  for (uint8_t i = 0; i < active_connections_num; i++) {
+    conn = &conn_properties[i];
+    /* The OTA update drives the link until the server reboots */
+    if (lci_fleet_ota_owns(conn->connection_handle)) {
+      continue;
+    }
+    running = lci_gatt_client_running(&conn->client);
+    /* A synchronized server notifies one sample per sampling period */
+    expected = lci_time_sync_synced(conn->connection_handle)
+               ? LCI_CONN_SAMPLE_RATE_HZ
+               : lci_conn_scheduler_expected_samples(conn->connection_handle);
+    lci_time_sync_on_tick(conn->connection_handle);
+    switch (lci_link_quality_evaluate(&conn->link, running, expected)) {
+      case lci_link_use_coded_phy:
+        app_log_info("[%04X] Weak link, requesting coded PHY\n", conn->server_address);
+        sc = sl_bt_connection_set_preferred_phy(conn->connection_handle,
+                                                sl_bt_gap_phy_coded,
+                                                sl_bt_gap_phy_any);
+        break;
+      case lci_link_use_1m_phy:
+        sc = sl_bt_connection_set_preferred_phy(conn->connection_handle,
+                                                sl_bt_gap_phy_1m,
+                                                sl_bt_gap_phy_any);
+        break;
+      case lci_link_relax_timeout:
+        slot = lci_conn_scheduler_get_slot(conn->connection_handle);
+        if (slot == NULL) {
+          break;
+        }
+        sc = sl_bt_connection_set_parameters(conn->connection_handle,
+                                             slot->interval,
+                                             slot->interval,
+                                             CONN_RESPONDER_LATENCY,
+                                             CONN_RELAXED_TIMEOUT,
+                                             0,
+                                             slot->max_ce_length);
+        break;
+      case lci_link_reconnect:
+        /* The closed event starts the reconnection */
+        app_log_info("[%04X] Link stalled, reconnecting\n", conn->server_address);
+        sc = sl_bt_connection_close(conn->connection_handle);
+        break;
+      default:
+        sc = SL_STATUS_OK;
+        break;
+    }
+    if (sc != SL_STATUS_OK) {
+      app_log_status_warning_f(sc, "[%04X] Link policy action failed\n", conn->server_address);
+    }
+  }
+  lci_conn_scheduler_update(LCI_LINK_PERIOD_MS);
+  if (++export_periods >= LCI_LINK_EXPORT_PERIODS) {
+    export_periods = 0;
+    export_link_stats();
+  }
+}
+/**
+* @brief Export the statistics of all links at once
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void export_link_stats(void)
+{
+#if LCI_TELEMETRY_BINARY
+  lci_telemetry_link_t links[SL_BT_CONFIG_MAX_CONNECTIONS];
+  const lci_link_stats_t *link;
+
+  for (uint8_t i = 0; i < active_connections_num; i++) {
+    link = &conn_properties[i].link;
+    links[i].sensor_id = link->server_id;
+    links[i].rssi = (int8_t)(link->rssi_q2 / 4);
+    links[i].phy = link->phy;
+    links[i].delivered = link->delivered;
+    links[i].expected = link->expected;
+    links[i].supervision_timeouts = link->supervision_timeouts;
+    links[i].gatt_timeouts = link->gatt_timeouts;
+    links[i].retries = link->retries;
+    links[i].reconnects = link->reconnects;
+  }
+  (void)lci_telemetry_report_links(links, active_connections_num);
+#else
+  const lci_error_stats_t *errors = lci_error_get_stats();
+
+  for (uint8_t i = 0; i < active_connections_num; i++) {
+    lci_link_quality_log(&conn_properties[i].link);
+  }
+  app_log_info("Errors: %lu transient, %lu link, %lu retries, %lu recovered, %lu teardowns, "
+               "%lu optional\n",
+               (unsigned long)errors->transient,
+               (unsigned long)errors->link,
+               (unsigned long)errors->retries,
+               (unsigned long)errors->recovered,
+               (unsigned long)errors->teardowns,
+               (unsigned long)errors->optional);
+#endif
+  lci_conn_scheduler_log();
+  lci_relay_log();
+#if LCI_BONDING
+  lci_bonding_log();
+#endif
+}
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/**
+* @brief Hand a decoded sample to the telemetry task
+ *
+* @param[in] sample decoded sample
+*
+* @retval None
+*/
+static void queue_sample(const sample_t *sample)
+{
+  if (lci_spsc_queue_push(&telemetry_queue, sample)) {
+    xTaskNotifyGive(telemetry_task.handle);
+  }
+}
+/**
+* @brief Hand the temperature and humidity of one sample to the telemetry task
+ *
+* @param[in] sample      sample with the server address and the timestamp
+* @param[in] temperature temperature in 0.01 degree Celsius
+* @param[in] humidity    humidity in 0.01 %RH
+*
+* @retval None
+*/
+static void queue_rht(sample_t *sample, int32_t temperature, int32_t humidity)
+{
+  sample->profile = LCI_GATT_PROFILE_ENVSENS;
+  sample->instance = 0;
+  sample->desc = LCI_GATT_ENVSENS_TEMPERATURE;
+  sample->value = temperature;
+  queue_sample(sample);
+  sample->desc = LCI_GATT_ENVSENS_HUMIDITY;
+  sample->value = humidity;
+  queue_sample(sample);
+}
+/**
+* @brief Sensor acquisition task, decodes the readings of the servers
+ *
+* @param[in] arg unused
+*
+* @retval None
+*/
+static void acquisition_task_fn(void *arg)
+{
+  reading_t reading;
+  sample_t sample;
+  lci_time_sync_sample_t timed;
+  lci_relay_reading_t relayed;
+  (void)arg;
+
+  while (1) {
+    (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (lci_spsc_queue_pop(&reading_queue, &reading)) {
+      sample.server_address = reading.server_address;
+      sample.profile = reading.profile;
+      sample.desc = reading.desc;
+      sample.instance = reading.instance;
+      sample.stamp = stamp_arrival;
+      sample.timestamp_ms = 0;
+      /* A timed sample carries both readings of one sampling instant */
+      if (reading.profile == LCI_GATT_PROFILE_TIME_SYNC) {
+        if (!lci_time_sync_decode(reading.value, reading.len, &timed)) {
+          continue;
+        }
+        sample.stamp = stamp_synced;
+        sample.timestamp_ms = timed.instant;
+        queue_rht(&sample, timed.temperature, timed.humidity);
+        continue;
+      }
+      /* Reading of a server out of range, checked by the Bluetooth task */
+      if (reading.profile == LCI_GATT_PROFILE_RELAY) {
+        if (!lci_relay_unpack(reading.value, reading.len, &relayed)) {
+          continue;
+        }
+        sample.stamp = stamp_relayed;
+        sample.timestamp_ms = relayed.timestamp_ms;
+        queue_rht(&sample, relayed.temperature, relayed.humidity);
+        continue;
+      }
+      /* Decoders of the profile table */
+      if (!lci_gatt_profiles_decode(reading.profile,
+                                    reading.desc,
+                                    reading.value,
+                                    reading.len,
+                                    &sample.value)) {
+        continue;
+      }
+      queue_sample(&sample);
+    }
+  }
+}
+/**
+* @brief Telemetry task, logs the readings and the task statistics report
+ *
+* @param[in] arg unused
+*
+* @retval None
+*/
+static void telemetry_task_fn(void *arg)
+{
+  sample_t sample;
+  TickType_t stats_time = xTaskGetTickCount();
+  (void)arg;
+
+  while (1) {
+    (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TELEMETRY_TASK_PERIOD_MS));
+    while (lci_spsc_queue_pop(&telemetry_queue, &sample)) {
+      report_reading(sample.server_address,
+                     sample.profile,
+                     sample.desc,
+                     sample.instance,
+                     sample.value,
+                     sample.stamp,
+                     sample.timestamp_ms);
+    }
+#if LCI_TELEMETRY_BINARY
+    lci_telemetry_process();
+#endif
+    if ((xTaskGetTickCount() - stats_time) >= pdMS_TO_TICKS(LCI_RTOS_STATS_PERIOD_MS)) {
+      stats_time = xTaskGetTickCount();
+      lci_rtos_log_task_stats();
+      if ((reading_queue.dropped != 0) || (telemetry_queue.dropped != 0)) {
+        app_log_warning("Dropped readings: %lu acquisition, %lu telemetry\n",
+                        (unsigned long)reading_queue.dropped,
+                        (unsigned long)telemetry_queue.dropped);
+      }
+    }
+  }
+}
+#endif
 /**
 * @brief Application initialization procedure
  *
@@ -245,11 +1023,51 @@ static void print_bluetooth_address(void)
 */
 void app_init(void)
 {
-  bf_read_temp = false;
   /* Initialize connection properties */
   init_properties();
+#if ACCEPT_LIST_RECONNECT
+  lci_known_peers_init();
+#endif
   app_log_info("[SI7021 sensor] Laird Connectivity simple central client demo\n");
+#if LCI_TELEMETRY_BINARY
+  lci_telemetry_init();
+#endif
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  lci_spsc_queue_init(&reading_queue,
+                      reading_queue_storage,
+                      sizeof(reading_t),
+                      READING_QUEUE_SIZE);
+  lci_spsc_queue_init(&telemetry_queue,
+                      telemetry_queue_storage,
+                      sizeof(sample_t),
+                      TELEMETRY_QUEUE_SIZE);
+  lci_rtos_task_create(&telemetry_task,
+                       telemetry_task_fn,
+                       "telemetry",
+                       telemetry_task_stack,
+                       TELEMETRY_TASK_STACK_SIZE,
+                       TELEMETRY_TASK_PRIO);
+  lci_rtos_task_create(&acquisition_task,
+                       acquisition_task_fn,
+                       "acquisition",
+                       acquisition_task_stack,
+                       ACQUISITION_TASK_STACK_SIZE,
+                       ACQUISITION_TASK_PRIO);
+#endif
+}
+#if LCI_TELEMETRY_BINARY && !defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/**
+* @brief Application process action, called from the main loop
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void app_process_action(void)
+{
+  lci_telemetry_process();
 }
+#endif
 /**
 * @brief Bluetooth events handler
  *
@@ -263,7 +1081,10 @@ void sl_bt_on_event(sl_bt_msg_t* evt)
   uint8_t *char_value;
   uint8_t char_value_len;
   uint16_t addr_value;
+  uint8_t found;
   uint8_t table_index;
+  uint16_t read_handle;
+  const lci_gatt_client_char_t *characteristic;
   /* Handle stack events */
   switch (SL_BT_MSG_ID(evt->header)) {
     /* ------------------------------- */
@@ -278,45 +1099,73 @@ void sl_bt_on_event(sl_bt_msg_t* evt)
                    evt->data.evt_system_boot.build);
       /* Print bluetooth address */
       print_bluetooth_address();
-      /* Set passive scanning on 1Mb PHY */
-      sc = sl_bt_scanner_set_mode(sl_bt_gap_1m_phy, SCAN_PASSIVE);
-      app_assert_status(sc);
-      /* Set scan interval and scan window */
-      sc = sl_bt_scanner_set_timing(sl_bt_gap_1m_phy, SCAN_INTERVAL, SCAN_WINDOW);
-      app_assert_status(sc);
-      /* Set the default connection parameters for subsequent connections */
-      sc = sl_bt_connection_set_default_parameters(CONN_INTERVAL_MIN,
-                                                   CONN_INTERVAL_MAX,
-                                                   CONN_RESPONDER_LATENCY,
-                                                   CONN_TIMEOUT,
-                                                   CONN_MIN_CE_LENGTH,
-                                                   CONN_MAX_CE_LENGTH);
-      app_assert_status(sc);
-      /* Start scanning - looking for environmental sensing devices */
-      sc = sl_bt_scanner_start(sl_bt_gap_1m_phy, sl_bt_scanner_discover_generic);
-      app_assert_status_f(sc,
-                          "Failed to start discovery #1\n");
-      conn_state = scanning;
+      /* Scan mode and timing are set by the scan scheduler */
+      lci_scan_scheduler_init(SCAN_EXPECTED_SENSORS);
+      /* Connection parameters are set by the connection scheduler */
+      lci_conn_scheduler_init();
+      /* Closed-loop TX power control of the links */
+      lci_power_control_init();
+      /* Link quality statistics and policy */
+      lci_link_quality_init();
+      /* Retries of failed calls */
+      lci_error_retry_init(&connect_retry, SIGNAL_CONNECT_RETRY);
+      /* OTA update of the servers with the image cached by the host */
+      lci_fleet_ota_init();
+      /* Sampling of the servers on the central clock */
+      lci_time_sync_init();
+      /* Readings of the servers out of range */
+      lci_relay_init();
+#if LCI_BONDING
+      /* Encrypted links to the servers, bonded once */
+      sc = lci_bonding_init();
+      (void)lci_error_check_optional(sc, "Bonding configuration");
+#endif
+      /* Start looking for environmental sensing devices */
+      start_connecting();
       break;
     /* ------------------------------- */
     /* This event is generated when an advertisement packet or a scan response */
     /* is received from a responder */
     case sl_bt_evt_scanner_scan_report_id:
-      /* Parse advertisement packets */
-      if (evt->data.evt_scanner_scan_report.packet_type == 0) {
-        /* If an environmental sensing advertisement is found... */
-        if (find_service_in_advertisement(&(evt->data.evt_scanner_scan_report.data.data[0]),
-                                          evt->data.evt_scanner_scan_report.data.len) != 0) {
-          /* then stop scanning for a while */
-          sc = sl_bt_scanner_stop();
-          app_assert_status(sc);
-          /* and connect to that device */
+      /* Parse connectable advertisement packets and scan responses */
+      if ((evt->data.evt_scanner_scan_report.packet_type == 0)
+          || (evt->data.evt_scanner_scan_report.packet_type == 4)) {
+        found = lci_gatt_client_match_advertisement(&(evt->data.evt_scanner_scan_report.data.data[0]),
+                                                    evt->data.evt_scanner_scan_report.data.len);
+        /* Only the apploaders of the servers being updated are connected */
+        if ((found == LCI_GATT_PROFILE_OTA)
+            && !lci_fleet_ota_wants(&evt->data.evt_scanner_scan_report.address)) {
+          found = LCI_GATT_PROFILE_NONE;
+        }
+        lci_scan_scheduler_on_report(&evt->data.evt_scanner_scan_report,
+                                     found != LCI_GATT_PROFILE_NONE);
+        /* If a supported service is advertised and the last connection
+         * was opened long enough ago to place a new anchor... */
+        if ((found != LCI_GATT_PROFILE_NONE) && (conn_state == scanning)
+            && lci_conn_scheduler_open_allowed()) {
+          /* then stop scanning for a while, or try again on the next report */
+          sc = lci_scan_scheduler_stop();
+          if (lci_error_check(sc, "Stop scanning") != lci_error_none) {
+            break;
+          }
+          /* and connect to that device on the PHY it was heard on */
           if (active_connections_num < SL_BT_CONFIG_MAX_CONNECTIONS) {
+            sc = lci_conn_scheduler_prepare_open(LCI_CONN_SAMPLE_RATE_HZ,
+                                                 CONN_RESPONDER_LATENCY,
+                                                 CONN_TIMEOUT);
+            app_assert_status(sc);
             sc = sl_bt_connection_open(evt->data.evt_scanner_scan_report.address,
                                        evt->data.evt_scanner_scan_report.address_type,
-                                       sl_bt_gap_1m_phy,
+                                       evt->data.evt_scanner_scan_report.primary_phy,
                                        NULL);
-            app_assert_status(sc);
+            if (lci_error_check(sc, "Open connection") != lci_error_none) {
+              /* The scanner is stopped, scan again after a backoff */
+              if (!lci_error_retry_schedule(&connect_retry)) {
+                app_assert_status_f(sc, "Failed to open connection\n");
+              }
+              break;
+            }
+            lci_error_retry_done(&connect_retry);
             conn_state = opening;
           }
         }
@@ -325,20 +1174,56 @@ void sl_bt_on_event(sl_bt_msg_t* evt)
     /* ------------------------------- */
     /* This event is generated when a new connection is established */
     case sl_bt_evt_connection_opened_id:
+#if ACCEPT_LIST_RECONNECT
+      /* Remember the server for accept list reconnection */
+      if (evt->data.evt_connection_opened.connection == accept_list_connection) {
+        sl_simple_timer_stop(&reconnect_timer);
+        accept_list_connection = CONNECTION_HANDLE_INVALID;
+      }
+      /* Apploaders of the servers being updated never advertise again */
+      if (!lci_fleet_ota_wants(&evt->data.evt_connection_opened.address)) {
+        lci_known_peers_on_opened(evt->data.evt_connection_opened.address,
+                                  evt->data.evt_connection_opened.address_type,
+                                  evt->data.evt_connection_opened.connection);
+      }
+#endif
       /* Get last two bytes of sender address */
       addr_value = (uint16_t)(evt->data.evt_connection_opened.address.addr[1] << 8) + evt->data.evt_connection_opened.address.addr[0];
       /* Add connection to the connection_properties array */
       add_connection(evt->data.evt_connection_opened.connection, addr_value);
-      /* Discover environment sensing service on the responder device */
-      sc = sl_bt_gatt_discover_primary_services_by_uuid(evt->data.evt_connection_opened.connection,
-                                                        sizeof(envsens_service),
-                                                        (const uint8_t*)envsens_service);
-      app_assert_status(sc);
-      /* Set remote connection power reporting - needed for Power Control */
+      /* Discover the supported services on the responder device */
+      table_index = find_index_by_connection_handle(evt->data.evt_connection_opened.connection);
+      if (table_index == TABLE_INDEX_INVALID) {
+        /* No room left for its properties */
+        teardown_connection(evt->data.evt_connection_opened.connection);
+        break;
+      }
+      sc = lci_gatt_client_open(&conn_properties[table_index].client,
+                                evt->data.evt_connection_opened.connection);
+      if (lci_error_check(sc, "Discover services") != lci_error_none) {
+        /* The closed event connects the next server */
+        teardown_connection(evt->data.evt_connection_opened.connection);
+        break;
+      }
+      /* Set remote connection power reporting - needed for Power Control,
+       * the link still works without it */
       sc = sl_bt_connection_set_remote_power_reporting(
         evt->data.evt_connection_opened.connection,
         sl_bt_connection_power_reporting_enable);
-      app_assert_status(sc);
+      (void)lci_error_check_optional(sc, "Remote power reporting");
+      lci_power_control_on_opened(evt->data.evt_connection_opened.connection);
+      lci_conn_scheduler_on_opened(evt->data.evt_connection_opened.connection);
+      lci_fleet_ota_on_opened(evt->data.evt_connection_opened.connection, addr_value);
+      lci_time_sync_on_opened(evt->data.evt_connection_opened.connection);
+#if LCI_BONDING
+      /* Apploaders of the servers being updated are not bonded, the update
+       * only takes the link over once its services are discovered */
+      if (!lci_fleet_ota_wants(&evt->data.evt_connection_opened.address)) {
+        lci_bonding_on_opened(evt->data.evt_connection_opened.connection,
+                              addr_value,
+                              evt->data.evt_connection_opened.bonding);
+      }
+#endif
       conn_state = discover_services;
       break;
     /* ------------------------------- */
@@ -346,8 +1231,9 @@ void sl_bt_on_event(sl_bt_msg_t* evt)
     case sl_bt_evt_gatt_service_id:
       table_index = find_index_by_connection_handle(evt->data.evt_gatt_service.connection);
       if (table_index != TABLE_INDEX_INVALID) {
-        /* Save service handle for future reference */
-        conn_properties[table_index].envsens_service_handle = evt->data.evt_gatt_service.service;
+        /* Save the service handle if the profile table supports it */
+        lci_gatt_client_on_service(&conn_properties[table_index].client,
+                                   &evt->data.evt_gatt_service);
       }
       break;
     /* ------------------------------- */
@@ -355,13 +1241,9 @@ void sl_bt_on_event(sl_bt_msg_t* evt)
     case sl_bt_evt_gatt_characteristic_id:
       table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic.connection);
       if (table_index != TABLE_INDEX_INVALID) {
-        /* Save characteristic handle for future reference */
-        if(evt->data.evt_gatt_characteristic.uuid.data[0] == envsens_humidity_char[0]) {
-          conn_properties[table_index].envsens_humidity_characteristic_handle = evt->data.evt_gatt_characteristic.characteristic;
-        }
-        if(evt->data.evt_gatt_characteristic.uuid.data[0] == envsens_temp_char[0]) {
-          conn_properties[table_index].envsens_temp_characteristic_handle = evt->data.evt_gatt_characteristic.characteristic;
-        }
+        /* Save the characteristic handle if the profile describes it */
+        lci_gatt_client_on_characteristic(&conn_properties[table_index].client,
+                                          &evt->data.evt_gatt_characteristic);
       }
       break;
     /* ------------------------------- */
@@ -372,69 +1254,201 @@ void sl_bt_on_event(sl_bt_msg_t* evt)
       if (table_index == TABLE_INDEX_INVALID) {
         break;
       }
-      /* If service discovery finished */
-      if (conn_state == discover_services && conn_properties[table_index].envsens_service_handle != SERVICE_HANDLE_INVALID) {
-        sc = sl_bt_gatt_discover_characteristics(evt->data.evt_gatt_procedure_completed.connection,
-                                                 conn_properties[table_index].envsens_service_handle);
-        app_assert_status(sc);
-        conn_state = discover_characteristics;
+      /* Packet error statistics of the power controller and the link */
+      lci_power_control_on_transfer(evt->data.evt_gatt_procedure_completed.connection,
+                                    evt->data.evt_gatt_procedure_completed.result == 0);
+      lci_link_quality_on_read_completed(&conn_properties[table_index].link,
+                                         evt->data.evt_gatt_procedure_completed.result);
+      lci_conn_scheduler_on_exchange(evt->data.evt_gatt_procedure_completed.connection);
+      /* Discovery, subscription, then the next characteristic to read */
+      sc = lci_gatt_client_on_procedure_completed(&conn_properties[table_index].client,
+                                                  &read_handle);
+      if (sc == SL_STATUS_NOT_FOUND) {
+        app_log_warning("[%04X] No supported service\n", conn_properties[table_index].server_address);
+        teardown_connection(evt->data.evt_gatt_procedure_completed.connection);
         break;
       }
-      /* If characteristic discovery finished */
-      if (conn_state == discover_characteristics && conn_properties[table_index].envsens_humidity_characteristic_handle != CHARACTERISTIC_HANDLE_INVALID && bf_read_temp == false) {
-        sl_bt_scanner_stop();
-        sc = sl_bt_gatt_read_characteristic_value(evt->data.evt_gatt_procedure_completed.connection,
-                                                  conn_properties[table_index].envsens_humidity_characteristic_handle);
-        app_assert_status(sc);
-        bf_read_temp = true;
+      if (lci_error_check(sc, "GATT client") != lci_error_none) {
+        teardown_connection(evt->data.evt_gatt_procedure_completed.connection);
         break;
       }
-      if (conn_state == discover_characteristics && conn_properties[table_index].envsens_temp_characteristic_handle != CHARACTERISTIC_HANDLE_INVALID && bf_read_temp == true) {
-        sl_bt_scanner_stop();
-        sc = sl_bt_gatt_read_characteristic_value(evt->data.evt_gatt_procedure_completed.connection,
-                                             conn_properties[table_index].envsens_temp_characteristic_handle);
-        app_assert_status(sc);
-        bf_read_temp = false;
+      /* Next step of an OTA update instead of the next read */
+      if (lci_fleet_ota_on_procedure_completed(evt->data.evt_gatt_procedure_completed.connection,
+                                               &conn_properties[table_index].client,
+                                               evt->data.evt_gatt_procedure_completed.result)) {
+        scan_for_apploaders();
         break;
       }
+      /* Sync of the clock, or samples notified instead of read */
+      if (lci_time_sync_on_procedure_completed(evt->data.evt_gatt_procedure_completed.connection,
+                                               &conn_properties[table_index].client,
+                                               evt->data.evt_gatt_procedure_completed.result)) {
+        continue_discovery();
+        break;
+      }
+      if (read_handle != CHARACTERISTIC_HANDLE_INVALID) {
+        continue_discovery();
+        read_characteristic(table_index, read_handle);
+      }
       break;
     /* ------------------------------- */
-    /* This event is generated when GATT characteristic is read */
+    /* This event is generated when GATT characteristic is read, notified
+     * or indicated */
     case sl_bt_evt_gatt_characteristic_value_id:
       char_value_len = evt->data.evt_gatt_characteristic_value.value.len;
-      if(char_value_len >= sizeof(uint16_t)) {
-        char_value = &(evt->data.evt_gatt_characteristic_value.value.data[0]);
-        table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic_value.connection);
-        if (table_index != TABLE_INDEX_INVALID) {
-            if(evt->data.evt_gatt_characteristic_value.characteristic == conn_properties[table_index].envsens_temp_characteristic_handle) {
-                memcpy(&conn_properties[table_index].temp, &char_value[0], char_value_len);
-                app_log_info("Temperature [degree celsius] - %3.2f %cC", (float)conn_properties[table_index].temp / 100.0f, celsious_ascii_code);
-                app_log_nl();
-            }
-            if(evt->data.evt_gatt_characteristic_value.characteristic == conn_properties[table_index].envsens_humidity_characteristic_handle) {
-                memcpy(&conn_properties[table_index].humidity, &char_value[0], char_value_len);
-                app_log_info("Humidity [relative humidity as a percentage] - %3.2f %%RH", (float)conn_properties[table_index].humidity / 100.0f);
-                app_log_nl();
-            }
+      char_value = &(evt->data.evt_gatt_characteristic_value.value.data[0]);
+      table_index = find_index_by_connection_handle(evt->data.evt_gatt_characteristic_value.connection);
+      if (table_index == TABLE_INDEX_INVALID) {
+        break;
+      }
+      characteristic = lci_gatt_client_on_value(&conn_properties[table_index].client,
+                                                &evt->data.evt_gatt_characteristic_value);
+      if (characteristic != NULL) {
+        /* A relay batch is no sample of the link */
+        if (characteristic->profile != LCI_GATT_PROFILE_RELAY) {
+          lci_link_quality_on_sample(&conn_properties[table_index].link);
         }
-      } else {
-          app_log_warning("Characteristic value too short: %d\n",
-                          evt->data.evt_gatt_characteristic_value.value.len);
+        handle_reading(table_index, characteristic, char_value, char_value_len);
       }
       break;
     /* ------------------------------- */
     /* This event is generated when a connection is dropped */
     case sl_bt_evt_connection_closed_id:
+      /* keep the link statistics of the server */
+      table_index = find_index_by_connection_handle(evt->data.evt_connection_closed.connection);
+      if (table_index != TABLE_INDEX_INVALID) {
+        lci_link_quality_close(&conn_properties[table_index].link,
+                               evt->data.evt_connection_closed.reason);
+      }
       /* remove connection from active connections */
       remove_connection(evt->data.evt_connection_closed.connection);
+      lci_power_control_on_closed(evt->data.evt_connection_closed.connection,
+                                  evt->data.evt_connection_closed.reason);
+      lci_conn_scheduler_on_closed(evt->data.evt_connection_closed.connection);
+      lci_fleet_ota_on_closed(evt->data.evt_connection_closed.connection);
+      lci_time_sync_on_closed(evt->data.evt_connection_closed.connection);
+      lci_relay_on_closed(evt->data.evt_connection_closed.connection);
+#if LCI_BONDING
+      lci_bonding_on_closed(evt->data.evt_connection_closed.connection,
+                            evt->data.evt_connection_closed.reason);
+#endif
+#if ACCEPT_LIST_RECONNECT
+      lci_known_peers_on_closed(evt->data.evt_connection_closed.connection);
+      if (evt->data.evt_connection_closed.connection == accept_list_connection) {
+        accept_list_connection = CONNECTION_HANDLE_INVALID;
+      }
+#endif
       if (conn_state != scanning) {
-        /* start scanning again to find new devices */
-        sc = sl_bt_scanner_start(sl_bt_gap_1m_phy, sl_bt_scanner_discover_generic);
-        app_assert_status_f(sc,
-                            "Failed to start discovery #3\n");
-        conn_state = scanning;
+        /* reconnect known devices or start scanning again to find new devices */
+        start_connecting();
+      }
+      break;
+    /* ------------------------------- */
+    /* This event is generated when the ATT MTU of a connection is exchanged */
+    case sl_bt_evt_gatt_mtu_exchanged_id:
+      lci_fleet_ota_on_mtu(evt->data.evt_gatt_mtu_exchanged.connection,
+                           evt->data.evt_gatt_mtu_exchanged.mtu);
+      break;
+    /* ------------------------------- */
+    /* This event is generated when the RSSI of a connection is read */
+    case sl_bt_evt_connection_rssi_id:
+      if (evt->data.evt_connection_rssi.status == SL_STATUS_OK) {
+        lci_power_control_on_rssi(evt->data.evt_connection_rssi.connection,
+                                  evt->data.evt_connection_rssi.rssi);
+        table_index = find_index_by_connection_handle(evt->data.evt_connection_rssi.connection);
+        if (table_index != TABLE_INDEX_INVALID) {
+          lci_link_quality_on_rssi(&conn_properties[table_index].link,
+                                   evt->data.evt_connection_rssi.rssi);
+        }
       }
       break;
+    /* ------------------------------- */
+    /* This event is generated when the parameters of a connection are set */
+    case sl_bt_evt_connection_parameters_id:
+      lci_conn_scheduler_on_parameters(evt->data.evt_connection_parameters.connection,
+                                       evt->data.evt_connection_parameters.interval);
+#if LCI_BONDING
+      /* Encrypted link, start the held read */
+      if (lci_bonding_on_parameters(evt->data.evt_connection_parameters.connection,
+                                    evt->data.evt_connection_parameters.security_mode)) {
+        release_read(evt->data.evt_connection_parameters.connection);
+      }
+#endif
+      break;
+#if LCI_BONDING
+    /* ------------------------------- */
+    /* This event is generated when a server paired and bonded */
+    case sl_bt_evt_sm_bonded_id:
+      lci_bonding_on_bonded(evt->data.evt_sm_bonded.connection,
+                            evt->data.evt_sm_bonded.bonding);
+      break;
+    /* ------------------------------- */
+    /* This event is generated when the pairing or the encryption failed */
+    case sl_bt_evt_sm_bonding_failed_id:
+      if (lci_bonding_on_failed(evt->data.evt_sm_bonding_failed.connection,
+                                evt->data.evt_sm_bonding_failed.reason)) {
+        release_read(evt->data.evt_sm_bonding_failed.connection);
+      }
+      break;
+#endif
+    /* ------------------------------- */
+    /* This event is generated when the PHY of a connection changes */
+    case sl_bt_evt_connection_phy_status_id:
+      table_index = find_index_by_connection_handle(evt->data.evt_connection_phy_status.connection);
+      if (table_index != TABLE_INDEX_INVALID) {
+        lci_link_quality_on_phy(&conn_properties[table_index].link,
+                                evt->data.evt_connection_phy_status.phy);
+      }
+      break;
+    /* ------------------------------- */
+    /* This event is generated when the local TX power of a connection changes */
+    case sl_bt_evt_connection_tx_power_id:
+      lci_power_control_on_tx_power(evt->data.evt_connection_tx_power.connection,
+                                    evt->data.evt_connection_tx_power.power_level);
+      break;
+    /* ------------------------------- */
+    /* This event is generated when the server reports a TX power change */
+    case sl_bt_evt_connection_remote_tx_power_id:
+      lci_power_control_on_remote_tx_power(evt->data.evt_connection_remote_tx_power.connection,
+                                           evt->data.evt_connection_remote_tx_power.power_level);
+      break;
+    /* ------------------------------- */
+    /* This event is generated by the scan scheduler, power control, link
+     * quality, retry, reconnect and OTA timers and by the host commands */
+    case sl_bt_evt_system_external_signal_id:
+      lci_scan_scheduler_on_signal(evt->data.evt_system_external_signal.extsignals,
+                                   active_connections_num);
+      lci_power_control_on_signal(evt->data.evt_system_external_signal.extsignals);
+      if (evt->data.evt_system_external_signal.extsignals & LCI_LINK_SIGNAL) {
+        evaluate_links();
+      }
+      if (evt->data.evt_system_external_signal.extsignals & SIGNAL_READ_RETRY) {
+        retry_reads();
+      }
+      lci_fleet_ota_on_signal(evt->data.evt_system_external_signal.extsignals);
+      scan_for_apploaders();
+      if ((evt->data.evt_system_external_signal.extsignals & SIGNAL_CONNECT_RETRY)
+          && (conn_state == scanning)) {
+        start_connecting();
+      }
+#if ACCEPT_LIST_RECONNECT
+      if ((evt->data.evt_system_external_signal.extsignals & SIGNAL_RECONNECT_TIMEOUT) == 0) {
+        break;
+      }
+      if ((conn_state == opening) && (accept_list_connection != CONNECTION_HANDLE_INVALID)) {
+        /* Known servers out of reach, cancel and discover new servers,
+         * the closed event of the cancelled attempt restarts discovery */
+        accept_list_expired = true;
+        sc = sl_bt_connection_close(accept_list_connection);
+        (void)lci_error_check(sc, "Cancel accept list connection");
+      } else if (conn_state == scanning) {
+        /* Discovery window over, retry the known servers */
+        sc = lci_scan_scheduler_stop();
+        (void)lci_error_check(sc, "Stop scanning");
+        start_connecting();
+      }
+#endif
+      break;
     default:
       break;
   }
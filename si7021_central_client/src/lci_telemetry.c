@@ -0,0 +1,631 @@
+/**
+ * @file lci_telemetry.c
+ * @brief Binary framed UART telemetry from the central client to a host
+ *
+ * The frames share the vcom port with the log. Under FreeRTOS the log of
+ * every task goes through a stream that writes vcom under the port mutex,
+ * and every frame is written whole under the same mutex, so no log byte of
+ * another task lands inside a frame.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "app_assert.h"
+#include "sl_iostream.h"
+#include "sl_iostream_uart.h"
+#include "sl_iostream_handles.h"
+#include "sl_sleeptimer.h"
+#include "sl_component_catalog.h"
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#endif
+#include "lci_telemetry.h"
+/* Largest unencoded frame */
+#define FRAME_MAX_SIZE   (LCI_TELEMETRY_HEADER_SIZE \
+                          + (LCI_TELEMETRY_BATCH_MAX * LCI_TELEMETRY_SAMPLE_SIZE) \
+                          + LCI_TELEMETRY_CRC_SIZE)
+/* Largest unencoded link statistics frame */
+#define LINKS_FRAME_MAX_SIZE (2 + (LCI_TELEMETRY_LINKS_MAX * LCI_TELEMETRY_LINK_SIZE) \
+                              + LCI_TELEMETRY_CRC_SIZE)
+/* COBS adds one byte per started 254 bytes, plus two frame delimiters */
+#define ENCODED_MAX_SIZE (FRAME_MAX_SIZE + (FRAME_MAX_SIZE / 254) + 1 + 2)
+#define LINKS_ENCODED_MAX_SIZE (LINKS_FRAME_MAX_SIZE + (LINKS_FRAME_MAX_SIZE / 254) + 1 + 2)
+/* Largest unencoded fleet OTA status frame */
+#define OTA_FRAME_MAX_SIZE (LCI_TELEMETRY_OTA_HEADER_SIZE \
+                            + (LCI_TELEMETRY_OTA_TARGETS_MAX * LCI_TELEMETRY_OTA_TARGET_SIZE) \
+                            + LCI_TELEMETRY_CRC_SIZE)
+#define OTA_ENCODED_MAX_SIZE (OTA_FRAME_MAX_SIZE + (OTA_FRAME_MAX_SIZE / 254) + 1 + 2)
+/* Receive buffer, large enough for an encoded command */
+#define RX_BUFFER_SIZE   (LCI_TELEMETRY_COMMAND_MAX_SIZE + 1)
+/* Bytes read from the port at once */
+#define RX_READ_SIZE     16
+/* Sample offsets */
+#define SAMPLE_ID_OFFSET    0
+#define SAMPLE_TIME_OFFSET  2
+#define SAMPLE_TEMP_OFFSET  6
+#define SAMPLE_HUM_OFFSET   8
+#define SAMPLE_FLAGS_OFFSET 10
+/* Frame under construction, the samples start after the header */
+static uint8_t frame[FRAME_MAX_SIZE];
+/* Number of samples in the frame under construction */
+static uint8_t batch_count;
+/* Time the first sample of the batch was added */
+static uint64_t batch_start_ms;
+/* COBS encoded frame */
+static uint8_t encoded[ENCODED_MAX_SIZE];
+/* Link statistics frame, built and encoded in the Bluetooth context, apart
+ * from the samples frame which may be owned by the telemetry task */
+static uint8_t links_frame[LINKS_FRAME_MAX_SIZE];
+static uint8_t links_encoded[LINKS_ENCODED_MAX_SIZE];
+/* Fleet OTA status frame, also built in the Bluetooth context */
+static uint8_t ota_frame[OTA_FRAME_MAX_SIZE];
+static uint8_t ota_encoded[OTA_ENCODED_MAX_SIZE];
+/* Handler of the host commands */
+static lci_telemetry_command_handler_t command_handler;
+/* Sequence number of the next samples frame */
+static uint8_t next_seq;
+/* Flow control state updated by the host acknowledgements */
+static bool flow_control;
+static uint8_t acked_seq;
+static uint8_t credits;
+/* Time of the last acknowledgement, or of the last probe */
+static uint64_t ack_ms;
+/* Partially received encoded frame from the host */
+static uint8_t rx_buffer[RX_BUFFER_SIZE];
+static uint8_t rx_len;
+static bool rx_overflow;
+/* Statistics */
+static lci_telemetry_stats_t stats;
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/* Port mutex, held for a whole frame or a log write */
+static StaticSemaphore_t port_mutex_storage;
+static SemaphoreHandle_t port_mutex;
+/* Default stream of the log of all the tasks */
+static sl_iostream_t log_stream;
+#endif
+/* Local functions */
+static uint64_t get_time_ms(void);
+static sl_status_t port_write(const void *data, size_t len);
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+static sl_status_t log_write(void *context, const void *buffer, size_t len);
+#endif
+static uint16_t crc16(const uint8_t *data, uint16_t len);
+static uint16_t cobs_encode(const uint8_t *src, uint16_t len, uint8_t *dst);
+static uint16_t cobs_decode(const uint8_t *src, uint16_t len, uint8_t *dst);
+static void put_le16(uint8_t *dst, uint16_t value);
+static void put_le32(uint8_t *dst, uint32_t value);
+static sl_status_t send_batch(void);
+static sl_status_t add_reading(uint16_t sensor_id,
+                               lci_telemetry_kind_t kind,
+                               int32_t value,
+                               uint8_t stamp,
+                               uint32_t timestamp_ms);
+static void handle_rx_frame(void);
+/**
+* @brief Read the system time
+ *
+* @param[in] None
+*
+* @retval time since boot in milliseconds
+*/
+static uint64_t get_time_ms(void)
+{
+  uint64_t ms = 0;
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return ms;
+}
+/**
+* @brief Write to the vcom port, under the port mutex once the kernel runs
+ *
+* @param[in] data pointer to the data
+* @param[in] len  length of the data
+*
+* @retval SL_STATUS_OK if written, error code otherwise
+*/
+static sl_status_t port_write(const void *data, size_t len)
+{
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  bool locked = (port_mutex != NULL)
+                && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+  sl_status_t sc;
+
+  if (locked) {
+    (void)xSemaphoreTake(port_mutex, portMAX_DELAY);
+  }
+  sc = sl_iostream_write(sl_iostream_vcom_handle, data, len);
+  if (locked) {
+    (void)xSemaphoreGive(port_mutex);
+  }
+  return sc;
+#else
+  return sl_iostream_write(sl_iostream_vcom_handle, data, len);
+#endif
+}
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/**
+* @brief Write handler of the log stream
+ *
+* @param[in] context unused
+* @param[in] buffer  log output
+* @param[in] len     length of the output
+*
+* @retval SL_STATUS_OK if written, error code otherwise
+*/
+static sl_status_t log_write(void *context, const void *buffer, size_t len)
+{
+  (void)context;
+  return port_write(buffer, len);
+}
+#endif
+/**
+* @brief CRC-16/CCITT-FALSE
+ *
+* @param[in] data pointer to the data
+* @param[in] len  length of the data
+*
+* @retval CRC of the data
+*/
+static uint16_t crc16(const uint8_t *data, uint16_t len)
+{
+  uint16_t crc = 0xFFFF;
+
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+/**
+* @brief Consistent Overhead Byte Stuffing encoder
+ *
+* @param[in]  src source data
+* @param[in]  len length of the source data
+* @param[out] dst destination, at least len + len / 254 + 1 bytes
+*
+* @retval length of the encoded data, without delimiter
+*/
+static uint16_t cobs_encode(const uint8_t *src, uint16_t len, uint8_t *dst)
+{
+  uint16_t code_index = 0;
+  uint16_t out = 1;
+  uint8_t code = 1;
+
+  for (uint16_t i = 0; i < len; i++) {
+    if (src[i] != 0) {
+      dst[out++] = src[i];
+      code++;
+    }
+    if ((src[i] == 0) || (code == 0xFF)) {
+      dst[code_index] = code;
+      code_index = out++;
+      code = 1;
+    }
+  }
+  dst[code_index] = code;
+  return out;
+}
+/**
+* @brief Consistent Overhead Byte Stuffing decoder
+ *
+* @param[in]  src encoded data, without delimiter
+* @param[in]  len length of the encoded data
+* @param[out] dst destination, at least len bytes
+*
+* @retval length of the decoded data, 0 if the encoding is invalid
+*/
+static uint16_t cobs_decode(const uint8_t *src, uint16_t len, uint8_t *dst)
+{
+  uint16_t in = 0;
+  uint16_t out = 0;
+  uint8_t code;
+
+  while (in < len) {
+    code = src[in++];
+    if ((code == 0) || ((uint16_t)(in + code - 1) > len)) {
+      return 0;
+    }
+    for (uint8_t i = 1; i < code; i++) {
+      dst[out++] = src[in++];
+    }
+    if ((code != 0xFF) && (in < len)) {
+      dst[out++] = 0;
+    }
+  }
+  return out;
+}
+/**
+* @brief Store 16-bit value little endian
+ *
+* @param[out] dst   destination
+* @param[in]  value value to store
+*
+* @retval None
+*/
+static void put_le16(uint8_t *dst, uint16_t value)
+{
+  dst[0] = (uint8_t)value;
+  dst[1] = (uint8_t)(value >> 8);
+}
+/**
+* @brief Store 32-bit value little endian
+ *
+* @param[out] dst   destination
+* @param[in]  value value to store
+*
+* @retval None
+*/
+static void put_le32(uint8_t *dst, uint32_t value)
+{
+  put_le16(&dst[0], (uint16_t)value);
+  put_le16(&dst[2], (uint16_t)(value >> 16));
+}
+/**
+* @brief Encode and send the batched samples if the host has credit left
+ *
+* @param[in] None
+*
+* @retval SL_STATUS_OK if the batch was sent or empty,
+*         SL_STATUS_FULL if the host has no credit left
+*/
+static sl_status_t send_batch(void)
+{
+  sl_status_t sc;
+  uint16_t len;
+  uint16_t crc;
+
+  if (batch_count == 0) {
+    return SL_STATUS_OK;
+  }
+  /* Backpressure: never exceed the frames granted by the host, but probe
+   * a host that stopped acknowledging */
+  if (flow_control && ((uint8_t)(next_seq - acked_seq - 1) >= credits)) {
+    if ((get_time_ms() - ack_ms) < LCI_TELEMETRY_CREDIT_TIMEOUT_MS) {
+      return SL_STATUS_FULL;
+    }
+    ack_ms = get_time_ms();
+    stats.credit_probes++;
+  }
+  frame[0] = LCI_TELEMETRY_FRAME_SAMPLES;
+  frame[1] = next_seq;
+  frame[2] = batch_count;
+  len = LCI_TELEMETRY_HEADER_SIZE + (batch_count * LCI_TELEMETRY_SAMPLE_SIZE);
+  crc = crc16(frame, len);
+  put_le16(&frame[len], crc);
+  len += LCI_TELEMETRY_CRC_SIZE;
+
+  encoded[0] = 0;
+  len = cobs_encode(frame, len, &encoded[1]) + 1;
+  encoded[len++] = 0;
+  sc = port_write(encoded, len);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  stats.frames_sent++;
+  stats.samples_sent += batch_count;
+  next_seq++;
+  batch_count = 0;
+  return SL_STATUS_OK;
+}
+/**
+* @brief Handle a complete encoded frame received from the host
+*
+* Acknowledgements update the flow control, commands go to the handler.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void handle_rx_frame(void)
+{
+  uint8_t decoded[RX_BUFFER_SIZE];
+  uint16_t len = cobs_decode(rx_buffer, rx_len, decoded);
+
+  if ((len <= LCI_TELEMETRY_CRC_SIZE)
+      || (crc16(decoded, len - LCI_TELEMETRY_CRC_SIZE)
+          != (uint16_t)(decoded[len - 2] | (decoded[len - 1] << 8)))) {
+    stats.rx_errors++;
+    return;
+  }
+  if (decoded[0] >= LCI_TELEMETRY_FRAME_CACHE_BEGIN) {
+    stats.commands_received++;
+    if (command_handler != NULL) {
+      command_handler(decoded, len - LCI_TELEMETRY_CRC_SIZE);
+    }
+    return;
+  }
+  if ((len != LCI_TELEMETRY_ACK_SIZE) || (decoded[0] != LCI_TELEMETRY_FRAME_ACK)) {
+    stats.rx_errors++;
+    return;
+  }
+  flow_control = true;
+  acked_seq = decoded[1];
+  credits = decoded[2];
+  ack_ms = get_time_ms();
+  stats.acks_received++;
+}
+/**
+* @brief Initialize the telemetry link
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_telemetry_init(void)
+{
+  batch_count = 0;
+  next_seq = 0;
+  flow_control = false;
+  rx_len = 0;
+  rx_overflow = false;
+  memset(&stats, 0, sizeof(stats));
+  /* The acknowledgements are polled from the main loop */
+  sl_iostream_uart_set_read_block(sl_iostream_uart_vcom_handle, false);
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  /* The log of every task waits for a frame being written */
+  port_mutex = xSemaphoreCreateMutexStatic(&port_mutex_storage);
+  app_assert(port_mutex != NULL, "Port mutex not created\n");
+  log_stream.context = NULL;
+  log_stream.write = log_write;
+  log_stream.read = NULL;
+  (void)sl_iostream_set_system_default(&log_stream);
+#endif
+}
+/**
+* @brief Add a reading to the current batch
+ *
+* A reading completes the sample of the same sensor in the batch if that
+* sample lacks the value, otherwise it starts a new sample. A synchronized
+* or relayed reading only completes the sample of the same timestamp.
+ *
+* @param[in] sensor_id    sensor identifier
+* @param[in] kind         reading kind
+* @param[in] value        reading value in 0.01 units
+* @param[in] stamp        LCI_TELEMETRY_FLAG_SYNCED, LCI_TELEMETRY_FLAG_RELAYED
+*                         or 0 for a reading timestamped on arrival
+* @param[in] timestamp_ms timestamp of the reading
+*
+* @retval SL_STATUS_OK if the reading was batched,
+*         SL_STATUS_FULL if it was dropped because of host backpressure
+*/
+static sl_status_t add_reading(uint16_t sensor_id,
+                               lci_telemetry_kind_t kind,
+                               int32_t value,
+                               uint8_t stamp,
+                               uint32_t timestamp_ms)
+{
+  uint8_t flag = (kind == lci_telemetry_temperature) ? LCI_TELEMETRY_FLAG_TEMP
+                                                     : LCI_TELEMETRY_FLAG_HUM;
+  uint8_t offset = (kind == lci_telemetry_temperature) ? SAMPLE_TEMP_OFFSET
+                                                       : SAMPLE_HUM_OFFSET;
+  uint8_t timestamp[4];
+  uint8_t *sample = NULL;
+  uint8_t *entry;
+
+  put_le32(timestamp, timestamp_ms);
+  for (uint8_t i = 0; i < batch_count; i++) {
+    entry = &frame[LCI_TELEMETRY_HEADER_SIZE + (i * LCI_TELEMETRY_SAMPLE_SIZE)];
+    if ((entry[SAMPLE_ID_OFFSET] == (uint8_t)sensor_id)
+        && (entry[SAMPLE_ID_OFFSET + 1] == (uint8_t)(sensor_id >> 8))
+        && ((entry[SAMPLE_FLAGS_OFFSET] & flag) == 0)
+        && ((entry[SAMPLE_FLAGS_OFFSET] & (LCI_TELEMETRY_FLAG_SYNCED | LCI_TELEMETRY_FLAG_RELAYED)) == stamp)
+        && (!stamp || (memcmp(&entry[SAMPLE_TIME_OFFSET], timestamp, sizeof(timestamp)) == 0))) {
+      sample = entry;
+      break;
+    }
+  }
+  if (sample == NULL) {
+    if ((batch_count == LCI_TELEMETRY_BATCH_MAX) && (send_batch() != SL_STATUS_OK)) {
+      stats.samples_dropped++;
+      return SL_STATUS_FULL;
+    }
+    if (batch_count == 0) {
+      batch_start_ms = get_time_ms();
+    }
+    sample = &frame[LCI_TELEMETRY_HEADER_SIZE + (batch_count * LCI_TELEMETRY_SAMPLE_SIZE)];
+    memset(sample, 0, LCI_TELEMETRY_SAMPLE_SIZE);
+    put_le16(&sample[SAMPLE_ID_OFFSET], sensor_id);
+    memcpy(&sample[SAMPLE_TIME_OFFSET], timestamp, sizeof(timestamp));
+    batch_count++;
+  }
+  put_le16(&sample[offset], (uint16_t)value);
+  sample[SAMPLE_FLAGS_OFFSET] |= flag | stamp;
+  return SL_STATUS_OK;
+}
+/**
+* @brief Report a reading timestamped on arrival
+ *
+* @param[in] sensor_id sensor identifier
+* @param[in] kind      reading kind
+* @param[in] value     reading value in 0.01 units
+*
+* @retval SL_STATUS_OK if the reading was batched,
+*         SL_STATUS_FULL if it was dropped because of host backpressure
+*/
+sl_status_t lci_telemetry_report(uint16_t sensor_id,
+                                 lci_telemetry_kind_t kind,
+                                 int32_t value)
+{
+  return add_reading(sensor_id, kind, value, 0, (uint32_t)get_time_ms());
+}
+/**
+* @brief Report a reading sampled at an instant of the central clock
+ *
+* @param[in] sensor_id    sensor identifier
+* @param[in] kind         reading kind
+* @param[in] value        reading value in 0.01 units
+* @param[in] timestamp_ms sampling instant in milliseconds of the central clock
+*
+* @retval SL_STATUS_OK if the reading was batched,
+*         SL_STATUS_FULL if it was dropped because of host backpressure
+*/
+sl_status_t lci_telemetry_report_at(uint16_t sensor_id,
+                                    lci_telemetry_kind_t kind,
+                                    int32_t value,
+                                    uint32_t timestamp_ms)
+{
+  return add_reading(sensor_id, kind, value, LCI_TELEMETRY_FLAG_SYNCED, timestamp_ms);
+}
+/**
+* @brief Report the reading of a server out of range, relayed by a server
+ *
+* @param[in] sensor_id    sensor identifier of the origin
+* @param[in] kind         reading kind
+* @param[in] value        reading value in 0.01 units
+* @param[in] timestamp_ms time the relay heard the reading in milliseconds of
+*                         the central clock
+*
+* @retval SL_STATUS_OK if the reading was batched,
+*         SL_STATUS_FULL if it was dropped because of host backpressure
+*/
+sl_status_t lci_telemetry_report_relayed(uint16_t sensor_id,
+                                         lci_telemetry_kind_t kind,
+                                         int32_t value,
+                                         uint32_t timestamp_ms)
+{
+  return add_reading(sensor_id, kind, value, LCI_TELEMETRY_FLAG_RELAYED, timestamp_ms);
+}
+/**
+* @brief Send the statistics of the links
+ *
+* @param[in] links statistics of the links
+* @param[in] count number of links
+*
+* @retval SL_STATUS_OK if sent, error code otherwise
+*/
+sl_status_t lci_telemetry_report_links(const lci_telemetry_link_t *links,
+                                       uint8_t count)
+{
+  sl_status_t sc = SL_STATUS_OK;
+  uint8_t *dst;
+  uint8_t chunk;
+  uint16_t len;
+
+  do {
+    chunk = (count > LCI_TELEMETRY_LINKS_MAX) ? LCI_TELEMETRY_LINKS_MAX : count;
+    links_frame[0] = LCI_TELEMETRY_FRAME_LINKS;
+    links_frame[1] = chunk;
+    dst = &links_frame[2];
+    for (uint8_t i = 0; i < chunk; i++, dst += LCI_TELEMETRY_LINK_SIZE) {
+      put_le16(&dst[0], links[i].sensor_id);
+      dst[2] = (uint8_t)links[i].rssi;
+      dst[3] = links[i].phy;
+      put_le32(&dst[4], links[i].delivered);
+      put_le32(&dst[8], links[i].expected);
+      put_le16(&dst[12], links[i].supervision_timeouts);
+      put_le16(&dst[14], links[i].gatt_timeouts);
+      put_le16(&dst[16], links[i].retries);
+      put_le16(&dst[18], links[i].reconnects);
+    }
+    len = 2 + (chunk * LCI_TELEMETRY_LINK_SIZE);
+    put_le16(&links_frame[len], crc16(links_frame, len));
+    len += LCI_TELEMETRY_CRC_SIZE;
+
+    links_encoded[0] = 0;
+    len = cobs_encode(links_frame, len, &links_encoded[1]) + 1;
+    links_encoded[len++] = 0;
+    sc = port_write(links_encoded, len);
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+    stats.link_frames_sent++;
+    links += chunk;
+    count -= chunk;
+  } while (count != 0);
+  return sc;
+}
+/**
+* @brief Send the fleet OTA status
+ *
+* @param[in] ota status, at most LCI_TELEMETRY_OTA_TARGETS_MAX targets are sent
+*
+* @retval SL_STATUS_OK if sent, error code otherwise
+*/
+sl_status_t lci_telemetry_report_ota(const lci_telemetry_ota_t *ota)
+{
+  uint8_t count = (ota->count > LCI_TELEMETRY_OTA_TARGETS_MAX) ? LCI_TELEMETRY_OTA_TARGETS_MAX
+                                                               : ota->count;
+  uint8_t *dst;
+  uint16_t len;
+
+  ota_frame[0] = LCI_TELEMETRY_FRAME_OTA;
+  ota_frame[1] = ota->command;
+  ota_frame[2] = ota->status;
+  put_le32(&ota_frame[3], ota->size);
+  put_le32(&ota_frame[7], ota->crc);
+  put_le32(&ota_frame[11], ota->cached);
+  ota_frame[15] = count;
+  dst = &ota_frame[LCI_TELEMETRY_OTA_HEADER_SIZE];
+  for (uint8_t i = 0; i < count; i++, dst += LCI_TELEMETRY_OTA_TARGET_SIZE) {
+    put_le16(&dst[0], ota->targets[i].sensor_id);
+    dst[2] = ota->targets[i].phase;
+    dst[3] = ota->targets[i].result;
+    put_le32(&dst[4], ota->targets[i].offset);
+  }
+  len = LCI_TELEMETRY_OTA_HEADER_SIZE + (count * LCI_TELEMETRY_OTA_TARGET_SIZE);
+  put_le16(&ota_frame[len], crc16(ota_frame, len));
+  len += LCI_TELEMETRY_CRC_SIZE;
+
+  ota_encoded[0] = 0;
+  len = cobs_encode(ota_frame, len, &ota_encoded[1]) + 1;
+  ota_encoded[len++] = 0;
+  return port_write(ota_encoded, len);
+}
+/**
+* @brief Set the handler of the host commands
+ *
+* @param[in] handler command handler, NULL to drop the commands
+*
+* @retval None
+*/
+void lci_telemetry_set_command_handler(lci_telemetry_command_handler_t handler)
+{
+  command_handler = handler;
+}
+/**
+* @brief Receive host acknowledgements and commands and send an aged batch
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_telemetry_process(void)
+{
+  uint8_t data[RX_READ_SIZE];
+  size_t data_len = 0;
+
+  if (sl_iostream_read(sl_iostream_vcom_handle, data, sizeof(data), &data_len) == SL_STATUS_OK) {
+    for (size_t i = 0; i < data_len; i++) {
+      if (data[i] == 0) {
+        if ((rx_len != 0) && !rx_overflow) {
+          handle_rx_frame();
+        }
+        rx_len = 0;
+        rx_overflow = false;
+      } else if (rx_len < sizeof(rx_buffer)) {
+        rx_buffer[rx_len++] = data[i];
+      } else {
+        rx_overflow = true;
+      }
+    }
+  }
+  if ((batch_count != 0) && ((get_time_ms() - batch_start_ms) >= LCI_TELEMETRY_FLUSH_MS)) {
+    (void)send_batch();
+  }
+}
+/**
+* @brief Telemetry statistics
+ *
+* @param[in] None
+*
+* @retval pointer to the statistics
+*/
+const lci_telemetry_stats_t *lci_telemetry_get_stats(void)
+{
+  return &stats;
+}
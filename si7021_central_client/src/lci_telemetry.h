@@ -0,0 +1,173 @@
+/**
+ * @file lci_telemetry.h
+ * @brief Binary framed UART telemetry from the central client to a host
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_TELEMETRY_H_
+#define LCI_TELEMETRY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_status.h"
+/* Set to 1 to report the readings as binary frames instead of log lines */
+#ifndef LCI_TELEMETRY_BINARY
+#define LCI_TELEMETRY_BINARY          0
+#endif
+/* Frame layout before COBS encoding, all fields little endian:
+ *
+ *   type (1) | seq (1) | count (1) | count * sample (11) | crc16 (2)
+ *
+ * sample: sensor id (2) | timestamp ms (4) | temperature 0.01 C (2) |
+ *         humidity 0.01 %RH (2) | flags (1)
+ *
+ * The CRC is CRC-16/CCITT-FALSE over type to the last sample. Every encoded
+ * frame is preceded and terminated by a 0x00 delimiter, so a decoder can
+ * resynchronise on any log text sharing the stream. */
+#define LCI_TELEMETRY_FRAME_SAMPLES   0x01
+#define LCI_TELEMETRY_FRAME_ACK       0x02
+#define LCI_TELEMETRY_FRAME_LINKS     0x03
+#define LCI_TELEMETRY_FRAME_OTA       0x04
+/* Fleet OTA commands from the host, see below */
+#define LCI_TELEMETRY_FRAME_CACHE_BEGIN 0x10
+#define LCI_TELEMETRY_FRAME_CACHE_DATA  0x11
+#define LCI_TELEMETRY_FRAME_CACHE_END   0x12
+#define LCI_TELEMETRY_FRAME_OTA_UPDATE  0x13
+#define LCI_TELEMETRY_FRAME_OTA_ABORT   0x14
+#define LCI_TELEMETRY_FRAME_OTA_QUERY   0x15
+/* Sample flags */
+#define LCI_TELEMETRY_FLAG_TEMP       0x01
+#define LCI_TELEMETRY_FLAG_HUM        0x02
+/* The timestamp is the sampling instant of a server synchronized to the
+ * central clock, not the time the reading arrived */
+#define LCI_TELEMETRY_FLAG_SYNCED     0x04
+/* The reading of a server out of range came through a relay, the timestamp
+ * is the time the relay heard it */
+#define LCI_TELEMETRY_FLAG_RELAYED    0x08
+/* Frame field sizes */
+#define LCI_TELEMETRY_HEADER_SIZE     3
+#define LCI_TELEMETRY_SAMPLE_SIZE     11
+#define LCI_TELEMETRY_CRC_SIZE        2
+/* Maximum number of samples batched into one frame */
+#define LCI_TELEMETRY_BATCH_MAX       8
+/* A partially filled batch is sent after this time in milliseconds */
+#define LCI_TELEMETRY_FLUSH_MS        1000
+/* Host acknowledgement frame: type (1) | seq (1) | credits (1) | crc16 (2).
+ * seq is the last samples frame received, credits the number of frames the
+ * host accepts beyond it. Until the first acknowledgement arrives the frames
+ * are sent without flow control. */
+#define LCI_TELEMETRY_ACK_SIZE        5
+/* Out of credits and without an acknowledgement for this time in
+ * milliseconds, one frame is sent as a probe: a lost acknowledgement or a
+ * restarted host acknowledges it and grants credits again */
+#define LCI_TELEMETRY_CREDIT_TIMEOUT_MS 2000
+/* Link statistics frame: type (1) | count (1) | count * link (20) | crc16 (2)
+ *
+ * link: sensor id (2) | RSSI dBm (1) | PHY (1) | samples delivered (4) |
+ *       samples expected (4) | supervision timeouts (2) | GATT timeouts (2) |
+ *       retries (2) | reconnects (2)
+ *
+ * The link statistics are sent periodically outside of the samples
+ * sequence and flow control. */
+#define LCI_TELEMETRY_LINK_SIZE       20
+/* Maximum number of links in one frame */
+#define LCI_TELEMETRY_LINKS_MAX       8
+/* Fleet OTA commands from the host: type (1) | payload | crc16 (2)
+ *
+ *   cache begin: image size (4) | CRC-32 of the image (4)
+ *   cache data:  offset (4) | 1 to 128 image bytes
+ *   cache end:   no payload, the cached image is checked
+ *   update:      count (1) | count * sensor id (2), 0 for every connected
+ *                server with the OTA service, at most one id per connection
+ *                and no id twice
+ *   abort:       no payload
+ *   query:       no payload
+ *
+ * Every command is answered by a fleet OTA status frame, the host sends the
+ * next command once the answer arrived:
+ *
+ *   type (1) | command (1) | status (1) | image size (4) | image CRC-32 (4) |
+ *   bytes cached (4) | count (1) | count * target (8) | crc16 (2)
+ *
+ * target: sensor id (2) | phase (1) | result (1) | bytes sent (4)
+ *
+ * While an update runs the status frame is also sent periodically, with
+ * command 0. */
+#define LCI_TELEMETRY_CACHE_CHUNK_MAX 128
+#define LCI_TELEMETRY_COMMAND_MAX_SIZE (1 + 4 + LCI_TELEMETRY_CACHE_CHUNK_MAX \
+                                        + LCI_TELEMETRY_CRC_SIZE)
+#define LCI_TELEMETRY_OTA_HEADER_SIZE 16
+#define LCI_TELEMETRY_OTA_TARGET_SIZE 8
+/* Maximum number of targets in one status frame */
+#define LCI_TELEMETRY_OTA_TARGETS_MAX 8
+/* Reading kinds */
+typedef enum {
+  lci_telemetry_temperature,
+  lci_telemetry_humidity
+} lci_telemetry_kind_t;
+/* Statistics of one link */
+typedef struct {
+  uint16_t sensor_id;
+  int8_t rssi;
+  uint8_t phy;
+  uint32_t delivered;
+  uint32_t expected;
+  uint16_t supervision_timeouts;
+  uint16_t gatt_timeouts;
+  uint16_t retries;
+  uint16_t reconnects;
+} lci_telemetry_link_t;
+/* Fleet OTA progress of one target */
+typedef struct {
+  uint16_t sensor_id;
+  uint8_t phase;
+  uint8_t result;
+  uint32_t offset;
+} lci_telemetry_ota_target_t;
+/* Fleet OTA status */
+typedef struct {
+  uint8_t command;
+  uint8_t status;
+  uint32_t size;
+  uint32_t crc;
+  uint32_t cached;
+  uint8_t count;
+  lci_telemetry_ota_target_t targets[LCI_TELEMETRY_OTA_TARGETS_MAX];
+} lci_telemetry_ota_t;
+/* Handler of a host command, called with the frame without its CRC from
+ * the context running lci_telemetry_process() */
+typedef void (*lci_telemetry_command_handler_t)(const uint8_t *frame, uint16_t len);
+/* Telemetry statistics */
+typedef struct {
+  uint32_t frames_sent;
+  uint32_t samples_sent;
+  uint32_t samples_dropped;
+  uint32_t acks_received;
+  uint32_t credit_probes;
+  uint32_t rx_errors;
+  uint32_t link_frames_sent;
+  uint32_t commands_received;
+} lci_telemetry_stats_t;
+
+void lci_telemetry_init(void);
+sl_status_t lci_telemetry_report(uint16_t sensor_id,
+                                 lci_telemetry_kind_t kind,
+                                 int32_t value);
+sl_status_t lci_telemetry_report_at(uint16_t sensor_id,
+                                    lci_telemetry_kind_t kind,
+                                    int32_t value,
+                                    uint32_t timestamp_ms);
+sl_status_t lci_telemetry_report_relayed(uint16_t sensor_id,
+                                         lci_telemetry_kind_t kind,
+                                         int32_t value,
+                                         uint32_t timestamp_ms);
+sl_status_t lci_telemetry_report_links(const lci_telemetry_link_t *links,
+                                       uint8_t count);
+sl_status_t lci_telemetry_report_ota(const lci_telemetry_ota_t *ota);
+void lci_telemetry_set_command_handler(lci_telemetry_command_handler_t handler);
+void lci_telemetry_process(void);
+const lci_telemetry_stats_t *lci_telemetry_get_stats(void);
+
+#endif /* LCI_TELEMETRY_H_ */
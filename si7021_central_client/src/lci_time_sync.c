@@ -0,0 +1,319 @@
+/**
+ * @file lci_time_sync.c
+ * @brief Distribution of the central clock to the servers
+ *
+ * The stack does not report the connection event of a GATT exchange, but a
+ * write with response and latency 0 has a fixed shape: the write goes in a
+ * connection event, the server answers in the next one. The response arrives
+ * one connection interval after the event that carried the write, which is
+ * the anchor the server timestamps with its own clock. The follow-up sends
+ * the anchor to the server.
+ *
+ * A write issued right after an event of the link waits close to a whole
+ * interval for the next one, and a server that answers an event late looks
+ * the same as such a write that was answered in time. Only round trips from
+ * one to two intervals, minus a margin for the host processing, are used;
+ * the others are retried. The writes are issued from the link timer, which
+ * runs at any phase of the connection events, so most of them pass.
+ *
+ * A synchronized server notifies its timed samples, the link stops the
+ * reads of the Environmental Sensing characteristics.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "sl_sleeptimer.h"
+#include "lci_time_sync.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Server with the time sync service */
+typedef struct {
+  uint8_t connection;
+  /* Sync characteristic, none until the client runs */
+  uint16_t handle;
+  uint8_t seq;
+  /* Sync written, waiting for the procedure to complete */
+  bool pending;
+  uint64_t sent_ms;
+  /* The reads are held back for the next sync */
+  bool held;
+  bool synced;
+  uint64_t next_sync_ms;
+  uint32_t syncs;
+  uint32_t rejected;
+} link_t;
+static link_t links[SL_BT_CONFIG_MAX_CONNECTIONS];
+/* Local functions */
+static uint64_t get_time_ms(void);
+static link_t *find_link(uint8_t connection);
+static void start_sync(link_t *link);
+static void complete_sync(link_t *link, uint16_t result);
+/**
+* @brief Read the system time
+ *
+* @param[in] None
+*
+* @retval milliseconds since the boot
+*/
+static uint64_t get_time_ms(void)
+{
+  uint64_t ms = 0;
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return ms;
+}
+/**
+* @brief Find a server connection
+ *
+* @param[in] connection connection handle
+*
+* @retval link, NULL if not known
+*/
+static link_t *find_link(uint8_t connection)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == connection) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Write the sync to a server
+ *
+* @param[in] link server connection
+*
+* @retval None
+*/
+static void start_sync(link_t *link)
+{
+  uint8_t value[2];
+  sl_status_t sc;
+
+  value[0] = LCI_TIME_SYNC_OP_SYNC;
+  value[1] = ++link->seq;
+  sc = sl_bt_gatt_write_characteristic_value(link->connection,
+                                             link->handle,
+                                             sizeof(value),
+                                             value);
+  if (sc != SL_STATUS_OK) {
+    /* A procedure of the link is still running, try on the next tick */
+    return;
+  }
+  link->sent_ms = get_time_ms();
+  link->pending = true;
+  link->held = false;
+}
+/**
+* @brief Complete the sync of a server with the follow-up
+ *
+* @param[in] link   server connection
+* @param[in] result result of the sync write
+*
+* @retval None
+*/
+static void complete_sync(link_t *link, uint16_t result)
+{
+  const lci_conn_slot_t *slot = lci_conn_scheduler_get_slot(link->connection);
+  uint64_t now = get_time_ms();
+  uint32_t interval_ms;
+  uint32_t round_trip;
+  uint32_t anchor;
+  uint8_t value[LCI_TIME_SYNC_FOLLOW_UP_SIZE];
+  uint16_t sent_len;
+  sl_status_t sc;
+
+  link->pending = false;
+  link->next_sync_ms = now + LCI_TIME_SYNC_RETRY_MS;
+  if ((result != 0) || (slot == NULL)) {
+    link->rejected++;
+    return;
+  }
+  /* 1.25 ms units, rounded */
+  interval_ms = ((uint32_t)slot->interval * 5u + 2u) / 4u;
+  round_trip = (uint32_t)(now - link->sent_ms);
+  if ((round_trip < interval_ms)
+      || (round_trip > (2u * interval_ms) - LCI_TIME_SYNC_SLACK_MS)) {
+    link->rejected++;
+    return;
+  }
+  anchor = (uint32_t)(now - interval_ms);
+  value[0] = LCI_TIME_SYNC_OP_FOLLOW_UP;
+  value[1] = link->seq;
+  value[2] = (uint8_t)anchor;
+  value[3] = (uint8_t)(anchor >> 8);
+  value[4] = (uint8_t)(anchor >> 16);
+  value[5] = (uint8_t)(anchor >> 24);
+  value[6] = (uint8_t)LCI_TIME_SYNC_SAMPLE_PERIOD_MS;
+  value[7] = (uint8_t)(LCI_TIME_SYNC_SAMPLE_PERIOD_MS >> 8);
+  sc = sl_bt_gatt_write_characteristic_value_without_response(link->connection,
+                                                              link->handle,
+                                                              sizeof(value),
+                                                              value,
+                                                              &sent_len);
+  if (sc != SL_STATUS_OK) {
+    link->rejected++;
+    return;
+  }
+  if (!link->synced) {
+    app_log_info("Time sync: connection %u synchronized, round trip %lu ms\n",
+                 link->connection,
+                 (unsigned long)round_trip);
+  }
+  link->synced = true;
+  link->syncs++;
+  link->next_sync_ms = now + LCI_TIME_SYNC_PERIOD_MS;
+}
+/**
+* @brief Initialize the time sync
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_time_sync_init(void)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    links[i].connection = CONNECTION_HANDLE_INVALID;
+  }
+}
+/**
+* @brief A server connection was opened
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_time_sync_on_opened(uint8_t connection)
+{
+  link_t *link = find_link(CONNECTION_HANDLE_INVALID);
+
+  if (link == NULL) {
+    return;
+  }
+  link->connection = connection;
+  link->handle = LCI_GATT_CLIENT_HANDLE_NONE;
+  link->pending = false;
+  link->held = false;
+  link->synced = false;
+  link->next_sync_ms = 0;
+  link->syncs = 0;
+  link->rejected = 0;
+}
+/**
+* @brief A GATT procedure of a link completed
+*
+* Completes a sync, and holds the reads of a link that is due for a sync or
+* gets its samples notified.
+ *
+* @param[in] connection connection handle
+* @param[in] client     GATT client of the connection
+* @param[in] result     result of the procedure
+*
+* @retval true if the link is driven by the time sync, no read to start
+*/
+bool lci_time_sync_on_procedure_completed(uint8_t connection,
+                                          const lci_gatt_client_t *client,
+                                          uint16_t result)
+{
+  link_t *link = find_link(connection);
+
+  if (link == NULL) {
+    return false;
+  }
+  if (link->pending) {
+    complete_sync(link, result);
+  }
+  if ((link->handle == LCI_GATT_CLIENT_HANDLE_NONE) && lci_gatt_client_running(client)) {
+    /* Both characteristics, a sync is no use without the timed samples */
+    if (lci_gatt_client_find_handle(client,
+                                    LCI_GATT_PROFILE_TIME_SYNC,
+                                    LCI_GATT_TIME_SYNC_SAMPLE) != LCI_GATT_CLIENT_HANDLE_NONE) {
+      link->handle = lci_gatt_client_find_handle(client,
+                                                 LCI_GATT_PROFILE_TIME_SYNC,
+                                                 LCI_GATT_TIME_SYNC_WRITE);
+    }
+    if (link->handle == LCI_GATT_CLIENT_HANDLE_NONE) {
+      /* Not a time sync server, read as before */
+      link->connection = CONNECTION_HANDLE_INVALID;
+      return false;
+    }
+  }
+  if (link->handle == LCI_GATT_CLIENT_HANDLE_NONE) {
+    return false;
+  }
+  if (!link->synced && (get_time_ms() >= link->next_sync_ms)) {
+    /* Idle until the link timer writes the sync at a random phase */
+    link->held = true;
+  }
+  return link->synced || link->held;
+}
+/**
+* @brief Link timer tick, writes the syncs that are due on idle links
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_time_sync_on_tick(uint8_t connection)
+{
+  link_t *link = find_link(connection);
+
+  if ((link == NULL) || (link->handle == LCI_GATT_CLIENT_HANDLE_NONE) || link->pending) {
+    return;
+  }
+  /* An unsynchronized link is idle only while held */
+  if ((link->synced || link->held) && (get_time_ms() >= link->next_sync_ms)) {
+    start_sync(link);
+  }
+}
+/**
+* @brief A server connection was closed
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_time_sync_on_closed(uint8_t connection)
+{
+  link_t *link = find_link(connection);
+
+  if (link != NULL) {
+    link->connection = CONNECTION_HANDLE_INVALID;
+  }
+}
+/**
+* @brief Check whether a server samples on the central clock
+ *
+* @param[in] connection connection handle
+*
+* @retval true if synchronized, its samples are notified
+*/
+bool lci_time_sync_synced(uint8_t connection)
+{
+  link_t *link = find_link(connection);
+
+  return (link != NULL) && link->synced;
+}
+/**
+* @brief Decode a timed sample
+ *
+* @param[in]  data   characteristic value
+* @param[in]  len    characteristic value length
+* @param[out] sample decoded sample
+*
+* @retval true if decoded, false if the value is too short
+*/
+bool lci_time_sync_decode(const uint8_t *data, uint8_t len, lci_time_sync_sample_t *sample)
+{
+  if (len < LCI_TIME_SYNC_SAMPLE_SIZE) {
+    return false;
+  }
+  sample->instant = (uint32_t)data[0] | ((uint32_t)data[1] << 8)
+                    | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+  sample->temperature = (int16_t)(data[4] | (data[5] << 8));
+  sample->humidity = (uint16_t)(data[6] | (data[7] << 8));
+  return true;
+}
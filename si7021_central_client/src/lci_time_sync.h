@@ -0,0 +1,53 @@
+/**
+ * @file lci_time_sync.h
+ * @brief Distribution of the central clock to the servers
+ *
+ * Servers with the LCI Time Sync service read their sensors at the same
+ * instants of the central clock and notify the samples tagged with their
+ * instant, see the README of the SI7021 peripheral server.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_TIME_SYNC_H_
+#define LCI_TIME_SYNC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lci_conn_scheduler.h"
+#include "lci_gatt_client.h"
+/* Operations of the sync characteristic */
+#define LCI_TIME_SYNC_OP_SYNC         0x01
+#define LCI_TIME_SYNC_OP_FOLLOW_UP    0x02
+/* Size of the follow-up and of the timed sample */
+#define LCI_TIME_SYNC_FOLLOW_UP_SIZE  8
+#define LCI_TIME_SYNC_SAMPLE_SIZE     8
+/* Sampling period of the servers in milliseconds */
+#define LCI_TIME_SYNC_SAMPLE_PERIOD_MS (1000 / LCI_CONN_SAMPLE_RATE_HZ)
+/* Resync period of a synchronized link in milliseconds */
+#define LCI_TIME_SYNC_PERIOD_MS       10000
+/* Retry period of a link not synchronized yet in milliseconds */
+#define LCI_TIME_SYNC_RETRY_MS        1000
+/* Margin for the host processing in the round trip check in milliseconds */
+#define LCI_TIME_SYNC_SLACK_MS        3
+/* Sample of a synchronized server */
+typedef struct {
+  /* Sampling instant in central milliseconds */
+  uint32_t instant;
+  /* 0.01 degree Celsius and 0.01 %RH */
+  int32_t temperature;
+  int32_t humidity;
+} lci_time_sync_sample_t;
+
+void lci_time_sync_init(void);
+void lci_time_sync_on_opened(uint8_t connection);
+bool lci_time_sync_on_procedure_completed(uint8_t connection,
+                                          const lci_gatt_client_t *client,
+                                          uint16_t result);
+void lci_time_sync_on_tick(uint8_t connection);
+void lci_time_sync_on_closed(uint8_t connection);
+bool lci_time_sync_synced(uint8_t connection);
+bool lci_time_sync_decode(const uint8_t *data, uint8_t len, lci_time_sync_sample_t *sample);
+
+#endif /* LCI_TIME_SYNC_H_ */
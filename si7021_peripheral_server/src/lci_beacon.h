@@ -0,0 +1,42 @@
+/**
+ * @file lci_beacon.h
+ * @brief Non-connectable beacon carrying the live state of the server
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_BEACON_H_
+#define LCI_BEACON_H_
+
+#include <stdint.h>
+#include "sl_status.h"
+/* Laird Connectivity company identifier assigned by Bluetooth SIG */
+#define LCI_BEACON_COMPANY_ID         0x0077
+/* Beacon advertising interval */
+#define LCI_BEACON_INTERVAL           160  /* 100 milliseconds */
+/* Beacon TX power in dBm, independent of the connectable advertising */
+#ifndef LCI_BEACON_TX_POWER
+#define LCI_BEACON_TX_POWER           0
+#endif
+/* Period of the state refresh in milliseconds */
+#define LCI_BEACON_UPDATE_MS          1000
+/* State bytes that fit into the manufacturer specific data */
+#define LCI_BEACON_STATE_MAX          25
+/* Kind of the state in the beacon
+ *
+ * The manufacturer specific data is: length, 0xFF, company ID (2 bytes,
+ * little-endian), kind, sequence number incremented on every state change,
+ * state. */
+typedef enum {
+  /* Temperature in 0.01 degree Celsius (int16), humidity in 0.01 %RH
+   * (uint16), both little-endian */
+  lci_beacon_rht = 0x01,
+  /* Digital states, bit 0 LED, bit 1 button */
+  lci_beacon_aio = 0x02
+} lci_beacon_kind_t;
+
+sl_status_t lci_beacon_start(lci_beacon_kind_t kind, uint32_t update_signal);
+sl_status_t lci_beacon_update(const uint8_t *state, uint8_t len);
+
+#endif /* LCI_BEACON_H_ */
@@ -0,0 +1,180 @@
+/**
+ * @file lci_bonding.c
+ * @brief Bonding with LE Secure Connections for encrypted reconnects
+ *
+ * The client pairs once, Just Works with LE Secure Connections, and both
+ * sides keep the long term key. The stack stores the bonds in NVM3, so on a
+ * reconnect of a bonded client, also after a reset, the link is encrypted
+ * with the stored key by a single encryption procedure of the controller:
+ * no new key exchange, no new pairing. The bonding table holds
+ * LCI_BONDING_MAX bonds, a new client replaces the one seen the longest
+ * time ago.
+ *
+ * The client starts the encryption, the server logs the time from the
+ * connection to the encryption and whether an existing bond was resumed.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdbool.h>
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "sl_sleeptimer.h"
+#include "lci_bonding.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Connection of a client */
+typedef struct {
+  uint8_t connection;
+  /* Bond found when the connection opened */
+  uint8_t bonding;
+  bool encrypted;
+  uint32_t opened_ms;
+} link_t;
+static link_t links[SL_BT_CONFIG_MAX_CONNECTIONS];
+/* Local functions */
+static uint32_t local_ms(void);
+static link_t *find_link(uint8_t connection);
+/**
+* @brief Local time in milliseconds since the boot
+ *
+* @param[in] None
+*
+* @retval milliseconds, wrapping at 32 bits
+*/
+static uint32_t local_ms(void)
+{
+  uint64_t ms = 0;
+
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return (uint32_t)ms;
+}
+/**
+* @brief Find a client connection
+ *
+* @param[in] connection connection handle
+*
+* @retval link, NULL if not known
+*/
+static link_t *find_link(uint8_t connection)
+{
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    if (links[i].connection == connection) {
+      return &links[i];
+    }
+  }
+  return NULL;
+}
+/**
+* @brief Configure the security manager, before the first connection
+ *
+* @param[in] None
+*
+* @retval SL_STATUS_OK if configured, error code otherwise
+*/
+sl_status_t lci_bonding_init(void)
+{
+  sl_status_t sc;
+
+  for (uint8_t i = 0; i < SL_BT_CONFIG_MAX_CONNECTIONS; i++) {
+    links[i].connection = CONNECTION_HANDLE_INVALID;
+  }
+  sc = sl_bt_sm_configure(LCI_BONDING_SM_FLAGS, sl_bt_sm_io_capability_noinputnooutput);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  sc = sl_bt_sm_store_bonding_configuration(LCI_BONDING_MAX, LCI_BONDING_POLICY_LRU);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  return sl_bt_sm_set_bondable_mode(1);
+}
+/**
+* @brief A client connected
+ *
+* @param[in] connection connection handle
+* @param[in] bonding    bond of the client, LCI_BONDING_NONE if not bonded
+*
+* @retval None
+*/
+void lci_bonding_on_opened(uint8_t connection, uint8_t bonding)
+{
+  link_t *link = find_link(CONNECTION_HANDLE_INVALID);
+
+  if (link == NULL) {
+    return;
+  }
+  link->connection = connection;
+  link->bonding = bonding;
+  link->encrypted = false;
+  link->opened_ms = local_ms();
+}
+/**
+* @brief Log the time to the encryption of a link
+ *
+* @param[in] connection    connection handle
+* @param[in] security_mode security mode of the link
+*
+* @retval None
+*/
+void lci_bonding_on_parameters(uint8_t connection, uint8_t security_mode)
+{
+  link_t *link = find_link(connection);
+
+  if ((link == NULL) || link->encrypted || (security_mode == sl_bt_connection_mode1_level1)) {
+    return;
+  }
+  link->encrypted = true;
+  app_log_info("Connection %u encrypted in %lu ms, %s\n",
+               connection,
+               (unsigned long)(local_ms() - link->opened_ms),
+               (link->bonding != LCI_BONDING_NONE) ? "bond resumed" : "paired");
+}
+/**
+* @brief A client paired and bonded
+ *
+* @param[in] connection connection handle
+* @param[in] bonding    new bond
+*
+* @retval None
+*/
+void lci_bonding_on_bonded(uint8_t connection, uint8_t bonding)
+{
+  link_t *link = find_link(connection);
+
+  app_log_info("Connection %u bonded, bond %u\n", connection, bonding);
+  if (link != NULL) {
+    link->bonding = bonding;
+  }
+}
+/**
+* @brief Pairing or encryption of a client failed
+*
+* The reason tells a client without the keys of the bond from a rejected
+* or timed out pairing.
+ *
+* @param[in] connection connection handle
+* @param[in] reason     result of the procedure
+*
+* @retval None
+*/
+void lci_bonding_on_failed(uint8_t connection, uint16_t reason)
+{
+  app_log_status_warning_f(reason, "Connection %u bonding failed\n", connection);
+}
+/**
+* @brief A client disconnected
+ *
+* @param[in] connection closed connection handle
+*
+* @retval None
+*/
+void lci_bonding_on_closed(uint8_t connection)
+{
+  link_t *link = find_link(connection);
+
+  if (link != NULL) {
+    link->connection = CONNECTION_HANDLE_INVALID;
+  }
+}
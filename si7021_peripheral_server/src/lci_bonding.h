@@ -0,0 +1,35 @@
+/**
+ * @file lci_bonding.h
+ * @brief Bonding with LE Secure Connections for encrypted reconnects
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_BONDING_H_
+#define LCI_BONDING_H_
+
+#include <stdint.h>
+#include "sl_status.h"
+/* Set to 0 to leave the links unencrypted */
+#ifndef LCI_BONDING
+#define LCI_BONDING                   1
+#endif
+/* Bonds kept by the stack, a new one replaces the least recently used */
+#define LCI_BONDING_MAX               4
+/* Security manager: bonding without MITM protection (no display or keys),
+ * encryption requires bonding, LE Secure Connections only */
+#define LCI_BONDING_SM_FLAGS          0x06
+/* Bonding policy: a new bond overwrites the one used the longest time ago */
+#define LCI_BONDING_POLICY_LRU        2
+/* Bonding handle of a connection without a bond */
+#define LCI_BONDING_NONE              0xFF
+
+sl_status_t lci_bonding_init(void);
+void lci_bonding_on_opened(uint8_t connection, uint8_t bonding);
+void lci_bonding_on_parameters(uint8_t connection, uint8_t security_mode);
+void lci_bonding_on_bonded(uint8_t connection, uint8_t bonding);
+void lci_bonding_on_failed(uint8_t connection, uint16_t reason);
+void lci_bonding_on_closed(uint8_t connection);
+
+#endif /* LCI_BONDING_H_ */
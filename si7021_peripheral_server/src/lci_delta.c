@@ -0,0 +1,481 @@
+/**
+ * @file lci_delta.c
+ * @brief Streaming applier of differential firmware updates
+ *
+ * The patch is applied while it arrives, in chunks of any size, with a
+ * fixed amount of RAM: the reference bytes are read straight from the
+ * installed application in flash and the rebuilt GBL goes to the storage
+ * slot through a small buffer. The installed application is checked
+ * against the CRC of the patch header before the first byte is written,
+ * the rebuilt GBL against the size and CRC of the new image at the end.
+ * The bootloader then verifies its signature as for a full update.
+ *
+ * The file has no SDK dependencies, the host tools build it as is.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "lci_delta.h"
+/* Size of a GBL tag header: tag ID and length */
+#define TAG_HEADER_SIZE               8
+/* Patch parser states */
+#define STATE_HEADER                  0
+#define STATE_OP                      1
+#define STATE_LENGTH                  2
+#define STATE_OFFSET                  3
+#define STATE_LITERAL                 4
+#define STATE_ZERO_RUN                5
+#define STATE_LITERAL_COUNT           6
+#define STATE_DIFF_BYTES              7
+#define STATE_END                     8
+/* Local functions */
+static uint32_t read_le32(const uint8_t *data);
+static bool read_varint(lci_delta_t *delta, uint8_t byte);
+static lci_delta_status_t fail(lci_delta_t *delta, lci_delta_status_t status);
+static bool flush(lci_delta_t *delta);
+static bool emit(lci_delta_t *delta, const uint8_t *data, uint32_t len);
+static lci_delta_status_t parse_header(lci_delta_t *delta);
+static lci_delta_status_t start_op(lci_delta_t *delta);
+static lci_delta_status_t emit_old(lci_delta_t *delta, uint32_t len);
+static lci_delta_status_t push_byte(lci_delta_t *delta, uint8_t byte);
+/**
+* @brief Read a little-endian 32-bit value
+ *
+* @param[in] data pointer to the value
+*
+* @retval value
+*/
+static uint32_t read_le32(const uint8_t *data)
+{
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8)
+         | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+/**
+* @brief Add a byte to the LEB128 varint under decoding
+ *
+* @param[in] delta applier state
+* @param[in] byte  patch byte
+*
+* @retval true if the varint is complete
+*/
+static bool read_varint(lci_delta_t *delta, uint8_t byte)
+{
+  if (delta->varint_shift < 32) {
+    delta->varint |= (uint32_t)(byte & 0x7F) << delta->varint_shift;
+  }
+  delta->varint_shift += 7;
+  return (byte & 0x80) == 0;
+}
+/**
+* @brief Latch an error, every later call returns it
+ *
+* @param[in] delta  applier state
+* @param[in] status error
+*
+* @retval the error
+*/
+static lci_delta_status_t fail(lci_delta_t *delta, lci_delta_status_t status)
+{
+  delta->status = status;
+  return status;
+}
+/**
+* @brief Write the buffered bytes to the storage slot
+ *
+* @param[in] delta applier state
+*
+* @retval true if written
+*/
+static bool flush(lci_delta_t *delta)
+{
+  if (delta->buffered == 0) {
+    return true;
+  }
+  if (!delta->write(delta->written, delta->buffer, delta->buffered, delta->context)) {
+    return false;
+  }
+  delta->written += delta->buffered;
+  delta->buffered = 0;
+  return true;
+}
+/**
+* @brief Append rebuilt bytes to the new image
+ *
+* @param[in] delta applier state
+* @param[in] data  rebuilt bytes
+* @param[in] len   number of bytes
+*
+* @retval true if buffered or written
+*/
+static bool emit(lci_delta_t *delta, const uint8_t *data, uint32_t len)
+{
+  uint32_t chunk;
+
+  delta->crc = lci_delta_crc32(delta->crc, data, len);
+  while (len > 0) {
+    chunk = LCI_DELTA_BUFFER_SIZE - delta->buffered;
+    if (chunk > len) {
+      chunk = len;
+    }
+    memcpy(&delta->buffer[delta->buffered], data, chunk);
+    delta->buffered = (uint16_t)(delta->buffered + chunk);
+    data += chunk;
+    len -= chunk;
+    if ((delta->buffered == LCI_DELTA_BUFFER_SIZE) && !flush(delta)) {
+      return false;
+    }
+  }
+  return true;
+}
+/**
+* @brief Check the patch header against the installed application
+ *
+* @param[in] delta applier state
+*
+* @retval lci_delta_ok if the patch applies to the installed application
+*/
+static lci_delta_status_t parse_header(lci_delta_t *delta)
+{
+  uint32_t old_address = read_le32(&delta->header[8]);
+
+  if ((read_le32(&delta->header[0]) != LCI_DELTA_MAGIC)
+      || (delta->header[4] != LCI_DELTA_VERSION)) {
+    return fail(delta, lci_delta_bad_format);
+  }
+  delta->old_size = read_le32(&delta->header[12]);
+  delta->new_size = read_le32(&delta->header[20]);
+  delta->new_crc = read_le32(&delta->header[24]);
+  if ((old_address < delta->old_address)
+      || ((old_address - delta->old_address) > delta->old_limit)
+      || (delta->old_size > (delta->old_limit - (old_address - delta->old_address)))) {
+    return fail(delta, lci_delta_wrong_base);
+  }
+  delta->old_base = delta->old_image + (old_address - delta->old_address);
+  if (lci_delta_crc32(0, delta->old_base, delta->old_size) != read_le32(&delta->header[16])) {
+    return fail(delta, lci_delta_wrong_base);
+  }
+  delta->state = STATE_OP;
+  return lci_delta_ok;
+}
+/**
+* @brief Start an operation once its length is known
+ *
+* @param[in] delta applier state
+*
+* @retval lci_delta_ok, or the error of a wrong operation
+*/
+static lci_delta_status_t start_op(lci_delta_t *delta)
+{
+  delta->op_remaining = delta->varint;
+  if ((delta->written + delta->buffered + delta->op_remaining) > delta->new_size) {
+    return fail(delta, lci_delta_bad_size);
+  }
+  delta->varint = 0;
+  delta->varint_shift = 0;
+  delta->state = (delta->op == LCI_DELTA_OP_ADD) ? STATE_LITERAL : STATE_OFFSET;
+  if ((delta->op == LCI_DELTA_OP_ADD) && (delta->op_remaining == 0)) {
+    delta->state = STATE_OP;
+  }
+  return lci_delta_ok;
+}
+/**
+* @brief Copy the next bytes of the old range unchanged
+ *
+* @param[in] delta applier state
+* @param[in] len   number of bytes
+*
+* @retval lci_delta_ok, or the error of a failed write
+*/
+static lci_delta_status_t emit_old(lci_delta_t *delta, uint32_t len)
+{
+  if (!emit(delta, &delta->old_base[delta->old_cursor], len)) {
+    return fail(delta, lci_delta_write_error);
+  }
+  delta->old_cursor += len;
+  delta->op_remaining -= len;
+  return lci_delta_ok;
+}
+/**
+* @brief Run the patch parser on one byte
+ *
+* @param[in] delta applier state
+* @param[in] byte  patch byte
+*
+* @retval lci_delta_ok, lci_delta_done at the end of the patch, error otherwise
+*/
+static lci_delta_status_t push_byte(lci_delta_t *delta, uint8_t byte)
+{
+  int32_t offset;
+  uint8_t value;
+
+  switch (delta->state) {
+    case STATE_HEADER:
+      delta->header[delta->header_len++] = byte;
+      if (delta->header_len == LCI_DELTA_HEADER_SIZE) {
+        return parse_header(delta);
+      }
+      break;
+    case STATE_OP:
+      delta->op = byte;
+      delta->varint = 0;
+      delta->varint_shift = 0;
+      if (byte == LCI_DELTA_OP_END) {
+        delta->state = STATE_END;
+        return fail(delta, lci_delta_done);
+      }
+      if (byte > LCI_DELTA_OP_DIFF) {
+        return fail(delta, lci_delta_bad_format);
+      }
+      delta->state = STATE_LENGTH;
+      break;
+    case STATE_LENGTH:
+      if (read_varint(delta, byte)) {
+        return start_op(delta);
+      }
+      break;
+    case STATE_OFFSET:
+      if (!read_varint(delta, byte)) {
+        break;
+      }
+      /* Zigzag, relative to the end of the previous old range */
+      offset = (int32_t)(delta->varint >> 1) ^ -(int32_t)(delta->varint & 1);
+      delta->old_cursor += (uint32_t)offset;
+      if ((delta->old_cursor > delta->old_size)
+          || (delta->op_remaining > (delta->old_size - delta->old_cursor))) {
+        return fail(delta, lci_delta_bad_format);
+      }
+      delta->varint = 0;
+      delta->varint_shift = 0;
+      if (delta->op == LCI_DELTA_OP_COPY) {
+        delta->state = STATE_OP;
+        return emit_old(delta, delta->op_remaining);
+      }
+      delta->state = (delta->op_remaining == 0) ? STATE_OP : STATE_ZERO_RUN;
+      break;
+    case STATE_LITERAL:
+      if (!emit(delta, &byte, 1)) {
+        return fail(delta, lci_delta_write_error);
+      }
+      if (--delta->op_remaining == 0) {
+        delta->state = STATE_OP;
+      }
+      break;
+    case STATE_ZERO_RUN:
+      if (!read_varint(delta, byte)) {
+        break;
+      }
+      if (delta->varint > delta->op_remaining) {
+        return fail(delta, lci_delta_bad_format);
+      }
+      if (emit_old(delta, delta->varint) != lci_delta_ok) {
+        return delta->status;
+      }
+      delta->varint = 0;
+      delta->varint_shift = 0;
+      delta->state = (delta->op_remaining == 0) ? STATE_OP : STATE_LITERAL_COUNT;
+      break;
+    case STATE_LITERAL_COUNT:
+      if (!read_varint(delta, byte)) {
+        break;
+      }
+      if ((delta->varint == 0) || (delta->varint > delta->op_remaining)) {
+        return fail(delta, lci_delta_bad_format);
+      }
+      delta->segment_remaining = delta->varint;
+      delta->varint = 0;
+      delta->varint_shift = 0;
+      delta->state = STATE_DIFF_BYTES;
+      break;
+    case STATE_DIFF_BYTES:
+      value = (uint8_t)(delta->old_base[delta->old_cursor++] + byte);
+      if (!emit(delta, &value, 1)) {
+        return fail(delta, lci_delta_write_error);
+      }
+      delta->op_remaining--;
+      if (--delta->segment_remaining == 0) {
+        delta->state = (delta->op_remaining == 0) ? STATE_OP : STATE_ZERO_RUN;
+      }
+      break;
+    default:
+      /* Nothing but the padding of the tag may follow the end of the patch */
+      if (byte != 0) {
+        return fail(delta, lci_delta_bad_format);
+      }
+      break;
+  }
+  return lci_delta_ok;
+}
+/**
+* @brief Initialize the applier
+ *
+* @param[in] delta       applier state
+* @param[in] old_image   installed application, or a flash area containing it
+* @param[in] old_address flash address of old_image
+* @param[in] old_limit   size of the flash area at old_image
+* @param[in] write       writes rebuilt bytes to the storage slot
+* @param[in] context     context of the write function
+*
+* @retval None
+*/
+void lci_delta_init(lci_delta_t *delta,
+                    const uint8_t *old_image,
+                    uint32_t old_address,
+                    uint32_t old_limit,
+                    lci_delta_write_t write,
+                    void *context)
+{
+  memset(delta, 0, sizeof(*delta));
+  delta->old_image = old_image;
+  delta->old_address = old_address;
+  delta->old_limit = old_limit;
+  delta->write = write;
+  delta->context = context;
+  delta->status = lci_delta_ok;
+  delta->state = STATE_HEADER;
+}
+/**
+* @brief Refresh the pointers of a state copied back from storage, e.g. to
+*        resume a transfer after a reset
+ *
+* @param[in] delta     restored applier state
+* @param[in] old_image installed application at the flash address of lci_delta_init
+* @param[in] write     writes rebuilt bytes to the storage slot
+* @param[in] context   context of the write function
+*
+* @retval None
+*/
+void lci_delta_rebind(lci_delta_t *delta,
+                      const uint8_t *old_image,
+                      lci_delta_write_t write,
+                      void *context)
+{
+  if (delta->old_base != NULL) {
+    delta->old_base = old_image + (delta->old_base - delta->old_image);
+  }
+  delta->old_image = old_image;
+  delta->write = write;
+  delta->context = context;
+}
+/**
+* @brief Apply the next bytes of a GBL container, the patch is taken from
+*        its metadata tag and every other tag is skipped
+ *
+* @param[in] delta applier state
+* @param[in] data  container bytes
+* @param[in] len   number of bytes
+*
+* @retval lci_delta_ok, lci_delta_done at the end of the patch, error otherwise
+*/
+lci_delta_status_t lci_delta_push_container(lci_delta_t *delta, const uint8_t *data, uint32_t len)
+{
+  uint32_t chunk;
+  lci_delta_status_t status;
+
+  while (len > 0) {
+    if ((delta->status != lci_delta_ok) && (delta->status != lci_delta_done)) {
+      return delta->status;
+    }
+    if (delta->tag_header_len < TAG_HEADER_SIZE) {
+      delta->tag_header[delta->tag_header_len++] = *data++;
+      len--;
+      if (delta->tag_header_len == TAG_HEADER_SIZE) {
+        delta->tag_id = read_le32(&delta->tag_header[0]);
+        delta->tag_remaining = read_le32(&delta->tag_header[4]);
+        if (delta->tag_remaining == 0) {
+          delta->tag_header_len = 0;
+        }
+      }
+      continue;
+    }
+    chunk = (len < delta->tag_remaining) ? len : delta->tag_remaining;
+    if (delta->tag_id == LCI_DELTA_GBL_TAG_METADATA) {
+      status = lci_delta_push_patch(delta, data, chunk);
+      if ((status != lci_delta_ok) && (status != lci_delta_done)) {
+        return status;
+      }
+    }
+    data += chunk;
+    len -= chunk;
+    delta->tag_remaining -= chunk;
+    if (delta->tag_remaining == 0) {
+      delta->tag_header_len = 0;
+    }
+  }
+  return delta->status;
+}
+/**
+* @brief Apply the next bytes of a bare patch
+ *
+* @param[in] delta applier state
+* @param[in] data  patch bytes
+* @param[in] len   number of bytes
+*
+* @retval lci_delta_ok, lci_delta_done at the end of the patch, error otherwise
+*/
+lci_delta_status_t lci_delta_push_patch(lci_delta_t *delta, const uint8_t *data, uint32_t len)
+{
+  lci_delta_status_t status;
+
+  for (uint32_t i = 0; i < len; i++) {
+    if ((delta->status != lci_delta_ok) && (delta->status != lci_delta_done)) {
+      return delta->status;
+    }
+    status = push_byte(delta, data[i]);
+    if ((status != lci_delta_ok) && (status != lci_delta_done)) {
+      return status;
+    }
+  }
+  return delta->status;
+}
+/**
+* @brief Write the last bytes and check the rebuilt image
+ *
+* @param[in] delta applier state
+*
+* @retval lci_delta_ok if the rebuilt image has the size and CRC of the
+*         patch header, error otherwise
+*/
+lci_delta_status_t lci_delta_finish(lci_delta_t *delta)
+{
+  if (delta->status != lci_delta_done) {
+    return fail(delta, (delta->status == lci_delta_ok) ? lci_delta_bad_format : delta->status);
+  }
+  if (!flush(delta)) {
+    return fail(delta, lci_delta_write_error);
+  }
+  if (delta->written != delta->new_size) {
+    return fail(delta, lci_delta_bad_size);
+  }
+  if (delta->crc != delta->new_crc) {
+    return fail(delta, lci_delta_bad_crc);
+  }
+  return lci_delta_ok;
+}
+/**
+* @brief CRC-32 (IEEE 802.3) as used by the GBL format, nibble table
+ *
+* @param[in] crc  CRC of the previous bytes, 0 to start
+* @param[in] data bytes
+* @param[in] len  number of bytes
+*
+* @retval updated CRC
+*/
+uint32_t lci_delta_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+  static const uint32_t table[16] = {
+    0x00000000u, 0x1DB71064u, 0x3B6E20C8u, 0x26D930ACu,
+    0x76DC4190u, 0x6B6B51F4u, 0x4DB26158u, 0x5005713Cu,
+    0xEDB88320u, 0xF00F9344u, 0xD6D6A3E8u, 0xCB61B38Cu,
+    0x9B64C2B0u, 0x86D3D2D4u, 0xA00AE278u, 0xBDBDF21Cu
+  };
+
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+  }
+  return ~crc;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file lci_delta.h
+ * @brief Streaming applier of differential firmware updates
+ *
+ * A delta rebuilds the new signed application GBL from the application
+ * installed in flash. Patch layout, all fields little-endian:
+ *
+ *   magic "LDLT" (4) | version (1) | reserved (3) | old base address (4) |
+ *   old size (4) | old CRC-32 (4) | new size (4) | new CRC-32 (4) | ops
+ *
+ * ops, lengths and offsets as LEB128 varints, offsets zigzag encoded and
+ * relative to the end of the previous old range:
+ *
+ *   0x00 end
+ *   0x01 copy:    length, offset
+ *   0x02 add:     length, length literal bytes
+ *   0x03 diff:    length, offset, then segments until length bytes are
+ *                 covered: zero run, literal count, literal bytes added
+ *                 to the old bytes
+ *
+ * The patch travels in the metadata tag of a GBL container, so it is signed
+ * like any other GBL file and ignored by a bootloader that gets it directly.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_DELTA_H_
+#define LCI_DELTA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Patch header */
+#define LCI_DELTA_MAGIC               0x544C444Cu  /* "LDLT" */
+#define LCI_DELTA_VERSION             1
+#define LCI_DELTA_HEADER_SIZE         28
+/* Patch operations */
+#define LCI_DELTA_OP_END              0x00
+#define LCI_DELTA_OP_COPY             0x01
+#define LCI_DELTA_OP_ADD              0x02
+#define LCI_DELTA_OP_DIFF             0x03
+/* GBL tags of the container */
+#define LCI_DELTA_GBL_TAG_HEADER      0x03A617EBu
+#define LCI_DELTA_GBL_TAG_METADATA    0xF60808F6u
+#define LCI_DELTA_GBL_TAG_END         0xFC0404FCu
+/* Rebuilt bytes buffered before a write to the storage slot */
+#define LCI_DELTA_BUFFER_SIZE         256
+/* Status of the applier */
+typedef enum {
+  lci_delta_ok,
+  /* End of the patch reached, waiting for lci_delta_finish */
+  lci_delta_done,
+  lci_delta_bad_format,
+  /* The installed application is not the one the patch was made from */
+  lci_delta_wrong_base,
+  lci_delta_write_error,
+  lci_delta_bad_size,
+  lci_delta_bad_crc
+} lci_delta_status_t;
+/* Writes rebuilt bytes to the storage slot, returns false on failure */
+typedef bool (*lci_delta_write_t)(uint32_t offset,
+                                  const uint8_t *data,
+                                  uint32_t len,
+                                  void *context);
+/* Applier state, about 340 bytes of RAM */
+typedef struct {
+  /* Reference image, the installed application, and its flash address */
+  const uint8_t *old_image;
+  uint32_t old_address;
+  uint32_t old_limit;
+  const uint8_t *old_base;
+  lci_delta_write_t write;
+  void *context;
+  lci_delta_status_t status;
+  /* GBL container walker */
+  uint8_t tag_header[8];
+  uint8_t tag_header_len;
+  uint32_t tag_id;
+  uint32_t tag_remaining;
+  /* Patch parser */
+  uint8_t header[LCI_DELTA_HEADER_SIZE];
+  uint8_t header_len;
+  uint8_t state;
+  uint8_t op;
+  uint32_t varint;
+  uint8_t varint_shift;
+  uint32_t op_remaining;
+  uint32_t segment_remaining;
+  uint32_t old_cursor;
+  uint32_t old_size;
+  uint32_t new_size;
+  uint32_t new_crc;
+  /* Rebuilt image */
+  uint8_t buffer[LCI_DELTA_BUFFER_SIZE];
+  uint16_t buffered;
+  uint32_t written;
+  uint32_t crc;
+} lci_delta_t;
+
+void lci_delta_init(lci_delta_t *delta,
+                    const uint8_t *old_image,
+                    uint32_t old_address,
+                    uint32_t old_limit,
+                    lci_delta_write_t write,
+                    void *context);
+void lci_delta_rebind(lci_delta_t *delta,
+                      const uint8_t *old_image,
+                      lci_delta_write_t write,
+                      void *context);
+lci_delta_status_t lci_delta_push_container(lci_delta_t *delta, const uint8_t *data, uint32_t len);
+lci_delta_status_t lci_delta_push_patch(lci_delta_t *delta, const uint8_t *data, uint32_t len);
+lci_delta_status_t lci_delta_finish(lci_delta_t *delta);
+uint32_t lci_delta_crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LCI_DELTA_H_ */
@@ -0,0 +1,41 @@
+/**
+ * @file lci_fast_start.h
+ * @brief Fast start of the advertising after a reset
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_FAST_START_H_
+#define LCI_FAST_START_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_status.h"
+/* Set to 0 to build the advertising data on every boot instead of
+ * starting from the copy kept in NVM3 */
+#ifndef LCI_FAST_START
+#define LCI_FAST_START                1
+#endif
+/* NVM3 key of the fast start cache, application key range 0x00000-0x0FFFF */
+#define LCI_FAST_START_NVM3_KEY       0x01200
+/* Legacy advertising and scan response data size */
+#define LCI_FAST_START_ADV_DATA_MAX   31
+/* Length of the System ID characteristic, built from the identity address
+ * on every boot */
+#define LCI_FAST_START_SYSTEM_ID_LEN  8
+/* Boot timestamps in milliseconds since reset, 0 until reached */
+typedef struct {
+  uint32_t boot_ms;
+  uint32_t advertising_ms;
+  uint32_t connection_ms;
+} lci_fast_start_times_t;
+
+void lci_fast_start_init(uint16_t service_uuid);
+sl_status_t lci_fast_start_set_adv_data(uint8_t advertising_set);
+bool lci_fast_start_on_advertising(void);
+void lci_fast_start_on_connection(void);
+void lci_fast_start_complete(uint8_t advertising_set);
+const lci_fast_start_times_t *lci_fast_start_get_times(void);
+
+#endif /* LCI_FAST_START_H_ */
@@ -0,0 +1,36 @@
+/**
+ * @file lci_fixed_point.h
+ * @brief Integer scaling and decimal formatting of sensor values
+ *
+ * The SI7021 driver reports millidegrees Celsius and milli-percent relative
+ * humidity, the GATT characteristics carry 0.01 units. Values are scaled
+ * and printed with integer arithmetic only, so neither soft-float nor the
+ * floating point support of printf are needed.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_FIXED_POINT_H_
+#define LCI_FIXED_POINT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Buffer size holding any formatted 32-bit value, "-21474836.48" */
+#define LCI_FP_STR_SIZE               13
+/* Decimal places of the driver and GATT units */
+#define LCI_FP_MILLI                  3
+#define LCI_FP_CENTI                  2
+
+int32_t lci_fp_rescale(int32_t value, uint8_t from_decimals, uint8_t to_decimals);
+int32_t lci_fp_milli_to_centi(int32_t milli);
+uint8_t lci_fp_format(char *buf, int32_t value, uint8_t decimals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LCI_FIXED_POINT_H_ */
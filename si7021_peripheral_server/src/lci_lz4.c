@@ -0,0 +1,316 @@
+/**
+ * @file lci_lz4.c
+ * @brief Streaming decompressor of LZ4 compressed firmware updates
+ *
+ * The stream is decompressed while it arrives, in chunks of any size, with
+ * a fixed amount of RAM. LZ4 matches reach up to 64 KB back, instead of a
+ * window in RAM the decompressor reads them back from the storage slot,
+ * which is mapped in memory, and only keeps the last bytes that are not
+ * written yet. The decompressed GBL is checked against the size and CRC of
+ * the stream header at the end, the bootloader then verifies its signature
+ * as for an uncompressed update.
+ *
+ * The file has no SDK dependencies, the host tools build it as is.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "lci_delta.h"
+#include "lci_lz4.h"
+/* Shortest LZ4 match */
+#define MIN_MATCH                     4
+/* Length nibble of the token that is followed by length bytes */
+#define LENGTH_EXTENDED               15
+/* Decompressor states */
+#define STATE_HEADER                  0
+#define STATE_TOKEN                   1
+#define STATE_LITERAL_LENGTH          2
+#define STATE_LITERALS                3
+#define STATE_OFFSET_LOW              4
+#define STATE_OFFSET_HIGH             5
+#define STATE_MATCH_LENGTH            6
+#define STATE_END                     7
+/* Local functions */
+static uint32_t read_le32(const uint8_t *data);
+static lci_lz4_status_t fail(lci_lz4_t *lz4, lci_lz4_status_t status);
+static bool flush(lci_lz4_t *lz4);
+static lci_lz4_status_t end_literals(lci_lz4_t *lz4);
+static lci_lz4_status_t copy_match(lci_lz4_t *lz4);
+static lci_lz4_status_t push_byte(lci_lz4_t *lz4, uint8_t byte);
+/**
+* @brief Read a little-endian 32-bit value
+ *
+* @param[in] data pointer to the value
+*
+* @retval value
+*/
+static uint32_t read_le32(const uint8_t *data)
+{
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8)
+         | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+/**
+* @brief Latch an error, every later call returns it
+ *
+* @param[in] lz4    decompressor state
+* @param[in] status error
+*
+* @retval the error
+*/
+static lci_lz4_status_t fail(lci_lz4_t *lz4, lci_lz4_status_t status)
+{
+  lz4->status = status;
+  return status;
+}
+/**
+* @brief Write the buffered bytes to the storage slot
+ *
+* @param[in] lz4 decompressor state
+*
+* @retval true if written
+*/
+static bool flush(lci_lz4_t *lz4)
+{
+  if (lz4->buffered == 0) {
+    return true;
+  }
+  if (!lz4->write(lz4->written, lz4->buffer, lz4->buffered, lz4->context)) {
+    return false;
+  }
+  lz4->crc = lci_delta_crc32(lz4->crc, lz4->buffer, lz4->buffered);
+  lz4->written += lz4->buffered;
+  lz4->buffered = 0;
+  return true;
+}
+/**
+* @brief Continue after the literals of a sequence
+ *
+* @param[in] lz4 decompressor state
+*
+* @retval lci_lz4_ok, lci_lz4_done at the end of the last sequence
+*/
+static lci_lz4_status_t end_literals(lci_lz4_t *lz4)
+{
+  if ((lz4->written + lz4->buffered) == lz4->raw_size) {
+    lz4->state = STATE_END;
+    return fail(lz4, lci_lz4_done);
+  }
+  lz4->state = STATE_OFFSET_LOW;
+  return lci_lz4_ok;
+}
+/**
+* @brief Copy the match of a sequence, from the buffer or the storage slot
+ *
+* @param[in] lz4 decompressor state
+*
+* @retval lci_lz4_ok, lci_lz4_done at the end of the raw data, error otherwise
+*/
+static lci_lz4_status_t copy_match(lci_lz4_t *lz4)
+{
+  uint32_t position;
+
+  if ((lz4->written + lz4->buffered + lz4->length) > lz4->raw_size) {
+    return fail(lz4, lci_lz4_bad_size);
+  }
+  /* Byte by byte, a match may overlap the bytes it produces */
+  while (lz4->length > 0) {
+    position = lz4->written + lz4->buffered - lz4->offset;
+    lz4->buffer[lz4->buffered] = (position >= lz4->written)
+                                 ? lz4->buffer[position - lz4->written]
+                                 : lz4->slot[position];
+    lz4->buffered++;
+    lz4->length--;
+    if ((lz4->buffered == LCI_LZ4_BUFFER_SIZE) && !flush(lz4)) {
+      return fail(lz4, lci_lz4_write_error);
+    }
+  }
+  lz4->state = STATE_TOKEN;
+  if ((lz4->written + lz4->buffered) == lz4->raw_size) {
+    lz4->state = STATE_END;
+    return fail(lz4, lci_lz4_done);
+  }
+  return lci_lz4_ok;
+}
+/**
+* @brief Run the decompressor on one byte, except for literals
+ *
+* @param[in] lz4  decompressor state
+* @param[in] byte stream byte
+*
+* @retval lci_lz4_ok, lci_lz4_done at the end of the raw data, error otherwise
+*/
+static lci_lz4_status_t push_byte(lci_lz4_t *lz4, uint8_t byte)
+{
+  switch (lz4->state) {
+    case STATE_HEADER:
+      lz4->header[lz4->header_len++] = byte;
+      if (lz4->header_len < LCI_LZ4_HEADER_SIZE) {
+        break;
+      }
+      if ((read_le32(&lz4->header[0]) != LCI_LZ4_MAGIC)
+          || (lz4->header[4] != LCI_LZ4_VERSION)) {
+        return fail(lz4, lci_lz4_bad_format);
+      }
+      lz4->raw_size = read_le32(&lz4->header[8]);
+      lz4->raw_crc = read_le32(&lz4->header[12]);
+      lz4->state = STATE_TOKEN;
+      break;
+    case STATE_TOKEN:
+      lz4->token = byte;
+      lz4->length = byte >> 4;
+      if (lz4->length == LENGTH_EXTENDED) {
+        lz4->state = STATE_LITERAL_LENGTH;
+      } else if (lz4->length > 0) {
+        lz4->state = STATE_LITERALS;
+      } else {
+        return end_literals(lz4);
+      }
+      break;
+    case STATE_LITERAL_LENGTH:
+      lz4->length += byte;
+      if (byte != 255) {
+        lz4->state = STATE_LITERALS;
+      }
+      break;
+    case STATE_OFFSET_LOW:
+      lz4->offset = byte;
+      lz4->state = STATE_OFFSET_HIGH;
+      break;
+    case STATE_OFFSET_HIGH:
+      lz4->offset = (uint16_t)(lz4->offset | ((uint16_t)byte << 8));
+      if ((lz4->offset == 0) || (lz4->offset > (lz4->written + lz4->buffered))) {
+        return fail(lz4, lci_lz4_bad_format);
+      }
+      lz4->length = (uint32_t)(lz4->token & 0x0F) + MIN_MATCH;
+      if ((lz4->token & 0x0F) == LENGTH_EXTENDED) {
+        lz4->state = STATE_MATCH_LENGTH;
+        break;
+      }
+      return copy_match(lz4);
+    case STATE_MATCH_LENGTH:
+      lz4->length += byte;
+      if (byte != 255) {
+        return copy_match(lz4);
+      }
+      break;
+    default:
+      /* Nothing may follow the end of the raw data */
+      return fail(lz4, lci_lz4_bad_format);
+  }
+  return lci_lz4_ok;
+}
+/**
+* @brief Initialize the decompressor
+ *
+* @param[in] lz4     decompressor state
+* @param[in] slot    storage slot as mapped in memory
+* @param[in] write   writes decompressed bytes to the storage slot
+* @param[in] context context of the write function
+*
+* @retval None
+*/
+void lci_lz4_init(lci_lz4_t *lz4, const uint8_t *slot, lci_lz4_write_t write, void *context)
+{
+  memset(lz4, 0, sizeof(*lz4));
+  lz4->slot = slot;
+  lz4->write = write;
+  lz4->context = context;
+  lz4->status = lci_lz4_ok;
+  lz4->state = STATE_HEADER;
+}
+/**
+* @brief Refresh the pointers of a state copied back from storage, e.g. to
+*        resume a transfer after a reset
+ *
+* @param[in] lz4     restored decompressor state
+* @param[in] slot    storage slot as mapped in memory
+* @param[in] write   writes decompressed bytes to the storage slot
+* @param[in] context context of the write function
+*
+* @retval None
+*/
+void lci_lz4_rebind(lci_lz4_t *lz4, const uint8_t *slot, lci_lz4_write_t write, void *context)
+{
+  lz4->slot = slot;
+  lz4->write = write;
+  lz4->context = context;
+}
+/**
+* @brief Decompress the next bytes of the stream
+ *
+* @param[in] lz4  decompressor state
+* @param[in] data stream bytes
+* @param[in] len  number of bytes
+*
+* @retval lci_lz4_ok, lci_lz4_done at the end of the raw data, error otherwise
+*/
+lci_lz4_status_t lci_lz4_push(lci_lz4_t *lz4, const uint8_t *data, uint32_t len)
+{
+  uint32_t chunk;
+  lci_lz4_status_t status;
+
+  while (len > 0) {
+    if ((lz4->status != lci_lz4_ok) && (lz4->status != lci_lz4_done)) {
+      return lz4->status;
+    }
+    if (lz4->state != STATE_LITERALS) {
+      status = push_byte(lz4, *data++);
+      if ((status != lci_lz4_ok) && (status != lci_lz4_done)) {
+        return status;
+      }
+      len--;
+      /* A length that is complete before its literals check the raw size */
+      if ((lz4->state == STATE_LITERALS)
+          && ((lz4->written + lz4->buffered + lz4->length) > lz4->raw_size)) {
+        return fail(lz4, lci_lz4_bad_size);
+      }
+      continue;
+    }
+    /* Literals are copied in runs */
+    chunk = LCI_LZ4_BUFFER_SIZE - lz4->buffered;
+    if (chunk > lz4->length) {
+      chunk = lz4->length;
+    }
+    if (chunk > len) {
+      chunk = len;
+    }
+    memcpy(&lz4->buffer[lz4->buffered], data, chunk);
+    lz4->buffered = (uint16_t)(lz4->buffered + chunk);
+    lz4->length -= chunk;
+    data += chunk;
+    len -= chunk;
+    if ((lz4->buffered == LCI_LZ4_BUFFER_SIZE) && !flush(lz4)) {
+      return fail(lz4, lci_lz4_write_error);
+    }
+    if (lz4->length == 0) {
+      end_literals(lz4);
+    }
+  }
+  return lz4->status;
+}
+/**
+* @brief Write the last bytes and check the decompressed GBL
+ *
+* @param[in] lz4 decompressor state
+*
+* @retval lci_lz4_ok if the decompressed data has the size and CRC of the
+*         stream header, error otherwise
+*/
+lci_lz4_status_t lci_lz4_finish(lci_lz4_t *lz4)
+{
+  if (lz4->status != lci_lz4_done) {
+    return fail(lz4, (lz4->status == lci_lz4_ok) ? lci_lz4_bad_format : lz4->status);
+  }
+  if (!flush(lz4)) {
+    return fail(lz4, lci_lz4_write_error);
+  }
+  if (lz4->written != lz4->raw_size) {
+    return fail(lz4, lci_lz4_bad_size);
+  }
+  if (lz4->crc != lz4->raw_crc) {
+    return fail(lz4, lci_lz4_bad_crc);
+  }
+  return lci_lz4_ok;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file lci_lz4.h
+ * @brief Streaming decompressor of LZ4 compressed firmware updates
+ *
+ * A compressed update is a signed GBL file compressed as a whole, so the
+ * decompressed bytes written to the storage slot are the GBL file the
+ * bootloader verifies. Layout, all fields little-endian:
+ *
+ *   magic "LLZ4" (4) | version (1) | reserved (3) | raw size (4) |
+ *   raw CRC-32 (4) | one LZ4 block of the raw file
+ *
+ * The LZ4 block format is the standard one: sequences of a token, the
+ * literals and a match of at least 4 bytes up to 65535 bytes back, the last
+ * sequence has literals only.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_LZ4_H_
+#define LCI_LZ4_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Stream header */
+#define LCI_LZ4_MAGIC                 0x345A4C4Cu  /* "LLZ4" */
+#define LCI_LZ4_VERSION               1
+#define LCI_LZ4_HEADER_SIZE           16
+/* Decompressed bytes buffered before a write to the storage slot */
+#define LCI_LZ4_BUFFER_SIZE           256
+/* Status of the decompressor */
+typedef enum {
+  lci_lz4_ok,
+  /* Raw size reached, waiting for lci_lz4_finish */
+  lci_lz4_done,
+  lci_lz4_bad_format,
+  lci_lz4_write_error,
+  lci_lz4_bad_size,
+  lci_lz4_bad_crc
+} lci_lz4_status_t;
+/* Writes decompressed bytes to the storage slot, returns false on failure */
+typedef bool (*lci_lz4_write_t)(uint32_t offset,
+                                const uint8_t *data,
+                                uint32_t len,
+                                void *context);
+/* Decompressor state, about 300 bytes of RAM */
+typedef struct {
+  /* Storage slot as mapped in memory, matches read the written bytes back */
+  const uint8_t *slot;
+  lci_lz4_write_t write;
+  void *context;
+  lci_lz4_status_t status;
+  uint8_t header[LCI_LZ4_HEADER_SIZE];
+  uint8_t header_len;
+  uint8_t state;
+  uint8_t token;
+  uint32_t length;
+  uint16_t offset;
+  uint32_t raw_size;
+  uint32_t raw_crc;
+  /* Decompressed bytes */
+  uint8_t buffer[LCI_LZ4_BUFFER_SIZE];
+  uint16_t buffered;
+  uint32_t written;
+  uint32_t crc;
+} lci_lz4_t;
+
+void lci_lz4_init(lci_lz4_t *lz4, const uint8_t *slot, lci_lz4_write_t write, void *context);
+void lci_lz4_rebind(lci_lz4_t *lz4, const uint8_t *slot, lci_lz4_write_t write, void *context);
+lci_lz4_status_t lci_lz4_push(lci_lz4_t *lz4, const uint8_t *data, uint32_t len);
+lci_lz4_status_t lci_lz4_finish(lci_lz4_t *lz4);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LCI_LZ4_H_ */
@@ -0,0 +1,707 @@
+/**
+ * @file lci_ota.c
+ * @brief In-application OTA update service
+ *
+ * The apploader takes the device offline for the whole transfer. Here the
+ * image is received by the application: the sensor service, the beacon
+ * and the log keep running, the device is only offline for the reboot
+ * that installs the verified image. The transfer is written without
+ * response at the largest MTU on the 2M PHY with a short connection
+ * interval, so several packets go in every connection event, and the
+ * acknowledgements only pace the client to what the flash accepts.
+ *
+ * The received bytes go to the storage slot as is, through the LZ4
+ * decompressor or through the delta applier. Either way the slot ends up
+ * with a GBL file, which the bootloader verifies before the install.
+ *
+ * When the output of the decoder reaches a flash page of the slot, the
+ * state of the transfer is checkpointed in NVM3: the bytes received, their
+ * running CRC-32 and the decoder with its buffered bytes. Everything before
+ * the page is in the slot, and the first write of the page erases it
+ * again, so the transfer continues from the checkpoint after a disconnect
+ * or a reset. The CRC-32 checked at the finish covers the bytes received
+ * before and after the resume.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "app_log.h"
+#include "btl_interface.h"
+#include "em_device.h"
+#include "nvm3.h"
+#include "nvm3_default.h"
+#include "sl_bluetooth.h"
+#include "sl_simple_timer.h"
+#include "sl_sleeptimer.h"
+#include "lci_delta.h"
+#include "lci_lz4.h"
+#include "lci_ota.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Bytes written to the slot at once in GBL mode */
+#define STAGE_SIZE                    256
+/* Flash write unit of the storage slot */
+#define WRITE_ALIGN                   4
+/* Version of the checkpoint layout, a mismatch drops the checkpoint */
+#define CHECKPOINT_VERSION            1
+/* The decoder is stored in pieces below the default NVM3 object limit */
+#define CHECKPOINT_PIECE              240
+/* State of the transfer */
+typedef enum {
+  ota_idle,
+  ota_receiving,
+  ota_verified
+} ota_state_t;
+/* Storage slot */
+static BootloaderStorageSlot_t slot;
+static bool slot_ready;
+/* Transfer */
+static ota_state_t state = ota_idle;
+static lci_ota_mode_t mode;
+static uint32_t size;
+static uint32_t image_crc;
+static uint32_t received;
+static uint32_t crc;
+static uint32_t resumed;
+static uint32_t acked;
+static uint32_t start_tick;
+/* Only one decoder runs at a time */
+static union {
+  lci_lz4_t lz4;
+  lci_delta_t delta;
+  struct {
+    uint8_t buffer[STAGE_SIZE];
+    uint16_t buffered;
+    uint32_t written;
+  } stage;
+} decoder;
+/* Checkpoint header, the decoder follows in the next NVM3 keys */
+typedef struct {
+  uint8_t version;
+  uint8_t mode;
+  uint32_t size;
+  uint32_t image_crc;
+  uint32_t received;
+  uint32_t crc;
+  /* Output offset of the decoder, at a flash page of the slot */
+  uint32_t written;
+  /* CRC-32 of the stored decoder, detects a checkpoint torn by a reset */
+  uint32_t decoder_crc;
+} checkpoint_t;
+/* Last checkpoint stored, valid if version is CHECKPOINT_VERSION */
+static checkpoint_t checkpoint;
+/* Client */
+static uint16_t control_characteristic;
+static uint8_t client_connection = CONNECTION_HANDLE_INVALID;
+static bool client_notify;
+/* Reboot after the install reply went out */
+static sl_simple_timer_t reboot_timer;
+/* Local functions */
+static void hdl_reboot_timer_event(sl_simple_timer_t *timer, void *data);
+static bool slot_write(uint32_t offset, const uint8_t *data, uint32_t len, void *context);
+static void reply(lci_ota_cmd_t cmd, lci_ota_status_t status);
+static void fail(lci_ota_status_t status);
+static void request_fast_link(uint8_t connection);
+static uint32_t decoder_written(void);
+static void save_checkpoint(void);
+static bool load_checkpoint(void);
+static void delete_checkpoint(void);
+static lci_ota_status_t start(uint8_t connection, const uint8_t *data, uint8_t len);
+static lci_ota_status_t begin(uint8_t connection);
+static lci_ota_status_t push(const uint8_t *data, uint8_t len);
+static lci_ota_status_t finish(void);
+/**
+* @brief Reboot timer handler, the bootloader installs the image
+ *
+* @param[in] timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_reboot_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+  bootloader_rebootAndInstall();
+}
+/**
+* @brief Write to the storage slot, erasing its pages on the way
+ *
+* @param[in] offset  offset in the slot, consecutive writes only
+* @param[in] data    bytes
+* @param[in] len     number of bytes, padded with 0xFF to the write unit
+* @param[in] context unused
+*
+* @retval true if written
+*/
+static bool slot_write(uint32_t offset, const uint8_t *data, uint32_t len, void *context)
+{
+  uint8_t tail[WRITE_ALIGN];
+  uint32_t aligned = len & ~(uint32_t)(WRITE_ALIGN - 1);
+
+  (void)context;
+  if ((offset > slot.length) || (len > (slot.length - offset))) {
+    return false;
+  }
+  if ((aligned > 0)
+      && (bootloader_eraseWriteStorage(LCI_OTA_SLOT, offset, (uint8_t *)data, aligned) != BOOTLOADER_OK)) {
+    return false;
+  }
+  if (aligned < len) {
+    /* Only the last write of a transfer can end unaligned */
+    memset(tail, 0xFF, sizeof(tail));
+    memcpy(tail, &data[aligned], len - aligned);
+    if (bootloader_eraseWriteStorage(LCI_OTA_SLOT, offset + aligned, tail, sizeof(tail)) != BOOTLOADER_OK) {
+      return false;
+    }
+  }
+  return true;
+}
+/**
+* @brief Notify a reply to the client
+ *
+* @param[in] cmd    command replied to, or the data acknowledgement
+* @param[in] status status of the command
+*
+* @retval None
+*/
+static void reply(lci_ota_cmd_t cmd, lci_ota_status_t status)
+{
+  uint8_t value[LCI_OTA_REPLY_SIZE];
+  sl_status_t sc;
+
+  if ((client_connection == CONNECTION_HANDLE_INVALID) || !client_notify) {
+    return;
+  }
+  value[0] = (uint8_t)cmd;
+  value[1] = (uint8_t)status;
+  value[2] = (uint8_t)received;
+  value[3] = (uint8_t)(received >> 8);
+  value[4] = (uint8_t)(received >> 16);
+  value[5] = (uint8_t)(received >> 24);
+  sc = sl_bt_gatt_server_send_notification(client_connection,
+                                           control_characteristic,
+                                           sizeof(value),
+                                           value);
+  if (sc != SL_STATUS_OK) {
+    app_log_status_warning_f(sc, "OTA reply failed\n");
+  }
+}
+/**
+* @brief Drop the transfer and tell the client why
+ *
+* @param[in] status reason
+*
+* @retval None
+*/
+static void fail(lci_ota_status_t status)
+{
+  app_log_warning("OTA failed at %lu bytes, status %u\n",
+                  (unsigned long)received,
+                  (unsigned)status);
+  state = ota_idle;
+  delete_checkpoint();
+  reply(lci_ota_cmd_data_ack, status);
+}
+/**
+* @brief Ask for the link settings of a fast transfer
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+static void request_fast_link(uint8_t connection)
+{
+  sl_status_t sc;
+
+  sc = sl_bt_connection_set_preferred_phy(connection,
+                                          sl_bt_gap_phy_2m,
+                                          sl_bt_gap_phy_any);
+  if (sc != SL_STATUS_OK) {
+    app_log_status_warning_f(sc, "OTA 2M PHY request failed\n");
+  }
+  sc = sl_bt_connection_set_parameters(connection,
+                                       LCI_OTA_CONN_INTERVAL_MIN,
+                                       LCI_OTA_CONN_INTERVAL_MAX,
+                                       0,
+                                       LCI_OTA_CONN_TIMEOUT,
+                                       0,
+                                       0xFFFF);
+  if (sc != SL_STATUS_OK) {
+    app_log_status_warning_f(sc, "OTA connection parameters request failed\n");
+  }
+}
+/**
+* @brief Output offset of the decoder, the slot is written up to it
+ *
+* @param[in] None
+*
+* @retval offset in the slot
+*/
+static uint32_t decoder_written(void)
+{
+  switch (mode) {
+    case lci_ota_mode_lz4:
+      return decoder.lz4.written;
+    case lci_ota_mode_delta:
+      return decoder.delta.written;
+    default:
+      return decoder.stage.written;
+  }
+}
+/**
+* @brief Store the state of the transfer in NVM3
+*
+* The decoder goes first and the header last, a reset in between leaves a
+* header whose decoder CRC no longer matches.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void save_checkpoint(void)
+{
+  const uint8_t *bytes = (const uint8_t *)&decoder;
+  uint32_t offset;
+  uint32_t piece;
+  Ecode_t ec = ECODE_NVM3_OK;
+
+  for (offset = 0; (offset < sizeof(decoder)) && (ec == ECODE_NVM3_OK); offset += piece) {
+    piece = sizeof(decoder) - offset;
+    if (piece > CHECKPOINT_PIECE) {
+      piece = CHECKPOINT_PIECE;
+    }
+    ec = nvm3_writeData(nvm3_defaultHandle,
+                        LCI_OTA_NVM3_KEY + 1 + (offset / CHECKPOINT_PIECE),
+                        &bytes[offset],
+                        piece);
+  }
+  if (ec == ECODE_NVM3_OK) {
+    checkpoint.version = CHECKPOINT_VERSION;
+    checkpoint.mode = (uint8_t)mode;
+    checkpoint.size = size;
+    checkpoint.image_crc = image_crc;
+    checkpoint.received = received;
+    checkpoint.crc = crc;
+    checkpoint.written = decoder_written();
+    checkpoint.decoder_crc = lci_delta_crc32(0, bytes, sizeof(decoder));
+    ec = nvm3_writeData(nvm3_defaultHandle, LCI_OTA_NVM3_KEY, &checkpoint, sizeof(checkpoint));
+  }
+  if (ec != ECODE_NVM3_OK) {
+    checkpoint.version = 0;
+    app_log_warning("OTA checkpoint failed: 0x%lx\n", (unsigned long)ec);
+  }
+}
+/**
+* @brief Load the decoder of the checkpoint
+ *
+* @param[in] None
+*
+* @retval true if the decoder is the one of the checkpoint header
+*/
+static bool load_checkpoint(void)
+{
+  uint8_t *bytes = (uint8_t *)&decoder;
+  uint32_t offset;
+  uint32_t piece;
+
+  for (offset = 0; offset < sizeof(decoder); offset += piece) {
+    piece = sizeof(decoder) - offset;
+    if (piece > CHECKPOINT_PIECE) {
+      piece = CHECKPOINT_PIECE;
+    }
+    if (nvm3_readData(nvm3_defaultHandle,
+                      LCI_OTA_NVM3_KEY + 1 + (offset / CHECKPOINT_PIECE),
+                      &bytes[offset],
+                      piece) != ECODE_NVM3_OK) {
+      return false;
+    }
+  }
+  return lci_delta_crc32(0, bytes, sizeof(decoder)) == checkpoint.decoder_crc;
+}
+/**
+* @brief Drop the checkpoint, the next start begins at byte 0
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void delete_checkpoint(void)
+{
+  uint32_t key;
+
+  if (checkpoint.version == 0) {
+    return;
+  }
+  checkpoint.version = 0;
+  for (key = 0; key <= ((sizeof(decoder) - 1) / CHECKPOINT_PIECE) + 1; key++) {
+    (void)nvm3_deleteObject(nvm3_defaultHandle, LCI_OTA_NVM3_KEY + key);
+  }
+}
+/**
+* @brief Start a transfer
+ *
+* @param[in] connection connection handle of the client
+* @param[in] data       start command
+* @param[in] len        length of the command
+*
+* @retval lci_ota_ok if the transfer started
+*/
+static lci_ota_status_t start(uint8_t connection, const uint8_t *data, uint8_t len)
+{
+  if (len != LCI_OTA_START_SIZE) {
+    return lci_ota_bad_command;
+  }
+  if (!slot_ready) {
+    return lci_ota_storage_error;
+  }
+  /* A new start drops the transfer in progress */
+  state = ota_idle;
+  mode = (lci_ota_mode_t)data[1];
+  size = (uint32_t)data[2] | ((uint32_t)data[3] << 8)
+         | ((uint32_t)data[4] << 16) | ((uint32_t)data[5] << 24);
+  image_crc = (uint32_t)data[6] | ((uint32_t)data[7] << 8)
+              | ((uint32_t)data[8] << 16) | ((uint32_t)data[9] << 24);
+  if ((checkpoint.version == CHECKPOINT_VERSION)
+      && (checkpoint.mode == (uint8_t)mode)
+      && (checkpoint.size == size)
+      && (checkpoint.image_crc == image_crc)
+      && load_checkpoint()) {
+    /* Same transfer, continue from the checkpoint */
+    if (mode == lci_ota_mode_lz4) {
+      lci_lz4_rebind(&decoder.lz4, (const uint8_t *)(uintptr_t)slot.address, slot_write, NULL);
+    } else if (mode == lci_ota_mode_delta) {
+      lci_delta_rebind(&decoder.delta, (const uint8_t *)FLASH_BASE, slot_write, NULL);
+    }
+    received = checkpoint.received;
+    crc = checkpoint.crc;
+    return begin(connection);
+  }
+  switch (mode) {
+    case lci_ota_mode_gbl:
+      if (size > slot.length) {
+        return lci_ota_too_large;
+      }
+      memset(&decoder.stage, 0, sizeof(decoder.stage));
+      break;
+    case lci_ota_mode_lz4:
+      lci_lz4_init(&decoder.lz4, (const uint8_t *)(uintptr_t)slot.address, slot_write, NULL);
+      break;
+    case lci_ota_mode_delta:
+      /* The running application is the reference, it ends at the slot */
+      lci_delta_init(&decoder.delta,
+                     (const uint8_t *)FLASH_BASE,
+                     FLASH_BASE,
+                     slot.address - FLASH_BASE,
+                     slot_write,
+                     NULL);
+      break;
+    default:
+      return lci_ota_bad_command;
+  }
+  delete_checkpoint();
+  received = 0;
+  crc = 0;
+  return begin(connection);
+}
+/**
+* @brief Receive from the current offset
+ *
+* @param[in] connection connection handle of the client
+*
+* @retval lci_ota_ok
+*/
+static lci_ota_status_t begin(uint8_t connection)
+{
+  client_connection = connection;
+  resumed = received;
+  acked = received;
+  start_tick = sl_sleeptimer_get_tick_count();
+  state = ota_receiving;
+  request_fast_link(connection);
+  app_log_info("OTA started, mode %u, %lu bytes from %lu\n",
+               (unsigned)mode,
+               (unsigned long)size,
+               (unsigned long)received);
+  return lci_ota_ok;
+}
+/**
+* @brief Pass received bytes to the slot or the decoder
+ *
+* @param[in] data received bytes
+* @param[in] len  number of bytes
+*
+* @retval lci_ota_ok, or the reason to drop the transfer
+*/
+static lci_ota_status_t push(const uint8_t *data, uint8_t len)
+{
+  lci_lz4_status_t lz4_status;
+  lci_delta_status_t delta_status;
+  uint32_t chunk;
+
+  switch (mode) {
+    case lci_ota_mode_lz4:
+      lz4_status = lci_lz4_push(&decoder.lz4, data, len);
+      if (lz4_status == lci_lz4_write_error) {
+        return lci_ota_storage_error;
+      }
+      return ((lz4_status == lci_lz4_ok) || (lz4_status == lci_lz4_done)) ? lci_ota_ok : lci_ota_image_error;
+    case lci_ota_mode_delta:
+      delta_status = lci_delta_push_container(&decoder.delta, data, len);
+      if (delta_status == lci_delta_write_error) {
+        return lci_ota_storage_error;
+      }
+      return ((delta_status == lci_delta_ok) || (delta_status == lci_delta_done)) ? lci_ota_ok : lci_ota_image_error;
+    default:
+      while (len > 0) {
+        chunk = STAGE_SIZE - decoder.stage.buffered;
+        if (chunk > len) {
+          chunk = len;
+        }
+        memcpy(&decoder.stage.buffer[decoder.stage.buffered], data, chunk);
+        decoder.stage.buffered = (uint16_t)(decoder.stage.buffered + chunk);
+        data += chunk;
+        len = (uint8_t)(len - chunk);
+        if (decoder.stage.buffered == STAGE_SIZE) {
+          if (!slot_write(decoder.stage.written, decoder.stage.buffer, STAGE_SIZE, NULL)) {
+            return lci_ota_storage_error;
+          }
+          decoder.stage.written += STAGE_SIZE;
+          decoder.stage.buffered = 0;
+        }
+      }
+      return lci_ota_ok;
+  }
+}
+/**
+* @brief Complete the image in the slot and verify it
+ *
+* @param[in] None
+*
+* @retval lci_ota_ok if the bootloader accepts the image
+*/
+static lci_ota_status_t finish(void)
+{
+  uint32_t elapsed_ms;
+  int32_t result;
+
+  if (received != size) {
+    return lci_ota_bad_state;
+  }
+  /* The transfer is complete either way, a retry starts over */
+  delete_checkpoint();
+  if (crc != image_crc) {
+    return lci_ota_crc_error;
+  }
+  switch (mode) {
+    case lci_ota_mode_lz4:
+      if (lci_lz4_finish(&decoder.lz4) != lci_lz4_ok) {
+        return lci_ota_image_error;
+      }
+      break;
+    case lci_ota_mode_delta:
+      if (lci_delta_finish(&decoder.delta) != lci_delta_ok) {
+        return lci_ota_image_error;
+      }
+      break;
+    default:
+      if (!slot_write(decoder.stage.written, decoder.stage.buffer, decoder.stage.buffered, NULL)) {
+        return lci_ota_storage_error;
+      }
+      break;
+  }
+  elapsed_ms = sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count() - start_tick);
+  app_log_info("OTA received %lu bytes in %lu ms (%lu bytes/s)\n",
+               (unsigned long)(received - resumed),
+               (unsigned long)elapsed_ms,
+               (unsigned long)((elapsed_ms > 0) ? ((uint64_t)(received - resumed) * 1000u / elapsed_ms) : 0));
+  result = bootloader_verifyImage(LCI_OTA_SLOT, NULL);
+  if (result != BOOTLOADER_OK) {
+    app_log_warning("OTA image rejected by the bootloader: 0x%lx\n", (unsigned long)result);
+    return lci_ota_verify_error;
+  }
+  app_log_info("OTA image verified\n");
+  return lci_ota_ok;
+}
+/**
+* @brief Initialize the OTA service
+ *
+* @param[in] characteristic control characteristic
+*
+* @retval SL_STATUS_OK, SL_STATUS_FAIL if the bootloader has no storage slot
+*/
+sl_status_t lci_ota_init(uint16_t characteristic)
+{
+  uint16_t mtu;
+  sl_status_t sc;
+
+  control_characteristic = characteristic;
+  sc = sl_bt_gatt_server_set_max_mtu(LCI_OTA_MTU, &mtu);
+  if (sc != SL_STATUS_OK) {
+    app_log_status_warning_f(sc, "OTA MTU setting failed\n");
+  }
+  slot_ready = (bootloader_init() == BOOTLOADER_OK)
+               && (bootloader_getStorageSlotInfo(LCI_OTA_SLOT, &slot) == BOOTLOADER_OK);
+  if (!slot_ready) {
+    return SL_STATUS_FAIL;
+  }
+  app_log_info("OTA slot at 0x%08lx, %lu bytes\n",
+               (unsigned long)slot.address,
+               (unsigned long)slot.length);
+  if ((nvm3_readData(nvm3_defaultHandle,
+                     LCI_OTA_NVM3_KEY,
+                     &checkpoint,
+                     sizeof(checkpoint)) != ECODE_NVM3_OK)
+      || (checkpoint.version != CHECKPOINT_VERSION)) {
+    memset(&checkpoint, 0, sizeof(checkpoint));
+  } else {
+    app_log_info("OTA resumable at %lu of %lu bytes\n",
+                 (unsigned long)checkpoint.received,
+                 (unsigned long)checkpoint.size);
+  }
+  return SL_STATUS_OK;
+}
+/**
+* @brief Track the client of the control characteristic
+ *
+* @param[in] connection     connection handle
+* @param[in] notify_enabled true if the client enabled the notifications
+*
+* @retval None
+*/
+void lci_ota_set_client(uint8_t connection, bool notify_enabled)
+{
+  if ((state == ota_receiving) && (connection != client_connection)) {
+    return;
+  }
+  client_connection = connection;
+  client_notify = notify_enabled;
+}
+/**
+* @brief Handle a write to the control characteristic
+ *
+* @param[in] connection connection handle
+* @param[in] data       command
+* @param[in] len        length of the command
+*
+* @retval None
+*/
+void lci_ota_on_control(uint8_t connection, const uint8_t *data, uint8_t len)
+{
+  lci_ota_cmd_t cmd = (len > 0) ? (lci_ota_cmd_t)data[0] : (lci_ota_cmd_t)0;
+  lci_ota_status_t status;
+
+  if ((state == ota_receiving) && (connection != client_connection)) {
+    /* Another client owns the slot until it finishes or disconnects */
+    return;
+  }
+  client_connection = connection;
+  switch (cmd) {
+    case lci_ota_cmd_start:
+      status = start(connection, data, len);
+      break;
+    case lci_ota_cmd_finish:
+      status = (state == ota_receiving) ? finish() : lci_ota_bad_state;
+      state = (status == lci_ota_ok) ? ota_verified : ota_idle;
+      break;
+    case lci_ota_cmd_install:
+      status = lci_ota_bad_state;
+      if ((state == ota_verified) && (bootloader_setImageToBootload(LCI_OTA_SLOT) == BOOTLOADER_OK)) {
+        app_log_info("OTA installing, rebooting\n");
+        status = (sl_simple_timer_start(&reboot_timer,
+                                        LCI_OTA_REBOOT_DELAY_MS,
+                                        hdl_reboot_timer_event,
+                                        NULL,
+                                        false) == SL_STATUS_OK) ? lci_ota_ok : lci_ota_storage_error;
+      }
+      break;
+    case lci_ota_cmd_abort:
+      state = ota_idle;
+      delete_checkpoint();
+      status = lci_ota_ok;
+      break;
+    default:
+      status = lci_ota_bad_command;
+      break;
+  }
+  reply(cmd, status);
+}
+/**
+* @brief Handle a write to the data characteristic
+ *
+* @param[in] connection connection handle
+* @param[in] data       image bytes
+* @param[in] len        number of bytes
+*
+* @retval None
+*/
+void lci_ota_on_data(uint8_t connection, const uint8_t *data, uint8_t len)
+{
+  lci_ota_status_t status;
+  uint32_t written;
+
+  if ((state != ota_receiving) || (connection != client_connection)) {
+    return;
+  }
+  if (len > (size - received)) {
+    fail(lci_ota_too_large);
+    return;
+  }
+  status = push(data, len);
+  if (status != lci_ota_ok) {
+    fail(status);
+    return;
+  }
+  received += len;
+  crc = lci_delta_crc32(crc, data, len);
+  written = decoder_written();
+  if ((received < size)
+      && ((written % FLASH_PAGE_SIZE) == 0)
+      && (written > ((checkpoint.version == CHECKPOINT_VERSION) ? checkpoint.written : 0))) {
+    save_checkpoint();
+  }
+  if (((received - acked) >= LCI_OTA_ACK_INTERVAL) || (received == size)) {
+    acked = received;
+    reply(lci_ota_cmd_data_ack, lci_ota_ok);
+  }
+}
+/**
+* @brief Drop the transfer of a closed connection
+ *
+* @param[in] connection connection handle
+*
+* @retval None
+*/
+void lci_ota_on_closed(uint8_t connection)
+{
+  if (connection != client_connection) {
+    return;
+  }
+  if (state == ota_receiving) {
+    app_log_info("OTA aborted at %lu of %lu bytes\n",
+                 (unsigned long)received,
+                 (unsigned long)size);
+    state = ota_idle;
+  }
+  client_connection = CONNECTION_HANDLE_INVALID;
+  client_notify = false;
+}
+/**
+* @brief Transfer that a start can resume, for the beacon
+ *
+* @param[out] image_crc CRC-32 of the transfer
+* @param[out] offset    offset to continue from
+*
+* @retval true if a checkpoint is stored and no transfer is running
+*/
+bool lci_ota_get_resume(uint32_t *image_crc, uint32_t *offset)
+{
+  if ((checkpoint.version != CHECKPOINT_VERSION) || (state == ota_receiving)) {
+    return false;
+  }
+  *image_crc = checkpoint.image_crc;
+  *offset = checkpoint.received;
+  return true;
+}
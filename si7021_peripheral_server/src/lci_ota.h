@@ -0,0 +1,106 @@
+/**
+ * @file lci_ota.h
+ * @brief In-application OTA update service
+ *
+ * The update is received into the internal storage slot of the bootloader
+ * while the application keeps running, the device only reboots to install
+ * the verified image.
+ *
+ * The client writes commands to the control characteristic and gets the
+ * replies as notifications on it:
+ *
+ *   start:   0x01, mode (1 byte), size of the transfer (4 bytes),
+ *            CRC-32 of the transfer (4 bytes)
+ *   finish:  0x02, the image is rebuilt and its signature verified
+ *   install: 0x03, reboot into the bootloader to install the image
+ *   abort:   0x04
+ *
+ *   reply:   command or 0x80 for a data acknowledgement (1 byte),
+ *            status (1 byte), bytes received (4 bytes)
+ *
+ * The image is written without response to the data characteristic, in
+ * chunks of any size up to the ATT MTU minus 3. The client keeps at most
+ * LCI_OTA_WINDOW bytes beyond the last acknowledgement in flight, the
+ * firmware acknowledges every LCI_OTA_ACK_INTERVAL bytes. All values are
+ * little-endian.
+ *
+ * The progress is checkpointed in NVM3 at every flash page of the slot. A
+ * start of the same transfer after a disconnect or a reset resumes from the
+ * checkpoint: the reply carries the offset to continue from, 0 for a new
+ * transfer. The beacon advertises the CRC-32 and the offset of a transfer
+ * that can be resumed.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_OTA_H_
+#define LCI_OTA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_status.h"
+/* Storage slot of the bootloader receiving the image */
+#define LCI_OTA_SLOT                  0
+/* Largest ATT MTU requested from the clients */
+#define LCI_OTA_MTU                   247
+/* Received bytes between two acknowledgements */
+#define LCI_OTA_ACK_INTERVAL          4096
+/* Bytes a client may send beyond the last acknowledgement */
+#define LCI_OTA_WINDOW                (2 * LCI_OTA_ACK_INTERVAL)
+/* Connection interval while receiving, 7.5 to 15 ms */
+#define LCI_OTA_CONN_INTERVAL_MIN     6
+#define LCI_OTA_CONN_INTERVAL_MAX     12
+/* Supervision timeout while receiving, 2 s */
+#define LCI_OTA_CONN_TIMEOUT          200
+/* Delay between the install reply and the reboot in milliseconds */
+#define LCI_OTA_REBOOT_DELAY_MS       200
+/* Size of the control commands and replies */
+#define LCI_OTA_START_SIZE            10
+#define LCI_OTA_REPLY_SIZE            6
+/* NVM3 keys of the checkpoint, application key range 0x00000-0x0FFFF.
+ * The checkpoint takes LCI_OTA_NVM3_KEY and the next few keys. */
+#define LCI_OTA_NVM3_KEY              0x01210
+/* Control commands */
+typedef enum {
+  lci_ota_cmd_start = 0x01,
+  lci_ota_cmd_finish = 0x02,
+  lci_ota_cmd_install = 0x03,
+  lci_ota_cmd_abort = 0x04,
+  lci_ota_cmd_data_ack = 0x80
+} lci_ota_cmd_t;
+/* Format of the transfer */
+typedef enum {
+  /* GBL file, written to the slot as is */
+  lci_ota_mode_gbl = 0x01,
+  /* GBL file compressed by lci_lz4 */
+  lci_ota_mode_lz4 = 0x02,
+  /* Delta GBL container made by lci_delta against the running application */
+  lci_ota_mode_delta = 0x03
+} lci_ota_mode_t;
+/* Status of a reply */
+typedef enum {
+  lci_ota_ok = 0x00,
+  /* Unknown command or wrong length */
+  lci_ota_bad_command = 0x01,
+  /* Command not allowed in the current state */
+  lci_ota_bad_state = 0x02,
+  /* Transfer larger than announced or than the slot */
+  lci_ota_too_large = 0x03,
+  lci_ota_storage_error = 0x04,
+  /* The decompressor or the delta applier rejected the transfer */
+  lci_ota_image_error = 0x05,
+  /* The bootloader rejected the image, e.g. a wrong signature */
+  lci_ota_verify_error = 0x06,
+  /* The CRC-32 of the received bytes differs from the one of the start */
+  lci_ota_crc_error = 0x07
+} lci_ota_status_t;
+
+sl_status_t lci_ota_init(uint16_t characteristic);
+void lci_ota_set_client(uint8_t connection, bool notify_enabled);
+void lci_ota_on_control(uint8_t connection, const uint8_t *data, uint8_t len);
+void lci_ota_on_data(uint8_t connection, const uint8_t *data, uint8_t len);
+void lci_ota_on_closed(uint8_t connection);
+bool lci_ota_get_resume(uint32_t *image_crc, uint32_t *offset);
+
+#endif /* LCI_OTA_H_ */
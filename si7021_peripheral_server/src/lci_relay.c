@@ -0,0 +1,419 @@
+/**
+ * @file lci_relay.c
+ * @brief Relay of the readings of neighbour servers to the central
+ *
+ * The neighbours already broadcast their live reading in the LCI beacon, so
+ * the relay collects them with a passive scan next to its peripheral link
+ * instead of connecting to them: no connection slot, no GATT procedure and
+ * no extra radio schedule to fit around the link to the central.
+ *
+ * A neighbour repeats its beacon every 100 ms, the sequence number of the
+ * beacon tells a new reading from a repeated one. New readings are queued
+ * with the time they were heard and sent in batches, a full notification at
+ * once or a partial one when its oldest entry waited LCI_RELAY_FLUSH_MS.
+ * While the central is away the queue keeps the newest entries.
+ *
+ * Only beacons are relayed, never the batches of other relays, so a reading
+ * travels one hop and can not loop. A neighbour heard by several relays, or
+ * connected to the central itself, reaches the central more than once; the
+ * central drops the duplicates by origin and beacon sequence number.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "sl_simple_timer.h"
+#include "sl_sleeptimer.h"
+#include "lci_beacon.h"
+#include "lci_time_sync.h"
+#include "lci_relay.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Scan mode of sl_bt_scanner_set_mode */
+#define SCAN_PASSIVE                  0
+/* Advertising data type of the manufacturer specific data */
+#define AD_TYPE_MANUFACTURER          0xFF
+/* Manufacturer specific data of an RHT beacon: type, company ID, kind,
+ * sequence number, temperature, humidity */
+#define BEACON_RHT_SIZE               9
+/* ATT MTU before the exchange and the notification header */
+#define ATT_MTU_DEFAULT               23
+#define ATT_NOTIFY_HEADER             3
+/* Reading heard from a neighbour */
+typedef struct {
+  uint16_t origin;
+  uint8_t seq;
+  uint32_t heard_ms;
+  int16_t temperature;
+  uint16_t humidity;
+} entry_t;
+/* Neighbour beacon */
+typedef struct {
+  bool used;
+  uint16_t id;
+  uint8_t seq;
+  uint32_t queued_ms;
+} neighbour_t;
+/* Characteristic and external signal */
+static uint16_t batch_char;
+static uint32_t signal;
+static sl_simple_timer_t tick_timer;
+/* Central that enabled the notifications and its ATT MTU */
+static uint8_t client_connection = CONNECTION_HANDLE_INVALID;
+static uint16_t client_mtu = ATT_MTU_DEFAULT;
+/* Neighbours heard lately */
+static neighbour_t neighbours[LCI_RELAY_NEIGHBOURS_MAX];
+/* Entries waiting for a batch, oldest first */
+static entry_t queue[LCI_RELAY_QUEUE_SIZE];
+static uint8_t queue_head;
+static uint8_t queue_count;
+static uint8_t batch_seq;
+/* Statistics since the last log */
+static uint32_t relayed;
+static uint32_t dropped;
+static uint32_t expired;
+static uint32_t batches;
+static uint32_t last_log_ms;
+/* Local functions */
+static void hdl_tick_timer_event(sl_simple_timer_t *timer, void *data);
+static uint32_t local_ms(void);
+static neighbour_t *find_neighbour(uint16_t id, uint32_t now);
+static void enqueue(const entry_t *entry);
+static uint8_t batch_capacity(void);
+static bool send_batch(uint8_t count, uint32_t now);
+static void put_u16(uint8_t *p, uint16_t value);
+/**
+* @brief Tick timer handler, the flush runs in the Bluetooth context
+ *
+* @param[in] timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_tick_timer_event(sl_simple_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+  sl_bt_external_signal(signal);
+}
+/**
+* @brief Local time in milliseconds since the boot
+ *
+* @param[in] None
+*
+* @retval milliseconds, wrapping at 32 bits
+*/
+static uint32_t local_ms(void)
+{
+  uint64_t ms = 0;
+
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return (uint32_t)ms;
+}
+/**
+* @brief Find a neighbour, or take the slot of the one relayed the longest ago
+ *
+* @param[in] id  sensor ID of the neighbour
+* @param[in] now local time in milliseconds
+*
+* @retval neighbour, new ones are marked unused
+*/
+static neighbour_t *find_neighbour(uint16_t id, uint32_t now)
+{
+  neighbour_t *oldest = &neighbours[0];
+
+  for (uint8_t i = 0; i < LCI_RELAY_NEIGHBOURS_MAX; i++) {
+    if (neighbours[i].used && (neighbours[i].id == id)) {
+      return &neighbours[i];
+    }
+    if (!neighbours[i].used) {
+      oldest = &neighbours[i];
+    } else if (oldest->used
+               && ((now - neighbours[i].queued_ms) > (now - oldest->queued_ms))) {
+      oldest = &neighbours[i];
+    }
+  }
+  oldest->used = false;
+  oldest->id = id;
+  return oldest;
+}
+/**
+* @brief Queue an entry, the oldest one is dropped if the queue is full
+ *
+* @param[in] entry reading of a neighbour
+*
+* @retval None
+*/
+static void enqueue(const entry_t *entry)
+{
+  if (queue_count == LCI_RELAY_QUEUE_SIZE) {
+    queue_head = (uint8_t)((queue_head + 1) % LCI_RELAY_QUEUE_SIZE);
+    queue_count--;
+    dropped++;
+  }
+  queue[(queue_head + queue_count) % LCI_RELAY_QUEUE_SIZE] = *entry;
+  queue_count++;
+}
+/**
+* @brief Entries that fit into one notification
+ *
+* @param[in] None
+*
+* @retval number of entries
+*/
+static uint8_t batch_capacity(void)
+{
+  uint16_t room = (uint16_t)(client_mtu - ATT_NOTIFY_HEADER - LCI_RELAY_HEADER_SIZE);
+  uint16_t capacity = (uint16_t)(room / LCI_RELAY_ENTRY_SIZE);
+
+  return (uint8_t)((capacity > LCI_RELAY_BATCH_MAX) ? LCI_RELAY_BATCH_MAX : capacity);
+}
+/**
+* @brief Store a 16-bit value little-endian
+ *
+* @param[out] p     destination
+* @param[in]  value value to store
+*
+* @retval None
+*/
+static void put_u16(uint8_t *p, uint16_t value)
+{
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+}
+/**
+* @brief Notify the oldest entries of the queue in one batch
+ *
+* @param[in] count number of entries, within the batch capacity
+* @param[in] now   local time in milliseconds
+*
+* @retval true if sent and dequeued, false if the stack is out of buffers
+*/
+static bool send_batch(uint8_t count, uint32_t now)
+{
+  uint8_t value[LCI_RELAY_HEADER_SIZE + (LCI_RELAY_BATCH_MAX * LCI_RELAY_ENTRY_SIZE)];
+  uint8_t *p = &value[LCI_RELAY_HEADER_SIZE];
+  uint32_t send_ms = now;
+  uint8_t flags = 0;
+  sl_status_t sc;
+
+  /* The central takes the last hop off the send time if the clocks agree */
+  if (lci_time_sync_now(client_connection, &send_ms)) {
+    flags |= LCI_RELAY_FLAG_SYNCED;
+  }
+  value[0] = batch_seq;
+  value[1] = flags;
+  put_u16(&value[2], (uint16_t)send_ms);
+  put_u16(&value[4], (uint16_t)(send_ms >> 16));
+  value[6] = count;
+  for (uint8_t i = 0; i < count; i++) {
+    const entry_t *entry = &queue[(queue_head + i) % LCI_RELAY_QUEUE_SIZE];
+    uint32_t age = now - entry->heard_ms;
+
+    put_u16(&p[0], entry->origin);
+    p[2] = entry->seq;
+    /* Heard directly from the origin */
+    p[3] = 1;
+    put_u16(&p[4], (uint16_t)((age > UINT16_MAX) ? UINT16_MAX : age));
+    put_u16(&p[6], (uint16_t)entry->temperature);
+    put_u16(&p[8], entry->humidity);
+    p += LCI_RELAY_ENTRY_SIZE;
+  }
+  sc = sl_bt_gatt_server_send_notification(client_connection,
+                                           batch_char,
+                                           (uint16_t)(p - value),
+                                           value);
+  if (sc != SL_STATUS_OK) {
+    /* Kept for the next tick */
+    return false;
+  }
+  batch_seq++;
+  batches++;
+  relayed += count;
+  queue_head = (uint8_t)((queue_head + count) % LCI_RELAY_QUEUE_SIZE);
+  queue_count = (uint8_t)(queue_count - count);
+  return true;
+}
+/**
+* @brief Start scanning for the beacons of the neighbours
+ *
+* @param[in] batch_characteristic characteristic of the relay batches
+* @param[in] tick_signal          external signal raised by the flush timer
+*
+* @retval SL_STATUS_OK if started, error code otherwise
+*/
+sl_status_t lci_relay_start(uint16_t batch_characteristic, uint32_t tick_signal)
+{
+  sl_status_t sc;
+
+  batch_char = batch_characteristic;
+  signal = tick_signal;
+  sc = sl_bt_scanner_set_mode(sl_bt_gap_1m_phy, SCAN_PASSIVE);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  sc = sl_bt_scanner_set_timing(sl_bt_gap_1m_phy,
+                                LCI_RELAY_SCAN_INTERVAL,
+                                LCI_RELAY_SCAN_WINDOW);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  /* Observation, the beacons are not discoverable */
+  sc = sl_bt_scanner_start(sl_bt_gap_1m_phy, sl_bt_scanner_discover_observation);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+  last_log_ms = local_ms();
+  app_log_info("Relay started\n");
+  return sl_simple_timer_start(&tick_timer,
+                               LCI_RELAY_TICK_MS,
+                               hdl_tick_timer_event,
+                               NULL,
+                               true);
+}
+/**
+* @brief Handle a scan report, queues the new readings of neighbour beacons
+ *
+* @param[in] report scan report
+*
+* @retval None
+*/
+void lci_relay_on_scan_report(const sl_bt_evt_scanner_scan_report_t *report)
+{
+  const uint8_t *data = report->data.data;
+  uint8_t len = report->data.len;
+  uint8_t i = 0;
+
+  while ((i + 1) < len) {
+    uint8_t ad_len = data[i];
+    const uint8_t *ad = &data[i + 1];
+
+    if ((ad_len == 0) || ((i + 1 + ad_len) > len)) {
+      return;
+    }
+    if ((ad_len >= BEACON_RHT_SIZE)
+        && (ad[0] == AD_TYPE_MANUFACTURER)
+        && (ad[1] == (uint8_t)LCI_BEACON_COMPANY_ID)
+        && (ad[2] == (uint8_t)(LCI_BEACON_COMPANY_ID >> 8))
+        && (ad[3] == lci_beacon_rht)) {
+      uint32_t now = local_ms();
+      uint16_t id = (uint16_t)(report->address.addr[0] | (report->address.addr[1] << 8));
+      neighbour_t *neighbour = find_neighbour(id, now);
+      entry_t entry;
+
+      if (neighbour->used
+          && (neighbour->seq == ad[4])
+          && ((now - neighbour->queued_ms) < LCI_RELAY_REFRESH_MS)) {
+        /* Repeated beacon */
+        return;
+      }
+      neighbour->used = true;
+      neighbour->seq = ad[4];
+      neighbour->queued_ms = now;
+      entry.origin = id;
+      entry.seq = ad[4];
+      entry.heard_ms = now;
+      entry.temperature = (int16_t)(ad[5] | (ad[6] << 8));
+      entry.humidity = (uint16_t)(ad[7] | (ad[8] << 8));
+      enqueue(&entry);
+      return;
+    }
+    i = (uint8_t)(i + 1 + ad_len);
+  }
+}
+/**
+* @brief Track the client of the relay batches
+ *
+* @param[in] connection     connection handle
+* @param[in] notify_enabled true if the client enabled the notifications
+*
+* @retval None
+*/
+void lci_relay_set_client(uint8_t connection, bool notify_enabled)
+{
+  if (notify_enabled) {
+    if (connection != client_connection) {
+      client_mtu = ATT_MTU_DEFAULT;
+    }
+    client_connection = connection;
+  } else if (connection == client_connection) {
+    client_connection = CONNECTION_HANDLE_INVALID;
+  }
+}
+/**
+* @brief Track the ATT MTU of the client
+*
+* The exchange may complete before the client enables the notifications,
+* the MTU of any new connection is kept until then.
+ *
+* @param[in] connection connection handle
+* @param[in] mtu        ATT MTU
+*
+* @retval None
+*/
+void lci_relay_on_mtu(uint8_t connection, uint16_t mtu)
+{
+  if ((client_connection == CONNECTION_HANDLE_INVALID) || (connection == client_connection)) {
+    client_mtu = mtu;
+  }
+}
+/**
+* @brief Keep the entries for the next central when the client disconnects
+ *
+* @param[in] connection closed connection handle
+*
+* @retval None
+*/
+void lci_relay_on_closed(uint8_t connection)
+{
+  if (connection == client_connection) {
+    client_connection = CONNECTION_HANDLE_INVALID;
+    client_mtu = ATT_MTU_DEFAULT;
+  }
+}
+/**
+* @brief Handle the external signal of the flush timer
+ *
+* @param[in] signals external signals of the event
+*
+* @retval None
+*/
+void lci_relay_on_signal(uint32_t signals)
+{
+  uint32_t now;
+  uint8_t capacity;
+
+  if (!(signals & signal)) {
+    return;
+  }
+  now = local_ms();
+  while ((queue_count > 0) && ((now - queue[queue_head].heard_ms) > LCI_RELAY_MAX_AGE_MS)) {
+    queue_head = (uint8_t)((queue_head + 1) % LCI_RELAY_QUEUE_SIZE);
+    queue_count--;
+    expired++;
+  }
+  capacity = batch_capacity();
+  if ((client_connection != CONNECTION_HANDLE_INVALID) && (capacity > 0)) {
+    while ((queue_count >= capacity)
+           || ((queue_count > 0) && ((now - queue[queue_head].heard_ms) >= LCI_RELAY_FLUSH_MS))) {
+      if (!send_batch((queue_count < capacity) ? queue_count : capacity, now)) {
+        break;
+      }
+    }
+  }
+  if ((now - last_log_ms) >= LCI_RELAY_LOG_MS) {
+    last_log_ms = now;
+    app_log_info("Relay: %lu readings in %lu batches, %lu dropped, %lu expired, %u queued\n",
+                 (unsigned long)relayed,
+                 (unsigned long)batches,
+                 (unsigned long)dropped,
+                 (unsigned long)expired,
+                 queue_count);
+    relayed = 0;
+    batches = 0;
+    dropped = 0;
+    expired = 0;
+  }
+}
@@ -0,0 +1,68 @@
+/**
+ * @file lci_relay.h
+ * @brief Relay of the readings of neighbour servers to the central
+ *
+ * The relay keeps its own link to the central and scans, as an observer,
+ * for the beacons of neighbour SI7021 servers the central does not reach.
+ * Their readings are batched into notifications of the relay batch
+ * characteristic:
+ *
+ *   header: sequence number (1 byte), flags (1 byte), send time (4 bytes),
+ *           number of entries (1 byte)
+ *   entry:  origin sensor ID (2 bytes), beacon sequence number (1 byte),
+ *           hops (1 byte), age in milliseconds (2 bytes), temperature in
+ *           0.01 degree Celsius (int16), humidity in 0.01 %RH (uint16)
+ *
+ * The sensor ID is the last two bytes of the server address, as the central
+ * uses for its own links. The age is the time the entry spent in the relay
+ * since its beacon was heard. The send time is in central milliseconds if
+ * the relay is synchronized to the central (flag 0x01), so the central can
+ * tell the time of the last hop as well. All values are little-endian.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_RELAY_H_
+#define LCI_RELAY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+/* Set to 1 to relay the readings of neighbour servers */
+#ifndef LCI_RELAY
+#define LCI_RELAY                     0
+#endif
+/* Passive scan for the neighbour beacons, 20 ms every 100 ms */
+#define LCI_RELAY_SCAN_INTERVAL       160
+#define LCI_RELAY_SCAN_WINDOW         32
+/* Batch layout */
+#define LCI_RELAY_HEADER_SIZE         7
+#define LCI_RELAY_ENTRY_SIZE          10
+#define LCI_RELAY_FLAG_SYNCED         0x01
+/* Entries of one notification at most, the ATT MTU may allow less */
+#define LCI_RELAY_BATCH_MAX           16
+/* Entries buffered while the central is away, the oldest are dropped */
+#define LCI_RELAY_QUEUE_SIZE          32
+/* Neighbours tracked for their beacon sequence numbers */
+#define LCI_RELAY_NEIGHBOURS_MAX      16
+/* A partial batch is sent once its oldest entry is this old */
+#define LCI_RELAY_FLUSH_MS            1000
+/* Period of the flush check in milliseconds */
+#define LCI_RELAY_TICK_MS             250
+/* An unchanged reading is relayed again after this time, so the central
+ * tells a steady neighbour from a lost one */
+#define LCI_RELAY_REFRESH_MS          10000
+/* Entries older than this are dropped instead of sent */
+#define LCI_RELAY_MAX_AGE_MS          30000
+/* Period of the relay statistics log in milliseconds */
+#define LCI_RELAY_LOG_MS              10000
+
+sl_status_t lci_relay_start(uint16_t batch_characteristic, uint32_t tick_signal);
+void lci_relay_on_scan_report(const sl_bt_evt_scanner_scan_report_t *report);
+void lci_relay_set_client(uint8_t connection, bool notify_enabled);
+void lci_relay_on_mtu(uint8_t connection, uint16_t mtu);
+void lci_relay_on_closed(uint8_t connection);
+void lci_relay_on_signal(uint32_t signals);
+
+#endif /* LCI_RELAY_H_ */
@@ -0,0 +1,261 @@
+/**
+ * @file lci_rtos.c
+ * @brief Kernel helpers shared by the FreeRTOS configuration of the samples
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "sl_component_catalog.h"
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+#include <string.h>
+#include "em_device.h"
+#include "app_assert.h"
+#include "lci_rtos.h"
+#if (configUSE_TRACE_FACILITY == 1)
+/* Snapshot of the kernel task list used for the statistics report */
+static TaskStatus_t task_status[LCI_RTOS_MAX_TASKS];
+#endif
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+/* Run time counters of the previous report, to compute the load per period */
+static UBaseType_t prev_task_number[LCI_RTOS_MAX_TASKS];
+static uint32_t prev_task_run_time[LCI_RTOS_MAX_TASKS];
+static uint32_t prev_total_run_time;
+/* Local function for looking up the run time of the previous report */
+static uint32_t find_prev_run_time(UBaseType_t task_number);
+/**
+* @brief Find the run time counter of a task in the previous report
+ *
+* @param[in] task_number kernel assigned task number
+*
+* @retval run time counter of the task, 0 if the task is new
+*/
+static uint32_t find_prev_run_time(UBaseType_t task_number)
+{
+  for (uint8_t i = 0; i < LCI_RTOS_MAX_TASKS; i++) {
+    if (prev_task_number[i] == task_number) {
+      return prev_task_run_time[i];
+    }
+  }
+  return 0;
+}
+#endif
+/**
+* @brief Initialize a single producer, single consumer queue
+ *
+* @param[in] queue     queue resource pointer
+* @param[in] storage   caller supplied storage of capacity * item_size bytes
+* @param[in] item_size size of one queue item in bytes
+* @param[in] capacity  number of items, must be a power of two
+*
+* @retval None
+*/
+void lci_spsc_queue_init(lci_spsc_queue_t *queue,
+                         void *storage,
+                         uint16_t item_size,
+                         uint16_t capacity)
+{
+  app_assert((capacity != 0) && ((capacity & (capacity - 1)) == 0),
+             "Queue capacity must be a power of two\n");
+  queue->storage = (uint8_t *)storage;
+  queue->item_size = item_size;
+  queue->mask = capacity - 1;
+  queue->head = 0;
+  queue->tail = 0;
+  queue->dropped = 0;
+}
+/**
+* @brief Push an item to the queue, called by the producer task only
+ *
+* @param[in] queue queue resource pointer
+* @param[in] item  pointer to the item to be copied into the queue
+*
+* @retval true if the item was queued, false if the queue is full
+*/
+bool lci_spsc_queue_push(lci_spsc_queue_t *queue, const void *item)
+{
+  uint16_t head = queue->head;
+
+  if ((uint16_t)(head - queue->tail) > queue->mask) {
+    queue->dropped++;
+    return false;
+  }
+  memcpy(&queue->storage[(head & queue->mask) * queue->item_size],
+         item,
+         queue->item_size);
+  /* The item has to be visible before the consumer sees the new head */
+  __DMB();
+  queue->head = head + 1;
+  return true;
+}
+/**
+* @brief Pop an item from the queue, called by the consumer task only
+ *
+* @param[in]  queue queue resource pointer
+* @param[out] item  pointer to the buffer receiving the item
+*
+* @retval true if an item was returned, false if the queue is empty
+*/
+bool lci_spsc_queue_pop(lci_spsc_queue_t *queue, void *item)
+{
+  uint16_t tail = queue->tail;
+
+  if (tail == queue->head) {
+    return false;
+  }
+  /* Do not read the item before the head that published it */
+  __DMB();
+  memcpy(item,
+         &queue->storage[(tail & queue->mask) * queue->item_size],
+         queue->item_size);
+  /* The slot has to be read out before the producer may reuse it */
+  __DMB();
+  queue->tail = tail + 1;
+  return true;
+}
+/**
+* @brief Initialize a latest value slot
+ *
+* @param[in] latest    slot resource pointer
+* @param[in] storage   caller supplied storage of 2 * item_size bytes
+* @param[in] item_size size of the value in bytes
+*
+* @retval None
+*/
+void lci_latest_init(lci_latest_t *latest, void *storage, uint16_t item_size)
+{
+  latest->storage = (uint8_t *)storage;
+  latest->item_size = item_size;
+  latest->sequence = 0;
+}
+/**
+* @brief Publish a new value, called by the writer task only
+ *
+* @param[in] latest slot resource pointer
+* @param[in] item   pointer to the value to be copied
+*
+* @retval None
+*/
+void lci_latest_write(lci_latest_t *latest, const void *item)
+{
+  uint32_t sequence = latest->sequence;
+
+  /* The half the reader may be copying is left alone */
+  memcpy(&latest->storage[((sequence + 1) & 1) * latest->item_size],
+         item,
+         latest->item_size);
+  /* The value has to be visible before the reader sees the new sequence */
+  __DMB();
+  latest->sequence = sequence + 1;
+}
+/**
+* @brief Read the latest value, called by the reader task only
+ *
+* @param[in]  latest slot resource pointer
+* @param[out] item   pointer to the buffer receiving the value
+*
+* @retval true if a value was returned, false if none was written yet
+*/
+bool lci_latest_read(lci_latest_t *latest, void *item)
+{
+  uint32_t sequence;
+
+  do {
+    sequence = latest->sequence;
+    if (sequence == 0) {
+      return false;
+    }
+    /* Do not read the value before the sequence that published it */
+    __DMB();
+    memcpy(item,
+           &latest->storage[(sequence & 1) * latest->item_size],
+           latest->item_size);
+    __DMB();
+    /* The writer went on meanwhile, the copy may be torn */
+  } while (sequence != latest->sequence);
+  return true;
+}
+/**
+* @brief Create a task with statically allocated stack and control block
+ *
+* @param[in] task        static task resource pointer
+* @param[in] function    task entry function
+* @param[in] name        task name, also used by the statistics report
+* @param[in] stack       statically allocated stack
+* @param[in] stack_depth stack size in StackType_t words
+* @param[in] priority    task priority
+*
+* @retval None
+*/
+void lci_rtos_task_create(lci_rtos_task_t *task,
+                          TaskFunction_t function,
+                          const char *name,
+                          StackType_t *stack,
+                          uint32_t stack_depth,
+                          UBaseType_t priority)
+{
+  task->handle = xTaskCreateStatic(function,
+                                   name,
+                                   stack_depth,
+                                   NULL,
+                                   priority,
+                                   stack,
+                                   &task->tcb);
+  app_assert(task->handle != NULL, "Failed to create %s task\n", name);
+}
+/**
+* @brief Log stack high-water mark and CPU load of every kernel task
+ *
+* @param[in] None
+*
+* @retval None
+*/
+void lci_rtos_log_task_stats(void)
+{
+#if (configUSE_TRACE_FACILITY == 1)
+  UBaseType_t task_num;
+  uint32_t total_run_time = 0;
+
+  task_num = uxTaskGetSystemState(task_status,
+                                  LCI_RTOS_MAX_TASKS,
+                                  &total_run_time);
+  if (task_num == 0) {
+    app_log_warning("Task statistics: more than %d tasks\n",
+                    LCI_RTOS_MAX_TASKS);
+    return;
+  }
+#if (configGENERATE_RUN_TIME_STATS == 1)
+  uint32_t period_run_time = total_run_time - prev_total_run_time;
+  uint32_t task_run_time;
+  uint32_t load;
+
+  for (UBaseType_t i = 0; i < task_num; i++) {
+    task_run_time = task_status[i].ulRunTimeCounter
+                    - find_prev_run_time(task_status[i].xTaskNumber);
+    /* Load of the last period in 0.1 % units */
+    load = (period_run_time != 0)
+           ? (uint32_t)(((uint64_t)task_run_time * 1000u) / period_run_time)
+           : 0;
+    app_log_info("Task %-12s stack free %5u words, CPU %3lu.%lu %%\n",
+                 task_status[i].pcTaskName,
+                 (unsigned int)task_status[i].usStackHighWaterMark,
+                 (unsigned long)(load / 10),
+                 (unsigned long)(load % 10));
+  }
+  memset(prev_task_number, 0, sizeof(prev_task_number));
+  for (UBaseType_t i = 0; i < task_num; i++) {
+    prev_task_number[i] = task_status[i].xTaskNumber;
+    prev_task_run_time[i] = task_status[i].ulRunTimeCounter;
+  }
+  prev_total_run_time = total_run_time;
+#else
+  (void)total_run_time;
+  for (UBaseType_t i = 0; i < task_num; i++) {
+    app_log_info("Task %-12s stack free %5u words\n",
+                 task_status[i].pcTaskName,
+                 (unsigned int)task_status[i].usStackHighWaterMark);
+  }
+#endif
+#endif
+}
+#endif /* SL_CATALOG_FREERTOS_KERNEL_PRESENT */
@@ -0,0 +1,65 @@
+/**
+ * @file lci_rtos.h
+ * @brief Kernel helpers shared by the FreeRTOS configuration of the samples
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_RTOS_H_
+#define LCI_RTOS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+/* Period of the task statistics report printed by the telemetry task */
+#define LCI_RTOS_STATS_PERIOD_MS      10000
+/* Maximum number of kernel tasks covered by the statistics report */
+#define LCI_RTOS_MAX_TASKS            12
+/* Single producer, single consumer lock-free queue.
+ * The producer only writes head, the consumer only writes tail, so one task
+ * may push while another pops without a critical section. The capacity must
+ * be a power of two and the storage is supplied by the caller (static). */
+typedef struct {
+  uint8_t *storage;
+  uint16_t item_size;
+  uint16_t mask;
+  volatile uint16_t head;
+  volatile uint16_t tail;
+  volatile uint32_t dropped;
+} lci_spsc_queue_t;
+/* Latest value of a single writer task for a single reader task.
+ * The writer fills the slot not published, then publishes it by counting
+ * the write in sequence. A reader that overlapped a write retries, older
+ * values are overwritten and never queued. The storage of two items is
+ * supplied by the caller (static). */
+typedef struct {
+  uint8_t *storage;
+  uint16_t item_size;
+  volatile uint32_t sequence;
+} lci_latest_t;
+/* Static task resources */
+typedef struct {
+  TaskHandle_t handle;
+  StaticTask_t tcb;
+} lci_rtos_task_t;
+
+void lci_spsc_queue_init(lci_spsc_queue_t *queue,
+                         void *storage,
+                         uint16_t item_size,
+                         uint16_t capacity);
+bool lci_spsc_queue_push(lci_spsc_queue_t *queue, const void *item);
+bool lci_spsc_queue_pop(lci_spsc_queue_t *queue, void *item);
+void lci_latest_init(lci_latest_t *latest, void *storage, uint16_t item_size);
+void lci_latest_write(lci_latest_t *latest, const void *item);
+bool lci_latest_read(lci_latest_t *latest, void *item);
+void lci_rtos_task_create(lci_rtos_task_t *task,
+                          TaskFunction_t function,
+                          const char *name,
+                          StackType_t *stack,
+                          uint32_t stack_depth,
+                          UBaseType_t priority);
+void lci_rtos_log_task_stats(void);
+
+#endif /* LCI_RTOS_H_ */
@@ -17,20 +17,118 @@
 #include "sl_simple_button_instances.h"
 #include "sl_gatt_service_rht.h"
 #include "sl_sensor_rht.h"
+#include "sl_component_catalog.h"
+#include "lci_fixed_point.h"
+#include "lci_error.h"
+#include "lci_fast_start.h"
+#include "lci_beacon.h"
+#include "lci_ota.h"
+#include "lci_time_sync.h"
+#include "lci_relay.h"
+#include "lci_bonding.h"
+#include "lci_gatt_caching.h"
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+#include "lci_rtos.h"
+#else
+#include "sl_si70xx.h"
+#include "sl_i2cspm_instances.h"
+#endif
 /* Simple timer timeout in milliseconds */
 #define ADV_TIMER_TIMEOUT_MS  1000
 /* LED instance selection*/
 #define ADV_IND_LED           SL_SIMPLE_LED_INSTANCE(0)
+/* Advertised service, Environmental Sensing */
+#define ADV_SERVICE_UUID      0x181A
+/* Connectable advertising interval, the beacon carries the live data */
+#define ADV_INTERVAL          800  /* 500 milliseconds */
+/* External signal raised by the advertising retry timer */
+#define ADV_RETRY_SIGNAL      (1u << 0)
+/* External signal raised by the beacon update timer */
+#define BEACON_SIGNAL         (1u << 1)
+/* External signal raised at a sampling instant synchronized to the central */
+#define TIME_SYNC_SIGNAL      (1u << 2)
+/* External signal raised by the relay flush timer */
+#define RELAY_SIGNAL          (1u << 4)
+#if !defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/* I2C instance of the sensor, the one of the RHT sensor component */
+#ifndef RHT_I2CSPM
+#define RHT_I2CSPM            sl_i2cspm_sensor
+#endif
+#endif
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/* Sensor acquisition period in milliseconds, unless synchronized */
+#define SENSOR_TASK_PERIOD_MS         1000
+/* External signal raised by the sensor task for a synchronized sample */
+#define SAMPLE_SIGNAL                 (1u << 3)
+/* Task stack sizes in StackType_t words */
+#define SENSOR_TASK_STACK_SIZE        (512 / sizeof(StackType_t))
+#define TELEMETRY_TASK_STACK_SIZE     (1024 / sizeof(StackType_t))
+/* Task priorities, both below the Bluetooth stack tasks */
+#define SENSOR_TASK_PRIO              (tskIDLE_PRIORITY + 2)
+#define TELEMETRY_TASK_PRIO           (tskIDLE_PRIORITY + 1)
+/* Queue capacities, power of two. The sample queue only carries the
+ * samples of the synchronized instants, drained at once on SAMPLE_SIGNAL */
+#define SAMPLE_QUEUE_SIZE             4
+#define TELEMETRY_QUEUE_SIZE          16
+/* Sensor reading passed between the tasks */
+typedef struct {
+  sl_status_t status;
+  uint32_t rh;
+  int32_t t;
+  /* Sampling instant in central time, if read at a synchronized instant */
+  bool timed;
+  uint32_t instant;
+} rht_sample_t;
+/* Sensor acquisition task -> Bluetooth event task, the latest sample for
+ * the GATT service and the synchronized samples for the central */
+static rht_sample_t sample_latest_storage[2];
+static lci_latest_t sample_latest;
+static rht_sample_t sample_queue_storage[SAMPLE_QUEUE_SIZE];
+static lci_spsc_queue_t sample_queue;
+/* Sensor acquisition task -> telemetry task */
+static rht_sample_t telemetry_queue_storage[TELEMETRY_QUEUE_SIZE];
+static lci_spsc_queue_t telemetry_queue;
+/* Statically allocated tasks */
+static StackType_t sensor_task_stack[SENSOR_TASK_STACK_SIZE];
+static lci_rtos_task_t sensor_task;
+static StackType_t telemetry_task_stack[TELEMETRY_TASK_STACK_SIZE];
+static lci_rtos_task_t telemetry_task;
+/* Last sample handed to the GATT service */
+static rht_sample_t last_sample = { SL_STATUS_NOT_READY, 0, 0, false, 0 };
+/* Synchronized instant handed to the sensor task with its notification */
+static volatile uint32_t sensor_instant;
+/* Kernel task functions */
+static void sensor_task_fn(void *arg);
+static void telemetry_task_fn(void *arg);
+static void drain_samples(void);
+#else
+/* Last reading of the sensor, refreshed on every beacon update */
+static sl_status_t last_status = SL_STATUS_NOT_READY;
+static uint32_t last_rh;
+static int32_t last_t;
+/* A no-hold measurement runs since the last beacon update */
+static bool measuring;
+#endif
 /* The advertising set handle allocated from Bluetooth stack */
 static uint8_t advertising_set_handle = 0xff;
 /* ASCII code for degree celsious sign */
 static const uint8_t celsious_ascii_code = 248;
 /* Simple timer for controlling an LED#0 during advertising */
 static sl_simple_timer_t adv_timer;
+/* Retries of a failed advertiser start */
+static lci_error_retry_t adv_retry;
 /* Simple timer local functions */
 static void hdl_adv_timer_event(sl_simple_timer_t *timer, void *data);
 static void adv_start_timer(void);
 static void adv_stop_timer(void);
+static void start_advertising(void);
+static sl_status_t read_rht(uint32_t *rh, int32_t *t);
+static void sample_at_instant(uint32_t instant);
+static void update_beacon(void);
+#if !defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+static void refresh_reading(void);
+#endif
+static void log_rht_sample(sl_status_t sc, uint32_t rh, int32_t t);
 /**
 * @brief Simple timer handler
  *
@@ -77,6 +175,282 @@ static void adv_stop_timer(void)
   sl_led_turn_on(ADV_IND_LED);
 }
 /**
+* @brief Start general advertising and enable connections
+*
+* A failed start, e.g. while the stack still releases the resources of a
+* closed connection, is retried with a backoff instead of a reset.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void start_advertising(void)
+{
+  sl_status_t sc;
+  /* The advertising data is set by the fast start */
+  sc = sl_bt_advertiser_start(
+    advertising_set_handle,
+    sl_bt_advertiser_user_data,
+    sl_bt_advertiser_connectable_scannable);
+  if (lci_error_check(sc, "Advertising start") != lci_error_none) {
+    if (!lci_error_retry_schedule(&adv_retry)) {
+      app_assert_status_f(sc, "Failed to start advertising\n");
+    }
+    return;
+  }
+  if (lci_fast_start_on_advertising()) {
+    /* System ID and the rest once the server can be found */
+    lci_fast_start_complete(advertising_set_handle);
+  }
+  lci_error_retry_done(&adv_retry);
+  adv_start_timer();
+}
+/**
+* @brief Read the latest humidity and temperature
+ *
+* @param[out] rh relative humidity value
+* @param[out] t  temperature value
+*
+* @retval SL_STATUS_OK if the reading is valid, error code otherwise
+*/
+static sl_status_t read_rht(uint32_t *rh, int32_t *t)
+{
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  /* Serve the latest sample of the sensor task, never block the stack */
+  drain_samples();
+  (void)lci_latest_read(&sample_latest, &last_sample);
+  if (SL_STATUS_OK == last_sample.status) {
+    *rh = last_sample.rh;
+    *t = last_sample.t;
+  }
+  return last_sample.status;
+#else
+  sl_status_t sc = sl_sensor_rht_get(rh, t);
+
+  if (SL_STATUS_OK == sc) {
+    last_status = sc;
+    last_rh = *rh;
+    last_t = *t;
+  }
+  return sc;
+#endif
+}
+/**
+* @brief Read the sensor at a sampling instant synchronized to the central
+*
+* Under FreeRTOS the sensor task reads it, the sample is published once it
+* comes back through the sample queue.
+ *
+* @param[in] instant sampling instant in central milliseconds
+*
+* @retval None
+*/
+static void sample_at_instant(uint32_t instant)
+{
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  sensor_instant = instant;
+  xTaskNotifyGive(sensor_task.handle);
+#else
+  uint32_t rh = 0;
+  int32_t t = 0;
+  sl_status_t sc;
+
+  sc = sl_sensor_rht_get(&rh, &t);
+  if (SL_STATUS_OK == sc) {
+    last_status = sc;
+    last_rh = rh;
+    last_t = t;
+  }
+  lci_time_sync_publish(instant, sc, rh, t);
+#endif
+}
+#if !defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/**
+* @brief Refresh the last reading without blocking the stack
+*
+* Every call collects the result of the no-hold measurement started by the
+* previous one, the conversion is long done, and starts the next. The stack
+* only waits for the short I2C transfers. A hold measurement for a client
+* in between takes the result, the read fails and the next call starts
+* over.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void refresh_reading(void)
+{
+  uint32_t rh;
+  int32_t t;
+
+  if (measuring
+      && (sl_si70xx_read_rh_and_temp(RHT_I2CSPM, SI7021_ADDR, &rh, &t) == SL_STATUS_OK)) {
+    last_status = SL_STATUS_OK;
+    last_rh = rh;
+    last_t = t;
+  }
+  measuring = (sl_si70xx_start_no_hold_measure_rh(RHT_I2CSPM, SI7021_ADDR) == SL_STATUS_OK);
+}
+#endif
+/**
+* @brief Broadcast the latest reading in the beacon
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void update_beacon(void)
+{
+  uint8_t state[12];
+  uint8_t len = 4;
+  uint32_t rh;
+  int32_t t;
+  int32_t value;
+  uint32_t image_crc;
+  uint32_t offset;
+
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  if (read_rht(&rh, &t) != SL_STATUS_OK) {
+    return;
+  }
+#else
+  /* Sampled on its own, whether a client reads the sensor or not */
+  refresh_reading();
+  if (last_status != SL_STATUS_OK) {
+    return;
+  }
+  rh = last_rh;
+  t = last_t;
+#endif
+  /* The 0.01 units and byte order of the GATT characteristics */
+  value = lci_fp_milli_to_centi(t);
+  state[0] = (uint8_t)value;
+  state[1] = (uint8_t)(value >> 8);
+  value = lci_fp_milli_to_centi((int32_t)rh);
+  state[2] = (uint8_t)value;
+  state[3] = (uint8_t)(value >> 8);
+  /* An interrupted OTA transfer, for the client to resume */
+  if (lci_ota_get_resume(&image_crc, &offset)) {
+    for (uint8_t i = 0; i < 4; i++) {
+      state[4 + i] = (uint8_t)(image_crc >> (8 * i));
+      state[8 + i] = (uint8_t)(offset >> (8 * i));
+    }
+    len = sizeof(state);
+  }
+  (void)lci_error_check_optional(lci_beacon_update(state, len), "Beacon update");
+}
+/**
+* @brief Log a humidity and temperature reading
+ *
+* @param[in] sc status of the sensor reading
+* @param[in] rh relative humidity value
+* @param[in] t  temperature value
+*
+* @retval None
+*/
+static void log_rht_sample(sl_status_t sc, uint32_t rh, int32_t t)
+{
+  char text[LCI_FP_STR_SIZE];
+
+  if (SL_STATUS_OK == sc) {
+    /* Driver units rounded to the 0.01 units of the GATT characteristics */
+    (void)lci_fp_format(text, lci_fp_milli_to_centi((int32_t)rh), LCI_FP_CENTI);
+    app_log_info("Humidity [relative humidity as a percentage] - %s %%RH", text);
+    app_log_nl();
+    (void)lci_fp_format(text, lci_fp_milli_to_centi(t), LCI_FP_CENTI);
+    app_log_info("Temperature [degree celsius] - %s %cC", text, celsious_ascii_code);
+    app_log_nl();
+  } else {
+    app_log_status_error_f(sc, "RHT sensor measurement failed");
+    app_log_nl();
+  }
+}
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+/**
+* @brief Hand the synchronized samples of the sensor task to the central
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void drain_samples(void)
+{
+  rht_sample_t sample;
+
+  while (lci_spsc_queue_pop(&sample_queue, &sample)) {
+    lci_time_sync_publish(sample.instant,
+                          sample.status,
+                          sample.rh,
+                          sample.t);
+  }
+}
+/**
+* @brief Sensor acquisition task, reads the sensor off the Bluetooth task
+*
+* Synchronized to a central, the sensor is read when the Bluetooth task
+* notifies a sampling instant, otherwise on its own period.
+ *
+* @param[in] arg unused
+*
+* @retval None
+*/
+static void sensor_task_fn(void *arg)
+{
+  rht_sample_t sample;
+  TickType_t wake_time = xTaskGetTickCount();
+  TickType_t elapsed;
+  (void)arg;
+
+  while (1) {
+    elapsed = xTaskGetTickCount() - wake_time;
+    if (elapsed > pdMS_TO_TICKS(SENSOR_TASK_PERIOD_MS)) {
+      elapsed = pdMS_TO_TICKS(SENSOR_TASK_PERIOD_MS);
+    }
+    sample.timed = ulTaskNotifyTake(pdTRUE,
+                                    pdMS_TO_TICKS(SENSOR_TASK_PERIOD_MS) - elapsed) > 0;
+    sample.instant = sensor_instant;
+    wake_time = xTaskGetTickCount();
+    sample.status = sl_sensor_rht_get(&sample.rh, &sample.t);
+    /* The GATT service always gets the newest sample */
+    lci_latest_write(&sample_latest, &sample);
+    if (sample.timed && lci_spsc_queue_push(&sample_queue, &sample)) {
+      sl_bt_external_signal(SAMPLE_SIGNAL);
+    }
+    if (lci_spsc_queue_push(&telemetry_queue, &sample)) {
+      xTaskNotifyGive(telemetry_task.handle);
+    }
+  }
+}
+/**
+* @brief Telemetry task, logs the samples and the task statistics report
+ *
+* @param[in] arg unused
+*
+* @retval None
+*/
+static void telemetry_task_fn(void *arg)
+{
+  rht_sample_t sample;
+  TickType_t stats_time = xTaskGetTickCount();
+  (void)arg;
+
+  while (1) {
+    (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LCI_RTOS_STATS_PERIOD_MS));
+    while (lci_spsc_queue_pop(&telemetry_queue, &sample)) {
+      log_rht_sample(sample.status, sample.rh, sample.t);
+    }
+    if ((xTaskGetTickCount() - stats_time) >= pdMS_TO_TICKS(LCI_RTOS_STATS_PERIOD_MS)) {
+      stats_time = xTaskGetTickCount();
+      lci_rtos_log_task_stats();
+      if (telemetry_queue.dropped != 0) {
+        app_log_warning("Telemetry queue dropped %lu samples\n",
+                        (unsigned long)telemetry_queue.dropped);
+      }
+    }
+  }
+}
+#endif
+/**
 * @brief Application initialization procedure
  *
 * @param[in] None
@@ -85,8 +459,29 @@ static void adv_stop_timer(void)
 */
 void app_init(void)
 {
-  app_log_info("[SI7021 sensor] Laird Connectivity simple peripheral server demo");
-  app_log_nl();
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  lci_latest_init(&sample_latest, sample_latest_storage, sizeof(rht_sample_t));
+  lci_spsc_queue_init(&sample_queue,
+                      sample_queue_storage,
+                      sizeof(rht_sample_t),
+                      SAMPLE_QUEUE_SIZE);
+  lci_spsc_queue_init(&telemetry_queue,
+                      telemetry_queue_storage,
+                      sizeof(rht_sample_t),
+                      TELEMETRY_QUEUE_SIZE);
+  lci_rtos_task_create(&telemetry_task,
+                       telemetry_task_fn,
+                       "telemetry",
+                       telemetry_task_stack,
+                       TELEMETRY_TASK_STACK_SIZE,
+                       TELEMETRY_TASK_PRIO);
+  lci_rtos_task_create(&sensor_task,
+                       sensor_task_fn,
+                       "sensor",
+                       sensor_task_stack,
+                       SENSOR_TASK_STACK_SIZE,
+                       SENSOR_TASK_PRIO);
+#endif
 }
 /**
 * @brief Bluetooth events handler
@@ -98,9 +493,7 @@ void app_init(void)
 void sl_bt_on_event(sl_bt_msg_t *evt)
 {
   sl_status_t sc;
-  bd_addr address;
-  uint8_t address_type;
-  uint8_t system_id[8];
+  uint32_t instant;
 
   switch (SL_BT_MSG_ID(evt->header)) {
     /* ------------------------------- */
@@ -110,63 +503,207 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
      */
     case sl_bt_evt_system_boot_id:
 
-      /* Extract unique ID from BT Address */
-      sc = sl_bt_system_get_identity_address(&address, &address_type);
-      app_assert_status(sc);
-
-      /* Pad and reverse unique ID to get System ID */
-      system_id[0] = address.addr[5];
-      system_id[1] = address.addr[4];
-      system_id[2] = address.addr[3];
-      system_id[3] = 0xFF;
-      system_id[4] = 0xFE;
-      system_id[5] = address.addr[2];
-      system_id[6] = address.addr[1];
-      system_id[7] = address.addr[0];
-
-      sc = sl_bt_gatt_server_write_attribute_value(gattdb_system_id,
-                                                   0,
-                                                   sizeof(system_id),
-                                                   system_id);
-      app_assert_status(sc);
+      /* Load the advertising data kept from the previous boot */
+      lci_fast_start_init(ADV_SERVICE_UUID);
 
       /* Create an advertising set */
       sc = sl_bt_advertiser_create_set(&advertising_set_handle);
       app_assert_status(sc);
 
-      /* Set advertising interval to 100ms */
+      /* Set advertising interval to 500ms */
       sc = sl_bt_advertiser_set_timing(
         advertising_set_handle,
-        160, /* min. adv. interval (milliseconds * 1.6) */
-        160, /* max. adv. interval (milliseconds * 1.6) */
+        ADV_INTERVAL, /* min. adv. interval (milliseconds * 1.6) */
+        ADV_INTERVAL, /* max. adv. interval (milliseconds * 1.6) */
         0,   /* adv. duration */
         0);  /* max. num. adv. events */
       app_assert_status(sc);
-      /* Start general advertising and enable connections */
-      sc = sl_bt_advertiser_start(
-        advertising_set_handle,
-        sl_bt_advertiser_general_discoverable,
-        sl_bt_advertiser_connectable_scannable);
+      sc = lci_fast_start_set_adv_data(advertising_set_handle);
       app_assert_status(sc);
-      adv_start_timer();
+#if LCI_BONDING
+      /* Bonded clients reconnect encrypted, set up before the first one */
+      sc = lci_bonding_init();
+      (void)lci_error_check_optional(sc, "Bonding configuration");
+#endif
+#if LCI_GATT_CACHING
+      /* Bonded clients learn about a new database on reconnect */
+      lci_gatt_caching_init();
+#endif
+      /* Start general advertising and enable connections */
+      lci_error_retry_init(&adv_retry, ADV_RETRY_SIGNAL);
+      start_advertising();
+      app_log_info("[SI7021 sensor] Laird Connectivity simple peripheral server demo");
+      app_log_nl();
+      /* Live readings for passive listeners, also while connected */
+      sc = lci_beacon_start(lci_beacon_rht, BEACON_SIGNAL);
+      (void)lci_error_check_optional(sc, "Beacon start");
+      /* Updates are received while the sensor keeps running */
+      sc = lci_ota_init(gattdb_ota_control);
+      (void)lci_error_check(sc, "OTA storage slot");
+      /* Sampling instants follow the clock of the central */
+      lci_time_sync_init(gattdb_timed_rht, TIME_SYNC_SIGNAL);
+#if LCI_RELAY
+      /* Readings of the neighbours the central does not reach */
+      sc = lci_relay_start(gattdb_relay_batch, RELAY_SIGNAL);
+      (void)lci_error_check_optional(sc, "Relay start");
+#endif
       break;
 
     /* ------------------------------- */
     /* This event indicates that a new connection was opened */
     case sl_bt_evt_connection_opened_id:
+      lci_fast_start_on_connection();
+#if LCI_BONDING
+      lci_bonding_on_opened(evt->data.evt_connection_opened.connection,
+                            evt->data.evt_connection_opened.bonding);
+#endif
+#if LCI_GATT_CACHING
+      lci_gatt_caching_on_opened(evt->data.evt_connection_opened.connection,
+                                 evt->data.evt_connection_opened.bonding);
+#endif
       adv_stop_timer();
       break;
 
     /* ------------------------------- */
     /* This event indicates that a connection was closed */
     case sl_bt_evt_connection_closed_id:
+      lci_ota_on_closed(evt->data.evt_connection_closed.connection);
+      lci_time_sync_on_closed(evt->data.evt_connection_closed.connection);
+#if LCI_BONDING
+      lci_bonding_on_closed(evt->data.evt_connection_closed.connection);
+#endif
+#if LCI_GATT_CACHING
+      lci_gatt_caching_on_closed(evt->data.evt_connection_closed.connection);
+#endif
+#if LCI_RELAY
+      lci_relay_on_closed(evt->data.evt_connection_closed.connection);
+#endif
       /* Restart advertising after client has disconnected */
-      sc = sl_bt_advertiser_start(
-        advertising_set_handle,
-        sl_bt_advertiser_general_discoverable,
-        sl_bt_advertiser_connectable_scannable);
-      app_assert_status(sc);
-      adv_start_timer();
+      start_advertising();
+      break;
+
+    /* ------------------------------- */
+    /* This event indicates the PHY of a connection changed */
+    case sl_bt_evt_connection_phy_status_id:
+      app_log_info("Connection PHY: %u\n", evt->data.evt_connection_phy_status.phy);
+      break;
+
+#if LCI_BONDING
+    /* ------------------------------- */
+    /* This event indicates the parameters or the security of a connection */
+    case sl_bt_evt_connection_parameters_id:
+      lci_bonding_on_parameters(evt->data.evt_connection_parameters.connection,
+                                evt->data.evt_connection_parameters.security_mode);
+#if LCI_GATT_CACHING
+      lci_gatt_caching_on_parameters(evt->data.evt_connection_parameters.connection,
+                                     evt->data.evt_connection_parameters.security_mode);
+#endif
+      break;
+
+    /* ------------------------------- */
+    /* This event indicates a new bond with the client */
+    case sl_bt_evt_sm_bonded_id:
+      lci_bonding_on_bonded(evt->data.evt_sm_bonded.connection,
+                            evt->data.evt_sm_bonded.bonding);
+#if LCI_GATT_CACHING
+      lci_gatt_caching_on_bonded(evt->data.evt_sm_bonded.connection,
+                                 evt->data.evt_sm_bonded.bonding);
+#endif
+      break;
+
+    /* ------------------------------- */
+    /* This event indicates a failed pairing or encryption */
+    case sl_bt_evt_sm_bonding_failed_id:
+      lci_bonding_on_failed(evt->data.evt_sm_bonding_failed.connection,
+                            evt->data.evt_sm_bonding_failed.reason);
+      break;
+#endif
+
+#if LCI_RELAY
+    /* ------------------------------- */
+    /* This event indicates the ATT MTU of a connection */
+    case sl_bt_evt_gatt_mtu_exchanged_id:
+      lci_relay_on_mtu(evt->data.evt_gatt_mtu_exchanged.connection,
+                       evt->data.evt_gatt_mtu_exchanged.mtu);
+      break;
+
+    /* ------------------------------- */
+    /* This event indicates an advertisement of a neighbour */
+    case sl_bt_evt_scanner_scan_report_id:
+      lci_relay_on_scan_report(&evt->data.evt_scanner_scan_report);
+      break;
+#endif
+
+    /* ------------------------------- */
+    /* This event indicates a change of the client configuration */
+    case sl_bt_evt_gatt_server_characteristic_status_id:
+      if ((evt->data.evt_gatt_server_characteristic_status.characteristic == gattdb_ota_control)
+          && (evt->data.evt_gatt_server_characteristic_status.status_flags == sl_bt_gatt_server_client_config)) {
+        lci_ota_set_client(evt->data.evt_gatt_server_characteristic_status.connection,
+                           (evt->data.evt_gatt_server_characteristic_status.client_config_flags
+                            & sl_bt_gatt_notification) != 0);
+      } else if ((evt->data.evt_gatt_server_characteristic_status.characteristic == gattdb_timed_rht)
+                 && (evt->data.evt_gatt_server_characteristic_status.status_flags == sl_bt_gatt_server_client_config)) {
+        lci_time_sync_set_client(evt->data.evt_gatt_server_characteristic_status.connection,
+                                 (evt->data.evt_gatt_server_characteristic_status.client_config_flags
+                                  & sl_bt_gatt_notification) != 0);
+      }
+#if LCI_RELAY
+      if ((evt->data.evt_gatt_server_characteristic_status.characteristic == gattdb_relay_batch)
+          && (evt->data.evt_gatt_server_characteristic_status.status_flags == sl_bt_gatt_server_client_config)) {
+        lci_relay_set_client(evt->data.evt_gatt_server_characteristic_status.connection,
+                             (evt->data.evt_gatt_server_characteristic_status.client_config_flags
+                              & sl_bt_gatt_notification) != 0);
+      }
+#endif
+#if LCI_GATT_CACHING
+      if (evt->data.evt_gatt_server_characteristic_status.characteristic == gattdb_service_changed_char) {
+        lci_gatt_caching_on_status(evt->data.evt_gatt_server_characteristic_status.connection,
+                                   evt->data.evt_gatt_server_characteristic_status.status_flags,
+                                   evt->data.evt_gatt_server_characteristic_status.client_config_flags);
+      }
+#endif
+      break;
+
+    /* ------------------------------- */
+    /* This event indicates the client wrote a characteristic value */
+    case sl_bt_evt_gatt_server_attribute_value_id:
+      if (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_ota_control) {
+        lci_ota_on_control(evt->data.evt_gatt_server_attribute_value.connection,
+                           evt->data.evt_gatt_server_attribute_value.value.data,
+                           evt->data.evt_gatt_server_attribute_value.value.len);
+      } else if (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_ota_data) {
+        lci_ota_on_data(evt->data.evt_gatt_server_attribute_value.connection,
+                        evt->data.evt_gatt_server_attribute_value.value.data,
+                        evt->data.evt_gatt_server_attribute_value.value.len);
+      } else if (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_time_sync) {
+        lci_time_sync_on_write(evt->data.evt_gatt_server_attribute_value.connection,
+                               evt->data.evt_gatt_server_attribute_value.value.data,
+                               evt->data.evt_gatt_server_attribute_value.value.len);
+      }
+      break;
+
+    /* ------------------------------- */
+    /* This event is generated by the advertising retry, beacon, sampling
+     * instant and relay timers */
+    case sl_bt_evt_system_external_signal_id:
+      if (evt->data.evt_system_external_signal.extsignals & ADV_RETRY_SIGNAL) {
+        start_advertising();
+      }
+      if (evt->data.evt_system_external_signal.extsignals & BEACON_SIGNAL) {
+        update_beacon();
+      }
+      if (lci_time_sync_on_signal(evt->data.evt_system_external_signal.extsignals, &instant)) {
+        sample_at_instant(instant);
+      }
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+      if (evt->data.evt_system_external_signal.extsignals & SAMPLE_SIGNAL) {
+        drain_samples();
+      }
+#endif
+#if LCI_RELAY
+      lci_relay_on_signal(evt->data.evt_system_external_signal.extsignals);
+#endif
       break;
 
     /* ------------------------------- */
@@ -202,16 +739,12 @@ void sl_button_on_change(const sl_button_t *handle)
 */
 sl_status_t sl_gatt_service_rht_get(uint32_t *rh, int32_t *t)
 {
+#if defined(SL_CATALOG_FREERTOS_KERNEL_PRESENT)
+  return read_rht(rh, t);
+#else
   sl_status_t sc;
-  sc = sl_sensor_rht_get(rh, t);
-  if (SL_STATUS_OK == sc) {
-    app_log_info("Humidity [relative humidity as a percentage] - %3.2f %%RH", (float)*rh / 1000.0f);
-    app_log_nl();
-    app_log_info("Temperature [degree celsius] - %3.2f %cC", (float)*t / 1000.0f, celsious_ascii_code);
-    app_log_nl();
-  } else {
-    app_log_status_error_f(sc, "RHT sensor measurement failed");
-    app_log_nl();
-  }
+  sc = read_rht(rh, t);
+  log_rht_sample(sc, *rh, *t);
   return sc;
+#endif
 }
@@ -0,0 +1,299 @@
+/**
+ * @file lci_time_sync.c
+ * @brief Sampling synchronized to the clock of the central
+ *
+ * The central can not tell when a write reaches the server, but it knows
+ * its own connection events: the response to a write with response goes in
+ * the connection event after the one that carried the write, so the event
+ * of the write is one connection interval before the response arrives.
+ * The follow-up carries that time, and the server pairs it with its own
+ * time of the write. What is left is the difference of the host processing
+ * delays on both sides, well below the millisecond resolution here.
+ *
+ * The first offset and any larger jump are applied at once, the periodic
+ * resyncs of the central are smoothed so the sampling instants do not jitter
+ * from one sync to the next.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include "app_log.h"
+#include "sl_bluetooth.h"
+#include "sl_sleeptimer.h"
+#include "lci_fixed_point.h"
+#include "lci_time_sync.h"
+/* Invalidated connection handle */
+#define CONNECTION_HANDLE_INVALID     ((uint8_t)0xFFu)
+/* Share of an offset change applied per resync, 1/2^SMOOTH_SHIFT */
+#define SMOOTH_SHIFT                  2
+/* Characteristic and external signal */
+static uint16_t timed_char;
+static uint32_t signal;
+/* Central that synchronizes the clock */
+static uint8_t client_connection = CONNECTION_HANDLE_INVALID;
+/* Connection that enabled the notifications of the timed characteristic */
+static uint8_t notify_connection = CONNECTION_HANDLE_INVALID;
+/* Pending sync: sequence number and local time of the write */
+static bool sync_pending;
+static uint8_t sync_seq;
+static uint32_t sync_local_ms;
+/* Central time minus local time */
+static bool synced;
+static int32_t offset_ms;
+static uint16_t period_ms;
+/* Next sampling instant in central time */
+static uint32_t next_instant;
+static sl_sleeptimer_timer_handle_t instant_timer;
+/* Local functions */
+static void hdl_instant_timer_event(sl_sleeptimer_timer_handle_t *handle, void *data);
+static uint32_t local_ms(void);
+static void schedule(void);
+static void unsync(void);
+/**
+* @brief Sampling instant timer handler, runs in interrupt context
+ *
+* @param[in] handle timer resource pointer
+* @param[in] data pointer
+*
+* @retval None
+*/
+static void hdl_instant_timer_event(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  sl_bt_external_signal(signal);
+}
+/**
+* @brief Local time in milliseconds since the boot
+ *
+* @param[in] None
+*
+* @retval milliseconds, wrapping at 32 bits like the central time
+*/
+static uint32_t local_ms(void)
+{
+  uint64_t ms = 0;
+
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64(), &ms);
+  return (uint32_t)ms;
+}
+/**
+* @brief Arm the timer for the next multiple of the period on the central clock
+*
+* The timer may fire a tick early, the half period of rounding keeps the
+* instant just reached from being scheduled twice.
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void schedule(void)
+{
+  uint32_t now = local_ms() + (uint32_t)offset_ms;
+  sl_status_t sc;
+
+  next_instant = ((now + period_ms / 2) / period_ms + 1) * period_ms;
+  (void)sl_sleeptimer_stop_timer(&instant_timer);
+  sc = sl_sleeptimer_start_timer_ms(&instant_timer,
+                                    next_instant - now,
+                                    hdl_instant_timer_event,
+                                    NULL,
+                                    0,
+                                    0);
+  if (sc != SL_STATUS_OK) {
+    app_log_status_error_f(sc, "Time sync timer");
+    app_log_nl();
+  }
+}
+/**
+* @brief Stop the synchronized sampling
+ *
+* @param[in] None
+*
+* @retval None
+*/
+static void unsync(void)
+{
+  (void)sl_sleeptimer_stop_timer(&instant_timer);
+  synced = false;
+  sync_pending = false;
+}
+/**
+* @brief Initialize the synchronized sampling
+ *
+* @param[in] timed_characteristic characteristic of the timed samples
+* @param[in] instant_signal       external signal raised at a sampling instant
+*
+* @retval None
+*/
+void lci_time_sync_init(uint16_t timed_characteristic, uint32_t instant_signal)
+{
+  timed_char = timed_characteristic;
+  signal = instant_signal;
+}
+/**
+* @brief Track the client of the timed characteristic
+ *
+* @param[in] connection     connection handle
+* @param[in] notify_enabled true if the client enabled the notifications
+*
+* @retval None
+*/
+void lci_time_sync_set_client(uint8_t connection, bool notify_enabled)
+{
+  if (notify_enabled) {
+    notify_connection = connection;
+  } else if (connection == notify_connection) {
+    notify_connection = CONNECTION_HANDLE_INVALID;
+  }
+}
+/**
+* @brief Handle a write to the sync characteristic
+*
+* The clock follows the central that wrote the last sync, the samples go to
+* that central only.
+ *
+* @param[in] connection connection handle
+* @param[in] data       sync or follow-up
+* @param[in] len        length of the write
+*
+* @retval None
+*/
+void lci_time_sync_on_write(uint8_t connection, const uint8_t *data, uint8_t len)
+{
+  uint32_t anchor;
+  uint16_t period;
+  int32_t offset;
+  bool step;
+
+  if ((len == 2) && (data[0] == LCI_TIME_SYNC_OP_SYNC)) {
+    /* Timestamped first, the event is the closest to the connection event */
+    uint32_t now = local_ms();
+    if (connection != client_connection) {
+      unsync();
+      client_connection = connection;
+    }
+    sync_local_ms = now;
+    sync_seq = data[1];
+    sync_pending = true;
+    return;
+  }
+  if ((len != LCI_TIME_SYNC_FOLLOW_UP_SIZE)
+      || (data[0] != LCI_TIME_SYNC_OP_FOLLOW_UP)
+      || (connection != client_connection)
+      || !sync_pending
+      || (data[1] != sync_seq)) {
+    return;
+  }
+  sync_pending = false;
+  anchor = (uint32_t)data[2] | ((uint32_t)data[3] << 8)
+           | ((uint32_t)data[4] << 16) | ((uint32_t)data[5] << 24);
+  period = (uint16_t)(data[6] | (data[7] << 8));
+  if (period < LCI_TIME_SYNC_PERIOD_MIN_MS) {
+    return;
+  }
+  offset = (int32_t)(anchor - sync_local_ms);
+  step = !synced || (abs(offset - offset_ms) > LCI_TIME_SYNC_STEP_MS);
+  if (step) {
+    app_log_info("Time sync: offset %ld ms, stepped from %ld ms\n",
+                 (long)offset, (long)offset_ms);
+    offset_ms = offset;
+  } else {
+    offset_ms += (offset - offset_ms) / (1 << SMOOTH_SHIFT);
+  }
+  /* The armed instant stays valid unless the clock or the period jumped */
+  if (step || (period != period_ms)) {
+    synced = true;
+    period_ms = period;
+    schedule();
+  }
+}
+/**
+* @brief Stop the synchronized sampling when its central disconnects
+ *
+* @param[in] connection closed connection handle
+*
+* @retval None
+*/
+void lci_time_sync_on_closed(uint8_t connection)
+{
+  if (connection == client_connection) {
+    unsync();
+    client_connection = CONNECTION_HANDLE_INVALID;
+  }
+  if (connection == notify_connection) {
+    notify_connection = CONNECTION_HANDLE_INVALID;
+  }
+}
+/**
+* @brief Handle the external signal of the sampling instant
+ *
+* @param[in]  signals external signals of the event
+* @param[out] instant sampling instant reached, in central milliseconds
+*
+* @retval true if the sensor is to be read for the instant
+*/
+bool lci_time_sync_on_signal(uint32_t signals, uint32_t *instant)
+{
+  if (!(signals & signal) || !synced) {
+    return false;
+  }
+  *instant = next_instant;
+  schedule();
+  return true;
+}
+/**
+* @brief Read the central clock
+ *
+* @param[in]  connection connection handle of the central
+* @param[out] central_ms time in central milliseconds
+*
+* @retval true if synchronized to that central, false to leave the time as is
+*/
+bool lci_time_sync_now(uint8_t connection, uint32_t *central_ms)
+{
+  if (!synced || (connection != client_connection)) {
+    return false;
+  }
+  *central_ms = local_ms() + (uint32_t)offset_ms;
+  return true;
+}
+/**
+* @brief Publish the sample of a sampling instant
+ *
+* @param[in] instant sampling instant in central milliseconds
+* @param[in] sc      status of the sensor reading
+* @param[in] rh      relative humidity value
+* @param[in] t       temperature value
+*
+* @retval None
+*/
+void lci_time_sync_publish(uint32_t instant, sl_status_t sc, uint32_t rh, int32_t t)
+{
+  uint8_t value[LCI_TIME_SYNC_SAMPLE_SIZE];
+  int32_t centi;
+
+  if (SL_STATUS_OK != sc) {
+    return;
+  }
+  value[0] = (uint8_t)instant;
+  value[1] = (uint8_t)(instant >> 8);
+  value[2] = (uint8_t)(instant >> 16);
+  value[3] = (uint8_t)(instant >> 24);
+  centi = lci_fp_milli_to_centi(t);
+  value[4] = (uint8_t)centi;
+  value[5] = (uint8_t)(centi >> 8);
+  centi = lci_fp_milli_to_centi((int32_t)rh);
+  value[6] = (uint8_t)centi;
+  value[7] = (uint8_t)(centi >> 8);
+  (void)sl_bt_gatt_server_write_attribute_value(timed_char, 0, sizeof(value), value);
+  if ((client_connection != CONNECTION_HANDLE_INVALID)
+      && (client_connection == notify_connection)) {
+    (void)sl_bt_gatt_server_send_notification(client_connection,
+                                              timed_char,
+                                              sizeof(value),
+                                              value);
+  }
+}
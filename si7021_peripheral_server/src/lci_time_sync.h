@@ -0,0 +1,53 @@
+/**
+ * @file lci_time_sync.h
+ * @brief Sampling synchronized to the clock of the central
+ *
+ * The central writes the sync characteristic in two steps:
+ *
+ *   sync:      0x01, sequence number (1 byte), written with response
+ *   follow-up: 0x02, sequence number (1 byte), time of the connection
+ *              event that carried the sync in central milliseconds
+ *              (4 bytes), sampling period in milliseconds (2 bytes),
+ *              written without response
+ *
+ * The local time of the sync write and the time of the follow-up give the
+ * offset of the local clock to the central clock. The sensor is then read
+ * at every multiple of the period on the central clock, the same instants
+ * on every server of the central, and each sample is notified on the timed
+ * characteristic:
+ *
+ *   sample:    instant in central milliseconds (4 bytes), temperature in
+ *              0.01 degree Celsius (int16), humidity in 0.01 %RH (uint16)
+ *
+ * All values are little-endian.
+ *
+ * Copyright (c) 2020-2021 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef LCI_TIME_SYNC_H_
+#define LCI_TIME_SYNC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_status.h"
+/* Operations of the sync characteristic */
+#define LCI_TIME_SYNC_OP_SYNC         0x01
+#define LCI_TIME_SYNC_OP_FOLLOW_UP    0x02
+/* Size of the follow-up and of the timed sample */
+#define LCI_TIME_SYNC_FOLLOW_UP_SIZE  8
+#define LCI_TIME_SYNC_SAMPLE_SIZE     8
+/* Offset changes above this are applied at once, smaller ones smoothed */
+#define LCI_TIME_SYNC_STEP_MS         20
+/* Shortest sampling period accepted in milliseconds */
+#define LCI_TIME_SYNC_PERIOD_MIN_MS   100
+
+void lci_time_sync_init(uint16_t timed_characteristic, uint32_t instant_signal);
+void lci_time_sync_set_client(uint8_t connection, bool notify_enabled);
+void lci_time_sync_on_write(uint8_t connection, const uint8_t *data, uint8_t len);
+void lci_time_sync_on_closed(uint8_t connection);
+bool lci_time_sync_on_signal(uint32_t signals, uint32_t *instant);
+bool lci_time_sync_now(uint8_t connection, uint32_t *central_ms);
+void lci_time_sync_publish(uint32_t instant, sl_status_t sc, uint32_t rh, int32_t t);
+
+#endif /* LCI_TIME_SYNC_H_ */